@@ -18,6 +18,8 @@ extern "C" {
 
 #define LBLK_SCOPY_NENTRY_MAX 128
 
+#define LBLK_DSM_NRANGES_MAX 256
+
 /**
  * Logical Block Command Set opcodes
  *
@@ -26,7 +28,20 @@ extern "C" {
  * @enum lblk_cmd_opc
  */
 enum lblk_cmd_opc {
-	LBLK_CMD_OPC_SCOPY	= 0x19,	///< LBLK_CMD_OPC_SCOPY
+	LBLK_CMD_OPC_WRITE_ZEROES	= 0x08,	///< LBLK_CMD_OPC_WRITE_ZEROES
+	LBLK_CMD_OPC_DSM		= 0x09,	///< LBLK_CMD_OPC_DSM
+	LBLK_CMD_OPC_SCOPY		= 0x19,	///< LBLK_CMD_OPC_SCOPY
+};
+
+/**
+ * Attributes of the Dataset Management command, see cdw11 of ::lblk_cmd_dsm
+ *
+ * @enum lblk_dsm_attr
+ */
+enum lblk_dsm_attr {
+	LBLK_DSM_ATTR_IDR	= 0x1,		///< Integral Dataset for Read
+	LBLK_DSM_ATTR_IDW	= 0x1 << 1,	///< Integral Dataset for Write
+	LBLK_DSM_ATTR_AD	= 0x1 << 2,	///< Deallocate
 };
 
 /**
@@ -187,6 +202,72 @@ struct lblk_cmd_scopy {
 };
 XNVME_STATIC_ASSERT(sizeof(struct lblk_cmd_scopy) == 64, "Incorrect size")
 
+/**
+ * NVMe Command Accessor for command with opcode LBLK_CMD_OPC_WRITE_ZEROES
+ *
+ * @struct lblk_cmd_write_zeroes
+ */
+struct lblk_cmd_write_zeroes {
+	uint32_t cdw00_09[10];		///< Command dword 0 to 9
+
+	/* cdw 10-11 */
+	uint64_t slba;			///< Start LBA
+
+	/* cdw 12 */
+	uint32_t nlb		: 16;	///< Number of logical blocks, zero-based
+	uint32_t rsvd1		: 9;
+	uint32_t deac		: 1;	///< Deallocate
+	uint32_t prinfo		: 4;	///< Protection Information Field
+	uint32_t fua		: 1;	///< Force Unit Access
+	uint32_t lr		: 1;	///< Limited Retry
+
+	/* cdw 13 */
+	uint32_t rsvd2;
+
+	/* cdw 14 */
+	uint32_t ilbrt;			///< Initial Logical Block Ref. Tag
+
+	/* cdw 15 */
+	uint32_t lbat		: 16;	///< Logical Block App. Tag
+	uint32_t lbatm		: 16;	///< Logical Block App. Tag Mask
+};
+XNVME_STATIC_ASSERT(sizeof(struct lblk_cmd_write_zeroes) == 64, "Incorrect size")
+
+/**
+ * NVMe Command Accessor for command with opcode LBLK_CMD_OPC_DSM
+ *
+ * @struct lblk_cmd_dsm
+ */
+struct lblk_cmd_dsm {
+	uint32_t cdw00_09[10];		///< Command dword 0 to 9
+
+	/* cdw 10 */
+	uint32_t nr		: 8;	///< Number of Ranges, zero-based
+	uint32_t rsvd1		: 24;
+
+	/* cdw 11 */
+	uint32_t idr		: 1;	///< Integral Dataset for Read
+	uint32_t idw		: 1;	///< Integral Dataset for Write
+	uint32_t ad		: 1;	///< Deallocate
+	uint32_t rsvd2		: 29;
+
+	uint32_t cdw12_15[4];		///< Command dword 12 to 15
+};
+XNVME_STATIC_ASSERT(sizeof(struct lblk_cmd_dsm) == 64, "Incorrect size")
+
+/**
+ * Dataset Management range as consumed by the command with opcode
+ * LBLK_CMD_OPC_DSM
+ *
+ * @struct lblk_dsm_range
+ */
+struct lblk_dsm_range {
+	uint32_t cattr;		///< Context Attributes
+	uint32_t nlb;		///< Number of logical blocks, NOT zero-based
+	uint64_t slba;		///< Start LBA
+};
+XNVME_STATIC_ASSERT(sizeof(struct lblk_dsm_range) == 16, "Incorrect size")
+
 /**
  * Kernel format structre for scopy
  *
@@ -207,6 +288,8 @@ struct lblk_cmd {
 		struct xnvme_spec_cmd base;
 		struct xnvme_spec_cmd_common common;
 		struct lblk_cmd_scopy copy;
+		struct lblk_cmd_write_zeroes write_zeroes;
+		struct lblk_cmd_dsm dsm;
 		uint32_t cdw[16];
 	};
 };
@@ -324,6 +407,12 @@ XNVME_STATIC_ASSERT(sizeof(struct lblk_idfy) == 4096, "Incorrect size")
 /**
  * Submit, and optionally wait for completion of, a NVMe Copy Command
  *
+ * When the controller does not support the Copy command, as reported by
+ * ::lblk_idfy_ctrlr.oncs, then the copy is emulated by the library, reading
+ * and writing the ranges through a bounded window of buffers allocated with
+ * xnvme_buf_alloc(). The emulation requires ::LBLK_SCOPY_FMT_ZERO and, when
+ * submitted with ::XNVME_CMD_ASYNC, completes once via the callback of `ret`
+ *
  * @see xnvme_cmd_opts
  *
  * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
@@ -342,6 +431,46 @@ lblk_cmd_scopy(struct xnvme_dev *dev, uint32_t nsid, uint64_t sdlba,
 	       struct lblk_scopy_fmt_zero *ranges, uint8_t nr,
 	       enum lblk_scopy_fmt copy_fmt, int opts, struct xnvme_req *ret);
 
+/**
+ * Submit, and optionally wait for completion of, a NVMe Write Zeroes Command
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param nsid Namespace Identifier
+ * @param slba The LBA to start zeroing at
+ * @param nlb Number of LBAs to zero, NOTE: nlb is a zero-based value
+ * @param deac Deallocate the LBAs when set to 1, when 0 they are written
+ * @param opts command options, see ::xnvme_cmd_opts
+ * @param ret Pointer to structure for NVMe completion and async. context
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+lblk_cmd_write_zeroes(struct xnvme_dev *dev, uint32_t nsid, uint64_t slba,
+		      uint16_t nlb, uint8_t deac, int opts,
+		      struct xnvme_req *ret);
+
+/**
+ * Submit, and optionally wait for completion of, a NVMe Dataset Management
+ * Command
+ *
+ * All the given ranges are sent with a single command, that is, a deallocate
+ * of many ranges is submitted as a batch rather than as a command per range.
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param nsid Namespace Identifier
+ * @param ranges Pointer to ranges-buffer allocated with xnvme_buf_alloc()
+ * @param nr Number of ranges in the given ranges-buffer, zero-based value
+ * @param attr Command attributes, a combination of ::lblk_dsm_attr
+ * @param opts command options, see ::xnvme_cmd_opts
+ * @param ret Pointer to structure for NVMe completion and async. context
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+lblk_cmd_dsm(struct xnvme_dev *dev, uint32_t nsid,
+	     struct lblk_dsm_range *ranges, uint8_t nr, int attr, int opts,
+	     struct xnvme_req *ret);
+
 #ifdef __cplusplus
 }
 #endif
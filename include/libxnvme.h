@@ -69,8 +69,17 @@ xnvme_3p_ver_pr(const char *ver[], enum xnvme_pr opts);
 enum xnvme_async_opts {
 	XNVME_ASYNC_IOPOLL = 0x1,       ///< XNVME_ASYNC_IOPOLL: io_context is polled
 	XNVME_ASYNC_SQPOLL = 0x1 << 1,  ///< XNVME_ASYNC_SQPOLL: SQ poll thread
+
+	XNVME_ASYNC_QPRIO_HIGH = 0x1 << 2,	///< XNVME_ASYNC_QPRIO_HIGH: High priority queue, with weighted round robin
+	XNVME_ASYNC_QPRIO_MEDIUM = 0x1 << 3,	///< XNVME_ASYNC_QPRIO_MEDIUM: Medium priority queue, with weighted round robin
+	XNVME_ASYNC_QPRIO_LOW = 0x1 << 4,	///< XNVME_ASYNC_QPRIO_LOW: Low priority queue, with weighted round robin
+
+	XNVME_ASYNC_SHARED = 0x1 << 5,	///< XNVME_ASYNC_SHARED: Submitted to by producers, see xnvme_async_producer_init()
+	XNVME_ASYNC_ORDERED = 0x1 << 6,	///< XNVME_ASYNC_ORDERED: Callbacks are invoked in the order of submission
 };
 
+#define XNVME_ASYNC_QPRIO_MASK ( XNVME_ASYNC_QPRIO_HIGH | XNVME_ASYNC_QPRIO_MEDIUM | XNVME_ASYNC_QPRIO_LOW )
+
 /**
  * Representation of xNVMe library backend attributes
  *
@@ -262,20 +271,22 @@ enum xnvme_cmd_opts {
 
 	XNVME_CMD_UPLD_SGLD	= 0x1 << 2,	///< XNVME_CMD_UPLD_SGLD: User-managed SGL data
 	XNVME_CMD_UPLD_SGLM	= 0x1 << 3,	///< XNVME_CMD_UPLD_SGLM: User-managed SGL meta
+
+	XNVME_CMD_BUFSEL	= 0x1 << 4,	///< XNVME_CMD_BUFSEL: Backend-selected buffer, see xnvme_async_bufs_init()
 };
 
 #define XNVME_CMD_MASK_IOMD ( XNVME_CMD_SYNC | XNVME_CMD_ASYNC )
 #define XNVME_CMD_MASK_UPLD ( XNVME_CMD_UPLD_SGLD | XNVME_CMD_UPLD_SGLM )
-#define XNVME_CMD_MASK ( XNVME_CMD_MASK_IOMD | XNVME_CMD_MASK_UPLD )
+#define XNVME_CMD_MASK ( XNVME_CMD_MASK_IOMD | XNVME_CMD_MASK_UPLD | XNVME_CMD_BUFSEL )
 
 #define XNVME_CMD_DEF_IOMD XNVME_CMD_SYNC
 #define XNVME_CMD_DEF_UPLD ( 0x0 )
 
 #define XNVME_IDENT_URI_LEN 384
-#define XNVME_IDENT_URI_LEN_MIN 10
+#define XNVME_IDENT_URI_LEN_MIN 5
 
-#define XNVME_IDENT_SCHM_LEN 5
-#define XNVME_IDENT_TRGT_LEN 155
+#define XNVME_IDENT_SCHM_LEN 8
+#define XNVME_IDENT_TRGT_LEN 152
 #define XNVME_IDENT_OPTS_LEN 160
 #define XNVME_IDENT_OPTS_SEP '?'
 
@@ -370,6 +381,12 @@ xnvme_enumeration_pr(struct xnvme_enumeration *list, int opts);
 /**
  * Enumerate devices on the given system
  *
+ * The backends enumerate concurrently, and devices are identified in parallel.
+ * When the environment variable XNVME_ENUMERATE_CACHE gives the path of a file,
+ * then the Linux backend caches the devices found in it, and does not identify
+ * them again, as long as the serial number and firmware revision of their
+ * controller, and the modification time of their sysfs entry, are unchanged
+ *
  * @param list Pointer to pointer of the list of device enumerated
  * @param sys_uri URI of the system to enumerate on, when NULL, localhost/PCIe
  * @param opts System enumeration options
@@ -500,6 +517,67 @@ xnvme_buf_virt_alloc(size_t alignment, size_t nbytes);
 void
 xnvme_buf_virt_free(void *buf);
 
+/**
+ * Advice on the access pattern of a device-mapping, see xnvme_mmap()
+ *
+ * @enum xnvme_madv
+ */
+enum xnvme_madv {
+	XNVME_MADV_NORMAL	= 0x0,	///< Read-ahead, growing on sequential faults
+	XNVME_MADV_RANDOM	= 0x1,	///< No read-ahead
+	XNVME_MADV_SEQUENTIAL	= 0x2,	///< Read-ahead of the maximum window
+	XNVME_MADV_WILLNEED	= 0x4,	///< Read the range in the background
+	XNVME_MADV_DONTNEED	= 0x8,	///< Drop the range, it is read again on access
+};
+
+/**
+ * Map the given range of the device, read-only, into the address space of the
+ * process. Pages are read on first access, by a thread of the mapping servicing
+ * the page-faults via userfaultfd, with reads batched on an asynchronous
+ * context of its own, along with read-ahead as advised
+ *
+ * @note
+ * The device must not be closed before the mapping is unmapped with
+ * xnvme_munmap(), and it must have an asynchronous interface. A page which
+ * fails to be read raises SIGBUS on access, as it is poisoned via userfaultfd
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param off Byte-offset on the device, a multiple of the page size
+ * @param len Length in bytes of the range to map, beyond the end of the device
+ * the mapping reads as zeroes
+ * @param flags Advice on the access pattern, see enum xnvme_madv
+ *
+ * @return On success, the address of the mapping is returned. On error, NULL is
+ * returned and `errno` set to indicate the error, ENOSYS when the platform has
+ * no userfaultfd, ENOTSUP when the kernel cannot poison pages via userfaultfd
+ */
+void *
+xnvme_mmap(struct xnvme_dev *dev, uint64_t off, size_t len, int flags);
+
+/**
+ * Unmap the given mapping
+ *
+ * @param addr Address of a mapping returned by xnvme_mmap()
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_munmap(void *addr);
+
+/**
+ * Advise on the access pattern of the given range of a mapping; the read-ahead
+ * advice applies to the mapping as a whole, XNVME_MADV_WILLNEED and
+ * XNVME_MADV_DONTNEED to the given range
+ *
+ * @param addr Address within a mapping returned by xnvme_mmap()
+ * @param len Length in bytes of the range
+ * @param advice Advice on the access pattern, see enum xnvme_madv
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_madvise(void *addr, size_t len, int advice);
+
 /**
  * Opaque handle for Scatter Gather List (SGL).
  *
@@ -623,10 +701,21 @@ xnvme_sgl_add(struct xnvme_dev *dev, struct xnvme_sgl *sgl, void *buf,
  */
 struct xnvme_async_ctx;
 
+struct xnvme_req;
+
 /**
  * Allocate an asynchronous context for command submission of the given depth
  * for submission of commands to the given device
  *
+ * @note
+ * The context must be used by the thread allocating it, some backends, e.g.
+ * io_uring, tie it to that thread
+ *
+ * With XNVME_ASYNC_ORDERED, a completion is held back until the commands
+ * submitted before it have completed, thus callbacks are invoked, and
+ * xnvme_async_reap() returns requests, in the order of submission; a command
+ * held back counts towards the depth of the context
+ *
  * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
  * @param ctx Pointer-pointer to initialized context
  * @param depth Maximum iodepth / qdepth, maximum number of outstanding commands
@@ -639,6 +728,37 @@ int
 xnvme_async_init(struct xnvme_dev *dev, struct xnvme_async_ctx **ctx,
 		 uint16_t depth, int flags);
 
+/**
+ * Allocate a producer of commands for the given shared context, that is, one
+ * allocated with XNVME_ASYNC_SHARED, thus letting multiple threads submit to
+ * the same backend queue
+ *
+ * The producer is itself a context, used by a single thread, commands are
+ * submitted on it, and it is poked, waited on and torn down with
+ * xnvme_async_term(), like any other context. Submission pushes the command on
+ * a lock-free queue of the shared context, poking the shared context, or any of
+ * its producers, submits the commands queued, in a batch, and reaps the
+ * completions of the shared context, one thread at a time; completions are
+ * handed back to the producer of the command, and its callback is invoked by
+ * poking the producer.
+ *
+ * @note
+ * Commands are not submitted directly on the shared context, and
+ * backend-selected buffers are not supported, on a producer, the commands of a
+ * chain are submitted one at a time
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param ctx Shared context, allocated with XNVME_ASYNC_SHARED
+ * @param depth Maximum number of commands outstanding on the producer, a power
+ * of 2 within the range [1,4096]
+ * @param producer Pointer-pointer to initialized producer
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_async_producer_init(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+			  uint16_t depth, struct xnvme_async_ctx **producer);
+
 /**
  * Get the I/O depth of the context.
  *
@@ -661,9 +781,23 @@ xnvme_async_get_depth(struct xnvme_async_ctx *ctx);
 uint32_t
 xnvme_async_get_outstanding(struct xnvme_async_ctx *ctx);
 
+/**
+ * Get the number of reads hedged on the context, that is, reads duplicated to
+ * another device as they were slow to complete, e.g. by the mirror backend
+ *
+ * @param ctx Asynchronous context
+ *
+ * @return The number of reads hedged, 0 when the backend does not hedge
+ */
+uint32_t
+xnvme_async_get_nhedged(struct xnvme_async_ctx *ctx);
+
 /**
  * Tear down the given Asynchronous context
  *
+ * A producer is waited on, until its commands have completed, a shared context
+ * must be torn down after its producers, otherwise -EBUSY is returned
+ *
  * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
  * @param ctx
  *
@@ -693,6 +827,364 @@ xnvme_async_poke(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
 int
 xnvme_async_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx);
 
+/**
+ * Reap at most 'max' completions from the given 'ctx' into the array 'out',
+ * without invoking the callbacks of the completed requests; the completion of
+ * each is in req->cpl, and the caller is free to re-submit the requests
+ *
+ * This avoids an indirect call per completion, and lets the caller process
+ * completions in batches, in its own loop. Since callbacks are not invoked,
+ * do not reap a context with commands submitted via xnvme_cmd_chain() on a
+ * backend without native chaining, nor with commands which other library
+ * functionality completes via their callback.
+ *
+ * @note
+ * Supported by the io_uring, libaio, nil and SPDK backends
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param ctx Asynchronous context
+ * @param out Array of at least 'max' entries
+ * @param max Maximum number of completions to reap, must be greater than 0
+ *
+ * @return On success, the number of requests stored in 'out', may be 0. On
+ * error, negative `errno` is returned, -ENOSYS when the backend does not
+ * support reaping.
+ */
+int
+xnvme_async_reap(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+		 struct xnvme_req **out, uint32_t max);
+
+/**
+ * Provide the given context with 'nbufs' buffers of 'nbytes' each, a read
+ * submitted with XNVME_CMD_BUFSEL, and without a buffer, is then read into a
+ * buffer which the backend selects once the read is issued; thus, buffers are
+ * only tied up by reads in-flight, rather than one for every slot of the
+ * context
+ *
+ * On completion, req->async.bid holds the id of the selected buffer, or -1
+ * when none was selected. The buffer is retrieved with xnvme_async_buf(), and
+ * is owned by the caller until handed back with xnvme_async_buf_put(). When
+ * all the buffers are owned by the caller, reads fail with status ENOBUFS.
+ *
+ * @note
+ * Supported by the io_uring backend, using a provided-buffer ring, on Linux
+ * 5.19 and newer
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param ctx Asynchronous context, without buffers provided
+ * @param nbufs Number of buffers, within the range [1,32768]
+ * @param nbytes Size of each buffer, a multiple of the logical block size
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned,
+ * specifically -ENOSYS when the backend does not support it.
+ */
+int
+xnvme_async_bufs_init(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+		      uint32_t nbufs, uint32_t nbytes);
+
+/**
+ * Retrieve the buffer with the given id, as selected for a read submitted with
+ * XNVME_CMD_BUFSEL
+ *
+ * @param ctx Asynchronous context with buffers, see xnvme_async_bufs_init()
+ * @param bid Buffer id, as given by req->async.bid
+ *
+ * @return On success, pointer to the buffer is returned. On error, NULL.
+ */
+void *
+xnvme_async_buf(struct xnvme_async_ctx *ctx, int32_t bid);
+
+/**
+ * Hand back the buffer with the given id, such that the backend can select it
+ * for another read
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param ctx Asynchronous context with buffers, see xnvme_async_bufs_init()
+ * @param bid Buffer id, as given by req->async.bid
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_async_buf_put(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+		    int32_t bid);
+
+/**
+ * Limits of a token-bucket rate-limiter, a limit of 0 means unlimited
+ *
+ * @struct xnvme_qos_limits
+ */
+struct xnvme_qos_limits {
+	uint64_t read_iops;	///< Max. number of read commands per second
+	uint64_t write_iops;	///< Max. number of write commands per second
+	uint64_t read_bps;	///< Max. number of bytes read per second
+	uint64_t write_bps;	///< Max. number of bytes written per second
+	uint32_t burst_usec;	///< Bucket capacity, in usec. of the rate, 0 = default
+};
+
+/**
+ * Statistics of a rate-limiter, see xnvme_qos_get_stats()
+ *
+ * @struct xnvme_qos_stats
+ */
+struct xnvme_qos_stats {
+	uint64_t nsubmitted;		///< Commands passed through the limiter
+	uint64_t nthrottled;		///< Commands held back, lacking tokens
+	uint64_t throttled_nsec;	///< Time commands were held back, in total
+};
+
+/**
+ * Opaque rate-limiter, it can be shared by several asynchronous contexts, e.g.
+ * all the contexts of a tenant, also across threads
+ */
+struct xnvme_qos;
+
+/**
+ * Create a rate-limiter with the given limits
+ *
+ * @param qos Pointer to the rate-limiter to create
+ * @param limits The limits to enforce
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_qos_create(struct xnvme_qos **qos, const struct xnvme_qos_limits *limits);
+
+/**
+ * Destroy the given rate-limiter, it must no longer be set on any context
+ *
+ * @param qos The rate-limiter to destroy
+ */
+void
+xnvme_qos_destroy(struct xnvme_qos *qos);
+
+/**
+ * Retrieve the statistics of the given rate-limiter
+ *
+ * @param qos The rate-limiter to retrieve statistics from
+ * @param stats Pointer to the structure to fill
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_qos_get_stats(struct xnvme_qos *qos, struct xnvme_qos_stats *stats);
+
+/**
+ * Rate-limit the read and write commands submitted via the given context
+ *
+ * Commands exceeding the limits are held back by the library and submitted by
+ * xnvme_async_poke() / xnvme_async_wait() once the limits allow. Only the
+ * XNVME_SPEC_OPC_READ and XNVME_SPEC_OPC_WRITE commands are limited and charged
+ * for their payload, other commands are passed through. At most 'depth'
+ * commands are held back, beyond that -EBUSY is returned on submission.
+ * Commands held back count as outstanding, see xnvme_async_get_outstanding()
+ *
+ * @param ctx Asynchronous context, without commands held back
+ * @param qos The rate-limiter to use, NULL removes the current one
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_async_set_qos(struct xnvme_async_ctx *ctx, struct xnvme_qos *qos);
+
+/**
+ * Options of a completion dispatcher, see xnvme_dispatcher_create()
+ *
+ * @struct xnvme_dispatcher_opts
+ */
+struct xnvme_dispatcher_opts {
+	uint32_t nthreads;	///< Number of callback threads, within [1,64]
+	uint32_t ncpus;		///< Number of CPUs in 'cpus', 0 = not pinned
+	const int *cpus;	///< Thread 'i' is pinned to CPU cpus[i % ncpus]
+	uint32_t nbatches;	///< Queue capacity in batches, pow2 >= 2, 0 = default
+};
+
+/**
+ * Statistics of a completion dispatcher, see xnvme_dispatcher_get_stats()
+ *
+ * @struct xnvme_dispatcher_stats
+ */
+struct xnvme_dispatcher_stats {
+	uint64_t ndispatched;	///< Callbacks invoked by the callback threads
+	uint64_t nbatches;	///< Batches consumed by the callback threads
+	uint64_t ninline;	///< Batches called back by poke, the queue was full
+	uint64_t delay_nsec;	///< Time from reaping to callback, in total
+};
+
+/**
+ * Opaque completion dispatcher, a pool of callback threads invoking the
+ * callbacks of the contexts it is set on, see xnvme_async_set_dispatcher();
+ * it can be set on several contexts, also of different threads
+ */
+struct xnvme_dispatcher;
+
+/**
+ * Create a completion dispatcher, starting its callback threads
+ *
+ * @param dispatcher Pointer to the dispatcher to create
+ * @param opts The number of threads, the CPUs to pin them to, and the capacity
+ * of the queue of batches
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_dispatcher_create(struct xnvme_dispatcher **dispatcher,
+			const struct xnvme_dispatcher_opts *opts);
+
+/**
+ * Stop the callback threads and destroy the given dispatcher, it must no longer
+ * be set on any context
+ *
+ * @param dispatcher The dispatcher to destroy
+ */
+void
+xnvme_dispatcher_destroy(struct xnvme_dispatcher *dispatcher);
+
+/**
+ * Retrieve the statistics of the given dispatcher
+ *
+ * @param dispatcher The dispatcher to retrieve statistics from
+ * @param stats Pointer to the structure to fill
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_dispatcher_get_stats(struct xnvme_dispatcher *dispatcher,
+			   struct xnvme_dispatcher_stats *stats);
+
+/**
+ * Invoke the callbacks of the commands submitted via the given context on the
+ * callback threads of the given dispatcher
+ *
+ * xnvme_async_poke() then only reaps completions, timestamps them, and batches
+ * them; a batch is enqueued when it holds 'batch' completions, and at the end
+ * of every poke. xnvme_async_wait() returns once the callbacks are invoked as
+ * well. Callbacks run concurrently, on any of the callback threads, thus they
+ * must not submit on the context; xnvme_async_reap() and xnvme_cmd_chain() are
+ * not supported on a context with a dispatcher. Completions not yet called back
+ * occupy the context, beyond its depth -EBUSY is returned on submission. Should
+ * the queue of the dispatcher be full, the batch is called back by the poking
+ * thread
+ *
+ * @param ctx Asynchronous context, without outstanding commands, neither
+ * shared nor ordered
+ * @param dispatcher The dispatcher to use, NULL removes the current one
+ * @param batch Completions per batch, within [1,256]
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_async_set_dispatcher(struct xnvme_async_ctx *ctx,
+			   struct xnvme_dispatcher *dispatcher, uint32_t batch);
+
+/**
+ * Opaque group of asynchronous contexts, possibly of different devices and
+ * backends, which are poked as one; contexts without outstanding commands are
+ * skipped. A group, like its contexts, is used by a single thread
+ *
+ * @see xnvme_async_group_create
+ * @see xnvme_async_group_poke
+ *
+ * @struct xnvme_async_group
+ */
+struct xnvme_async_group;
+
+/**
+ * Create a group with room for the given number of contexts
+ *
+ * @param group Pointer to the group to create
+ * @param capacity Maximum number of contexts in the group, within the range
+ * [1,4096]
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_async_group_create(struct xnvme_async_group **group, uint32_t capacity);
+
+/**
+ * Destroy the given group, the contexts still in it are removed, not
+ * terminated
+ *
+ * @param group The group to destroy
+ */
+void
+xnvme_async_group_destroy(struct xnvme_async_group *group);
+
+/**
+ * Add the given context to the group, a context is in at most one group, and
+ * is removed from it by xnvme_async_group_remove() or xnvme_async_term()
+ *
+ * @param group The group to add the context to
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param ctx Asynchronous context of the given device
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_async_group_add(struct xnvme_async_group *group, struct xnvme_dev *dev,
+		      struct xnvme_async_ctx *ctx);
+
+/**
+ * Remove the given context from the group
+ *
+ * @param group The group to remove the context from
+ * @param ctx Asynchronous context in the given group
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_async_group_remove(struct xnvme_async_group *group,
+			 struct xnvme_async_ctx *ctx);
+
+/**
+ * Process completions from the contexts of the group with commands
+ * outstanding, starting with the context following the last one poked
+ *
+ * Set process 'max' to limit number of completions, 0 means no max.
+ *
+ * @return On success, number of completions processed, may be 0. On error,
+ * negative `errno` is returned.
+ */
+int
+xnvme_async_group_poke(struct xnvme_async_group *group, uint32_t max);
+
+/**
+ * Wait for completion of all outstanding commands on the contexts of the group,
+ * blocking on the eventfd of the group when all of the contexts with commands
+ * outstanding signal it
+ *
+ * @return On success, number of completions processed, may be 0. On error,
+ * negative `errno` is returned.
+ */
+int
+xnvme_async_group_wait(struct xnvme_async_group *group);
+
+/**
+ * Get the number of contexts in the group with commands outstanding
+ *
+ * @param group The group to query
+ *
+ * @return The number of contexts with commands outstanding, on error 0 is
+ * returned e.g. errors are silent
+ */
+uint32_t
+xnvme_async_group_get_nactive(struct xnvme_async_group *group);
+
+/**
+ * Get the eventfd of the group, it is signalled when commands complete on the
+ * contexts of backends supporting it, e.g. io_uring, for use with epoll() or
+ * similar. It is not read by xnvme_async_group_poke(), the caller must read it,
+ * or wait on it edge-triggered
+ *
+ * @param group The group to query
+ * @param nsignalling Number of contexts in the group signalling the eventfd,
+ * contexts which do not must be poked to discover completions; may be NULL
+ *
+ * @return On success, the eventfd is returned. On error, negative `errno` is
+ * returned, -ENOSYS when the platform has no eventfd.
+ */
+int
+xnvme_async_group_get_fd(struct xnvme_async_group *group, uint32_t *nsignalling);
+
 /**
  * Forward declaration, see definition further down
  */
@@ -704,6 +1196,31 @@ struct xnvme_req_pool;
  */
 typedef void (*xnvme_async_cb)(struct xnvme_req *req, void *opaque);
 
+/**
+ * I/O priority classes, these mirror the Linux ioprio classes
+ *
+ * @enum xnvme_prio_class
+ */
+enum xnvme_prio_class {
+	XNVME_PRIO_CLASS_NONE	= 0,	///< No priority given, the backend default
+	XNVME_PRIO_CLASS_RT	= 1,	///< Real-time, served before anything else
+	XNVME_PRIO_CLASS_BE	= 2,	///< Best-effort
+	XNVME_PRIO_CLASS_IDLE	= 3,	///< Idle, served when nothing else is
+};
+
+#define XNVME_PRIO_CLASS_SHIFT 13
+#define XNVME_PRIO_LEVEL_MASK 0x7
+
+/**
+ * Encode the given class and level, 0 is the highest and 7 the lowest level
+ * within a class, as the value of ::xnvme_req.async.prio
+ */
+#define XNVME_PRIO(class, level) \
+	((uint16_t)(((class) << XNVME_PRIO_CLASS_SHIFT) | ((level) & XNVME_PRIO_LEVEL_MASK)))
+
+#define XNVME_PRIO_CLASS(prio) ((prio) >> XNVME_PRIO_CLASS_SHIFT)
+#define XNVME_PRIO_LEVEL(prio) ((prio) & XNVME_PRIO_LEVEL_MASK)
+
 /**
  * Encapsulation and representation of lower-level error conditions
  *
@@ -717,15 +1234,18 @@ struct xnvme_req {
 		struct xnvme_async_ctx *ctx;	///< Asynchronous context
 		xnvme_async_cb cb;		///< User callback function
 		void *cb_arg;			///< User callback arguments
+		int32_t bid;			///< Buffer selected with XNVME_CMD_BUFSEL, -1 when none
+		uint16_t prio;			///< I/O priority, see XNVME_PRIO()
 
 		///< Per request backend specific data
-		uint8_t be_rsvd[8];
+		uint8_t be_rsvd[2];
 	} async;
 
 	///< Fields for request-pool
 	struct xnvme_req_pool *pool;
 	SLIST_ENTRY(xnvme_req) link;
 };
+XNVME_STATIC_ASSERT(sizeof(struct xnvme_req) == 64, "Incorrect size")
 
 struct xnvme_req_pool {
 	SLIST_HEAD(, xnvme_req) head;
@@ -763,6 +1283,10 @@ xnvme_req_clear(struct xnvme_req *req);
 /**
  * Encapsulate completion-error checking here for now.
  *
+ * A command which fails submission after the library accepted it, e.g. when it
+ * was queued or held back, completes with the generic status Internal Error
+ * (0x06) and the negative `errno` of the failure in 'cpl.cdw0'.
+ *
  * @todo re-think this
  * @param req Pointer to the #xnvme_req to check status on
  *
@@ -1136,6 +1660,147 @@ xnvme_cmd_read(struct xnvme_dev *dev, uint32_t nsid, uint64_t slba,
 	       uint16_t nlb, void *dbuf, void *mbuf, int opts,
 	       struct xnvme_req *req);
 
+/**
+ * Submit, and optionally wait for completion of, a NVMe Flush
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param nsid Namespace Identifier
+ * @param opts command options, see ::xnvme_cmd_opts
+ * @param req Pointer to structure for NVMe completion and async. context
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_cmd_flush(struct xnvme_dev *dev, uint32_t nsid, int opts,
+		struct xnvme_req *req);
+
+/**
+ * Representation of a single command in a chain of commands
+ *
+ * @see xnvme_cmd_chain
+ *
+ * @struct xnvme_cmd_link
+ */
+struct xnvme_cmd_link {
+	struct xnvme_spec_cmd cmd;	///< The command to submit
+	void *dbuf;			///< Pointer to data-payload
+	size_t dbuf_nbytes;		///< Size of data-payload in bytes
+
+	struct xnvme_req req;		///< Completion of this link, managed by xNVMe
+};
+
+/**
+ * Submit, and optionally wait for completion of, a chain of commands
+ *
+ * The commands in the given 'links' are executed in order, a link is not
+ * started before the previous link has completed successfully. When a link
+ * fails, then the remaining links are not executed.
+ *
+ * With XNVME_CMD_ASYNC the chain completes as a unit, that is, the callback
+ * of the given 'req' is invoked once, after the last link has completed or
+ * after a link has failed. The completion of the failing, or the last, link is
+ * copied into 'req'. The completion of each link is available in the
+ * ::xnvme_cmd_link.req of the link.
+ *
+ * Backends which support linking natively, such as io_uring, submit the entire
+ * chain at once, other backends submit the next link from the completion of
+ * the previous.
+ *
+ * @note The 'links' must remain valid until the chain has completed
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param links Array of commands to execute in order
+ * @param nlinks Number of entries in 'links'
+ * @param opts command options, see ::xnvme_cmd_opts
+ * @param req Pointer to structure for NVMe completion and async. context
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_cmd_chain(struct xnvme_dev *dev, struct xnvme_cmd_link *links,
+		uint16_t nlinks, int opts, struct xnvme_req *req);
+
+/**
+ * Submit the given commands, and wait for all of them to complete
+ *
+ * The commands are independent, they are submitted at once, in the order
+ * given, and complete in any order. Thus, a batch of scattered reads costs
+ * about one round trip to the device, rather than one per command. The
+ * completion of each command is available in the ::xnvme_cmd_link.req of it.
+ *
+ * The commands are submitted via an async. context private to the calling
+ * thread, setup by the first batch of the thread on the device, and torn down
+ * by xnvme_dev_close(). On backends without an async. interface the commands
+ * are submitted one by one.
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param cmds Array of commands to execute
+ * @param ncmds Number of entries in 'cmds'
+ *
+ * @return On success, 0 is returned. When one or more commands fail, -EIO is
+ * returned, see the completion of each command. On any other error, negative
+ * `errno` is returned, and the commands which were not submitted complete with
+ * the generic status Internal Error (0x06) and the `errno` in 'cpl.cdw0'.
+ */
+int
+xnvme_cmd_batch_sync(struct xnvme_dev *dev, struct xnvme_cmd_link *cmds,
+		     uint16_t ncmds);
+
+/**
+ * Opaque template of a read or write command, see xnvme_cmd_tmpl_create()
+ *
+ * @struct xnvme_cmd_tmpl
+ */
+struct xnvme_cmd_tmpl;
+
+/**
+ * Create a template of read or write commands on the given device and context
+ *
+ * The command, and the backend handling it, is setup once, by the template,
+ * thus submitting via xnvme_cmd_tmpl_submit() only fills in what varies from
+ * command to command. The io_uring, libaio and nil backends pre-fill their
+ * submission entry, others submit via xnvme_cmd_pass().
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ * @param ctx Asynchronous context to submit on, with XNVME_CMD_ASYNC
+ * @param opcode XNVME_SPEC_OPC_READ or XNVME_SPEC_OPC_WRITE
+ * @param nsid Namespace Identifier
+ * @param opts command options, see ::xnvme_cmd_opts
+ * @param tmpl Pointer to the created template
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_cmd_tmpl_create(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+		      uint8_t opcode, uint32_t nsid, int opts,
+		      struct xnvme_cmd_tmpl **tmpl);
+
+/**
+ * Destroy the given template
+ *
+ * @param tmpl The template to destroy
+ */
+void
+xnvme_cmd_tmpl_destroy(struct xnvme_cmd_tmpl *tmpl);
+
+/**
+ * Submit, and optionally wait for completion of, a command from the template
+ *
+ * With XNVME_CMD_ASYNC, the command is submitted on the context of the
+ * template, and the callback of the given 'req' is invoked on completion.
+ *
+ * @param tmpl Template created with xnvme_cmd_tmpl_create()
+ * @param slba The LBA to start reading from or writing to
+ * @param nlb The number of LBAs, zero-based
+ * @param dbuf Pointer to data-payload
+ * @param req Pointer to structure for NVMe completion and async. context
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_cmd_tmpl_submit(struct xnvme_cmd_tmpl *tmpl, uint64_t slba,
+		      uint16_t nlb, void *dbuf, struct xnvme_req *req);
+
 /**
  * Creates a handle to given device identifier
  *
@@ -1159,6 +1824,22 @@ xnvme_dev_open(const char *dev_uri);
 struct xnvme_dev *
 xnvme_dev_openf(const char *dev_uri, int opts);
 
+/**
+ * Creates another handle to the device of the given handle
+ *
+ * The handle shares the identify data of the given handle instead of issuing
+ * identify commands, and has its own backend state, e.g. file descriptor. When
+ * the backend cannot duplicate, then this is equivalent to xnvme_dev_openf()
+ * with the identifier and options of the given handle.
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ *
+ * @return On success, a handle to the device. On error, NULL is returned and
+ * `errno` set to indicate the error.
+ */
+struct xnvme_dev *
+xnvme_dev_dup(struct xnvme_dev *dev);
+
 /**
  * Destroys device-handle
  *
@@ -1266,6 +1947,32 @@ xnvme_dev_get_be_state(const struct xnvme_dev *dev);
  */
 uint64_t xnvme_dev_get_ssw(const struct xnvme_dev *dev);
 
+/**
+ * Returns the NUMA node which the device is attached to, buffers allocated with
+ * xnvme_buf_alloc() are placed on it
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ *
+ * @return The NUMA node, or -1 when it is unknown, e.g. on single-node systems
+ * or backends not providing it
+ */
+int
+xnvme_dev_get_numa_node(const struct xnvme_dev *dev);
+
+/**
+ * Bind the calling thread to the CPUs of the NUMA node which the device is
+ * attached to, call it before xnvme_async_init(), such that the context and,
+ * with '?poll_sq', the submission-queue polling thread of the kernel, are
+ * placed on CPUs local to the device
+ *
+ * @param dev Device handle obtained with xnvme_dev_open() / xnvme_dev_openf()
+ *
+ * @return On success, 0 is returned. On error, negative errno is returned,
+ * -ENOENT when the NUMA node of the device is unknown.
+ */
+int
+xnvme_dev_bind_thread(const struct xnvme_dev *dev);
+
 #ifdef __cplusplus
 }
 #endif
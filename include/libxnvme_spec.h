@@ -990,6 +990,7 @@ enum xnvme_spec_opcodes {
 	XNVME_SPEC_OPC_SFEAT = 0x09, ///< XNVME_SPEC_OPC_SFEAT
 	XNVME_SPEC_OPC_GFEAT = 0x0A, ///< XNVME_SPEC_OPC_GFEAT
 
+	XNVME_SPEC_OPC_FLUSH = 0x00, ///< XNVME_SPEC_OPC_FLUSH
 	XNVME_SPEC_OPC_WRITE = 0x01, ///< XNVME_SPEC_OPC_WRITE
 	XNVME_SPEC_OPC_READ = 0x02, ///< XNVME_SPEC_OPC_READ
 
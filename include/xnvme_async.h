@@ -4,12 +4,69 @@
 #ifndef __INTERNAL_XNVME_ASYNC_H
 #define __INTERNAL_XNVME_ASYNC_H
 
+struct xnvme_async_qos;
+struct xnvme_async_inject;
+struct xnvme_async_group;
+struct xnvme_async_shared;
+struct xnvme_async_producer;
+struct xnvme_async_ordered;
+struct xnvme_async_dispatch;
+
+#define XNVME_ASYNC_BUFS_MAX 32768	///< Buffers provided to a context, at most
+#define XNVME_ASYNC_SC_INTERNAL_ERROR 0x06	///< Generic status: Internal Error
+
+/**
+ * Buffers provided to a context, see xnvme_async_bufs_init(), buffer 'bid' is
+ * at base + bid * nbytes
+ */
+struct xnvme_async_bufs {
+	uint8_t *base;
+	uint32_t nbufs;
+	uint32_t nbytes;
+};
+
 struct xnvme_async_ctx {
 	uint32_t depth;		///< IO depth
 	uint32_t outstanding;	///< Outstanding IO on the context/ring/queue
 
 	uint8_t be_rsvd[184];	///< Auxilary backend data
+
+	///< Library data, following the XNVME_BE_ACTX_NBYTES of the backend
+	struct xnvme_async_qos *qos;	///< Rate-limiter, see xnvme_async_set_qos()
+	struct xnvme_async_inject *inject;	///< Fault-injection, see xnvme_inject.h
+	struct xnvme_async_group *group;	///< Group, see xnvme_async_group_add()
+	struct xnvme_async_bufs *bufs;		///< See xnvme_async_bufs_init()
+	struct xnvme_async_shared *shared;	///< See XNVME_ASYNC_SHARED
+	struct xnvme_async_producer *producer;	///< Set on producers only
+	struct xnvme_async_ordered *ordered;	///< See XNVME_ASYNC_ORDERED
+	struct xnvme_async_dispatch *dispatch;	///< See xnvme_async_set_dispatcher()
+	uint32_t group_idx;			///< Member index in the group
+	uint32_t nhedged;			///< See xnvme_async_get_nhedged()
+
+	uint8_t _rsvd[56];
 };
-XNVME_STATIC_ASSERT(sizeof(struct xnvme_async_ctx) == 192, "Incorrect size")
+XNVME_STATIC_ASSERT(sizeof(struct xnvme_async_ctx) == 320, "Incorrect size")
+
+/**
+ * Check whether the given context has no commands outstanding, including those
+ * held back by the library, e.g. by rate-limiting or fault-injection
+ *
+ * @return 1 when idle, otherwise 0
+ */
+int
+xnvme_async_idle(struct xnvme_async_ctx *ctx);
+
+/**
+ * Complete 'req' as failed by the given negative errno; for a command which
+ * fails submission after it was accepted, e.g. when queued by the library, it
+ * is a generic Internal Error, with the errno, untruncated, in 'cdw0'
+ */
+static inline void
+xnvme_async_cpl_errno(struct xnvme_req *req, int err)
+{
+	req->cpl.cdw0 = (uint32_t)err;
+	req->cpl.status.sct = 0x0;
+	req->cpl.status.sc = XNVME_ASYNC_SC_INTERNAL_ERROR;
+}
 
 #endif /* __INTERNAL_XNVME_ASYNC_H */
@@ -0,0 +1,54 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_ASYNC_GROUP_H
+#define __INTERNAL_XNVME_ASYNC_GROUP_H
+#include <xnvme_async.h>
+
+#define XNVME_ASYNC_GROUP_CAPACITY_MAX 4096
+#define XNVME_ASYNC_GROUP_NWORDS (XNVME_ASYNC_GROUP_CAPACITY_MAX / 64)
+
+struct xnvme_async_group_member {
+	struct xnvme_dev *dev;
+	struct xnvme_async_ctx *ctx;	///< NULL when the slot is free
+	int notify;			///< The backend signals the eventfd
+	uint32_t _rsvd;
+};
+
+/**
+ * Contexts of possibly different devices and backends, which are poked as one;
+ * a member is marked active when a command is submitted on its context, and
+ * idle once poking finds nothing outstanding, only active members are poked
+ */
+struct xnvme_async_group {
+	uint32_t capacity;
+	uint32_t nmembers;
+	uint32_t nactive;		///< Members with commands outstanding
+	uint32_t rr;			///< Member to poke first
+	int efd;			///< Eventfd shared by members, -1 if none
+	uint32_t nsignalling;		///< Members signalling the eventfd
+	uint64_t active[XNVME_ASYNC_GROUP_NWORDS];	///< Bitmap of active members
+	struct xnvme_async_group_member members[];
+};
+
+/**
+ * Mark the member context as having commands outstanding, called on
+ * submission, thus cheap for contexts not in a group
+ */
+static inline void
+xnvme_async_group_mark(struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_async_group *group = ctx->group;
+	uint64_t bit;
+
+	if (!group) {
+		return;
+	}
+
+	bit = 1ULL << (ctx->group_idx % 64);
+	if (!(group->active[ctx->group_idx / 64] & bit)) {
+		group->active[ctx->group_idx / 64] |= bit;
+		group->nactive += 1;
+	}
+}
+
+#endif /* __INTERNAL_XNVME_ASYNC_GROUP_H */
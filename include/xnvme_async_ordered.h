@@ -0,0 +1,69 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_ASYNC_ORDERED_H
+#define __INTERNAL_XNVME_ASYNC_ORDERED_H
+#include <xnvme_async.h>
+
+/**
+ * A command submitted on an ordered context; its callback is replaced, until
+ * the completion is released, by which the callback is restored
+ */
+struct xnvme_async_ordered_slot {
+	struct xnvme_req *req;
+	xnvme_async_cb cb;		///< Callback of 'req', as submitted
+	void *cb_arg;			///< Callback argument of 'req', as submitted
+	uint32_t done;			///< Completed, not yet released
+	uint32_t _rsvd;
+};
+
+/**
+ * Reorder-ring of a context allocated with XNVME_ASYNC_ORDERED, a command is
+ * given the slot of its sequence number, from 'head', the oldest not released,
+ * to 'tail', the next to submit; the ring is used by the thread of the context
+ * only, thus without locking
+ */
+struct xnvme_async_ordered {
+	uint64_t head;
+	uint64_t tail;
+	uint32_t mask;			///< Number of slots minus one
+	uint32_t releasing;		///< Guards against re-entrant release
+	struct xnvme_async_ordered_slot slots[];
+};
+
+/**
+ * Setup the reorder-ring of the given context, with a slot for every command
+ * of its depth
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_async_ordered_init(struct xnvme_async_ctx *ctx);
+
+/**
+ * Give 'req' the next slot of the ring of its context, to be called before it
+ * is submitted
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned,
+ * e.g. -EBUSY when every slot is taken.
+ */
+int
+xnvme_async_ordered_enter(struct xnvme_req *req);
+
+/**
+ * Hand back the slot of 'req', which failed submission, and restore its
+ * callback
+ */
+void
+xnvme_async_ordered_cancel(struct xnvme_req *req);
+
+/**
+ * Release, to 'out', the completions reaped by the backend, in the order they
+ * were submitted, at most 'max'
+ *
+ * @return The number of completions released
+ */
+uint32_t
+xnvme_async_ordered_reap(struct xnvme_async_ctx *ctx, struct xnvme_req **out,
+			 uint32_t nreaped, uint32_t max);
+
+#endif /* __INTERNAL_XNVME_ASYNC_ORDERED_H */
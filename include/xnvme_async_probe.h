@@ -0,0 +1,62 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_ASYNC_PROBE_H
+#define __INTERNAL_XNVME_ASYNC_PROBE_H
+#include <stdio.h>
+#include <xnvme_be.h>
+
+#define XNVME_ASYNC_PROBE_NCANDIDATES 8
+#define XNVME_ASYNC_PROBE_NQDEPTHS 3		///< Queue depths: 1, 8 and 32
+#define XNVME_ASYNC_PROBE_NCMDS 512		///< Max. reads per run
+#define XNVME_ASYNC_PROBE_NSEC 5000000ULL	///< Max. submission time per run
+#define XNVME_ASYNC_PROBE_CACHE_LEN 64
+
+/**
+ * Reads of one logical block, at one queue depth, with one async. interface;
+ * CPU time is that of the process, thus including the threads of the interface
+ */
+struct xnvme_async_probe_run {
+	uint32_t qdepth;
+	uint32_t nios;			///< Reads completed
+	uint64_t wall_nsec;
+	uint64_t cpu_nsec;
+};
+
+struct xnvme_async_probe_candidate {
+	const char *id;			///< Identifier of the async. interface
+	int err;			///< Failure to run, then it is not chosen
+	double score;			///< Reads per CPU-second, of all runs
+	struct xnvme_async_probe_run runs[XNVME_ASYNC_PROBE_NQDEPTHS];
+};
+
+/**
+ * Measurements of the async. interfaces of a device, used to choose the one
+ * doing the most reads per CPU-second, see '?async=auto'
+ */
+struct xnvme_async_probe {
+	char uri[XNVME_IDENT_URI_LEN];	///< Device the measurements are of
+	uint32_t ncandidates;
+	uint32_t chosen;		///< Index of the chosen candidate
+	struct xnvme_async_probe_candidate candidates[XNVME_ASYNC_PROBE_NCANDIDATES];
+};
+
+/**
+ * Choose among the given async. interfaces the one doing the most reads per
+ * CPU-second with the given device, by a short probe or by the measurements of
+ * an earlier probe of the same device, and setup dev->be.async to use it
+ *
+ * The device must be identified, and have no contexts, the measurements are
+ * kept in dev->aprobe
+ *
+ * @return On success, 0 is returned. On error, negative errno is returned, and
+ * dev->be.async is left as it was.
+ */
+int
+xnvme_async_probe(struct xnvme_dev *dev, struct xnvme_be_async **asyncs,
+		  uint32_t nasyncs);
+
+int
+xnvme_async_probe_yaml(FILE *stream, const struct xnvme_async_probe *probe,
+		       int indent, const char *sep, int head);
+
+#endif /* __INTERNAL_XNVME_ASYNC_PROBE_H */
@@ -0,0 +1,118 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_ASYNC_SHARED_H
+#define __INTERNAL_XNVME_ASYNC_SHARED_H
+#include <pthread.h>
+#include <stdatomic.h>
+#include <xnvme_async.h>
+
+#define XNVME_ASYNC_SHARED_BATCH_MAX 64	///< Commands per backend submission
+
+/**
+ * A command of a producer, it is pushed on the queue of the shared context,
+ * submitted on the shared context by whichever thread drains the queue, and on
+ * completion, pushed on the completion list of the producer
+ */
+struct xnvme_async_shared_entry {
+	struct xnvme_cmd_link link;		///< Submitted on the shared context
+	void *mbuf;
+	size_t mbuf_nbytes;
+	int opts;
+	struct xnvme_req *ureq;			///< Request of the producer
+	struct xnvme_async_producer *producer;
+	struct xnvme_async_shared_entry *next;
+};
+
+/**
+ * State of a shared context, the queue is multi-producer, single-consumer;
+ * producers push on 'queue', and a thread holding 'lock' takes all of it,
+ * 'pending' holds those taken but not yet accepted by the backend
+ */
+struct xnvme_async_shared {
+	struct xnvme_dev *dev;
+	struct xnvme_async_ctx *ctx;		///< The shared context
+
+	_Atomic(struct xnvme_async_shared_entry *) queue;	///< LIFO
+	_Atomic uint32_t nqueued;		///< Commands not yet submitted
+	_Atomic uint32_t nproducers;
+
+	pthread_mutex_t lock;			///< Held while draining and poking
+	struct xnvme_async_shared_entry *pending;	///< FIFO, under 'lock'
+	struct xnvme_async_shared_entry *pending_tail;
+	int batch;				///< The backend submits batches
+};
+
+/**
+ * State of a producer, 'cpls' is pushed on by the thread poking the shared
+ * context, and taken by the producer, the other fields are only used by the
+ * producer
+ */
+struct xnvme_async_producer {
+	struct xnvme_async_shared *shared;
+	_Atomic(struct xnvme_async_shared_entry *) cpls;	///< LIFO
+	struct xnvme_async_shared_entry *ready;	///< FIFO, taken from 'cpls'
+	struct xnvme_async_shared_entry *ready_tail;
+	struct xnvme_async_shared_entry *free;
+	struct xnvme_async_shared_entry elm[];
+};
+
+/**
+ * Setup the shared state of the given context, allocated with
+ * XNVME_ASYNC_SHARED
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_async_shared_init(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx);
+
+/**
+ * Tear down the shared state of the given context, or the given producer
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_async_shared_term(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx);
+
+/**
+ * Queue the given command on the shared context of the producer of 'req'
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_async_shared_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+			  void *dbuf, size_t dbuf_nbytes, void *mbuf,
+			  size_t mbuf_nbytes, int opts, struct xnvme_req *req);
+
+/**
+ * Drive the shared context, unless another thread is at it, and when given a
+ * producer, invoke the callbacks of its commands completed, at most 'max' of
+ * them, 0 = unlimited
+ *
+ * @return On success, the number of completions processed, of the producer, or
+ * of the shared context. On error, negative `errno` is returned.
+ */
+int
+xnvme_async_shared_poke(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+			uint32_t max);
+
+/**
+ * Poke the shared context, or the given producer, until nothing is outstanding
+ *
+ * @return On success, the number of completions processed. On error, negative
+ * `errno` is returned.
+ */
+int
+xnvme_async_shared_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx);
+
+/**
+ * Hand the completed commands of the given producer to 'out', at most 'max',
+ * without invoking their callbacks
+ *
+ * @return On success, the number of completions returned. On error, negative
+ * `errno` is returned.
+ */
+int
+xnvme_async_shared_reap(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+			struct xnvme_req **out, uint32_t max);
+
+#endif /* __INTERNAL_XNVME_ASYNC_SHARED_H */
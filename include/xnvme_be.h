@@ -20,9 +20,15 @@
 
 #define XNVME_BE_ACTX_NBYTES 192
 
-#define XNVME_BE_ASYNC_NBYTES 64
+/**
+ * Flag of async. init(), in place of XNVME_ASYNC_SHARED, the context is driven
+ * by any thread, one at a time, and is passed on to the contexts of members
+ */
+#define XNVME_BE_ASYNC_ANY_THREAD (0x1 << 30)
+
+#define XNVME_BE_ASYNC_NBYTES 120
 #define XNVME_BE_SYNC_NBYTES 40
-#define XNVME_BE_DEV_NBYTES 24
+#define XNVME_BE_DEV_NBYTES 32
 #define XNVME_BE_MEM_NBYTES 32
 #define XNVME_BE_ATTR_NBYTES 24
 #define XNVME_BE_STATE_NBYTES 128
@@ -44,6 +50,65 @@ struct xnvme_be_async {
 
 	int (*supported)(struct xnvme_dev *, uint32_t);
 
+	/**
+	 * Submit a chain of commands which are linked in the backend, that is,
+	 * a link does not start before the previous link has completed. A
+	 * backend without support for linking returns -ENOSYS and the chain is
+	 * executed by the library instead
+	 */
+	int (*cmd_chain)(struct xnvme_dev *, struct xnvme_cmd_link *, uint16_t,
+			 int);
+
+	/**
+	 * Signal the given eventfd when commands complete on the given context,
+	 * a negative fd stops it. A backend without support returns -ENOSYS,
+	 * its contexts must then be poked to discover completions
+	 */
+	int (*notify)(struct xnvme_dev *, struct xnvme_async_ctx *, int);
+
+	/**
+	 * Register the given 'nbufs' buffers of 'nbytes' each with the context,
+	 * from which the backend selects the buffer of a read submitted with
+	 * XNVME_CMD_BUFSEL. A backend without support returns -ENOSYS
+	 */
+	int (*bufs_init)(struct xnvme_dev *, struct xnvme_async_ctx *, void *,
+			 uint32_t, uint32_t);
+
+	/**
+	 * Hand back the buffer with the given id, at the given address, such
+	 * that the backend can select it again
+	 */
+	int (*buf_put)(struct xnvme_dev *, struct xnvme_async_ctx *, uint16_t,
+		       void *, uint32_t);
+
+	/**
+	 * Store at most the given number of completed requests in the given
+	 * array, with their completion filled in, rather than invoking their
+	 * callbacks. A backend without support returns -ENOSYS
+	 */
+	int (*reap)(struct xnvme_dev *, struct xnvme_async_ctx *,
+		    struct xnvme_req **, uint32_t);
+
+	/**
+	 * Setup native submission of the given command template, that is, set
+	 * its 'submit' and pre-fill its 'be_rsvd', see xnvme_cmd_tmpl.h. A
+	 * backend without support returns -ENOSYS
+	 */
+	int (*cmd_tmpl)(struct xnvme_dev *, struct xnvme_cmd_tmpl *);
+
+	/**
+	 * Submit, in order, as many of the given commands as there is room for,
+	 * on the context of their requests, which must be the same, with a single
+	 * submission to the Kernel or device. A backend without support returns
+	 * -ENOSYS, the commands are then submitted one by one via cmd_io()
+	 *
+	 * Returns the number of commands submitted. When none is, then negative
+	 * errno, -EBUSY / -EAGAIN on lack of room, otherwise the error of the
+	 * first command
+	 */
+	int (*cmd_batch)(struct xnvme_dev *, struct xnvme_cmd_link **, uint16_t,
+			 int);
+
 	const char *id;
 
 	uint64_t enabled;
@@ -77,9 +142,10 @@ XNVME_STATIC_ASSERT(sizeof(struct xnvme_be_sync) == XNVME_BE_SYNC_NBYTES,
 
 struct xnvme_be_dev {
 	/**
-	 * Enumerate devices on/at the given 'sys_uri' when NULL local devices
+	 * Enumerate devices on/at the given 'sys_uri' when NULL local devices,
+	 * appending them to the list, which is grown as needed
 	 */
-	int (*enumerate)(struct xnvme_enumeration *, const char *, int);
+	int (*enumerate)(struct xnvme_enumeration **, const char *, int);
 
 	/**
 	 * Construct a device from the given identifier
@@ -90,6 +156,12 @@ struct xnvme_be_dev {
 	 * Close the given device
 	 */
 	void (*dev_close)(struct xnvme_dev *);
+
+	/**
+	 * Setup the backend of 'dup', a copy of the given device, without
+	 * identifying it; the device data of 'dup' is setup by the caller
+	 */
+	int (*dev_dup)(const struct xnvme_dev *, struct xnvme_dev *);
 };
 XNVME_STATIC_ASSERT(sizeof(struct xnvme_be_dev) == XNVME_BE_DEV_NBYTES,
 		    "Incorrect size")
@@ -188,10 +260,27 @@ xnvme_enumeration_alloc(struct xnvme_enumeration **list, uint32_t capacity);
 void
 xnvme_enumeration_free(struct xnvme_enumeration *list);
 
+/**
+ * Append the given entry to the list, growing the list when it is full
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
 int
-xnvme_enumeration_append(struct xnvme_enumeration *list,
+xnvme_enumeration_append(struct xnvme_enumeration **list,
 			 struct xnvme_ident *entry);
 
+/**
+ * Probe the given identifiers, by constructing a device from each of them with
+ * the given backend, using a pool of threads; probed[i] is set to 1 when the
+ * device was constructed, identifiers with probed[i] already set are skipped
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_be_enumerate_probe(const struct xnvme_be *be,
+			 const struct xnvme_ident *idents, uint32_t nidents,
+			 uint8_t *probed);
+
 bool
 has_scheme(const char *needle, const char *haystack[], int len);
 
@@ -202,4 +291,14 @@ bool
 xnvme_ident_opt_to_val(const struct xnvme_ident *ident, const char *opt,
 		       uint32_t *val);
 
+/**
+ * Parse the numerical value of the given option from the uri-options of the
+ * form '?opt=val&opt=val', matching the option by its full name
+ *
+ * @return true when the option is given with a numerical value, false otherwise
+ */
+bool
+xnvme_ident_opt_to_u64(const struct xnvme_ident *ident, const char *opt,
+		       uint64_t *val);
+
 #endif /* __INTERNAL_XNVME_BE_H */
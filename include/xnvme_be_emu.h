@@ -0,0 +1,134 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_BE_EMU_H
+#define __INTERNAL_XNVME_BE_EMU_H
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/queue.h>
+#include <xnvme_dev.h>
+
+#define XNVME_BE_EMU_NAME "emu"
+
+#define XNVME_BE_EMU_SIZE_MB_DEF 1024	///< Namespace size in MiB
+#define XNVME_BE_EMU_LBADS_DEF 12	///< LBA data size as a power of two
+#define XNVME_BE_EMU_ZSZE_MB_DEF 64	///< Zone size in MiB
+#define XNVME_BE_EMU_MDTS 7		///< Max. data transfer, 512KiB
+#define XNVME_BE_EMU_MSRC 127		///< Max. copy source ranges, zero-based
+#define XNVME_BE_EMU_NQUEUES 64		///< Number of I/O queues reported
+
+#define XNVME_BE_EMU_WHEEL_NSLOTS 256
+#define XNVME_BE_EMU_WHEEL_TICK_NSEC_DEF 1000
+
+#define XNVME_BE_EMU_NOPCODES 256
+
+/**
+ * Classes of commands whose latency models are given by the class options, a
+ * model of each opcode, and thereby command, is initialized from its class
+ */
+enum xnvme_be_emu_opclass {
+	XNVME_BE_EMU_OPCLASS_READ	= 0,
+	XNVME_BE_EMU_OPCLASS_WRITE	= 1,
+	XNVME_BE_EMU_OPCLASS_OTHER	= 2,
+	XNVME_BE_EMU_NOPCLASS		= 3,
+};
+
+/**
+ * Latency model of an opcode; the latency of a command is its base
+ * latency, fixed or sampled from a lognormal distribution with the base as its
+ * median, plus the time it takes to move its payload at the given bandwidth
+ */
+struct xnvme_be_emu_lat {
+	uint64_t nsec;		///< Base latency in nsec
+	uint64_t bps;		///< Bandwidth in bytes per second, 0 = unlimited
+	double sigma;		///< Lognormal shape, 0 = fixed latency
+};
+
+struct xnvme_be_emu_zone {
+	uint64_t wp;		///< Write pointer
+	uint8_t zs;		///< Zone state, see ::znd_state
+	uint8_t _rsvd[7];
+};
+
+/**
+ * The emulated controller and its single namespace; shared by all contexts of
+ * the device, zone state is serialized by 'zlock', data access is not
+ */
+struct xnvme_be_emu_ns {
+	uint8_t *data;			///< Backing memory of the namespace
+	size_t data_nbytes;		///< Size of the mapping of 'data'
+	size_t page_nbytes;		///< Page size of the mapping of 'data'
+
+	uint64_t nlb;			///< Number of logical blocks
+	uint32_t lbads;			///< LBA data size as a power of two
+	uint32_t zoned;
+
+	struct xnvme_be_emu_lat lat[XNVME_BE_EMU_NOPCODES];	///< By opcode
+	uint64_t tick_nsec;		///< Granularity of the timer wheel
+
+	uint64_t zsze;			///< Zone size in number of LBAs
+	uint64_t zcap;			///< Zone capacity in number of LBAs
+	uint64_t nzones;
+	uint32_t mar;			///< Max. active zones, 0 = unlimited
+	uint32_t mor;			///< Max. open zones, 0 = unlimited
+	uint32_t nactive;
+	uint32_t nopen;
+	pthread_mutex_t zlock;
+	struct xnvme_be_emu_zone *zones;
+
+	_Atomic uint64_t nbytes_read;
+	_Atomic uint64_t nbytes_written;
+	_Atomic uint64_t ncmds_read;
+	_Atomic uint64_t ncmds_written;
+
+	_Atomic uint32_t refcount;	///< Handles sharing the namespace
+};
+
+struct xnvme_be_emu_state {
+	struct xnvme_be_emu_ns *ns;
+
+	uint8_t _rsvd[120];
+};
+XNVME_STATIC_ASSERT(
+	sizeof(struct xnvme_be_emu_state) == XNVME_BE_STATE_NBYTES,
+	"Incorrect size"
+)
+
+/**
+ * A submitted command awaiting its completion time
+ */
+struct xnvme_be_emu_entry {
+	struct xnvme_req *req;
+	uint64_t due;			///< Time of completion in nsec
+	SLIST_ENTRY(xnvme_be_emu_entry) link;
+};
+
+SLIST_HEAD(xnvme_be_emu_slot, xnvme_be_emu_entry);
+
+/**
+ * Timer wheel of completions; an entry is hashed to the slot of the tick of its
+ * completion time, entries due more than a revolution ahead stay in their slot
+ * until the wheel comes around to them
+ */
+struct xnvme_be_emu_wheel {
+	uint64_t tick_nsec;		///< Time spanned by a slot
+	uint64_t cur;			///< Tick, up to which, slots are expired
+	struct xnvme_be_emu_slot pool;		///< Free entries
+	struct xnvme_be_emu_slot slots[XNVME_BE_EMU_WHEEL_NSLOTS];
+	struct xnvme_be_emu_entry elm[];
+};
+
+struct xnvme_async_ctx_emu {
+	uint32_t depth;		///< IO depth
+	uint32_t outstanding;	///< Outstanding IO on the context
+
+	struct xnvme_be_emu_wheel *wheel;
+	uint64_t rnd;		///< State of the latency sampling PRNG
+
+	uint8_t _rsvd[168];
+};
+XNVME_STATIC_ASSERT(
+	sizeof(struct xnvme_async_ctx_emu) == XNVME_BE_ACTX_NBYTES,
+	"Incorrect size"
+)
+
+#endif /* __INTERNAL_XNVME_BE_EMU_H */
@@ -2,12 +2,15 @@
 // SPDX-License-Identifier: Apache-2.0
 #ifndef __INTERNAL_XNVME_BE_LINUX_H
 #define __INTERNAL_XNVME_BE_LINUX_H
+#include <sched.h>
 #include <xnvme_dev.h>
 
 #ifndef LINUX_BLOCK_SSW
 #define LINUX_BLOCK_SSW 9
 #endif
 
+#define LINUX_NUMA_NODES_MAX 1024	///< Number of nodes in the mask given to mbind()
+
 /**
  * @enum xnvme_be_linux_opts
  */
@@ -24,8 +27,10 @@ struct xnvme_be_linux_state {
 	uint8_t pseudo;
 	uint8_t poll_io;
 	uint8_t poll_sq;
+	uint8_t async_auto;		///< '?async=auto', see xnvme_async_probe.h
+	uint8_t poll_sync;		///< '?poll_sync=1', IOPOLL for 'block_iou'
 
-	uint8_t _rsvd[121];
+	uint8_t _rsvd[119];
 };
 XNVME_STATIC_ASSERT(
 	sizeof(struct xnvme_be_linux_state) == XNVME_BE_STATE_NBYTES,
@@ -67,7 +72,10 @@ void
 xnvme_be_linux_dev_close(struct xnvme_dev *dev);
 
 int
-xnvme_be_linux_enumerate(struct xnvme_enumeration *list, const char *sys_uri,
+xnvme_be_linux_dev_dup(const struct xnvme_dev *dev, struct xnvme_dev *dup);
+
+int
+xnvme_be_linux_enumerate(struct xnvme_enumeration **list, const char *sys_uri,
 			 int opts);
 
 static inline uint64_t
@@ -93,6 +101,14 @@ int
 xnvme_be_linux_sysfs_dev_attr_to_num(struct xnvme_dev *dev, const char *attr,
 				     uint64_t *val);
 
+/**
+ * Setup the given set with the CPUs of the given NUMA node
+ *
+ * @return On success, 0 is returned. On error, negative errno is returned.
+ */
+int
+xnvme_be_linux_numa_cpus(int node, cpu_set_t *cpus);
+
 int
 xnvme_be_linux_uapi_ver_fpr(FILE *stream, enum xnvme_pr opts);
 
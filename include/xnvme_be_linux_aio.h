@@ -6,21 +6,46 @@
 #ifndef __INTERNAL_XNVME_BE_LINUX_AIO_H
 #define __INTERNAL_XNVME_BE_LINUX_AIO_H
 
+#define XNVME_BE_LINUX_AIO_RING_MAGIC 0xa10a10a1
+
+/**
+ * Completion ring of an aio context, which the Kernel maps into user-space at
+ * the address given by the io_context_t, see 'struct aio_ring' in fs/aio.c
+ */
+struct xnvme_be_linux_aio_ring {
+	unsigned id;
+	unsigned nr;			///< Number of io_events in the ring
+	unsigned head;			///< Advanced by the consumer
+	unsigned tail;			///< Advanced by the Kernel
+	unsigned magic;
+	unsigned compat_features;
+	unsigned incompat_features;
+	unsigned header_length;
+	struct io_event io_events[];
+};
+
 struct xnvme_async_ctx_aio {
 	uint32_t depth;         ///< IO depth
 	uint32_t outstanding;   ///< Outstanding IO on the context/ring/queue
 
 	io_context_t aio_ctx;
 	struct io_event *aio_events;
-	struct iocb **iocbs;
-	struct iocb iocb;
+	struct iocb **iocbs;	///< Ring of iocbs, from 'tail' to 'head' are queued
+	struct iocb *slots;	///< An iocb for every command outstanding
+	uint32_t *free;		///< Stack of indexes of unused 'slots'
+	uint32_t nfree;
 
 	uint32_t entries;
 	uint32_t queued;
 	uint32_t head;
 	uint32_t tail;
 
-	uint8_t rsvd[76];
+	uint8_t user_ring;	///< Completions are reaped from the mapped ring
+
+	struct iocb **failed;	///< Failed submission, completed on next process
+	uint32_t nfailed;
+
+	uint8_t rsvd[108];
 };
 XNVME_STATIC_ASSERT(
 	sizeof(struct xnvme_async_ctx_aio) == XNVME_BE_ACTX_NBYTES,
@@ -0,0 +1,22 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_BE_LINUX_BLOCK_H
+#define __INTERNAL_XNVME_BE_LINUX_BLOCK_H
+#include <xnvme_dev.h>
+
+int
+xnvme_be_linux_block_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+			    void *dbuf, size_t dbuf_nbytes, void *mbuf,
+			    size_t mbuf_nbytes, int opts, struct xnvme_req *req);
+
+int
+xnvme_be_linux_block_cmd_admin(struct xnvme_dev *dev,
+			       struct xnvme_spec_cmd *cmd, void *dbuf,
+			       size_t dbuf_nbytes, void *mbuf,
+			       size_t mbuf_nbytes, int opts,
+			       struct xnvme_req *req);
+
+int
+xnvme_be_linux_block_supported(struct xnvme_dev *dev, uint32_t opts);
+
+#endif /* __INTERNAL_XNVME_BE_LINUX_BLOCK_H */
@@ -4,16 +4,33 @@
 #define __INTERNAL_XNVME_BE_LINUX_IOU_H
 #include <liburing.h>
 
+/**
+ * Entry of a provided-buffer ring, as struct io_uring_buf of Linux 5.19, which
+ * the bundled liburing may predate; the tail of the ring aliases the 'resv'
+ * field of the first entry
+ */
+struct xnvme_be_linux_iou_pbuf {
+	uint64_t addr;
+	uint32_t len;
+	uint16_t bid;
+	uint16_t resv;
+};
+
 struct xnvme_async_ctx_linux_iou {
 	uint32_t depth;		///< IO depth
 	uint32_t outstanding;	///< Outstanding IO on the context/ring/queue
 
 	struct io_uring ring;
 
+	struct xnvme_be_linux_iou_pbuf *pbuf;	///< Provided-buffer ring
+	uint16_t pbuf_mask;
+
 	uint8_t poll_io;
 	uint8_t poll_sq;
+	uint8_t fixed_file;	///< The device is registered, at index 0
+	uint8_t taskrun;	///< The Kernel flags deferred completions
 
-	uint8_t _rsvd[14];
+	uint8_t _rsvd[2];
 };
 XNVME_STATIC_ASSERT(
 	sizeof(struct xnvme_async_ctx_linux_iou) == XNVME_BE_ACTX_NBYTES,
@@ -3,6 +3,9 @@
 #ifndef __INTERNAL_XNVME_BE_LINUX_THR_H
 #define __INTERNAL_XNVME_BE_LINUX_THR_H
 
+///< One submission queue for each level of each ::xnvme_prio_class
+#define XNVME_BE_LINUX_THR_NRANKS 32
+
 struct _entry {
 	struct xnvme_spec_cmd cmd;
 	struct xnvme_dev *dev;
@@ -16,8 +19,9 @@ struct _entry {
 
 struct _qp {
 	STAILQ_HEAD(, _entry) rp;	///< Request pool
-	STAILQ_HEAD(, _entry) sq;	///< Submission queue
+	STAILQ_HEAD(, _entry) sq[XNVME_BE_LINUX_THR_NRANKS];	///< Submission queues, by rank
 	STAILQ_HEAD(, _entry) cq;	///< Completion queue
+	uint32_t sq_ranks;		///< Bitmap of non-empty submission queues
 	uint32_t capacity;
 	struct _entry elm[];
 };
@@ -0,0 +1,115 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_BE_MIRROR_H
+#define __INTERNAL_XNVME_BE_MIRROR_H
+#include <sys/queue.h>
+#include <xnvme_be_vdev.h>
+#include <xnvme_dev.h>
+
+#define XNVME_BE_MIRROR_NAME "mirror"
+
+#define XNVME_BE_MIRROR_NMEMBERS_MAX 8
+#define XNVME_BE_MIRROR_NSAMPLES 1024	///< Read latencies kept for hedging
+#define XNVME_BE_MIRROR_NSAMPLES_MIN 256	///< Samples before hedging starts
+
+/**
+ * A mirrored (RAID-1) device; writes go to all members and complete once
+ * 'quorum' members have completed them, reads go to a single member
+ */
+struct xnvme_be_mirror {
+	struct xnvme_be_vdev vdev;	///< Members, first, see xnvme_be_vdev.h
+	uint32_t quorum;		///< Members to complete a write
+	uint32_t hedge;			///< Read latency percentile, 0 = no hedging
+};
+
+struct xnvme_be_mirror_parent;
+struct xnvme_be_mirror_queue;
+
+/**
+ * A command submitted to a member on behalf of a parent command
+ */
+struct xnvme_be_mirror_child {
+	struct xnvme_req req;
+	struct xnvme_be_mirror_queue *queue;
+	struct xnvme_be_mirror_parent *parent;
+	void *dbuf;			///< Buffer the member transfers to/from
+	uint64_t tsubmit;		///< Time of submission in nsec
+	uint32_t member;
+	uint32_t _rsvd;
+	SLIST_ENTRY(xnvme_be_mirror_child) link;
+};
+
+/**
+ * A command submitted to the mirror; it completes once 'nrequired' children
+ * have succeeded, or when that is no longer possible, and its slot is
+ * released once all of its children have completed. Children which complete
+ * after the parent, lagging, transfer to/from the bounce-buffers of the slot,
+ * never to the buffer of the parent
+ */
+struct xnvme_be_mirror_parent {
+	struct xnvme_req *req;		///< NULL once completed
+	struct xnvme_spec_cmd cmd;
+	void *dbuf;			///< Buffer of the parent command
+	size_t dbuf_nbytes;
+	void *bounce[2];		///< Bounce-buffers of the slot
+	uint64_t tsubmit;		///< Time of submission in nsec
+	uint32_t tried;			///< Members tried, bitmap
+	uint32_t npending;		///< Children yet to complete
+	uint32_t nsucceeded;
+	uint32_t nfailed;
+	uint32_t nrequired;		///< Children to succeed
+	uint32_t hedged;		///< A duplicate read was submitted
+	uint32_t queued;		///< On the list of reads to hedge
+	uint32_t _rsvd;
+	struct xnvme_spec_cpl cpl;	///< Completion of the first failed child
+	SLIST_ENTRY(xnvme_be_mirror_parent) link;
+	TAILQ_ENTRY(xnvme_be_mirror_parent) rlink;	///< Reads to hedge
+};
+
+/**
+ * Read latencies, of the most recent reads, and the percentile derived from
+ * them, above which reads are hedged
+ */
+struct xnvme_be_mirror_lat {
+	uint64_t samples[XNVME_BE_MIRROR_NSAMPLES];
+	uint64_t sorted[XNVME_BE_MIRROR_NSAMPLES];
+	uint64_t nsamples;		///< Samples recorded in total
+	uint64_t thr_nsec;		///< Hedging threshold, 0 = not yet known
+};
+
+/**
+ * The member contexts of a mirror context; a member context has the depth of
+ * the mirror context, as a parent has at most one child on each member
+ */
+struct xnvme_be_mirror_queue {
+	struct xnvme_dev *members[XNVME_BE_MIRROR_NMEMBERS_MAX];
+	struct xnvme_async_ctx *ctxs[XNVME_BE_MIRROR_NMEMBERS_MAX];
+	SLIST_HEAD(, xnvme_be_mirror_child) children[XNVME_BE_MIRROR_NMEMBERS_MAX];
+	uint32_t nfree[XNVME_BE_MIRROR_NMEMBERS_MAX];	///< Free children
+	SLIST_HEAD(, xnvme_be_mirror_parent) parents;
+	TAILQ_HEAD(, xnvme_be_mirror_parent) reads;	///< In submission order
+	struct xnvme_be_mirror *mirror;
+	struct xnvme_dev *dev;
+	uint32_t depth;
+	uint32_t rr;			///< Member to poke, and read from, first
+	uint32_t ncompleted;		///< Parents completed, wraps around
+	uint32_t nlagging;		///< Slots of completed parents in use
+	struct xnvme_be_mirror_lat lat;
+	struct xnvme_be_mirror_parent *pelm;
+	struct xnvme_be_mirror_child *celm;
+};
+
+struct xnvme_async_ctx_mirror {
+	uint32_t depth;		///< IO depth
+	uint32_t outstanding;	///< Outstanding IO on the context
+
+	struct xnvme_be_mirror_queue *queue;
+
+	uint8_t _rsvd[176];
+};
+XNVME_STATIC_ASSERT(
+	sizeof(struct xnvme_async_ctx_mirror) == XNVME_BE_ACTX_NBYTES,
+	"Incorrect size"
+)
+
+#endif /* __INTERNAL_XNVME_BE_MIRROR_H */
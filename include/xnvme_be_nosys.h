@@ -41,6 +41,37 @@ xnvme_be_nosys_async_term(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx);
 int
 xnvme_be_nosys_async_supported(struct xnvme_dev *dev, uint32_t opts);
 
+int
+xnvme_be_nosys_async_cmd_chain(struct xnvme_dev *dev,
+			       struct xnvme_cmd_link *links, uint16_t nlinks,
+			       int opts);
+
+int
+xnvme_be_nosys_async_notify(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+			    int fd);
+
+int
+xnvme_be_nosys_async_bufs_init(struct xnvme_dev *dev,
+			       struct xnvme_async_ctx *ctx, void *bufs,
+			       uint32_t nbufs, uint32_t nbytes);
+
+int
+xnvme_be_nosys_async_buf_put(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+			     uint16_t bid, void *buf, uint32_t nbytes);
+
+int
+xnvme_be_nosys_async_cmd_tmpl(struct xnvme_dev *dev,
+			      struct xnvme_cmd_tmpl *tmpl);
+
+int
+xnvme_be_nosys_async_reap(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+			  struct xnvme_req **out, uint32_t max);
+
+int
+xnvme_be_nosys_async_cmd_batch(struct xnvme_dev *dev,
+			       struct xnvme_cmd_link **cmds, uint16_t ncmds,
+			       int opts);
+
 void *
 xnvme_be_nosys_buf_alloc(const struct xnvme_dev *dev, size_t nbytes,
 			 uint64_t *phys);
@@ -57,7 +88,7 @@ void
 xnvme_be_nosys_buf_free(const struct xnvme_dev *dev, void *buf);
 
 int
-xnvme_be_nosys_enumerate(struct xnvme_enumeration *list,
+xnvme_be_nosys_enumerate(struct xnvme_enumeration **list,
 			 const char *sys_uri, int opts);
 
 int
@@ -67,6 +98,9 @@ xnvme_be_nosys_dev_from_ident(const struct xnvme_ident *ident,
 void
 xnvme_be_nosys_dev_close(struct xnvme_dev *dev);
 
+int
+xnvme_be_nosys_dev_dup(const struct xnvme_dev *dev, struct xnvme_dev *dup);
+
 #define XNVME_BE_NOSYS_SYNC {					\
 	.cmd_io = xnvme_be_nosys_sync_cmd_io,			\
 	.cmd_admin = xnvme_be_nosys_sync_cmd_admin,		\
@@ -82,6 +116,13 @@ xnvme_be_nosys_dev_close(struct xnvme_dev *dev);
 	.init = xnvme_be_nosys_async_init,			\
 	.term = xnvme_be_nosys_async_term,			\
 	.supported = xnvme_be_nosys_async_supported,		\
+	.cmd_chain = xnvme_be_nosys_async_cmd_chain,		\
+	.notify = xnvme_be_nosys_async_notify,			\
+	.bufs_init = xnvme_be_nosys_async_bufs_init,		\
+	.buf_put = xnvme_be_nosys_async_buf_put,		\
+	.reap = xnvme_be_nosys_async_reap,			\
+	.cmd_tmpl = xnvme_be_nosys_async_cmd_tmpl,		\
+	.cmd_batch = xnvme_be_nosys_async_cmd_batch,		\
 	.id = "ENOSYS",						\
 	.enabled = 0,						\
 }
@@ -97,6 +138,7 @@ xnvme_be_nosys_dev_close(struct xnvme_dev *dev);
 	.enumerate = xnvme_be_nosys_enumerate,			\
 	.dev_from_ident = xnvme_be_nosys_dev_from_ident,	\
 	.dev_close = xnvme_be_nosys_dev_close,			\
+	.dev_dup = xnvme_be_nosys_dev_dup,			\
 }
 
 #endif /* __INTERNAL_XNVME_BE_NOSYS_H */
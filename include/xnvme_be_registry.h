@@ -6,5 +6,8 @@
 extern struct xnvme_be xnvme_be_spdk;
 extern struct xnvme_be xnvme_be_linux;
 extern struct xnvme_be xnvme_be_fbsd;
+extern struct xnvme_be xnvme_be_emu;
+extern struct xnvme_be xnvme_be_stripe;
+extern struct xnvme_be xnvme_be_mirror;
 
 #endif /* __INTERNAL_XNVME_BE_REGISTRY_H */
@@ -16,7 +16,10 @@ struct xnvme_async_ctx_spdk {
 
 	struct spdk_nvme_qpair *qpair;
 
-	uint8_t rsvd[176];
+	struct xnvme_req **reaped;	///< When reaping, completed requests go here
+	uint32_t nreaped;
+
+	uint8_t rsvd[164];
 };
 XNVME_STATIC_ASSERT(
 	sizeof(struct xnvme_async_ctx_spdk) == XNVME_BE_ACTX_NBYTES,
@@ -56,8 +59,9 @@ struct xnvme_be_spdk_state {
 	// Options
 	uint8_t cmb_sqs;
 	uint8_t css;
+	uint8_t wrr;			///< Weighted Round Robin arbitration
 
-	uint8_t _rsvd[37];
+	uint8_t _rsvd[36];
 };
 XNVME_STATIC_ASSERT(
 	sizeof(struct xnvme_be_spdk_state) == XNVME_BE_STATE_NBYTES,
@@ -0,0 +1,82 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_BE_STRIPE_H
+#define __INTERNAL_XNVME_BE_STRIPE_H
+#include <sys/queue.h>
+#include <xnvme_be_vdev.h>
+#include <xnvme_dev.h>
+
+#define XNVME_BE_STRIPE_NAME "stripe"
+
+#define XNVME_BE_STRIPE_NMEMBERS_MAX 16
+#define XNVME_BE_STRIPE_CHUNK_KB_DEF 128	///< Chunk size in KiB
+#define XNVME_BE_STRIPE_MDEPTH_MAX 2048		///< Max. depth of member contexts
+
+/**
+ * A striped (RAID-0) device; the LBA space is split into chunks of 'chunk_nlb'
+ * logical blocks, which are laid out round-robin across the members
+ */
+struct xnvme_be_stripe {
+	struct xnvme_be_vdev vdev;	///< Members, first, see xnvme_be_vdev.h
+	uint64_t chunk_nlb;		///< Chunk size in number of LBAs
+	uint64_t member_nlb;		///< LBAs used of each member
+};
+
+struct xnvme_be_stripe_parent;
+
+/**
+ * A command submitted to a member, covering part of a parent command
+ */
+struct xnvme_be_stripe_child {
+	struct xnvme_req req;
+	struct xnvme_be_stripe_parent *parent;
+	uint32_t member;
+	uint32_t _rsvd;
+	SLIST_ENTRY(xnvme_be_stripe_child) link;
+};
+
+/**
+ * A command submitted to the stripe, completed once all of its children are;
+ * 'cpl' is the completion of the first child which failed
+ */
+struct xnvme_be_stripe_parent {
+	struct xnvme_req *req;
+	uint32_t npending;		///< Children yet to complete
+	uint32_t _rsvd;
+	struct xnvme_spec_cpl cpl;
+	SLIST_ENTRY(xnvme_be_stripe_parent) link;
+};
+
+/**
+ * The member contexts of a stripe context; a member context has room for the
+ * children of as many commands as the stripe context, of the maximum transfer
+ * size, and a pool of as many children
+ */
+struct xnvme_be_stripe_queue {
+	struct xnvme_dev *members[XNVME_BE_STRIPE_NMEMBERS_MAX];
+	struct xnvme_async_ctx *ctxs[XNVME_BE_STRIPE_NMEMBERS_MAX];
+	SLIST_HEAD(, xnvme_be_stripe_child) children[XNVME_BE_STRIPE_NMEMBERS_MAX];
+	uint32_t nfree[XNVME_BE_STRIPE_NMEMBERS_MAX];	///< Free children
+	SLIST_HEAD(, xnvme_be_stripe_parent) parents;
+	uint32_t nmembers;
+	uint32_t mdepth;		///< Depth of the member contexts
+	uint32_t rr;			///< Member to poke first
+	uint32_t ncompleted;		///< Parents completed, wraps around
+	struct xnvme_be_stripe_parent *pelm;
+	struct xnvme_be_stripe_child *celm;
+};
+
+struct xnvme_async_ctx_stripe {
+	uint32_t depth;		///< IO depth
+	uint32_t outstanding;	///< Outstanding IO on the context
+
+	struct xnvme_be_stripe_queue *queue;
+
+	uint8_t _rsvd[176];
+};
+XNVME_STATIC_ASSERT(
+	sizeof(struct xnvme_async_ctx_stripe) == XNVME_BE_ACTX_NBYTES,
+	"Incorrect size"
+)
+
+#endif /* __INTERNAL_XNVME_BE_STRIPE_H */
@@ -0,0 +1,126 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_BE_VDEV_H
+#define __INTERNAL_XNVME_BE_VDEV_H
+#include <xnvme_be.h>
+#include <xnvme_dev.h>
+
+#define XNVME_BE_VDEV_NMEMBERS_MAX 16
+
+/**
+ * The members of a virtual device, that is, a device composed of the devices
+ * given as a comma-separated list of device uris, e.g.
+ * 'stripe:emu:ram0,emu:ram1?chunk=8'. It is the first field of the device
+ * struct of the backend, which is allocated by xnvme_be_vdev_alloc()
+ */
+struct xnvme_be_vdev {
+	const struct xnvme_be *be;	///< The backend, as registered
+	uint32_t nbytes;		///< Size of the device struct of the backend
+	uint32_t nmembers;
+	struct xnvme_dev *members[XNVME_BE_VDEV_NMEMBERS_MAX];
+};
+
+struct xnvme_be_vdev_state {
+	struct xnvme_be_vdev *vdev;
+
+	uint8_t _rsvd[120];
+};
+XNVME_STATIC_ASSERT(
+	sizeof(struct xnvme_be_vdev_state) == XNVME_BE_STATE_NBYTES,
+	"Incorrect size"
+)
+
+static inline struct xnvme_be_vdev *
+xnvme_be_vdev(const struct xnvme_dev *dev)
+{
+	return ((struct xnvme_be_vdev_state *)dev->be.state)->vdev;
+}
+
+/**
+ * Allocate the zeroed device struct, of 'nbytes', of a virtual device backend
+ *
+ * @return On success, the device struct is returned. On error, NULL is returned
+ * and `errno` set to indicate the error.
+ */
+void *
+xnvme_be_vdev_alloc(size_t nbytes);
+
+/**
+ * Close the members and free the device struct allocated by
+ * xnvme_be_vdev_alloc()
+ */
+void
+xnvme_be_vdev_free(struct xnvme_be_vdev *vdev);
+
+/**
+ * Open the members given by the target of 'ident', of at most 'nmembers_max',
+ * which must be conventional namespaces of the same logical block format. The
+ * options of 'ident' are passed on to the members, except for 'inject', which
+ * applies to the virtual device itself, and those named in the NULL-terminated
+ * 'keys', which are for the backend. An option given as 'key.n=val' is passed
+ * on, as 'key=val', to member 'n' only, e.g. 'inject.1=error,opc=0x02'
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_be_vdev_open(struct xnvme_be_vdev *vdev, const struct xnvme_ident *ident,
+		   const char *keys[], uint32_t nmembers_max);
+
+/**
+ * Allocate the device of the given backend, with identify data of the first
+ * member, of 'nlb' logical blocks, and the smallest transfer size of the
+ * members. On success, the device owns 'vdev'
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_be_vdev_dev_alloc(struct xnvme_be_vdev *vdev,
+			const struct xnvme_ident *ident,
+			const struct xnvme_be *be, const char *mn, uint64_t nlb,
+			struct xnvme_dev **dev);
+
+/**
+ * Check that the command is a read, write, write zeroes or flush, without
+ * meta-data, within the bounds of the device
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_be_vdev_cmd_check(const struct xnvme_dev *dev,
+			const struct xnvme_spec_cmd *cmd, const void *mbuf);
+
+int
+xnvme_be_vdev_sync_cmd_admin(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+			     void *dbuf, size_t dbuf_nbytes, void *mbuf,
+			     size_t mbuf_nbytes, int opts,
+			     struct xnvme_req *req);
+
+int
+xnvme_be_vdev_supported(struct xnvme_dev *dev, uint32_t opts);
+
+int
+xnvme_be_vdev_enumerate(struct xnvme_enumeration **list, const char *sys_uri,
+			int opts);
+
+int
+xnvme_be_vdev_dev_dup(const struct xnvme_dev *dev, struct xnvme_dev *dup);
+
+void
+xnvme_be_vdev_dev_close(struct xnvme_dev *dev);
+
+void *
+xnvme_be_vdev_buf_alloc(const struct xnvme_dev *dev, size_t nbytes,
+			uint64_t *phys);
+
+void *
+xnvme_be_vdev_buf_realloc(const struct xnvme_dev *dev, void *buf,
+			  size_t nbytes, uint64_t *phys);
+
+void
+xnvme_be_vdev_buf_free(const struct xnvme_dev *dev, void *buf);
+
+int
+xnvme_be_vdev_buf_vtophys(const struct xnvme_dev *dev, void *buf,
+			  uint64_t *phys);
+
+#endif /* __INTERNAL_XNVME_BE_VDEV_H */
@@ -0,0 +1,27 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_CMD_BATCH_H
+#define __INTERNAL_XNVME_CMD_BATCH_H
+#include <pthread.h>
+#include <xnvme_be.h>
+
+#define XNVME_CMD_BATCH_QDEPTH 64	///< Depth of the context of a thread
+
+/**
+ * Async. context of a thread, setup by its first xnvme_cmd_batch_sync() on a
+ * device, and kept on the device until it is closed; 'ctx' is NULL when the
+ * backend has no async. interface, the batch is then submitted one by one
+ */
+struct xnvme_cmd_batch {
+	pthread_t thread;
+	struct xnvme_async_ctx *ctx;
+	struct xnvme_cmd_batch *next;
+};
+
+/**
+ * Tear down the contexts setup by xnvme_cmd_batch_sync() on the given device
+ */
+void
+xnvme_cmd_batch_teardown(struct xnvme_dev *dev);
+
+#endif /* __INTERNAL_XNVME_CMD_BATCH_H */
@@ -0,0 +1,28 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_CMD_TMPL_H
+#define __INTERNAL_XNVME_CMD_TMPL_H
+#include <xnvme_be.h>
+
+#define XNVME_CMD_TMPL_BE_NBYTES 64
+
+/**
+ * Template of a read or write command; with native submission, setup by the
+ * async. cmd_tmpl() of the backend, 'submit' consumes what the backend
+ * pre-filled in 'be_rsvd', otherwise commands are passed via xnvme_cmd_pass()
+ */
+struct xnvme_cmd_tmpl {
+	uint8_t be_rsvd[XNVME_CMD_TMPL_BE_NBYTES];	///< First, thus aligned
+
+	int (*submit)(struct xnvme_cmd_tmpl *, uint64_t, uint16_t, void *,
+		      struct xnvme_req *);
+
+	struct xnvme_dev *dev;
+	struct xnvme_async_ctx *ctx;	///< NULL with XNVME_CMD_SYNC
+	struct xnvme_spec_cmd cmd;	///< The invariant fields of the command
+	uint64_t ssw;			///< Bit-width for LBA to offset conversion
+	uint32_t lba_nbytes;
+	int opts;
+};
+
+#endif /* __INTERNAL_XNVME_CMD_TMPL_H */
@@ -6,32 +6,56 @@
 #include <libxnvme.h>
 #include <xnvme_be.h>
 
+struct xnvme_inject;
+struct xnvme_async_probe;
+struct xnvme_cmd_batch;
+
 enum xnvme_dev_type {
 	XNVME_DEV_TYPE_NVME_CONTROLLER,
 	XNVME_DEV_TYPE_NVME_NAMESPACE,
 	XNVME_DEV_TYPE_BLOCK_DEVICE,
 };
 
+#define XNVME_DEV_CTRLR_KEY_LEN 256
+#define XNVME_DEV_CTRLR_SHARED_LEN 64
+
+/**
+ * Controller identify data, referenced by device handles; shared by handles of
+ * namespaces on the same controller when the backend can tell which controller
+ * a handle belongs to, otherwise private to the handle and its duplicates
+ */
+struct xnvme_dev_ctrlr {
+	struct xnvme_spec_idfy_ctrlr id;	///< NVMe id-ctrlr
+	struct xnvme_spec_idfy_ctrlr idcss;	///< Command Set Specific id-ctrlr
+	char key[XNVME_DEV_CTRLR_KEY_LEN];	///< Empty when private
+	uint32_t refcount;
+};
+
 struct xnvme_dev {
 	struct xnvme_geo geo;		///< Device geometry
 	struct xnvme_be be;		///< Backend interface
 	uint64_t ssw;			///< Bit-width for LBA fmt conversion
 	uint64_t cmd_opts;		///< Default options for CMD execution
+	struct xnvme_inject *inject;	///< Fault-injection, see xnvme_inject.h
+	struct xnvme_async_probe *aprobe;	///< See xnvme_async_probe.h
+	struct xnvme_cmd_batch *batch;	///< See xnvme_cmd_batch.h
 
 	uint32_t nsid;			///< Namespace Identifier
 	enum xnvme_spec_csi csi;	///< Command Set Identifier
 
 	enum xnvme_dev_type dtype;	///< Device type
 
-	uint8_t _pad[36];
+	int32_t numa_node;		///< NUMA node of the device, -1 when unknown
+
+	uint8_t _pad[8];
+
+	struct xnvme_dev_ctrlr *ctrlr;	///< Controller identify data
 
 	struct {
-		struct xnvme_spec_idfy_ctrlr ctrlr;	///< NVMe id-ctrlr
 		struct xnvme_spec_idfy_ns ns;		///< NVMe id-ns
 	} id;
 
 	struct {
-		struct xnvme_spec_idfy_ctrlr ctrlr;	///< NVMe id-ctrlr
 		struct xnvme_spec_idfy_ns ns;		///< NVMe id-ns
 	} idcss;			///< Command Set Specific
 
@@ -42,6 +66,32 @@ struct xnvme_dev {
 int
 xnvme_dev_alloc(struct xnvme_dev **dev);
 
+/**
+ * Release the controller data referenced by the device and free it, for use by
+ * backends on failure to construct the device
+ */
+void
+xnvme_dev_free(struct xnvme_dev *dev);
+
+/**
+ * Setup the controller data of the device, taking a reference to the data
+ * shared under the given key, or allocating it when there is none or the key is
+ * NULL or empty
+ *
+ * @return On success, 1 when shared data is referenced, thus identify
+ * controller can be skipped, 0 when allocated. On error, negative errno.
+ */
+int
+xnvme_dev_ctrlr_get(struct xnvme_dev *dev, const char *key);
+
+/**
+ * Share the controller data of the device, setup by the backend after a call to
+ * xnvme_dev_ctrlr_get() returning 0, under the given key. When another handle
+ * shared its data first, then the device references that instead.
+ */
+void
+xnvme_dev_ctrlr_share(struct xnvme_dev *dev, const char *key);
+
 int
 xnvme_dev_be_init(struct xnvme_dev *dev, struct xnvme_be *be,
 		  const char *uri);
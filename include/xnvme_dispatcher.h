@@ -0,0 +1,112 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_DISPATCHER_H
+#define __INTERNAL_XNVME_DISPATCHER_H
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <xnvme_async.h>
+
+#define XNVME_DISPATCHER_NTHREADS_MAX 64
+#define XNVME_DISPATCHER_NBATCHES_DEF 4096
+#define XNVME_DISPATCHER_BATCH_MAX 256
+
+/**
+ * A command submitted on a context with a dispatcher; its callback is replaced,
+ * until the completion is handed to a callback thread, by which the callback is
+ * restored and invoked
+ */
+struct xnvme_dispatch_slot {
+	struct xnvme_req *req;
+	xnvme_async_cb cb;		///< Callback of 'req', as submitted
+	void *cb_arg;			///< Callback argument of 'req', as submitted
+	uint64_t ts;			///< Time, in nsec, of reaping the completion
+	struct xnvme_async_dispatch *dispatch;
+	struct xnvme_dispatch_slot *next;	///< Batch, or free-list, link
+};
+
+/**
+ * A cell of the queue of batches, 'seq' tells whether the cell is ready to be
+ * written or read for the given position
+ */
+struct xnvme_dispatcher_cell {
+	_Atomic uint64_t seq;
+	struct xnvme_dispatch_slot *batch;
+};
+
+/**
+ * Pool of callback threads, consuming batches of completions from a bounded,
+ * lock-free, multi-producer, multi-consumer queue; a thread sleeps on 'sem',
+ * which is posted once per batch enqueued, and once per thread on 'stop'
+ */
+struct xnvme_dispatcher {
+	_Atomic uint64_t enq;		///< Next to write
+	uint8_t _rsvd1[56];		///< Keeps 'enq' and 'deq' apart
+	_Atomic uint64_t deq;		///< Next to read
+	uint8_t _rsvd2[56];
+
+	struct xnvme_dispatcher_cell *cells;
+	uint64_t mask;			///< Number of cells minus one
+	sem_t sem;
+	_Atomic int stop;
+
+	pthread_t *threads;
+	uint32_t nthreads;
+
+	_Atomic uint64_t ndispatched;
+	_Atomic uint64_t nbatches;
+	_Atomic uint64_t ninline;
+	_Atomic uint64_t delay_nsec;
+};
+
+/**
+ * Dispatcher state of an asynchronous context; the slots and the batch being
+ * filled are used by the thread of the context only, 'freed' is pushed on by
+ * the callback threads and taken by the thread of the context when it runs out
+ * of slots
+ */
+struct xnvme_async_dispatch {
+	struct xnvme_dispatcher *dispatcher;
+	struct xnvme_dispatch_slot *batch;	///< FIFO, not yet enqueued
+	struct xnvme_dispatch_slot *batch_tail;
+	uint32_t nbatched;
+	uint32_t batch_max;			///< Completions per batch, at most
+	struct xnvme_dispatch_slot *free;
+	_Atomic(struct xnvme_dispatch_slot *) freed;	///< LIFO
+	_Atomic uint32_t nqueued;		///< Enqueued, not yet called back
+	uint32_t _rsvd;
+	struct xnvme_dispatch_slot elm[];
+};
+
+/**
+ * Give 'req' a slot of its context, replacing its callback, to be called before
+ * it is submitted
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned,
+ * e.g. -EBUSY when every slot is taken.
+ */
+int
+xnvme_async_dispatch_enter(struct xnvme_req *req);
+
+/**
+ * Hand back the slot of 'req', which failed submission, and restore its
+ * callback
+ */
+void
+xnvme_async_dispatch_cancel(struct xnvme_req *req);
+
+/**
+ * Enqueue the completions batched on the given context, to be called at the
+ * end of poking it
+ */
+void
+xnvme_async_dispatch_flush(struct xnvme_async_dispatch *dispatch);
+
+/**
+ * Wait for the callback threads to invoke the callbacks of every completion
+ * enqueued by the given context
+ */
+void
+xnvme_async_dispatch_drain(struct xnvme_async_dispatch *dispatch);
+
+#endif /* __INTERNAL_XNVME_DISPATCHER_H */
@@ -0,0 +1,96 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_INJECT_H
+#define __INTERNAL_XNVME_INJECT_H
+#include <stdatomic.h>
+#include <sys/queue.h>
+#include <xnvme_be.h>
+
+#define XNVME_INJECT_NRULES_MAX 8
+#define XNVME_INJECT_DELAY_USEC_DEF 1000
+#define XNVME_INJECT_TIMEOUT_USEC_DEF 1000000
+#define XNVME_INJECT_SC_DEF 0x06	///< Generic status: Internal Error
+#define XNVME_INJECT_SC_ABORT 0x07	///< Generic status: Abort Requested
+
+enum xnvme_inject_action {
+	XNVME_INJECT_DELAY	= 0x1,	///< Complete 'usec' later than the device
+	XNVME_INJECT_ERROR	= 0x2,	///< Fail, after 'usec', without submitting
+	XNVME_INJECT_TIMEOUT	= 0x3,	///< Abort, 'usec' after submission
+	XNVME_INJECT_DROP	= 0x4,	///< Never deliver the completion
+};
+
+/**
+ * A rule matches a command by opcode, LBA range and probability; the first
+ * matching rule, in the order given, is applied
+ */
+struct xnvme_inject_rule {
+	enum xnvme_inject_action action;
+	int admin;			///< Match admin instead of I/O commands
+	int opc;			///< Opcode to match, -1 = any
+	uint64_t slba;			///< First LBA of the range to match
+	uint64_t elba;			///< Last LBA of the range to match
+	uint64_t p_thr;			///< Probability, scaled to 2^53
+	uint64_t usec;
+	uint8_t sct;
+	uint8_t sc;
+
+	_Atomic uint64_t nhits;		///< Number of commands the rule applied to
+};
+
+/**
+ * Injection state of a device; the backend interfaces are replaced by the
+ * injecting ones, which call into the ones replaced, as kept here
+ */
+struct xnvme_inject {
+	struct xnvme_be_async async;
+	struct xnvme_be_sync sync;
+
+	uint32_t nrules;
+	struct xnvme_inject_rule rules[XNVME_INJECT_NRULES_MAX];
+};
+
+/**
+ * A command on which a rule is applied, held from submission until its
+ * completion is delivered
+ */
+struct xnvme_inject_entry {
+	struct xnvme_req *req;
+	xnvme_async_cb cb;		///< Callback of 'req', as submitted
+	void *cb_arg;			///< Callback argument of 'req', as submitted
+	struct xnvme_inject_rule *rule;
+	uint64_t due;			///< Time, in nsec, of delivering completion
+	TAILQ_ENTRY(xnvme_inject_entry) link;
+};
+
+/**
+ * Injection state of an asynchronous context; completions held back are not
+ * accounted in the 'outstanding' of the context, as that is owned by the
+ * backend, but in 'nheld'
+ */
+struct xnvme_async_inject {
+	struct xnvme_inject *inject;
+	TAILQ_HEAD(, xnvme_inject_entry) pool;	///< Free entries
+	TAILQ_HEAD(, xnvme_inject_entry) held;	///< Completions held back
+	uint32_t nheld;			///< Completions held, including dropped
+	uint32_t ndropped;		///< Completions which are never delivered
+	uint32_t nintercepted;		///< Completions taken from the backend
+	uint32_t _rsvd;
+	struct xnvme_inject_entry elm[];
+};
+
+/**
+ * Setup injection on the given device when its identifier has the option
+ * 'inject=rule[;rule]', where a rule is 'action[,key=val]' with:
+ *
+ * action: delay, error, timeout or drop
+ * keys: opc, slba=first-last, p (percent), usec, sct, sc and admin=1
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_inject_setup(struct xnvme_dev *dev);
+
+void
+xnvme_inject_teardown(struct xnvme_dev *dev);
+
+#endif /* __INTERNAL_XNVME_INJECT_H */
@@ -0,0 +1,59 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_MMAP_H
+#define __INTERNAL_XNVME_MMAP_H
+#include <pthread.h>
+#include <sys/queue.h>
+#include <libxnvme.h>
+
+#define XNVME_MMAP_QDEPTH 16		///< Reads outstanding per mapping
+#define XNVME_MMAP_NFAULTS 16		///< Page-faults serviced per batch
+#define XNVME_MMAP_RA_MIN 4		///< Read-ahead, in pages, of a random fault
+#define XNVME_MMAP_RA_MAX 128		///< Read-ahead, in pages, at most
+#define XNVME_MMAP_STAGE_NPAGES 512	///< Pages read per batch, at most
+
+/**
+ * A range of pages, read into the stage, and then copied into the mapping
+ */
+struct xnvme_mmap_extent {
+	uint64_t page;			///< First page, relative to the mapping
+	uint32_t npages;
+	uint32_t stage;			///< First page in the stage
+	int fault;			///< Faulting threads wait on the first page
+	int err;			///< Failure of a read of the extent
+};
+
+/**
+ * Device-mapping, the thread of the mapping sets up, and is the only user of,
+ * its async. context; the fields following the lock are shared with
+ * xnvme_mmap() and xnvme_madvise()
+ */
+struct xnvme_mmap {
+	struct xnvme_dev *dev;
+	struct xnvme_async_ctx *ctx;
+	struct xnvme_req_pool *pool;
+	uint8_t *stage;			///< Buffer which pages are read into
+	uint8_t *addr;			///< Address of the mapping
+	size_t nbytes;			///< Length of the mapping, in whole pages
+	uint64_t off;			///< Byte-offset of the mapping on the device
+	uint64_t npages;
+	uint32_t pagesize;
+	uint32_t ra_npages;		///< Current read-ahead window
+	uint64_t ra_next;		///< Page following the last read-ahead
+	int uffd;			///< userfaultfd of the mapping
+	int efd;			///< Wakes the thread, on stop and WILLNEED
+	pthread_t thread;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;		///< Signalled when 'ready' is set
+	int ready;			///< Thread is setup: 1, failed: negative errno
+	int stop;
+	int advice;			///< Read-ahead advice, see enum xnvme_madv
+	uint64_t wn_page;		///< Pages advised WILLNEED, yet to be read
+	uint64_t wn_end;
+	uint64_t *present;		///< Bitmap of pages read into the mapping
+
+	SLIST_ENTRY(xnvme_mmap) link;
+};
+
+#endif /* __INTERNAL_XNVME_MMAP_H */
@@ -0,0 +1,86 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef __INTERNAL_XNVME_QOS_H
+#define __INTERNAL_XNVME_QOS_H
+#include <stdatomic.h>
+#include <sys/queue.h>
+
+#define XNVME_QOS_BURST_USEC_DEF 100000
+#define XNVME_QOS_BURST_USEC_MAX 1000000
+
+enum xnvme_qos_bucket_idx {
+	XNVME_QOS_READ_IOPS	= 0,
+	XNVME_QOS_WRITE_IOPS	= 1,
+	XNVME_QOS_READ_BPS	= 2,
+	XNVME_QOS_WRITE_BPS	= 3,
+	XNVME_QOS_NBUCKETS	= 4,
+};
+
+/**
+ * A token-bucket, tokens are consumed without locking as long as the bucket is
+ * not empty; commands may take the bucket into debt, which is then paid back by
+ * refills before anything else is let through
+ */
+struct xnvme_qos_bucket {
+	_Atomic int64_t tokens;		///< Tokens available, may be negative
+	_Atomic uint64_t last;		///< Time, in nsec, refilled up to
+	uint64_t rate;			///< Tokens per second, 0 = unlimited
+	int64_t capacity;		///< Max. tokens in the bucket
+	uint64_t burst_nsec;		///< Max. time to refill for
+};
+
+struct xnvme_qos {
+	struct xnvme_qos_bucket buckets[XNVME_QOS_NBUCKETS];
+
+	_Atomic uint64_t nsubmitted;
+	_Atomic uint64_t nthrottled;
+	_Atomic uint64_t throttled_nsec;
+};
+
+/**
+ * A command held back by the rate-limiter
+ */
+struct xnvme_qos_entry {
+	struct xnvme_spec_cmd cmd;
+	void *dbuf;
+	size_t dbuf_nbytes;
+	void *mbuf;
+	size_t mbuf_nbytes;
+	int opts;
+	struct xnvme_req *req;
+	uint64_t ts;			///< Time, in nsec, of being held back
+	STAILQ_ENTRY(xnvme_qos_entry) link;
+};
+
+/**
+ * Rate-limiter state of an asynchronous context
+ */
+struct xnvme_async_qos {
+	struct xnvme_qos *qos;
+	STAILQ_HEAD(, xnvme_qos_entry) pool;	///< Free entries
+	STAILQ_HEAD(, xnvme_qos_entry) queue;	///< Commands held back, FIFO
+	uint32_t nqueued;
+	uint32_t capacity;
+	struct xnvme_qos_entry elm[];
+};
+
+/**
+ * Submit the given command via the rate-limiter of the context of 'req'
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+int
+xnvme_async_qos_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+		       void *dbuf, size_t dbuf_nbytes, void *mbuf,
+		       size_t mbuf_nbytes, int opts, struct xnvme_req *req);
+
+/**
+ * Submit the commands held back, as far as the limits allow
+ *
+ * @return On success, the number of commands submitted. On error, negative
+ * `errno` is returned.
+ */
+int
+xnvme_async_qos_release(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx);
+
+#endif /* __INTERNAL_XNVME_QOS_H */
@@ -5,6 +5,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <liblblk.h>
+#include <xnvme_async.h>
 #include <xnvme_be.h>
 #include <xnvme_dev.h>
 #include <xnvme_spec.h>
@@ -13,6 +14,10 @@ const char *
 lblk_cmd_opc_str(enum lblk_cmd_opc opc)
 {
 	switch (opc) {
+	case LBLK_CMD_OPC_WRITE_ZEROES:
+		return "LBLK_CMD_OPC_WRITE_ZEROES";
+	case LBLK_CMD_OPC_DSM:
+		return "LBLK_CMD_OPC_DSM";
 	case LBLK_CMD_OPC_SCOPY:
 		return "LBLK_CMD_OPC_SCOPY";
 	}
@@ -232,11 +237,382 @@ lblk_idfy_ns_pr(struct lblk_idfy_ns *idfy, int opts)
 	return lblk_idfy_ns_fpr(stdout, idfy, opts);
 }
 
+#define LBLK_SCOPY_EMU_NSLOTS 4
+#define LBLK_SCOPY_EMU_CHUNK_NBYTES (1 << 17)
+
+enum scopy_emu_state {
+	SCOPY_EMU_IDLE = 0,
+	SCOPY_EMU_READ,
+	SCOPY_EMU_WRITE,
+};
+
+struct scopy_emu;
+
+/**
+ * A slot moves one chunk at a time, reading it into its buffer and writing it
+ * out again, the slots in flight make up the window of the copy
+ */
+struct scopy_emu_slot {
+	struct scopy_emu *emu;
+	void *buf;
+	struct xnvme_req req;
+	uint64_t slba;			///< Source of the chunk in the slot
+	uint64_t dlba;			///< Destination of the chunk in the slot
+	uint16_t nlb;			///< Zero-based length of the chunk
+	enum scopy_emu_state state;
+};
+
+struct scopy_emu {
+	struct xnvme_dev *dev;
+	const struct lblk_scopy_fmt_zero *ranges;
+	struct xnvme_req *req;		///< Completion of the copy as a unit
+	struct xnvme_spec_cpl cpl;	///< Completion of the first failed command
+	int failed;
+	uint32_t nsid;
+	uint32_t nranges;
+	uint32_t range;			///< Number of ranges consumed
+	uint64_t ofz;			///< Number of LBAs consumed of the range
+	uint64_t dlba;			///< Destination of the next chunk
+	int reverse;			///< Consume the ranges back to front
+	uint64_t chunk_naddr;		///< Max. number of LBAs per chunk
+	uint32_t nslots;
+	uint32_t ninflight;
+	struct scopy_emu_slot slots[LBLK_SCOPY_EMU_NSLOTS];
+};
+
+/**
+ * Fail the emulated copy with the given negative 'errno', reported as for
+ * commands failing submission
+ */
+static inline void
+scopy_emu_errno(struct scopy_emu *emu, int err)
+{
+	emu->cpl.cdw0 = (uint32_t)err;
+	emu->cpl.status.sct = 0x0;
+	emu->cpl.status.sc = XNVME_ASYNC_SC_INTERNAL_ERROR;
+}
+
+/**
+ * Assign the next chunk of the source ranges to the given slot; back to front,
+ * starting at the end of the destination, when 'emu->reverse' is set
+ *
+ * @return 0 when a chunk is assigned, 1 when the source ranges are consumed
+ */
+static int
+scopy_emu_next(struct scopy_emu *emu, struct scopy_emu_slot *slot)
+{
+	const struct lblk_scopy_fmt_zero *range;
+	uint64_t naddr;
+
+	if (emu->range >= emu->nranges) {
+		return 1;
+	}
+
+	if (emu->reverse) {
+		range = &emu->ranges[emu->nranges - 1 - emu->range];
+		naddr = XNVME_MIN(range->nlb + 1ULL - emu->ofz, emu->chunk_naddr);
+
+		emu->dlba -= naddr;
+		slot->slba = range->slba + range->nlb + 1ULL - emu->ofz - naddr;
+		slot->dlba = emu->dlba;
+	} else {
+		range = &emu->ranges[emu->range];
+		naddr = XNVME_MIN(range->nlb + 1ULL - emu->ofz, emu->chunk_naddr);
+
+		slot->slba = range->slba + emu->ofz;
+		slot->dlba = emu->dlba;
+		emu->dlba += naddr;
+	}
+	slot->nlb = naddr - 1;
+
+	emu->ofz += naddr;
+	if (emu->ofz > range->nlb) {
+		emu->range += 1;
+		emu->ofz = 0;
+	}
+
+	return 0;
+}
+
+/**
+ * Determine whether the source ranges overlap the destination, and if so, the
+ * order in which a single chunk at a time can be copied without overwriting
+ * source LBAs before they are read
+ *
+ * A range overlapping the destination, and moved towards higher LBAs, has its
+ * LBAs overwritten by chunks copied before them front to back; likewise when
+ * moved towards lower LBAs and copied back to front.
+ *
+ * @return 0 on no overlap, 1 when copying front to back is safe, 2 when copying
+ * back to front is safe, and -EINVAL when neither is
+ */
+static int
+scopy_emu_overlap(uint64_t sdlba, const struct lblk_scopy_fmt_zero *ranges,
+		  uint32_t nranges)
+{
+	uint64_t naddr = 0, delba;
+	int fwd = 1, bwd = 1, overlap = 0;
+
+	for (uint32_t i = 0; i < nranges; ++i) {
+		naddr += ranges[i].nlb + 1ULL;
+	}
+	delba = sdlba + naddr - 1;
+
+	naddr = 0;
+	for (uint32_t i = 0; i < nranges; ++i) {
+		uint64_t slba = ranges[i].slba;
+		uint64_t elba = slba + ranges[i].nlb;
+		uint64_t dlba = sdlba + naddr;
+
+		naddr += ranges[i].nlb + 1ULL;
+
+		if ((elba < sdlba) || (slba > delba)) {
+			continue;
+		}
+		overlap = 1;
+
+		if (dlba > slba) {
+			fwd = 0;
+		}
+		if (dlba < slba) {
+			bwd = 0;
+		}
+	}
+
+	if (!overlap) {
+		return 0;
+	}
+	if (fwd) {
+		return 1;
+	}
+
+	return bwd ? 2 : -EINVAL;
+}
+
+static void
+scopy_emu_free(struct scopy_emu *emu)
+{
+	for (uint32_t i = 0; i < emu->nslots; ++i) {
+		xnvme_buf_free(emu->dev, emu->slots[i].buf);
+	}
+	free(emu);
+}
+
+/**
+ * Take the given slot a step further: from read to write, or from write, or
+ * idle, to reading the next chunk
+ */
+static int
+scopy_emu_step(struct scopy_emu *emu, struct scopy_emu_slot *slot)
+{
+	int err;
+
+	if (slot->state == SCOPY_EMU_READ) {
+		slot->state = SCOPY_EMU_WRITE;
+		err = xnvme_cmd_write(emu->dev, emu->nsid, slot->dlba,
+				      slot->nlb, slot->buf, NULL,
+				      XNVME_CMD_ASYNC, &slot->req);
+	} else {
+		if (scopy_emu_next(emu, slot)) {
+			slot->state = SCOPY_EMU_IDLE;
+			return 0;
+		}
+		slot->state = SCOPY_EMU_READ;
+		err = xnvme_cmd_read(emu->dev, emu->nsid, slot->slba,
+				     slot->nlb, slot->buf, NULL,
+				     XNVME_CMD_ASYNC, &slot->req);
+	}
+	if (err) {
+		slot->state = SCOPY_EMU_IDLE;
+		return err;
+	}
+
+	emu->ninflight += 1;
+
+	return 0;
+}
+
+static void
+scopy_emu_cb(struct xnvme_req *sreq, void *cb_arg)
+{
+	struct scopy_emu_slot *slot = cb_arg;
+	struct scopy_emu *emu = slot->emu;
+	struct xnvme_req *req = emu->req;
+
+	emu->ninflight -= 1;
+
+	if ((!emu->failed) && xnvme_req_cpl_status(sreq)) {
+		emu->cpl = sreq->cpl;
+		emu->failed = 1;
+	}
+
+	if (!emu->failed) {
+		int err = scopy_emu_step(emu, slot);
+
+		if (err) {
+			XNVME_DEBUG("FAILED: scopy_emu_step(), err: %d", err);
+			scopy_emu_errno(emu, err);
+			emu->failed = 1;
+		}
+	}
+
+	if (emu->ninflight) {
+		return;
+	}
+
+	req->cpl = emu->cpl;
+
+	scopy_emu_free(emu);
+
+	req->async.cb(req, req->async.cb_arg);
+}
+
+static int
+scopy_emu_sync(struct scopy_emu *emu, struct xnvme_req *ret)
+{
+	struct scopy_emu_slot *slot = &emu->slots[0];
+
+	while (!scopy_emu_next(emu, slot)) {
+		struct xnvme_req req = { 0 };
+		int err;
+
+		err = xnvme_cmd_read(emu->dev, emu->nsid, slot->slba,
+				     slot->nlb, slot->buf, NULL,
+				     XNVME_CMD_SYNC, &req);
+		if (!(err || xnvme_req_cpl_status(&req))) {
+			err = xnvme_cmd_write(emu->dev, emu->nsid, slot->dlba,
+					      slot->nlb, slot->buf, NULL,
+					      XNVME_CMD_SYNC, &req);
+		}
+		if (ret) {
+			ret->cpl = req.cpl;
+		}
+		if (err || xnvme_req_cpl_status(&req)) {
+			XNVME_DEBUG("FAILED: slba: 0x%016lx, dlba: 0x%016lx",
+				    slot->slba, slot->dlba);
+			return err ? err : -EIO;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Emulation of the Simple Copy Command for devices not supporting it; the data
+ * is moved by the library through a bounded window of device buffers, such
+ * that the copy has a single completion, just like the actual command
+ */
+static int
+scopy_emu(struct xnvme_dev *dev, uint32_t nsid, uint64_t sdlba,
+	  const struct lblk_scopy_fmt_zero *ranges, uint8_t nr, int opts,
+	  struct xnvme_req *ret)
+{
+	const struct xnvme_geo *geo = xnvme_dev_get_geo(dev);
+	struct scopy_emu *emu;
+	uint32_t nslots = 1;
+	int overlap, err = 0;
+
+	overlap = scopy_emu_overlap(sdlba, ranges, nr + 1);
+	if (overlap < 0) {
+		XNVME_DEBUG("FAILED: overlap of source and destination");
+		return overlap;
+	}
+
+	switch (opts & XNVME_CMD_MASK_IOMD) {
+	case XNVME_CMD_SYNC:
+		break;
+
+	case XNVME_CMD_ASYNC:
+		if (!(ret && ret->async.ctx && ret->async.cb)) {
+			XNVME_DEBUG("FAILED: req without async. ctx or callback");
+			return -EINVAL;
+		}
+		// Chunks in flight together are not ordered, hence overlap
+		// serializes them, one slot at a time
+		nslots = overlap ? 1 : XNVME_MIN(LBLK_SCOPY_EMU_NSLOTS,
+						 xnvme_async_get_depth(ret->async.ctx));
+		break;
+
+	default:
+		XNVME_DEBUG("FAILED: command-mode not provided");
+		return -EINVAL;
+	}
+
+	emu = calloc(1, sizeof(*emu));
+	if (!emu) {
+		XNVME_DEBUG("FAILED: calloc(emu), errno: %d", errno);
+		return -errno;
+	}
+	emu->dev = dev;
+	emu->ranges = ranges;
+	emu->req = ret;
+	emu->nsid = nsid;
+	emu->nranges = nr + 1;
+	emu->dlba = sdlba;
+	if (overlap == 2) {
+		emu->reverse = 1;
+		for (uint32_t i = 0; i < emu->nranges; ++i) {
+			emu->dlba += ranges[i].nlb + 1ULL;
+		}
+	}
+	emu->chunk_naddr = XNVME_MIN(geo->mdts_nbytes,
+				     LBLK_SCOPY_EMU_CHUNK_NBYTES) / geo->lba_nbytes;
+	emu->chunk_naddr = XNVME_MAX(emu->chunk_naddr, 1);
+
+	for (emu->nslots = 0; emu->nslots < nslots; ++emu->nslots) {
+		struct scopy_emu_slot *slot = &emu->slots[emu->nslots];
+
+		slot->buf = xnvme_buf_alloc(dev, emu->chunk_naddr *
+					    geo->lba_nbytes, NULL);
+		if (!slot->buf) {
+			XNVME_DEBUG("FAILED: xnvme_buf_alloc(), errno: %d", errno);
+			err = -errno;
+			goto failed;
+		}
+		slot->emu = emu;
+		slot->req.async.ctx = ret ? ret->async.ctx : NULL;
+		slot->req.async.cb = scopy_emu_cb;
+		slot->req.async.cb_arg = slot;
+		slot->req.async.prio = ret ? ret->async.prio : 0;
+	}
+
+	if ((opts & XNVME_CMD_MASK_IOMD) == XNVME_CMD_SYNC) {
+		err = scopy_emu_sync(emu, ret);
+		scopy_emu_free(emu);
+		return err;
+	}
+
+	// Fill the window; running short on queue-entries just makes it smaller
+	for (uint32_t i = 0; i < emu->nslots; ++i) {
+		err = scopy_emu_step(emu, &emu->slots[i]);
+		if (err) {
+			XNVME_DEBUG("INFO: scopy_emu_step(), slot: %u, err: %d",
+				    i, err);
+			break;
+		}
+	}
+	if (!emu->ninflight) {
+		goto failed;
+	}
+	if (err && (err != -EBUSY) && (err != -EAGAIN)) {
+		scopy_emu_errno(emu, err);
+		emu->failed = 1;
+	}
+
+	return 0;
+
+failed:
+	scopy_emu_free(emu);
+
+	return err;
+}
+
 int
 lblk_cmd_scopy(struct xnvme_dev *dev, uint32_t nsid, uint64_t sdlba,
 	       struct lblk_scopy_fmt_zero *ranges, uint8_t nr,
 	       enum lblk_scopy_fmt copy_fmt, int opts, struct xnvme_req *ret)
 {
+	const struct lblk_idfy_ctrlr *ctrlr = (void *)xnvme_dev_get_ctrlr(dev);
 	size_t ranges_nbytes = 0;
 
 	if (copy_fmt & LBLK_SCOPY_FMT_ZERO) {
@@ -246,6 +622,19 @@ lblk_cmd_scopy(struct xnvme_dev *dev, uint32_t nsid, uint64_t sdlba,
 		ranges_nbytes = (nr + 1) * sizeof(struct lblk_scopy_fmt_srclen);
 	}
 
+	if (!(ctrlr && ctrlr->oncs.copy)) {
+		if (copy_fmt != LBLK_SCOPY_FMT_ZERO) {
+			XNVME_DEBUG("FAILED: emulation needs LBLK_SCOPY_FMT_ZERO");
+			return -ENOSYS;
+		}
+		if (!ranges) {
+			XNVME_DEBUG("FAILED: !ranges");
+			return -EINVAL;
+		}
+
+		return scopy_emu(dev, nsid, sdlba, ranges, nr, opts, ret);
+	}
+
 	struct lblk_cmd cmd = { 0 };
 
 	cmd.common.opcode = LBLK_CMD_OPC_SCOPY;
@@ -259,3 +648,42 @@ lblk_cmd_scopy(struct xnvme_dev *dev, uint32_t nsid, uint64_t sdlba,
 			      opts, ret);
 }
 
+int
+lblk_cmd_write_zeroes(struct xnvme_dev *dev, uint32_t nsid, uint64_t slba,
+		      uint16_t nlb, uint8_t deac, int opts,
+		      struct xnvme_req *ret)
+{
+	struct lblk_cmd cmd = { 0 };
+
+	cmd.common.opcode = LBLK_CMD_OPC_WRITE_ZEROES;
+	cmd.common.nsid = nsid;
+	cmd.write_zeroes.slba = slba;
+	cmd.write_zeroes.nlb = nlb;
+	cmd.write_zeroes.deac = deac ? 1 : 0;
+
+	return xnvme_cmd_pass(dev, &cmd.base, NULL, 0, NULL, 0, opts, ret);
+}
+
+int
+lblk_cmd_dsm(struct xnvme_dev *dev, uint32_t nsid,
+	     struct lblk_dsm_range *ranges, uint8_t nr, int attr, int opts,
+	     struct xnvme_req *ret)
+{
+	const size_t ranges_nbytes = (nr + 1) * sizeof(*ranges);
+	struct lblk_cmd cmd = { 0 };
+
+	if (!ranges) {
+		XNVME_DEBUG("FAILED: !ranges");
+		return -EINVAL;
+	}
+
+	cmd.common.opcode = LBLK_CMD_OPC_DSM;
+	cmd.common.nsid = nsid;
+	cmd.dsm.nr = nr;
+	cmd.dsm.idr = (attr & LBLK_DSM_ATTR_IDR) ? 1 : 0;
+	cmd.dsm.idw = (attr & LBLK_DSM_ATTR_IDW) ? 1 : 0;
+	cmd.dsm.ad = (attr & LBLK_DSM_ATTR_AD) ? 1 : 0;
+
+	return xnvme_cmd_pass(dev, &cmd.base, ranges, ranges_nbytes, NULL, 0,
+			      opts, ret);
+}
@@ -2,16 +2,26 @@
 // Copyright (C) Klaus B. A. Jensen <k.jensen@samsung.com>
 // SPDX-License-Identifier: Apache-2.0
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
+#include <time.h>
 #include <libxnvme.h>
 #include <xnvme_be.h>
 #include <xnvme_dev.h>
 #include <xnvme_async.h>
+#include <xnvme_qos.h>
+#include <xnvme_inject.h>
+#include <xnvme_async_group.h>
+#include <xnvme_async_shared.h>
+#include <xnvme_async_ordered.h>
+#include <xnvme_dispatcher.h>
 
 int
 xnvme_async_init(struct xnvme_dev *dev, struct xnvme_async_ctx **ctx,
 		 uint16_t depth, int flags)
 {
+	int err;
+
 	if (!dev) {
 		XNVME_DEBUG("FAILED: !dev");
 		return -EINVAL;
@@ -21,23 +31,265 @@ xnvme_async_init(struct xnvme_dev *dev, struct xnvme_async_ctx **ctx,
 		return -EINVAL;
 	}
 
-	return dev->be.async.init(dev, ctx, depth, flags);
+	if ((flags & XNVME_ASYNC_SHARED) && (flags & XNVME_ASYNC_ORDERED)) {
+		XNVME_DEBUG("FAILED: a shared context is ordered by producer");
+		return -EINVAL;
+	}
+	if (flags & XNVME_ASYNC_ORDERED) {
+		err = dev->be.async.init(dev, ctx, depth,
+					 flags & ~XNVME_ASYNC_ORDERED);
+		if (err) {
+			return err;
+		}
+
+		err = xnvme_async_ordered_init(*ctx);
+		if (err) {
+			XNVME_DEBUG("FAILED: xnvme_async_ordered_init(), err: %d",
+				    err);
+			dev->be.async.term(dev, *ctx);
+			*ctx = NULL;
+		}
+
+		return err;
+	}
+	if (!(flags & XNVME_ASYNC_SHARED)) {
+		return dev->be.async.init(dev, ctx, depth, flags);
+	}
+
+	flags = (flags & ~XNVME_ASYNC_SHARED) | XNVME_BE_ASYNC_ANY_THREAD;
+
+	err = dev->be.async.init(dev, ctx, depth, flags);
+	if (err) {
+		return err;
+	}
+
+	err = xnvme_async_shared_init(dev, *ctx);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_async_shared_init(), err: %d", err);
+		dev->be.async.term(dev, *ctx);
+		*ctx = NULL;
+	}
+
+	return err;
 }
 
 int
 xnvme_async_term(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
 {
+	struct xnvme_async_bufs *bufs = NULL;
+	int err;
+
 	if (!dev) {
 		XNVME_DEBUG("FAILED: !dev");
 		return -EINVAL;
 	}
+	if (ctx && ctx->shared) {
+		// A producer has no state in the backend
+		if (ctx->producer) {
+			return xnvme_async_shared_term(dev, ctx);
+		}
+
+		err = xnvme_async_shared_term(dev, ctx);
+		if (err) {
+			XNVME_DEBUG("FAILED: xnvme_async_shared_term(), err: %d", err);
+			return err;
+		}
+	}
+	if (ctx) {
+		if (ctx->group) {
+			xnvme_async_group_remove(ctx->group, ctx);
+		}
+		free(ctx->qos);
+		ctx->qos = NULL;
+		free(ctx->ordered);
+		ctx->ordered = NULL;
+		if (ctx->dispatch) {
+			xnvme_async_dispatch_drain(ctx->dispatch);
+			free(ctx->dispatch);
+			ctx->dispatch = NULL;
+		}
+		bufs = ctx->bufs;
+	}
+
+	err = dev->be.async.term(dev, ctx);
+
+	// The backend may reference the buffers until the context is gone
+	if (bufs) {
+		xnvme_buf_free(dev, bufs->base);
+		free(bufs);
+	}
+
+	return err;
+}
+
+int
+xnvme_async_bufs_init(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+		      uint32_t nbufs, uint32_t nbytes)
+{
+	struct xnvme_async_bufs *bufs;
+	int err;
+
+	if (!(dev && ctx)) {
+		XNVME_DEBUG("FAILED: !dev || !ctx");
+		return -EINVAL;
+	}
+	if (ctx->bufs) {
+		XNVME_DEBUG("FAILED: buffers are already provided");
+		return -EEXIST;
+	}
+	if (ctx->shared) {
+		XNVME_DEBUG("FAILED: not supported on a shared context");
+		return -ENOSYS;
+	}
+	if ((!nbufs) || (nbufs > XNVME_ASYNC_BUFS_MAX)) {
+		XNVME_DEBUG("FAILED: nbufs: %u", nbufs);
+		return -EINVAL;
+	}
+	if ((!nbytes) || (nbytes % dev->geo.lba_nbytes)) {
+		XNVME_DEBUG("FAILED: nbytes: %u", nbytes);
+		return -EINVAL;
+	}
+
+	bufs = calloc(1, sizeof(*bufs));
+	if (!bufs) {
+		XNVME_DEBUG("FAILED: calloc(bufs), errno: %d", errno);
+		return -errno;
+	}
+	bufs->nbufs = nbufs;
+	bufs->nbytes = nbytes;
+
+	bufs->base = xnvme_buf_alloc(dev, (size_t)nbufs * nbytes, NULL);
+	if (!bufs->base) {
+		XNVME_DEBUG("FAILED: xnvme_buf_alloc(), errno: %d", errno);
+		err = -errno;
+		free(bufs);
+		return err;
+	}
+
+	err = dev->be.async.bufs_init(dev, ctx, bufs->base, nbufs, nbytes);
+	if (err) {
+		XNVME_DEBUG("FAILED: async.bufs_init(), err: %d", err);
+		xnvme_buf_free(dev, bufs->base);
+		free(bufs);
+		return err;
+	}
+	ctx->bufs = bufs;
+
+	return 0;
+}
+
+void *
+xnvme_async_buf(struct xnvme_async_ctx *ctx, int32_t bid)
+{
+	if (!(ctx && ctx->bufs) || (bid < 0) || ((uint32_t)bid >= ctx->bufs->nbufs)) {
+		XNVME_DEBUG("FAILED: no buffer with bid: %d", bid);
+		return NULL;
+	}
+
+	return ctx->bufs->base + (size_t)bid * ctx->bufs->nbytes;
+}
+
+int
+xnvme_async_buf_put(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+		    int32_t bid)
+{
+	void *buf = xnvme_async_buf(ctx, bid);
+
+	if (!buf) {
+		return -EINVAL;
+	}
+
+	return dev->be.async.buf_put(dev, ctx, bid, buf, ctx->bufs->nbytes);
+}
+
+/**
+ * Number of commands of which the completion is yet to be delivered, that is,
+ * excluding completions dropped by fault-injection
+ */
+static inline uint32_t
+async_npending(struct xnvme_async_ctx *ctx)
+{
+	if (ctx->inject) {
+		return ctx->outstanding + ctx->inject->nheld - \
+		       ctx->inject->ndropped;
+	}
+
+	return ctx->outstanding;
+}
+
+int
+xnvme_async_idle(struct xnvme_async_ctx *ctx)
+{
+	return !(async_npending(ctx) || (ctx->qos && ctx->qos->nqueued) ||
+		 (ctx->dispatch && (ctx->dispatch->nbatched ||
+				    atomic_load(&ctx->dispatch->nqueued))));
+}
+
+/**
+ * Waiting on a context with a rate-limiter, the commands held back must be
+ * submitted, which the backend knows nothing about, so poke until done
+ */
+static int
+async_wait_qos(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
+{
+	int acc = 0;
+
+	while (async_npending(ctx) || ctx->qos->nqueued) {
+		struct timespec ts1 = {.tv_sec = 0, .tv_nsec = 1000};
+		int err;
+
+		err = xnvme_async_poke(dev, ctx, 0);
+		if (err >= 0) {
+			acc += err;
+			if ((!err) && (!ctx->outstanding)) {
+				nanosleep(&ts1, NULL);
+			}
+			continue;
+		}
+
+		switch (err) {
+		case -EAGAIN:
+		case -EBUSY:
+			nanosleep(&ts1, NULL);
+			continue;
+
+		default:
+			return err;
+		}
+	}
+
+	return acc;
+}
 
-	return dev->be.async.term(dev, ctx);
+/**
+ * Waiting on a context with a dispatcher, the completions reaped are called back
+ * by the callback threads, which are waited for as well
+ */
+static int
+async_wait_dispatch(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
+{
+	int err;
+
+	err = ctx->qos ? async_wait_qos(dev, ctx) : dev->be.async.wait(dev, ctx);
+
+	xnvme_async_dispatch_drain(ctx->dispatch);
+
+	return err;
 }
 
 int
 xnvme_async_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
 {
+	if (ctx->shared) {
+		return xnvme_async_shared_wait(dev, ctx);
+	}
+	if (ctx->dispatch) {
+		return async_wait_dispatch(dev, ctx);
+	}
+	if (ctx->qos) {
+		return async_wait_qos(dev, ctx);
+	}
+
 	return dev->be.async.wait(dev, ctx);
 }
 
@@ -45,9 +297,79 @@ int
 xnvme_async_poke(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
 		 uint32_t max)
 {
+	if (ctx->shared) {
+		return xnvme_async_shared_poke(dev, ctx, max);
+	}
+	if (ctx->qos && ctx->qos->nqueued) {
+		int err = xnvme_async_qos_release(dev, ctx);
+
+		if (err < 0) {
+			XNVME_DEBUG("FAILED: xnvme_async_qos_release(), err: %d",
+				    err);
+			return err;
+		}
+	}
+	if (ctx->dispatch) {
+		int err = dev->be.async.poke(dev, ctx, max);
+
+		xnvme_async_dispatch_flush(ctx->dispatch);
+
+		return err;
+	}
+
 	return dev->be.async.poke(dev, ctx, max);
 }
 
+/**
+ * Reaping on an ordered context, the completions reaped are held back until
+ * those before them are reaped as well
+ */
+static int
+async_reap_ordered(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+		   struct xnvme_req **out, uint32_t max)
+{
+	int err;
+
+	err = dev->be.async.reap(dev, ctx, out, max);
+	if (err < 0) {
+		return err;
+	}
+
+	return xnvme_async_ordered_reap(ctx, out, err, max);
+}
+
+int
+xnvme_async_reap(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+		 struct xnvme_req **out, uint32_t max)
+{
+	if (!(out && max)) {
+		XNVME_DEBUG("FAILED: invalid out: %p, max: %u", (void *)out, max);
+		return -EINVAL;
+	}
+	if (ctx->shared) {
+		return xnvme_async_shared_reap(dev, ctx, out, max);
+	}
+	if (ctx->dispatch) {
+		XNVME_DEBUG("FAILED: completions are called back by the dispatcher");
+		return -EINVAL;
+	}
+	if (ctx->qos && ctx->qos->nqueued) {
+		int err = xnvme_async_qos_release(dev, ctx);
+
+		if (err < 0) {
+			XNVME_DEBUG("FAILED: xnvme_async_qos_release(), err: %d",
+				    err);
+			return err;
+		}
+	}
+
+	if (ctx->ordered) {
+		return async_reap_ordered(dev, ctx, out, max);
+	}
+
+	return dev->be.async.reap(dev, ctx, out, max);
+}
+
 uint32_t
 xnvme_async_get_depth(struct xnvme_async_ctx *ctx)
 {
@@ -57,5 +379,21 @@ xnvme_async_get_depth(struct xnvme_async_ctx *ctx)
 uint32_t
 xnvme_async_get_outstanding(struct xnvme_async_ctx *ctx)
 {
-	return ctx->outstanding;
+	uint32_t outstanding = ctx->outstanding;
+
+	// Commands held back by the library are outstanding to the user
+	if (ctx->inject) {
+		outstanding += ctx->inject->nheld;
+	}
+	if (ctx->qos) {
+		outstanding += ctx->qos->nqueued;
+	}
+
+	return outstanding;
+}
+
+uint32_t
+xnvme_async_get_nhedged(struct xnvme_async_ctx *ctx)
+{
+	return ctx->nhedged;
 }
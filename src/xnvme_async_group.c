@@ -0,0 +1,345 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <libxnvme.h>
+#include <xnvme_be.h>
+#include <xnvme_dev.h>
+#include <xnvme_async.h>
+#include <xnvme_async_group.h>
+#ifdef XNVME_BE_LINUX_ENABLED
+#include <poll.h>
+#include <sys/eventfd.h>
+#endif
+
+static inline void
+group_clear(struct xnvme_async_group *group, uint32_t idx)
+{
+	const uint64_t bit = 1ULL << (idx % 64);
+
+	if (group->active[idx / 64] & bit) {
+		group->active[idx / 64] &= ~bit;
+		group->nactive -= 1;
+	}
+}
+
+/**
+ * Poke the given member and mark it idle when nothing is left outstanding, the
+ * callbacks may submit commands, on this or other members, or remove members
+ */
+static inline int
+group_poke_member(struct xnvme_async_group *group, uint32_t idx, uint32_t max)
+{
+	struct xnvme_async_group_member *member = &group->members[idx];
+	struct xnvme_async_ctx *ctx = member->ctx;
+	int err;
+
+	err = xnvme_async_poke(member->dev, ctx, max);
+	if (err < 0) {
+		XNVME_DEBUG("FAILED: xnvme_async_poke(), idx: %u, err: %d", idx,
+			    err);
+		return err;
+	}
+	if ((member->ctx == ctx) && xnvme_async_idle(ctx)) {
+		group_clear(group, idx);
+	}
+
+	return err;
+}
+
+int
+xnvme_async_group_poke(struct xnvme_async_group *group, uint32_t max)
+{
+	const uint32_t nwords = (group->capacity + 63) / 64;
+	const uint32_t first = group->rr;
+	uint32_t acc = 0;
+
+	// The word of the first member is visited twice; first from the first
+	// member on, then, after wrapping around, the members before it
+	for (uint32_t i = 0; (i <= nwords) && group->nactive; ++i) {
+		const uint32_t word = (first / 64 + i) % nwords;
+		uint64_t pending = group->active[word];
+
+		if (!i) {
+			pending &= ~0ULL << (first % 64);
+		} else if (i == nwords) {
+			pending &= ~(~0ULL << (first % 64));
+		}
+
+		while (pending) {
+			const uint32_t idx = word * 64 + __builtin_ctzll(pending);
+			int err;
+
+			pending &= pending - 1;
+
+			if (!(group->active[word] & (1ULL << (idx % 64)))) {
+				continue;
+			}
+
+			err = group_poke_member(group, idx, max ? max - acc : 0);
+			if (err < 0) {
+				group->rr = idx;
+				return err;
+			}
+			acc += err;
+
+			if (max && (acc >= max)) {
+				group->rr = (idx + 1) % group->capacity;
+				return acc;
+			}
+		}
+	}
+
+	group->rr = (first + 1) % group->capacity;
+
+	return acc;
+}
+
+#ifdef XNVME_BE_LINUX_ENABLED
+/**
+ * Block on the eventfd until a command completes, when every active member
+ * signals it; otherwise return at once, as completions must be polled for
+ */
+static int
+group_block(struct xnvme_async_group *group)
+{
+	struct pollfd pfd = { .fd = group->efd, .events = POLLIN };
+	const uint32_t nwords = (group->capacity + 63) / 64;
+	eventfd_t val;
+
+	if (group->efd < 0) {
+		return 0;
+	}
+
+	for (uint32_t word = 0; word < nwords; ++word) {
+		uint64_t pending = group->active[word];
+
+		while (pending) {
+			const uint32_t idx = word * 64 + __builtin_ctzll(pending);
+			struct xnvme_async_group_member *member;
+
+			pending &= pending - 1;
+
+			member = &group->members[idx];
+			if (!member->notify || member->ctx->qos || \
+			    member->ctx->inject) {
+				return 0;
+			}
+		}
+	}
+
+	if (poll(&pfd, 1, -1) < 0) {
+		XNVME_DEBUG("FAILED: poll(), errno: %d", errno);
+		return errno == EINTR ? 0 : -errno;
+	}
+	eventfd_read(group->efd, &val);
+
+	return 0;
+}
+#else
+static int
+group_block(struct xnvme_async_group *XNVME_UNUSED(group))
+{
+	return 0;
+}
+#endif
+
+int
+xnvme_async_group_wait(struct xnvme_async_group *group)
+{
+	int acc = 0;
+
+	while (group->nactive) {
+		int err;
+
+		err = xnvme_async_group_poke(group, 0);
+		if (err > 0) {
+			acc += err;
+			continue;
+		}
+
+		switch (err) {
+		case 0:
+			err = group->nactive ? group_block(group) : 0;
+			if (err) {
+				return err;
+			}
+			continue;
+
+		case -EAGAIN:
+		case -EBUSY:
+			continue;
+
+		default:
+			return err;
+		}
+	}
+
+	return acc;
+}
+
+int
+xnvme_async_group_add(struct xnvme_async_group *group, struct xnvme_dev *dev,
+		      struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_async_group_member *member = NULL;
+	uint32_t idx;
+
+	if (!(group && dev && ctx)) {
+		XNVME_DEBUG("FAILED: group: %p, dev: %p, ctx: %p",
+			    (void *)group, (void *)dev, (void *)ctx);
+		return -EINVAL;
+	}
+	if (ctx->group) {
+		XNVME_DEBUG("FAILED: ctx is in a group");
+		return -EBUSY;
+	}
+	if (ctx->shared) {
+		XNVME_DEBUG("FAILED: ctx is shared, or a producer");
+		return -EINVAL;
+	}
+	if (group->nmembers == group->capacity) {
+		XNVME_DEBUG("FAILED: nmembers: %u == capacity", group->nmembers);
+		return -ENOSPC;
+	}
+
+	for (idx = 0; idx < group->capacity; ++idx) {
+		if (!group->members[idx].ctx) {
+			member = &group->members[idx];
+			break;
+		}
+	}
+
+	member->dev = dev;
+	member->ctx = ctx;
+	member->notify = 0;
+
+	if (group->efd >= 0) {
+		int err = dev->be.async.notify(dev, ctx, group->efd);
+
+		if (err && (err != -ENOSYS)) {
+			XNVME_DEBUG("INFO: be.async.notify(), err: %d", err);
+		}
+		member->notify = !err;
+		group->nsignalling += member->notify;
+	}
+
+	ctx->group = group;
+	ctx->group_idx = idx;
+	group->nmembers += 1;
+
+	if (!xnvme_async_idle(ctx)) {
+		xnvme_async_group_mark(ctx);
+	}
+
+	return 0;
+}
+
+int
+xnvme_async_group_remove(struct xnvme_async_group *group,
+			 struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_async_group_member *member;
+
+	if (!(group && ctx && (ctx->group == group))) {
+		XNVME_DEBUG("FAILED: ctx is not in the group");
+		return -EINVAL;
+	}
+
+	member = &group->members[ctx->group_idx];
+	if (member->notify) {
+		int err = member->dev->be.async.notify(member->dev, ctx, -1);
+
+		if (err) {
+			XNVME_DEBUG("INFO: be.async.notify(), err: %d", err);
+		}
+		group->nsignalling -= 1;
+	}
+
+	group_clear(group, ctx->group_idx);
+	group->nmembers -= 1;
+
+	member->dev = NULL;
+	member->ctx = NULL;
+	member->notify = 0;
+
+	ctx->group = NULL;
+	ctx->group_idx = 0;
+
+	return 0;
+}
+
+uint32_t
+xnvme_async_group_get_nactive(struct xnvme_async_group *group)
+{
+	return group ? group->nactive : 0;
+}
+
+int
+xnvme_async_group_get_fd(struct xnvme_async_group *group, uint32_t *nsignalling)
+{
+	if (!group) {
+		XNVME_DEBUG("FAILED: !group");
+		return -EINVAL;
+	}
+	if (group->efd < 0) {
+		XNVME_DEBUG("FAILED: no eventfd");
+		return -ENOSYS;
+	}
+	if (nsignalling) {
+		*nsignalling = group->nsignalling;
+	}
+
+	return group->efd;
+}
+
+int
+xnvme_async_group_create(struct xnvme_async_group **group, uint32_t capacity)
+{
+	if (!group) {
+		XNVME_DEBUG("FAILED: !group");
+		return -EINVAL;
+	}
+	if (!capacity || (capacity > XNVME_ASYNC_GROUP_CAPACITY_MAX)) {
+		XNVME_DEBUG("FAILED: capacity: %u", capacity);
+		return -EINVAL;
+	}
+
+	*group = calloc(1, sizeof(**group) + capacity * sizeof(*(*group)->members));
+	if (!*group) {
+		XNVME_DEBUG("FAILED: calloc(group), errno: %d", errno);
+		return -errno;
+	}
+	(*group)->capacity = capacity;
+	(*group)->efd = -1;
+
+#ifdef XNVME_BE_LINUX_ENABLED
+	(*group)->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if ((*group)->efd < 0) {
+		XNVME_DEBUG("INFO: eventfd(), errno: %d", errno);
+	}
+#endif
+
+	return 0;
+}
+
+void
+xnvme_async_group_destroy(struct xnvme_async_group *group)
+{
+	if (!group) {
+		return;
+	}
+
+	for (uint32_t idx = 0; idx < group->capacity; ++idx) {
+		if (group->members[idx].ctx) {
+			xnvme_async_group_remove(group,
+						 group->members[idx].ctx);
+		}
+	}
+	if (group->efd >= 0) {
+		close(group->efd);
+	}
+
+	free(group);
+}
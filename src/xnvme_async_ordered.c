@@ -0,0 +1,138 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <errno.h>
+#include <stdlib.h>
+#include <libxnvme.h>
+#include <xnvme_be.h>
+#include <xnvme_async.h>
+#include <xnvme_async_ordered.h>
+
+static inline struct xnvme_async_ordered_slot *
+ordered_slot(struct xnvme_async_ordered *ordered, uint64_t seq)
+{
+	return &ordered->slots[seq & ordered->mask];
+}
+
+/**
+ * Hand the completion of the slot at the head to the callback of its command,
+ * restored, the slot is free before the callback, which may submit again
+ */
+static inline struct xnvme_req *
+ordered_pop(struct xnvme_async_ordered *ordered)
+{
+	struct xnvme_async_ordered_slot *slot = ordered_slot(ordered,
+						ordered->head);
+	struct xnvme_req *req = slot->req;
+
+	req->async.cb = slot->cb;
+	req->async.cb_arg = slot->cb_arg;
+	slot->req = NULL;
+	slot->done = 0;
+	ordered->head += 1;
+
+	return req;
+}
+
+/**
+ * Completion of a command on an ordered context, the callbacks of the commands
+ * completed are invoked, from the head, until one which has not completed
+ */
+static void
+ordered_cb(struct xnvme_req *req, void *cb_arg)
+{
+	struct xnvme_async_ordered *ordered = req->async.ctx->ordered;
+	struct xnvme_async_ordered_slot *slot = cb_arg;
+
+	slot->done = 1;
+
+	// The callback of a command released may complete another, e.g. one it
+	// submits, failing right away, which is then released by the loop below
+	if (ordered->releasing) {
+		return;
+	}
+
+	ordered->releasing = 1;
+	while ((ordered->head != ordered->tail) &&
+	       ordered_slot(ordered, ordered->head)->done) {
+		struct xnvme_req *head = ordered_pop(ordered);
+
+		head->async.cb(head, head->async.cb_arg);
+	}
+	ordered->releasing = 0;
+}
+
+int
+xnvme_async_ordered_init(struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_async_ordered *ordered;
+
+	ordered = calloc(1, sizeof(*ordered) + ctx->depth * sizeof(*ordered->slots));
+	if (!ordered) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	ordered->mask = ctx->depth - 1;
+
+	ctx->ordered = ordered;
+
+	return 0;
+}
+
+int
+xnvme_async_ordered_enter(struct xnvme_req *req)
+{
+	struct xnvme_async_ordered *ordered = req->async.ctx->ordered;
+	struct xnvme_async_ordered_slot *slot;
+
+	// Completed commands hold their slot until released
+	if ((ordered->tail - ordered->head) > ordered->mask) {
+		XNVME_DEBUG("FAILED: reorder-ring is full");
+		return -EBUSY;
+	}
+
+	slot = ordered_slot(ordered, ordered->tail);
+	slot->req = req;
+	slot->cb = req->async.cb;
+	slot->cb_arg = req->async.cb_arg;
+	slot->done = 0;
+	ordered->tail += 1;
+
+	req->async.cb = ordered_cb;
+	req->async.cb_arg = slot;
+
+	return 0;
+}
+
+void
+xnvme_async_ordered_cancel(struct xnvme_req *req)
+{
+	struct xnvme_async_ordered *ordered = req->async.ctx->ordered;
+	struct xnvme_async_ordered_slot *slot = req->async.cb_arg;
+
+	// Nothing is submitted in between, thus it is the last slot taken
+	ordered->tail -= 1;
+	req->async.cb = slot->cb;
+	req->async.cb_arg = slot->cb_arg;
+	slot->req = NULL;
+}
+
+uint32_t
+xnvme_async_ordered_reap(struct xnvme_async_ctx *ctx, struct xnvme_req **out,
+			 uint32_t nreaped, uint32_t max)
+{
+	struct xnvme_async_ordered *ordered = ctx->ordered;
+	uint32_t n = 0;
+
+	for (uint32_t i = 0; i < nreaped; ++i) {
+		struct xnvme_async_ordered_slot *slot = out[i]->async.cb_arg;
+
+		slot->done = 1;
+	}
+
+	while ((n < max) && (ordered->head != ordered->tail) &&
+	       ordered_slot(ordered, ordered->head)->done) {
+		out[n++] = ordered_pop(ordered);
+	}
+
+	return n;
+}
@@ -0,0 +1,330 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <libxnvme.h>
+#include <libxnvme_util.h>
+#include <xnvme_be.h>
+#include <xnvme_dev.h>
+#include <xnvme_async_probe.h>
+
+static const uint32_t g_qdepths[XNVME_ASYNC_PROBE_NQDEPTHS] = { 1, 8, 32 };
+
+/**
+ * Measurements by device, a slot is NULL when free, entries live as long as the
+ * process, once the cache is full devices are probed on every open
+ */
+static struct xnvme_async_probe *g_cache[XNVME_ASYNC_PROBE_CACHE_LEN];
+static pthread_mutex_t g_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t
+_cpu_nsec(void)
+{
+	struct timespec ts = { 0 };
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
+_probe_cb(struct xnvme_req *req, void *cb_arg)
+{
+	struct xnvme_async_probe_run *run = cb_arg;
+
+	if (!xnvme_req_cpl_status(req)) {
+		run->nios += 1;
+	}
+
+	SLIST_INSERT_HEAD(&req->pool->head, req, link);
+}
+
+/**
+ * Read a logical block at a time, at the given queue depth, until either
+ * XNVME_ASYNC_PROBE_NCMDS are submitted or XNVME_ASYNC_PROBE_NSEC has passed
+ */
+static int
+_probe_run(struct xnvme_dev *dev, struct xnvme_async_probe_run *run)
+{
+	const struct xnvme_geo *geo = &dev->geo;
+	struct xnvme_async_ctx *ctx = NULL;
+	struct xnvme_req_pool *pool = NULL;
+	uint64_t wall, cpu, nsubmitted = 0;
+	uint8_t *buf = NULL;
+	int err;
+
+	err = xnvme_async_init(dev, &ctx, run->qdepth, 0);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_async_init(), err: %d", err);
+		return err;
+	}
+	err = xnvme_req_pool_alloc(&pool, run->qdepth);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_req_pool_alloc(), err: %d", err);
+		goto exit;
+	}
+	xnvme_req_pool_init(pool, ctx, _probe_cb, run);
+
+	buf = xnvme_buf_alloc(dev, run->qdepth * geo->lba_nbytes, NULL);
+	if (!buf) {
+		XNVME_DEBUG("FAILED: xnvme_buf_alloc(), errno: %d", errno);
+		err = -errno;
+		goto exit;
+	}
+
+	wall = _xnvme_timer_clock_sample();
+	cpu = _cpu_nsec();
+
+	while (nsubmitted < XNVME_ASYNC_PROBE_NCMDS) {
+		struct xnvme_req *req = SLIST_FIRST(&pool->head);
+		const uint32_t slot = req ? req - pool->elm : 0;
+
+		if (_xnvme_timer_clock_sample() - wall > XNVME_ASYNC_PROBE_NSEC) {
+			break;
+		}
+		if (!req) {
+			err = xnvme_async_poke(dev, ctx, 0);
+			if (err < 0) {
+				XNVME_DEBUG("FAILED: xnvme_async_poke(), err: %d",
+					    err);
+				goto exit;
+			}
+			continue;
+		}
+		SLIST_REMOVE_HEAD(&pool->head, link);
+
+		err = xnvme_cmd_read(dev, dev->nsid, nsubmitted % geo->nsect, 0,
+				     buf + slot * geo->lba_nbytes, NULL,
+				     XNVME_CMD_ASYNC, req);
+		switch (err) {
+		case 0:
+			nsubmitted += 1;
+			continue;
+
+		case -EBUSY:
+		case -EAGAIN:
+			SLIST_INSERT_HEAD(&pool->head, req, link);
+			xnvme_async_poke(dev, ctx, 0);
+			continue;
+
+		default:
+			XNVME_DEBUG("FAILED: xnvme_cmd_read(), err: %d", err);
+			SLIST_INSERT_HEAD(&pool->head, req, link);
+			goto exit;
+		}
+	}
+
+	err = xnvme_async_wait(dev, ctx);
+	if (err < 0) {
+		XNVME_DEBUG("FAILED: xnvme_async_wait(), err: %d", err);
+		goto exit;
+	}
+	err = 0;
+
+	run->wall_nsec = _xnvme_timer_clock_sample() - wall;
+	run->cpu_nsec = _cpu_nsec() - cpu;
+
+	if (run->nios != nsubmitted) {
+		XNVME_DEBUG("FAILED: nios: %u != nsubmitted: %lu", run->nios,
+			    nsubmitted);
+		err = -EIO;
+	}
+
+exit:
+	if (err) {
+		xnvme_async_wait(dev, ctx);
+	}
+	xnvme_buf_free(dev, buf);
+	xnvme_req_pool_free(pool);
+	xnvme_async_term(dev, ctx);
+
+	return err;
+}
+
+static void
+_probe_candidate(struct xnvme_dev *dev, struct xnvme_async_probe_candidate *cand)
+{
+	uint64_t nios = 0, cpu_nsec = 0;
+
+	for (int i = 0; i < XNVME_ASYNC_PROBE_NQDEPTHS; ++i) {
+		struct xnvme_async_probe_run *run = &cand->runs[i];
+
+		run->qdepth = g_qdepths[i];
+
+		cand->err = _probe_run(dev, run);
+		if (cand->err) {
+			XNVME_DEBUG("INFO: id: %s, qdepth: %u, err: %d",
+				    cand->id, run->qdepth, cand->err);
+			return;
+		}
+		nios += run->nios;
+		cpu_nsec += run->cpu_nsec;
+	}
+
+	cand->score = nios / ((cpu_nsec ? cpu_nsec : 1) / 1000000000.0);
+}
+
+static int
+_cache_lookup(const char *uri, struct xnvme_async_probe *probe)
+{
+	int found = 0;
+
+	pthread_mutex_lock(&g_cache_lock);
+	for (int i = 0; i < XNVME_ASYNC_PROBE_CACHE_LEN; ++i) {
+		if (g_cache[i] && !strcmp(g_cache[i]->uri, uri)) {
+			*probe = *g_cache[i];
+			found = 1;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&g_cache_lock);
+
+	return found;
+}
+
+static void
+_cache_insert(const struct xnvme_async_probe *probe)
+{
+	pthread_mutex_lock(&g_cache_lock);
+	for (int i = 0; i < XNVME_ASYNC_PROBE_CACHE_LEN; ++i) {
+		if (g_cache[i] && !strcmp(g_cache[i]->uri, probe->uri)) {
+			break;
+		}
+		if (!g_cache[i]) {
+			g_cache[i] = malloc(sizeof(*g_cache[i]));
+			if (g_cache[i]) {
+				*g_cache[i] = *probe;
+			}
+			break;
+		}
+	}
+	pthread_mutex_unlock(&g_cache_lock);
+}
+
+int
+xnvme_async_probe(struct xnvme_dev *dev, struct xnvme_be_async **asyncs,
+		  uint32_t nasyncs)
+{
+	const struct xnvme_be_async orig = dev->be.async;
+	struct xnvme_async_probe *probe;
+	int chosen = -1;
+
+	if (!nasyncs || (nasyncs > XNVME_ASYNC_PROBE_NCANDIDATES)) {
+		XNVME_DEBUG("FAILED: nasyncs: %u", nasyncs);
+		return -EINVAL;
+	}
+
+	probe = calloc(1, sizeof(*probe));
+	if (!probe) {
+		XNVME_DEBUG("FAILED: calloc(probe), errno: %d", errno);
+		return -errno;
+	}
+
+	if (_cache_lookup(dev->ident.uri, probe)) {
+		const char *id = probe->candidates[probe->chosen].id;
+
+		for (uint32_t i = 0; i < nasyncs; ++i) {
+			if (!strcmp(asyncs[i]->id, id)) {
+				dev->be.async = *asyncs[i];
+				dev->aprobe = probe;
+				XNVME_DEBUG("INFO: cached, chosen: %s", id);
+				return 0;
+			}
+		}
+		memset(probe, 0, sizeof(*probe));
+	}
+
+	snprintf(probe->uri, sizeof(probe->uri), "%s", dev->ident.uri);
+	probe->ncandidates = nasyncs;
+
+	for (uint32_t i = 0; i < nasyncs; ++i) {
+		struct xnvme_async_probe_candidate *cand = &probe->candidates[i];
+
+		cand->id = asyncs[i]->id;
+
+		dev->be.async = *asyncs[i];
+		_probe_candidate(dev, cand);
+		if (cand->err) {
+			continue;
+		}
+
+		XNVME_DEBUG("INFO: id: %s, score: %.0f", cand->id, cand->score);
+		if ((chosen < 0) || (cand->score > probe->candidates[chosen].score)) {
+			chosen = i;
+		}
+	}
+
+	if (chosen < 0) {
+		XNVME_DEBUG("FAILED: no candidate completed the probe");
+		dev->be.async = orig;
+		free(probe);
+		return -EIO;
+	}
+
+	probe->chosen = chosen;
+	dev->be.async = *asyncs[chosen];
+	dev->aprobe = probe;
+
+	_cache_insert(probe);
+
+	return 0;
+}
+
+int
+xnvme_async_probe_yaml(FILE *stream, const struct xnvme_async_probe *probe,
+		       int indent, const char *sep, int head)
+{
+	int wrtn = 0;
+
+	if (head) {
+		wrtn += fprintf(stream, "%*sxnvme_async_probe:", indent, "");
+		indent += 2;
+	}
+	if (!probe) {
+		wrtn += fprintf(stream, " ~");
+		return wrtn;
+	}
+	if (head) {
+		wrtn += fprintf(stream, "\n");
+	}
+
+	wrtn += fprintf(stream, "%*schosen: '%s'%s", indent, "",
+			probe->candidates[probe->chosen].id, sep);
+	wrtn += fprintf(stream, "%*scandidates:", indent, "");
+
+	for (uint32_t i = 0; i < probe->ncandidates; ++i) {
+		const struct xnvme_async_probe_candidate *cand;
+
+		cand = &probe->candidates[i];
+
+		wrtn += fprintf(stream, "%s%*s- id: '%s'%s", sep, indent + 2, "",
+				cand->id, sep);
+		wrtn += fprintf(stream, "%*serr: %d%s", indent + 4, "",
+				cand->err, sep);
+		wrtn += fprintf(stream, "%*sreads_per_cpu_sec: %.0f%s",
+				indent + 4, "", cand->score, sep);
+		wrtn += fprintf(stream, "%*sruns:", indent + 4, "");
+
+		for (int j = 0; !cand->err && (j < XNVME_ASYNC_PROBE_NQDEPTHS);
+		     ++j) {
+			const struct xnvme_async_probe_run *run = &cand->runs[j];
+
+			wrtn += fprintf(stream, "%s%*s- {qdepth: %u, nios: %u, "
+					"iops: %.0f, cpu_usec: %lu}", sep,
+					indent + 6, "", run->qdepth, run->nios,
+					run->nios / ((run->wall_nsec ?
+						      run->wall_nsec : 1) /
+						     1000000000.0),
+					run->cpu_nsec / 1000);
+		}
+		if (cand->err) {
+			wrtn += fprintf(stream, " ~");
+		}
+	}
+
+	return wrtn;
+}
@@ -0,0 +1,479 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libxnvme.h>
+#include <xnvme_be.h>
+#include <xnvme_be_nosys.h>
+#include <xnvme_dev.h>
+#include <xnvme_async.h>
+#include <xnvme_async_shared.h>
+
+static inline void
+shared_push(_Atomic(struct xnvme_async_shared_entry *) *head,
+	    struct xnvme_async_shared_entry *entry)
+{
+	struct xnvme_async_shared_entry *first;
+
+	first = atomic_load_explicit(head, memory_order_relaxed);
+	do {
+		entry->next = first;
+	} while (!atomic_compare_exchange_weak_explicit(head, &first, entry,
+			memory_order_release, memory_order_relaxed));
+}
+
+/**
+ * Take every entry pushed, by exchanging the head, thus without the ABA problem
+ * of popping one at a time
+ *
+ * @return The entries in the order they were pushed, NULL when there are none
+ */
+static inline struct xnvme_async_shared_entry *
+shared_take(_Atomic(struct xnvme_async_shared_entry *) *head)
+{
+	struct xnvme_async_shared_entry *entry, *fifo = NULL;
+
+	entry = atomic_exchange_explicit(head, NULL, memory_order_acquire);
+	while (entry) {
+		struct xnvme_async_shared_entry *next = entry->next;
+
+		entry->next = fifo;
+		fifo = entry;
+		entry = next;
+	}
+
+	return fifo;
+}
+
+/**
+ * Completion of a command on the shared context, invoked by the thread poking
+ * it, which hands the completion to the producer of the command
+ */
+static void
+shared_cb(struct xnvme_req *req, void *cb_arg)
+{
+	struct xnvme_async_shared_entry *entry = cb_arg;
+
+	entry->ureq->cpl = req->cpl;
+	shared_push(&entry->producer->cpls, entry);
+}
+
+/**
+ * Take the first 'n' commands off the pending list
+ */
+static inline void
+shared_pending_pop(struct xnvme_async_shared *shared, int n)
+{
+	for (int i = 0; i < n; ++i) {
+		shared->pending = shared->pending->next;
+	}
+	if (!shared->pending) {
+		shared->pending_tail = NULL;
+	}
+	atomic_fetch_sub_explicit(&shared->nqueued, n, memory_order_relaxed);
+}
+
+/**
+ * Submit the first of the pending commands, along with those following it, of
+ * the same options and without meta-data, in a single batch, when the backend
+ * supports it
+ *
+ * @return On success, the number of commands submitted. On error, negative
+ * `errno` of the first command.
+ */
+static int
+shared_submit(struct xnvme_async_shared *shared)
+{
+	struct xnvme_cmd_link *batch[XNVME_ASYNC_SHARED_BATCH_MAX];
+	struct xnvme_async_shared_entry *entry = shared->pending;
+	struct xnvme_dev *dev = shared->dev;
+	const int opts = entry->opts;
+	uint16_t nbatch = 0;
+	int err;
+
+	for (; shared->batch && entry && (!entry->mbuf) && (entry->opts == opts) &&
+	     (nbatch < XNVME_ASYNC_SHARED_BATCH_MAX); entry = entry->next) {
+		batch[nbatch++] = &entry->link;
+	}
+	if (nbatch > 1) {
+		return dev->be.async.cmd_batch(dev, batch, nbatch, opts);
+	}
+
+	entry = shared->pending;
+	err = dev->be.async.cmd_io(dev, &entry->link.cmd, entry->link.dbuf,
+				   entry->link.dbuf_nbytes, entry->mbuf,
+				   entry->mbuf_nbytes, entry->opts,
+				   &entry->link.req);
+
+	return err ? err : 1;
+}
+
+/**
+ * Submit the commands queued by producers, in the order they were queued,
+ * until the backend is out of room; must be called with the lock held
+ *
+ * @return The number of commands submitted
+ */
+static int
+shared_drain(struct xnvme_async_shared *shared)
+{
+	struct xnvme_async_shared_entry *taken;
+	int nsubmitted = 0;
+
+	taken = shared_take(&shared->queue);
+	if (taken) {
+		if (shared->pending) {
+			shared->pending_tail->next = taken;
+		} else {
+			shared->pending = taken;
+		}
+		for (shared->pending_tail = taken; shared->pending_tail->next;) {
+			shared->pending_tail = shared->pending_tail->next;
+		}
+	}
+
+	while (shared->pending) {
+		struct xnvme_async_shared_entry *entry = shared->pending;
+		int err;
+
+		err = shared_submit(shared);
+		if ((err == -EBUSY) || (err == -EAGAIN)) {
+			break;
+		}
+		if (err < 0) {
+			XNVME_DEBUG("FAILED: shared_submit(), err: %d", err);
+			shared_pending_pop(shared, 1);
+			xnvme_async_cpl_errno(&entry->link.req, err);
+			shared_cb(&entry->link.req, entry);
+			continue;
+		}
+
+		shared_pending_pop(shared, err);
+		nsubmitted += err;
+	}
+
+	return nsubmitted;
+}
+
+/**
+ * Submit what is queued, and reap completions of the shared context, unless
+ * another thread is already doing so
+ *
+ * @return On success, the number of completions reaped. On error, negative
+ * `errno` is returned.
+ */
+static int
+shared_drive(struct xnvme_async_shared *shared, uint32_t max)
+{
+	int err;
+
+	if (pthread_mutex_trylock(&shared->lock)) {
+		return 0;
+	}
+
+	shared_drain(shared);
+	err = shared->dev->be.async.poke(shared->dev, shared->ctx, max);
+
+	pthread_mutex_unlock(&shared->lock);
+
+	return err;
+}
+
+/**
+ * Hand the completions of the producer to 'out', or when it is NULL, invoke
+ * their callbacks, at most 'max' of them, 0 = unlimited
+ *
+ * @return The number of completions processed
+ */
+static int
+producer_deliver(struct xnvme_async_ctx *ctx, struct xnvme_req **out,
+		 uint32_t max)
+{
+	struct xnvme_async_producer *producer = ctx->producer;
+	struct xnvme_async_shared_entry *taken;
+	uint32_t n = 0;
+
+	taken = shared_take(&producer->cpls);
+	if (taken) {
+		if (producer->ready) {
+			producer->ready_tail->next = taken;
+		} else {
+			producer->ready = taken;
+		}
+		for (producer->ready_tail = taken; producer->ready_tail->next;) {
+			producer->ready_tail = producer->ready_tail->next;
+		}
+	}
+
+	while (producer->ready && ((!max) || (n < max))) {
+		struct xnvme_async_shared_entry *entry = producer->ready;
+		struct xnvme_req *ureq = entry->ureq;
+
+		producer->ready = entry->next;
+
+		// Freed before the callback, which may submit another command
+		entry->next = producer->free;
+		producer->free = entry;
+		ctx->outstanding -= 1;
+
+		if (out) {
+			out[n] = ureq;
+		} else {
+			ureq->async.cb(ureq, ureq->async.cb_arg);
+		}
+		n += 1;
+	}
+
+	return n;
+}
+
+int
+xnvme_async_shared_init(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_async_shared *shared;
+	int err;
+
+	shared = calloc(1, sizeof(*shared));
+	if (!shared) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	shared->dev = dev;
+	shared->ctx = ctx;
+	shared->batch = dev->be.async.cmd_batch != xnvme_be_nosys_async_cmd_batch;
+	atomic_init(&shared->queue, NULL);
+	atomic_init(&shared->nqueued, 0);
+	atomic_init(&shared->nproducers, 0);
+
+	err = pthread_mutex_init(&shared->lock, NULL);
+	if (err) {
+		XNVME_DEBUG("FAILED: pthread_mutex_init(), err: %d", err);
+		free(shared);
+		return -err;
+	}
+
+	ctx->shared = shared;
+
+	return 0;
+}
+
+int
+xnvme_async_shared_term(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_async_shared *shared = ctx->shared;
+	int err;
+
+	if (ctx->producer) {
+		err = xnvme_async_shared_wait(dev, ctx);
+		if (err < 0) {
+			XNVME_DEBUG("FAILED: xnvme_async_shared_wait(), err: %d",
+				    err);
+			return err;
+		}
+		atomic_fetch_sub(&shared->nproducers, 1);
+
+		free(ctx->producer);
+		free(ctx);
+		return 0;
+	}
+
+	if (atomic_load(&shared->nproducers)) {
+		XNVME_DEBUG("FAILED: nproducers: %u",
+			    atomic_load(&shared->nproducers));
+		return -EBUSY;
+	}
+
+	pthread_mutex_destroy(&shared->lock);
+	free(shared);
+	ctx->shared = NULL;
+
+	return 0;
+}
+
+int
+xnvme_async_producer_init(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+			  uint16_t depth, struct xnvme_async_ctx **producer)
+{
+	struct xnvme_async_producer *state;
+	struct xnvme_async_ctx *pctx;
+
+	if (!(dev && ctx && producer)) {
+		XNVME_DEBUG("FAILED: dev: %p, ctx: %p, producer: %p",
+			    (void *)dev, (void *)ctx, (void *)producer);
+		return -EINVAL;
+	}
+	if (!ctx->shared || ctx->producer) {
+		XNVME_DEBUG("FAILED: ctx is not setup with XNVME_ASYNC_SHARED");
+		return -EINVAL;
+	}
+	if (!(xnvme_is_pow2(depth) && (depth < 4096))) {
+		XNVME_DEBUG("EINVAL: depth: %u", depth);
+		return -EINVAL;
+	}
+
+	pctx = calloc(1, sizeof(*pctx));
+	if (!pctx) {
+		XNVME_DEBUG("FAILED: calloc(pctx), errno: %d", errno);
+		return -errno;
+	}
+	state = calloc(1, sizeof(*state) + depth * sizeof(*state->elm));
+	if (!state) {
+		XNVME_DEBUG("FAILED: calloc(state), errno: %d", errno);
+		free(pctx);
+		return -errno;
+	}
+	state->shared = ctx->shared;
+	atomic_init(&state->cpls, NULL);
+	for (uint16_t i = 0; i < depth; ++i) {
+		state->elm[i].producer = state;
+		state->elm[i].next = state->free;
+		state->free = &state->elm[i];
+	}
+
+	pctx->depth = depth;
+	pctx->shared = ctx->shared;
+	pctx->producer = state;
+
+	atomic_fetch_add(&ctx->shared->nproducers, 1);
+
+	*producer = pctx;
+
+	return 0;
+}
+
+int
+xnvme_async_shared_cmd_io(struct xnvme_dev *XNVME_UNUSED(dev),
+			  struct xnvme_spec_cmd *cmd, void *dbuf,
+			  size_t dbuf_nbytes, void *mbuf, size_t mbuf_nbytes,
+			  int opts, struct xnvme_req *req)
+{
+	struct xnvme_async_ctx *ctx = req->async.ctx;
+	struct xnvme_async_producer *producer = ctx->producer;
+	struct xnvme_async_shared *shared = ctx->shared;
+	struct xnvme_async_shared_entry *entry;
+
+	if (!producer) {
+		XNVME_DEBUG("FAILED: submit via xnvme_async_producer_init()");
+		return -EINVAL;
+	}
+
+	entry = producer->free;
+	if (!entry) {
+		XNVME_DEBUG("FAILED: queue is full");
+		return -EBUSY;
+	}
+	producer->free = entry->next;
+
+	memset(&entry->link.req, 0, sizeof(entry->link.req));
+	entry->link.req.async.ctx = shared->ctx;
+	entry->link.req.async.cb = shared_cb;
+	entry->link.req.async.cb_arg = entry;
+	entry->link.req.async.prio = req->async.prio;
+	entry->link.cmd = *cmd;
+	entry->link.dbuf = dbuf;
+	entry->link.dbuf_nbytes = dbuf_nbytes;
+	entry->mbuf = mbuf;
+	entry->mbuf_nbytes = mbuf_nbytes;
+	entry->opts = opts;
+	entry->ureq = req;
+
+	ctx->outstanding += 1;
+	atomic_fetch_add_explicit(&shared->nqueued, 1, memory_order_relaxed);
+	shared_push(&shared->queue, entry);
+
+	return 0;
+}
+
+int
+xnvme_async_shared_poke(struct xnvme_dev *XNVME_UNUSED(dev),
+			struct xnvme_async_ctx *ctx, uint32_t max)
+{
+	int err;
+
+	err = shared_drive(ctx->shared, ctx->producer ? 0 : max);
+	if ((err < 0) || (!ctx->producer)) {
+		return err;
+	}
+
+	return producer_deliver(ctx, NULL, max);
+}
+
+int
+xnvme_async_shared_reap(struct xnvme_dev *XNVME_UNUSED(dev),
+			struct xnvme_async_ctx *ctx, struct xnvme_req **out,
+			uint32_t max)
+{
+	int err;
+
+	if (!ctx->producer) {
+		XNVME_DEBUG("FAILED: reap via a producer");
+		return -EINVAL;
+	}
+
+	err = shared_drive(ctx->shared, 0);
+	if (err < 0) {
+		return err;
+	}
+
+	return producer_deliver(ctx, out, max);
+}
+
+/**
+ * Wait on the shared context itself, holding the lock, as it must be polled
+ * for the commands of every producer
+ */
+static int
+shared_wait(struct xnvme_async_shared *shared)
+{
+	struct xnvme_dev *dev = shared->dev;
+	struct xnvme_async_ctx *ctx = shared->ctx;
+	int acc = 0;
+
+	pthread_mutex_lock(&shared->lock);
+	while (atomic_load(&shared->nqueued) || ctx->outstanding) {
+		int err;
+
+		shared_drain(shared);
+
+		err = dev->be.async.poke(dev, ctx, 0);
+		if (err < 0) {
+			XNVME_DEBUG("FAILED: be.async.poke(), err: %d", err);
+			pthread_mutex_unlock(&shared->lock);
+			return err;
+		}
+		acc += err;
+	}
+	pthread_mutex_unlock(&shared->lock);
+
+	return acc;
+}
+
+int
+xnvme_async_shared_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
+{
+	int acc = 0;
+
+	if (!ctx->producer) {
+		return shared_wait(ctx->shared);
+	}
+
+	while (ctx->outstanding) {
+		struct timespec ts1 = {.tv_sec = 0, .tv_nsec = 1000};
+		int err;
+
+		err = xnvme_async_shared_poke(dev, ctx, 0);
+		if (err < 0) {
+			XNVME_DEBUG("FAILED: xnvme_async_shared_poke(), err: %d",
+				    err);
+			return err;
+		}
+		if (!err) {
+			nanosleep(&ts1, NULL);
+		}
+		acc += err;
+	}
+
+	return acc;
+}
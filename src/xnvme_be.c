@@ -2,9 +2,11 @@
 // SPDX-License-Identifier: Apache-2.0
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdatomic.h>
 #include <dirent.h>
 #include <paths.h>
 #include <errno.h>
+#include <pthread.h>
 #include <libxnvme.h>
 #include <libznd.h>
 #include <xnvme_be.h>
@@ -14,12 +16,18 @@ static struct xnvme_be *g_xnvme_be_registry[] = {
 	&xnvme_be_spdk,
 	&xnvme_be_linux,
 	&xnvme_be_fbsd,
+	&xnvme_be_emu,
+	&xnvme_be_stripe,
+	&xnvme_be_mirror,
 	NULL
 };
 
 static int
 xnvme_be_count = sizeof g_xnvme_be_registry / sizeof * g_xnvme_be_registry - 1;
 
+#define XNVME_BE_ENUMERATE_NTHREADS_MAX 16
+#define XNVME_ENUMERATION_CAPACITY_DEF 16
+
 int
 xnvme_be_yaml(FILE *stream, const struct xnvme_be *be, int indent,
 	      const char *sep, int head)
@@ -94,6 +102,28 @@ xnvme_ident_opt_to_val(const struct xnvme_ident *ident, const char *opt,
 	return sscanf(ofz, fmt, val) == 1;
 }
 
+bool
+xnvme_ident_opt_to_u64(const struct xnvme_ident *ident, const char *opt,
+		       uint64_t *val)
+{
+	const size_t opt_len = strlen(opt);
+	const char *ofz = ident->opts;
+
+	while ((ofz = strstr(ofz, opt))) {
+		const char *beg = ofz + opt_len + 1;
+		char *end = NULL;
+
+		if ((ofz == ident->opts || ofz[-1] == '?' || ofz[-1] == '&') && \
+		    (ofz[opt_len] == '=')) {
+			*val = strtoull(beg, &end, 10);
+			return end != beg;
+		}
+		ofz += opt_len;
+	}
+
+	return false;
+}
+
 int
 path_to_ll(const char *path, uint64_t *val)
 {
@@ -411,7 +441,7 @@ xnvme_be_dev_derive_geometry(struct xnvme_dev *dev)
 	// TODO: read the mpsmin register...
 	{
 		size_t mpsmin = 0;
-		size_t mdts = dev->id.ctrlr.mdts;
+		size_t mdts = dev->ctrlr->id.mdts;
 
 		if (!mdts) {
 			geo->mdts_nbytes = 1 << 20;
@@ -563,16 +593,27 @@ xnvme_enumeration_alloc(struct xnvme_enumeration **list, uint32_t capacity)
 }
 
 int
-xnvme_enumeration_append(struct xnvme_enumeration *list,
+xnvme_enumeration_append(struct xnvme_enumeration **list,
 			 struct xnvme_ident *entry)
 {
-	if (!list->capacity) {
-		XNVME_DEBUG("FAILED: syslist->capacity: %u", list->capacity);
-		return -ENOMEM;
+	if (!(*list)->capacity) {
+		uint32_t capacity = (*list)->nentries ? (*list)->nentries : \
+				    XNVME_ENUMERATION_CAPACITY_DEF;
+		struct xnvme_enumeration *grown;
+
+		grown = realloc(*list, sizeof(**list) + sizeof(*grown->entries) * \
+				((*list)->nentries + capacity));
+		if (!grown) {
+			XNVME_DEBUG("FAILED: realloc(list), nentries: %u",
+				    (*list)->nentries);
+			return -errno;
+		}
+		grown->capacity = capacity;
+		*list = grown;
 	}
 
-	list->entries[(list->nentries)++] = *entry;
-	list->capacity--;
+	(*list)->entries[((*list)->nentries)++] = *entry;
+	(*list)->capacity--;
 
 	return 0;
 }
@@ -695,29 +736,190 @@ xnvme_be_factory(const char *uri, struct xnvme_dev **dev)
 	return -ENXIO;
 }
 
+struct enumerate_probe {
+	const struct xnvme_be *be;
+	const struct xnvme_ident *idents;
+	uint8_t *probed;
+	uint32_t nidents;
+	atomic_uint next;		///< Next identifier to probe
+};
+
+static void *
+enumerate_probe_worker(void *arg)
+{
+	struct enumerate_probe *probe = arg;
+
+	for (uint32_t i = atomic_fetch_add(&probe->next, 1); i < probe->nidents;
+	     i = atomic_fetch_add(&probe->next, 1)) {
+		struct xnvme_dev *dev;
+
+		if (probe->probed[i]) {
+			continue;
+		}
+		if (probe->be->dev.dev_from_ident(&probe->idents[i], &dev)) {
+			XNVME_DEBUG("FAILED: dev_from_ident(%s)",
+				    probe->idents[i].uri);
+			continue;
+		}
+		probe->be->dev.dev_close(dev);
+		xnvme_dev_free(dev);
+
+		probe->probed[i] = 1;
+	}
+
+	return NULL;
+}
+
+int
+xnvme_be_enumerate_probe(const struct xnvme_be *be,
+			 const struct xnvme_ident *idents, uint32_t nidents,
+			 uint8_t *probed)
+{
+	pthread_t threads[XNVME_BE_ENUMERATE_NTHREADS_MAX - 1];
+	struct enumerate_probe probe = {
+		.be = be,
+		.idents = idents,
+		.probed = probed,
+		.nidents = nidents,
+	};
+	uint32_t nworkers = 0;
+	uint32_t nthreads = 0;
+
+	for (uint32_t i = 0; i < nidents; ++i) {
+		nworkers += !probed[i];
+	}
+	nworkers = XNVME_MIN(nworkers, XNVME_BE_ENUMERATE_NTHREADS_MAX);
+
+	// The calling thread probes as well, thus one thread less is started
+	for (uint32_t i = 1; i < nworkers; ++i) {
+		int err = pthread_create(&threads[nthreads], NULL,
+					 enumerate_probe_worker, &probe);
+		if (err) {
+			XNVME_DEBUG("FAILED: pthread_create(), err: %d", err);
+			break;
+		}
+		nthreads += 1;
+	}
+
+	enumerate_probe_worker(&probe);
+
+	for (uint32_t i = 0; i < nthreads; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+
+	return 0;
+}
+
+struct enumerate_be {
+	struct xnvme_be *be;
+	struct xnvme_enumeration *list;
+	const char *sys_uri;
+	int opts;
+	int err;
+	int started;			///< Enumerating on a thread of its own
+	pthread_t thread;
+};
+
+static void *
+enumerate_be_worker(void *arg)
+{
+	struct enumerate_be *ebe = arg;
+
+	ebe->err = ebe->be->dev.enumerate(&ebe->list, ebe->sys_uri, ebe->opts);
+
+	return NULL;
+}
+
+/**
+ * The backends enumerate concurrently, each into a list of its own, and the
+ * lists are then concatenated in the order of the registry. SPDK initializes
+ * its environment on the thread enumerating, thus it does so on the calling
+ * thread, as the application does when opening a device
+ */
 int
 xnvme_enumerate(struct xnvme_enumeration **list, const char *sys_uri, int opts)
 {
+	struct enumerate_be ebes[sizeof g_xnvme_be_registry /
+				 sizeof * g_xnvme_be_registry] = { 0 };
+	uint32_t nentries = 0;
 	int err;
 
-	// TODO: improve in this static allocation of 100 entries should be
-	// parsed on-wards as **, such that it can be re-allocated and expanded
-	err = xnvme_enumeration_alloc(list, 100);
+	for (int i = 0; g_xnvme_be_registry[i]; ++i) {
+		struct enumerate_be *ebe = &ebes[i];
+
+		if (!g_xnvme_be_registry[i]->attr.enabled) {
+			continue;
+		}
+
+		ebe->be = g_xnvme_be_registry[i];
+		ebe->sys_uri = sys_uri;
+		ebe->opts = opts;
+
+		err = xnvme_enumeration_alloc(&ebe->list,
+					      XNVME_ENUMERATION_CAPACITY_DEF);
+		if (err) {
+			XNVME_DEBUG("FAILED: xnvme_enumeration_alloc()");
+			goto exit;
+		}
+
+		if (ebe->be == &xnvme_be_spdk) {
+			continue;
+		}
+
+		err = pthread_create(&ebe->thread, NULL, enumerate_be_worker,
+				     ebe);
+		if (err) {
+			XNVME_DEBUG("INFO: pthread_create(), err: %d", err);
+			continue;
+		}
+		ebe->started = 1;
+	}
+
+	for (int i = 0; g_xnvme_be_registry[i]; ++i) {
+		struct enumerate_be *ebe = &ebes[i];
+
+		if (!ebe->list) {
+			continue;
+		}
+
+		if (ebe->started) {
+			pthread_join(ebe->thread, NULL);
+			ebe->started = 0;
+		} else {
+			enumerate_be_worker(ebe);
+		}
+		if (ebe->err) {
+			XNVME_DEBUG("FAILED: %s->enumerate(...), err: '%s', i: %d",
+				    ebe->be->attr.name, strerror(-ebe->err), i);
+		}
+
+		nentries += ebe->list->nentries;
+	}
+
+	err = xnvme_enumeration_alloc(list, nentries);
 	if (err) {
 		XNVME_DEBUG("FAILED: xnvme_enumeration_alloc()");
-		return err;
+		goto exit;
 	}
+	for (int i = 0; g_xnvme_be_registry[i]; ++i) {
+		struct enumerate_be *ebe = &ebes[i];
 
+		for (uint32_t j = 0; ebe->list && (j < ebe->list->nentries); ++j) {
+			(*list)->entries[(*list)->nentries++] = \
+				ebe->list->entries[j];
+		}
+	}
+	(*list)->capacity = 0;
+
+exit:
 	for (int i = 0; g_xnvme_be_registry[i]; ++i) {
-		err = g_xnvme_be_registry[i]->dev.enumerate(*list, sys_uri, opts);
-		if (err) {
-			XNVME_DEBUG("FAILED: %s->enumerate(...), err: '%s', i: %d",
-				    g_xnvme_be_registry[i]->attr.name,
-				    strerror(-err), i);
+		if (ebes[i].started) {
+			pthread_join(ebes[i].thread, NULL);
 		}
+		xnvme_enumeration_free(ebes[i].list);
 	}
 
-	return 0;
+	return err;
 }
 
 /**
@@ -782,7 +984,7 @@ bool
 has_scheme(const char *needle, const char *haystack[], int len)
 {
 	for (int i = 0; i < len; ++i) {
-		if (!strncmp(needle, haystack[i], 4)) {
+		if (!strncmp(needle, haystack[i], XNVME_IDENT_SCHM_LEN)) {
 			return true;
 		}
 	}
@@ -807,7 +1009,7 @@ xnvme_ident_from_uri(const char *uri, struct xnvme_ident *ident)
 		return -EINVAL;
 	}
 
-	matches = sscanf(ident->uri, "%4[a-z]%1[:]", ident->schm, sep);
+	matches = sscanf(ident->uri, "%7[a-z]%1[:]", ident->schm, sep);
 	if (matches != 2) {
 		return -EINVAL;
 	}
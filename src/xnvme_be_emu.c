@@ -0,0 +1,1669 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <libxnvme.h>
+#include <xnvme_be.h>
+#include <xnvme_be_nosys.h>
+
+#ifdef XNVME_BE_EMU_ENABLED
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <liblblk.h>
+#include <libznd.h>
+#include <xnvme_async.h>
+#include <xnvme_be_emu.h>
+#include <xnvme_dev.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+#define EMU_HUGEPAGE_NBYTES (1ULL << 21)
+#define EMU_ALIGN_UP(x, a) (((x) + (a) - 1) & ~((a) - 1))
+
+/**
+ * Status of an emulated command, encoded as (sct << 8 | sc)
+ */
+#define EMU_SC(sct, sc) (((sct) << 8) | (sc))
+
+enum emu_sc {
+	EMU_SC_INVALID_OPCODE	= EMU_SC(0x0, 0x01),
+	EMU_SC_INVALID_FIELD	= EMU_SC(0x0, 0x02),
+	EMU_SC_INVALID_NS	= EMU_SC(0x0, 0x0B),
+	EMU_SC_LBA_RANGE	= EMU_SC(0x0, 0x80),
+};
+
+#define EMU_SC_ZND(sc) EMU_SC(0x1, sc)
+
+extern struct xnvme_be xnvme_be_emu;
+
+static inline struct xnvme_be_emu_ns *
+_emu_ns(struct xnvme_dev *dev)
+{
+	return ((struct xnvme_be_emu_state *)dev->be.state)->ns;
+}
+
+static inline uint64_t
+_emu_rand(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+static inline uint64_t
+_emu_rand_seed(const void *ptr)
+{
+	return (_xnvme_timer_clock_sample() ^ (uintptr_t)ptr) | 0x1;
+}
+
+/**
+ * Sample the latency, in nsec, of a command moving 'nbytes' to or from media
+ */
+static uint64_t
+_emu_lat_nsec(const struct xnvme_be_emu_lat *lat, uint64_t *rnd, size_t nbytes)
+{
+	double nsec = lat->nsec;
+
+	if (lat->nsec && lat->sigma > 0.0) {
+		// Box-Muller transform of two uniforms, u1 in (0, 1]
+		const double u1 = ((_emu_rand(rnd) >> 11) + 1.0) / (1ULL << 53);
+		const double u2 = (_emu_rand(rnd) >> 11) / (double)(1ULL << 53);
+		const double z = sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+
+		nsec *= exp(lat->sigma * z);
+	}
+	if (lat->bps) {
+		nsec += ((double)nbytes * NSEC_PER_SEC) / lat->bps;
+	}
+
+	return nsec;
+}
+
+static inline enum xnvme_be_emu_opclass
+_emu_opclass(uint8_t opcode)
+{
+	switch (opcode) {
+	case XNVME_SPEC_OPC_READ:
+		return XNVME_BE_EMU_OPCLASS_READ;
+
+	case XNVME_SPEC_OPC_WRITE:
+	case ZND_CMD_OPC_APPEND:
+	case LBLK_CMD_OPC_WRITE_ZEROES:
+	case LBLK_CMD_OPC_SCOPY:
+		return XNVME_BE_EMU_OPCLASS_WRITE;
+
+	default:
+		return XNVME_BE_EMU_OPCLASS_OTHER;
+	}
+}
+
+static inline uint16_t
+_emu_mssrl(const struct xnvme_be_emu_ns *ns)
+{
+	const uint64_t mssrl = (1ULL << (XNVME_BE_EMU_MDTS + 12)) >> ns->lbads;
+
+	return mssrl > UINT16_MAX ? UINT16_MAX : mssrl;
+}
+
+static inline bool
+_emu_in_range(const struct xnvme_be_emu_ns *ns, uint64_t slba, uint64_t nlb)
+{
+	return (slba < ns->nlb) && (nlb <= ns->nlb - slba);
+}
+
+/**
+ * Zero the given range, releasing the backing memory of the whole pages in it
+ */
+static void
+_emu_ns_clear(struct xnvme_be_emu_ns *ns, uint64_t slba, uint64_t nlb)
+{
+	uint8_t *beg = ns->data + (slba << ns->lbads);
+	uint8_t *end = beg + (nlb << ns->lbads);
+	const uintptr_t mask = ns->page_nbytes - 1;
+	uint8_t *pbeg = (void *)(((uintptr_t)beg + mask) & ~mask);
+	uint8_t *pend = (void *)((uintptr_t)end & ~mask);
+
+	if ((pbeg < pend) && !madvise(pbeg, pend - pbeg, MADV_DONTNEED)) {
+		memset(beg, 0, pbeg - beg);
+		memset(pend, 0, end - pend);
+		return;
+	}
+
+	memset(beg, 0, end - beg);
+}
+
+static inline int
+_emu_zs_open(uint8_t zs)
+{
+	return (zs == ZND_STATE_IOPEN) || (zs == ZND_STATE_EOPEN);
+}
+
+static inline int
+_emu_zs_active(uint8_t zs)
+{
+	return _emu_zs_open(zs) || (zs == ZND_STATE_CLOSED);
+}
+
+/**
+ * Transition the zone to the given state, accounting for open and active
+ * resources; the caller must hold 'zlock'
+ */
+static int
+_emu_zone_trans(struct xnvme_be_emu_ns *ns, struct xnvme_be_emu_zone *zone,
+		uint8_t zs)
+{
+	const int dopen = _emu_zs_open(zs) - _emu_zs_open(zone->zs);
+	const int dactive = _emu_zs_active(zs) - _emu_zs_active(zone->zs);
+
+	if ((dactive > 0) && ns->mar && (ns->nactive >= ns->mar)) {
+		return EMU_SC_ZND(ZND_SC_TOO_MANY_ACTIVE);
+	}
+	if ((dopen > 0) && ns->mor && (ns->nopen >= ns->mor)) {
+		return EMU_SC_ZND(ZND_SC_TOO_MANY_OPEN);
+	}
+
+	ns->nopen += dopen;
+	ns->nactive += dactive;
+	zone->zs = zs;
+
+	return 0;
+}
+
+/**
+ * Advance the write pointer of the zone containing '*slba' by 'nlb', on return
+ * '*slba' is the LBA at which the data is to be written
+ */
+static int
+_emu_zone_write(struct xnvme_be_emu_ns *ns, uint64_t *slba, uint64_t nlb,
+		int append)
+{
+	const uint64_t zidx = *slba / ns->zsze;
+	const uint64_t zslba = zidx * ns->zsze;
+	struct xnvme_be_emu_zone *zone = &ns->zones[zidx];
+	uint64_t lba;
+	int err = 0;
+
+	if (append && (*slba != zslba)) {
+		return EMU_SC_INVALID_FIELD;
+	}
+
+	pthread_mutex_lock(&ns->zlock);
+
+	switch (zone->zs) {
+	case ZND_STATE_FULL:
+		err = EMU_SC_ZND(ZND_SC_IS_FULL);
+		goto exit;
+	case ZND_STATE_RONLY:
+		err = EMU_SC_ZND(ZND_SC_IS_READONLY);
+		goto exit;
+	case ZND_STATE_OFFLINE:
+		err = EMU_SC_ZND(ZND_SC_IS_OFFLINE);
+		goto exit;
+	}
+
+	lba = append ? zone->wp : *slba;
+	if (lba != zone->wp) {
+		err = EMU_SC_ZND(ZND_SC_INVALID_WRITE);
+		goto exit;
+	}
+	if (lba + nlb > zslba + ns->zcap) {
+		err = EMU_SC_ZND(ZND_SC_BOUNDARY_ERROR);
+		goto exit;
+	}
+	if ((zone->zs == ZND_STATE_EMPTY) || (zone->zs == ZND_STATE_CLOSED)) {
+		err = _emu_zone_trans(ns, zone, ZND_STATE_IOPEN);
+		if (err) {
+			goto exit;
+		}
+	}
+
+	zone->wp += nlb;
+	if (zone->wp == zslba + ns->zcap) {
+		_emu_zone_trans(ns, zone, ZND_STATE_FULL);
+	}
+	*slba = lba;
+
+exit:
+	pthread_mutex_unlock(&ns->zlock);
+
+	return err;
+}
+
+static int
+_emu_read(struct xnvme_be_emu_ns *ns, uint64_t slba, uint64_t nlb,
+	  void *dbuf, size_t dbuf_nbytes, size_t *nbytes)
+{
+	const size_t len = nlb << ns->lbads;
+
+	if (!_emu_in_range(ns, slba, nlb)) {
+		return EMU_SC_LBA_RANGE;
+	}
+	if (!dbuf || (dbuf_nbytes < len)) {
+		XNVME_DEBUG("FAILED: dbuf: %p, dbuf_nbytes: %zu < %zu", dbuf,
+			    dbuf_nbytes, len);
+		return -EINVAL;
+	}
+	if (ns->zoned && ((slba / ns->zsze) != ((slba + nlb - 1) / ns->zsze))) {
+		return EMU_SC_ZND(ZND_SC_BOUNDARY_ERROR);
+	}
+
+	memcpy(dbuf, ns->data + (slba << ns->lbads), len);
+
+	atomic_fetch_add_explicit(&ns->nbytes_read, len, memory_order_relaxed);
+	atomic_fetch_add_explicit(&ns->ncmds_read, 1, memory_order_relaxed);
+	*nbytes = len;
+
+	return 0;
+}
+
+static int
+_emu_write(struct xnvme_be_emu_ns *ns, uint64_t slba, uint64_t nlb,
+	   const void *dbuf, size_t dbuf_nbytes, int append,
+	   struct xnvme_spec_cpl *cpl, size_t *nbytes)
+{
+	const size_t len = nlb << ns->lbads;
+	int err;
+
+	if (!_emu_in_range(ns, slba, nlb)) {
+		return EMU_SC_LBA_RANGE;
+	}
+	if (!dbuf || (dbuf_nbytes < len)) {
+		XNVME_DEBUG("FAILED: dbuf: %p, dbuf_nbytes: %zu < %zu", dbuf,
+			    dbuf_nbytes, len);
+		return -EINVAL;
+	}
+	if (ns->zoned) {
+		err = _emu_zone_write(ns, &slba, nlb, append);
+		if (err) {
+			return err;
+		}
+	}
+
+	memcpy(ns->data + (slba << ns->lbads), dbuf, len);
+
+	atomic_fetch_add_explicit(&ns->nbytes_written, len,
+				  memory_order_relaxed);
+	atomic_fetch_add_explicit(&ns->ncmds_written, 1, memory_order_relaxed);
+	cpl->result = append ? slba : 0;
+	*nbytes = len;
+
+	return 0;
+}
+
+static int
+_emu_write_zeroes(struct xnvme_be_emu_ns *ns, struct lblk_cmd *cmd)
+{
+	uint64_t slba = cmd->write_zeroes.slba;
+	const uint64_t nlb = cmd->write_zeroes.nlb + 1ULL;
+	int err;
+
+	if (!_emu_in_range(ns, slba, nlb)) {
+		return EMU_SC_LBA_RANGE;
+	}
+	if (ns->zoned) {
+		err = _emu_zone_write(ns, &slba, nlb, 0);
+		if (err) {
+			return err;
+		}
+	}
+
+	_emu_ns_clear(ns, slba, nlb);
+
+	return 0;
+}
+
+static int
+_emu_dsm(struct xnvme_be_emu_ns *ns, struct lblk_cmd *cmd, void *dbuf,
+	 size_t dbuf_nbytes)
+{
+	struct lblk_dsm_range *ranges = dbuf;
+	const uint32_t nranges = cmd->dsm.nr + 1;
+
+	if (!ranges || (dbuf_nbytes < nranges * sizeof(*ranges))) {
+		XNVME_DEBUG("FAILED: ranges: %p, dbuf_nbytes: %zu",
+			    dbuf, dbuf_nbytes);
+		return -EINVAL;
+	}
+	for (uint32_t i = 0; i < nranges; ++i) {
+		if (!_emu_in_range(ns, ranges[i].slba, ranges[i].nlb)) {
+			return EMU_SC_LBA_RANGE;
+		}
+	}
+
+	// Attributes are hints and zones are only cleared by reset
+	if (!cmd->dsm.ad || ns->zoned) {
+		return 0;
+	}
+
+	for (uint32_t i = 0; i < nranges; ++i) {
+		if (ranges[i].nlb) {
+			_emu_ns_clear(ns, ranges[i].slba, ranges[i].nlb);
+		}
+	}
+
+	return 0;
+}
+
+static int
+_emu_scopy(struct xnvme_be_emu_ns *ns, struct lblk_cmd *cmd, void *dbuf,
+	   size_t dbuf_nbytes, size_t *nbytes)
+{
+	struct lblk_scopy_fmt_zero *ranges = dbuf;
+	const uint32_t nranges = cmd->copy.nr + 1;
+	uint64_t dlba = cmd->copy.sdlba;
+	uint64_t tlb = 0;
+	int err;
+
+	if (cmd->copy.df || (nranges > XNVME_BE_EMU_MSRC + 1)) {
+		return EMU_SC_INVALID_FIELD;
+	}
+	if (!ranges || (dbuf_nbytes < nranges * sizeof(*ranges))) {
+		XNVME_DEBUG("FAILED: ranges: %p, dbuf_nbytes: %zu",
+			    dbuf, dbuf_nbytes);
+		return -EINVAL;
+	}
+	for (uint32_t i = 0; i < nranges; ++i) {
+		const uint64_t nlb = ranges[i].nlb + 1ULL;
+
+		if (nlb > _emu_mssrl(ns)) {
+			return EMU_SC_INVALID_FIELD;
+		}
+		if (!_emu_in_range(ns, ranges[i].slba, nlb)) {
+			return EMU_SC_LBA_RANGE;
+		}
+		tlb += nlb;
+	}
+	if (tlb > (uint64_t)_emu_mssrl(ns) * (XNVME_BE_EMU_MSRC + 1)) {
+		return EMU_SC_INVALID_FIELD;
+	}
+	if (!_emu_in_range(ns, dlba, tlb)) {
+		return EMU_SC_LBA_RANGE;
+	}
+	if (ns->zoned) {
+		err = _emu_zone_write(ns, &dlba, tlb, 0);
+		if (err) {
+			return err;
+		}
+	}
+
+	for (uint32_t i = 0; i < nranges; ++i) {
+		const uint64_t nlb = ranges[i].nlb + 1ULL;
+
+		memmove(ns->data + (dlba << ns->lbads),
+			ns->data + (ranges[i].slba << ns->lbads),
+			nlb << ns->lbads);
+		dlba += nlb;
+	}
+	*nbytes = tlb << ns->lbads;
+
+	return 0;
+}
+
+/**
+ * Perform the given zone send action, the caller must hold 'zlock'
+ */
+static int
+_emu_zone_action(struct xnvme_be_emu_ns *ns, uint64_t zidx, uint8_t zsa)
+{
+	struct xnvme_be_emu_zone *zone = &ns->zones[zidx];
+	const uint64_t zslba = zidx * ns->zsze;
+
+	switch (zsa) {
+	case ZND_SEND_OPEN:
+		switch (zone->zs) {
+		case ZND_STATE_EOPEN:
+			return 0;
+		case ZND_STATE_EMPTY:
+		case ZND_STATE_IOPEN:
+		case ZND_STATE_CLOSED:
+			return _emu_zone_trans(ns, zone, ZND_STATE_EOPEN);
+		}
+		break;
+
+	case ZND_SEND_CLOSE:
+		switch (zone->zs) {
+		case ZND_STATE_CLOSED:
+			return 0;
+		case ZND_STATE_IOPEN:
+		case ZND_STATE_EOPEN:
+			return _emu_zone_trans(ns, zone, zone->wp == zslba ? \
+					       ZND_STATE_EMPTY : ZND_STATE_CLOSED);
+		}
+		break;
+
+	case ZND_SEND_FINISH:
+		switch (zone->zs) {
+		case ZND_STATE_FULL:
+			return 0;
+		case ZND_STATE_EMPTY:
+		case ZND_STATE_IOPEN:
+		case ZND_STATE_EOPEN:
+		case ZND_STATE_CLOSED:
+			zone->wp = zslba + ns->zcap;
+			return _emu_zone_trans(ns, zone, ZND_STATE_FULL);
+		}
+		break;
+
+	case ZND_SEND_RESET:
+		switch (zone->zs) {
+		case ZND_STATE_EMPTY:
+			return 0;
+		case ZND_STATE_IOPEN:
+		case ZND_STATE_EOPEN:
+		case ZND_STATE_CLOSED:
+		case ZND_STATE_FULL:
+			if (zone->wp > zslba) {
+				_emu_ns_clear(ns, zslba, zone->wp - zslba);
+			}
+			zone->wp = zslba;
+			return _emu_zone_trans(ns, zone, ZND_STATE_EMPTY);
+		}
+		break;
+
+	case ZND_SEND_OFFLINE:
+		switch (zone->zs) {
+		case ZND_STATE_OFFLINE:
+			return 0;
+		case ZND_STATE_RONLY:
+			return _emu_zone_trans(ns, zone, ZND_STATE_OFFLINE);
+		}
+		break;
+
+	default:
+		return EMU_SC_INVALID_FIELD;
+	}
+
+	return EMU_SC_ZND(ZND_SC_INVALID_TRANS);
+}
+
+/**
+ * Whether a zone in the given state is affected by the send action when
+ * 'select all' is set
+ */
+static bool
+_emu_zone_selected(uint8_t zsa, uint8_t zs)
+{
+	switch (zsa) {
+	case ZND_SEND_OPEN:
+		return zs == ZND_STATE_CLOSED;
+	case ZND_SEND_CLOSE:
+		return _emu_zs_open(zs);
+	case ZND_SEND_FINISH:
+		return _emu_zs_active(zs);
+	case ZND_SEND_RESET:
+		return _emu_zs_active(zs) || (zs == ZND_STATE_FULL);
+	case ZND_SEND_OFFLINE:
+		return zs == ZND_STATE_RONLY;
+	}
+
+	return false;
+}
+
+static int
+_emu_zone_mgmt_send(struct xnvme_be_emu_ns *ns, struct znd_cmd *cmd)
+{
+	const uint64_t slba = cmd->mgmt_send.slba;
+	int err = 0;
+
+	if (!cmd->mgmt_send.zsasf && \
+	    ((slba >= ns->nlb) || (slba % ns->zsze))) {
+		return EMU_SC_INVALID_FIELD;
+	}
+
+	pthread_mutex_lock(&ns->zlock);
+
+	if (!cmd->mgmt_send.zsasf) {
+		err = _emu_zone_action(ns, slba / ns->zsze, cmd->mgmt_send.zsa);
+		goto exit;
+	}
+	for (uint64_t zidx = 0; zidx < ns->nzones; ++zidx) {
+		if (!_emu_zone_selected(cmd->mgmt_send.zsa,
+					ns->zones[zidx].zs)) {
+			continue;
+		}
+		err = _emu_zone_action(ns, zidx, cmd->mgmt_send.zsa);
+		if (err) {
+			break;
+		}
+	}
+
+exit:
+	pthread_mutex_unlock(&ns->zlock);
+
+	return err;
+}
+
+static int
+_emu_zrasf_to_state(uint8_t zrasf)
+{
+	switch (zrasf) {
+	case ZND_RECV_SF_ALL:
+		return 0;
+	case ZND_RECV_SF_EMPTY:
+		return ZND_STATE_EMPTY;
+	case ZND_RECV_SF_IOPEN:
+		return ZND_STATE_IOPEN;
+	case ZND_RECV_SF_EOPEN:
+		return ZND_STATE_EOPEN;
+	case ZND_RECV_SF_CLOSED:
+		return ZND_STATE_CLOSED;
+	case ZND_RECV_SF_FULL:
+		return ZND_STATE_FULL;
+	case ZND_RECV_SF_RONLY:
+		return ZND_STATE_RONLY;
+	case ZND_RECV_SF_OFFLINE:
+		return ZND_STATE_OFFLINE;
+	}
+
+	return -1;
+}
+
+/**
+ * With partial=0 the header holds the number of zones, from and including
+ * slba, matching zrasf; with partial=1 the number of zones in the buffer
+ */
+static int
+_emu_zone_mgmt_recv(struct xnvme_be_emu_ns *ns, struct znd_cmd *cmd,
+		    void *dbuf, size_t dbuf_nbytes)
+{
+	struct znd_rprt_hdr *hdr = dbuf;
+	struct znd_descr *descr = (void *)((uint8_t *)dbuf + sizeof(*hdr));
+	const int zs = _emu_zrasf_to_state(cmd->mgmt_recv.zrasf);
+	uint64_t ndescr, nzones = 0;
+
+	if (!dbuf || (dbuf_nbytes < sizeof(*hdr))) {
+		XNVME_DEBUG("FAILED: dbuf: %p, dbuf_nbytes: %zu", dbuf,
+			    dbuf_nbytes);
+		return -EINVAL;
+	}
+	if ((cmd->mgmt_recv.zra != ZND_RECV_REPORT) || (zs < 0)) {
+		return EMU_SC_INVALID_FIELD;
+	}
+	if (cmd->mgmt_recv.slba >= ns->nlb) {
+		return EMU_SC_LBA_RANGE;
+	}
+
+	memset(dbuf, 0, dbuf_nbytes);
+	ndescr = (dbuf_nbytes - sizeof(*hdr)) / sizeof(*descr);
+
+	pthread_mutex_lock(&ns->zlock);
+	for (uint64_t zidx = cmd->mgmt_recv.slba / ns->zsze;
+	     zidx < ns->nzones; ++zidx) {
+		struct xnvme_be_emu_zone *zone = &ns->zones[zidx];
+
+		if (zs && (zone->zs != zs)) {
+			continue;
+		}
+		if (nzones < ndescr) {
+			descr[nzones].zt = ZND_TYPE_SEQWR;
+			descr[nzones].zs = zone->zs;
+			descr[nzones].zcap = ns->zcap;
+			descr[nzones].zslba = zidx * ns->zsze;
+			descr[nzones].wp = zone->wp;
+		} else if (cmd->mgmt_recv.partial) {
+			break;
+		}
+		++nzones;
+	}
+	pthread_mutex_unlock(&ns->zlock);
+
+	hdr->nzones = nzones;
+
+	return 0;
+}
+
+/**
+ * Execute the given I/O command against the namespace
+ *
+ * @return On success, 0 is returned and 'cpl' is filled, with the status of the
+ * command when it fails. On error, that is, when the command cannot be
+ * executed, negated errno is returned.
+ */
+static int
+_emu_cmd_exec(struct xnvme_be_emu_ns *ns, struct xnvme_spec_cmd *cmd,
+	      void *dbuf, size_t dbuf_nbytes, struct xnvme_spec_cpl *cpl,
+	      size_t *nbytes)
+{
+	struct lblk_cmd *lcmd = (void *)cmd;
+	struct znd_cmd *zcmd = (void *)cmd;
+	int err;
+
+	*nbytes = 0;
+
+	switch (cmd->common.opcode) {
+	case XNVME_SPEC_OPC_FLUSH:
+		err = 0;
+		break;
+
+	case XNVME_SPEC_OPC_READ:
+		err = _emu_read(ns, cmd->lblk.slba, cmd->lblk.nlb + 1ULL, dbuf,
+				dbuf_nbytes, nbytes);
+		break;
+
+	case XNVME_SPEC_OPC_WRITE:
+		err = _emu_write(ns, cmd->lblk.slba, cmd->lblk.nlb + 1ULL, dbuf,
+				 dbuf_nbytes, 0, cpl, nbytes);
+		break;
+
+	case LBLK_CMD_OPC_WRITE_ZEROES:
+		err = _emu_write_zeroes(ns, lcmd);
+		break;
+
+	case LBLK_CMD_OPC_DSM:
+		err = _emu_dsm(ns, lcmd, dbuf, dbuf_nbytes);
+		break;
+
+	case LBLK_CMD_OPC_SCOPY:
+		err = _emu_scopy(ns, lcmd, dbuf, dbuf_nbytes, nbytes);
+		break;
+
+	case ZND_CMD_OPC_APPEND:
+		err = ns->zoned ? \
+		      _emu_write(ns, zcmd->append.zslba,
+				 zcmd->append.nlb + 1ULL, dbuf, dbuf_nbytes, 1,
+				 cpl, nbytes) : EMU_SC_INVALID_OPCODE;
+		break;
+
+	case ZND_CMD_OPC_MGMT_SEND:
+		err = ns->zoned ? _emu_zone_mgmt_send(ns, zcmd) : \
+		      EMU_SC_INVALID_OPCODE;
+		break;
+
+	case ZND_CMD_OPC_MGMT_RECV:
+		err = ns->zoned ? \
+		      _emu_zone_mgmt_recv(ns, zcmd, dbuf, dbuf_nbytes) : \
+		      EMU_SC_INVALID_OPCODE;
+		break;
+
+	default:
+		XNVME_DEBUG("INFO: unsupported opcode: 0x%x",
+			    cmd->common.opcode);
+		err = EMU_SC_INVALID_OPCODE;
+		break;
+	}
+
+	if (err < 0) {
+		return err;
+	}
+	cpl->status.sct = err >> 8;
+	cpl->status.sc = err & 0xFF;
+
+	return 0;
+}
+
+static void
+_emu_str_pad(int8_t *dst, const char *src, size_t dst_len)
+{
+	memset(dst, ' ', dst_len);
+	memcpy(dst, src, XNVME_MIN(strlen(src), dst_len));
+}
+
+static int
+_emu_idfy(struct xnvme_be_emu_ns *ns, struct xnvme_spec_cmd *cmd, void *dbuf,
+	  size_t dbuf_nbytes)
+{
+	const uint32_t nsid = cmd->common.nsid;
+
+	if (!dbuf || (dbuf_nbytes < sizeof(struct xnvme_spec_idfy))) {
+		XNVME_DEBUG("FAILED: dbuf: %p, dbuf_nbytes: %zu", dbuf,
+			    dbuf_nbytes);
+		return -EINVAL;
+	}
+	memset(dbuf, 0, sizeof(struct xnvme_spec_idfy));
+
+	switch (cmd->idfy.cns) {
+	case XNVME_SPEC_IDFY_CTRLR: {
+		struct xnvme_spec_idfy_ctrlr *ctrlr = dbuf;
+		struct lblk_idfy_ctrlr *lctrlr = dbuf;
+
+		_emu_str_pad(ctrlr->sn, "EMU0001", sizeof(ctrlr->sn));
+		_emu_str_pad(ctrlr->mn, "xNVMe emulated controller",
+			     sizeof(ctrlr->mn));
+		_emu_str_pad((int8_t *)ctrlr->fr, XNVME_BE_EMU_NAME,
+			     sizeof(ctrlr->fr));
+		ctrlr->mdts = XNVME_BE_EMU_MDTS;
+		ctrlr->nn = 1;
+
+		lctrlr->oncs.dsm = 1;
+		lctrlr->oncs.write_zeroes = 1;
+		lctrlr->oncs.copy = 1;
+		lctrlr->ocfs.copy_fmt0 = 1;
+		return 0;
+	}
+
+	case XNVME_SPEC_IDFY_NS: {
+		struct xnvme_spec_idfy_ns *idns = dbuf;
+		struct lblk_idfy_ns *lns = dbuf;
+
+		if ((nsid != 1) && (nsid != 0xFFFFFFFF)) {
+			return EMU_SC_INVALID_NS;
+		}
+
+		idns->nsze = ns->nlb;
+		idns->ncap = ns->zoned ? ns->nzones * ns->zcap : ns->nlb;
+		idns->nuse = idns->ncap;
+		idns->nlbaf = 0;
+		idns->flbas.format = 0;
+		idns->lbaf[0].ds = ns->lbads;
+
+		lns->mssrl = _emu_mssrl(ns);
+		lns->mcl = lns->mssrl * (XNVME_BE_EMU_MSRC + 1);
+		lns->msrc = XNVME_BE_EMU_MSRC;
+		return 0;
+	}
+
+	case XNVME_SPEC_IDFY_NS_IOCS:
+		if (nsid != 1) {
+			return EMU_SC_INVALID_NS;
+		}
+
+		switch (cmd->idfy.csi) {
+		case XNVME_SPEC_CSI_LBLK:
+			return 0;
+
+		case XNVME_SPEC_CSI_ZONED: {
+			struct znd_idfy_ns *zns = dbuf;
+
+			if (!ns->zoned) {
+				break;
+			}
+			zns->mar = ns->mar ? ns->mar - 1 : 0xFFFFFFFF;
+			zns->mor = ns->mor ? ns->mor - 1 : 0xFFFFFFFF;
+			zns->lbafe[0].zsze = ns->zsze;
+			return 0;
+		}
+		}
+		break;
+
+	case XNVME_SPEC_IDFY_CTRLR_IOCS:
+		switch (cmd->idfy.csi) {
+		case XNVME_SPEC_CSI_LBLK:
+			return 0;
+
+		case XNVME_SPEC_CSI_ZONED:
+			if (!ns->zoned) {
+				break;
+			}
+			((struct znd_idfy_ctrlr *)dbuf)->zasl = 0;
+			return 0;
+		}
+		break;
+	}
+
+	return EMU_SC_INVALID_FIELD;
+}
+
+static int
+_emu_gfeat(struct xnvme_spec_cmd *cmd, struct xnvme_spec_cpl *cpl)
+{
+	struct xnvme_spec_feat feat = { .val = 0 };
+
+	switch (cmd->gfeat.fid) {
+	case XNVME_SPEC_FEAT_NQUEUES:
+		feat.nqueues.nsqa = XNVME_BE_EMU_NQUEUES - 1;
+		feat.nqueues.ncqa = XNVME_BE_EMU_NQUEUES - 1;
+		break;
+
+	default:
+		return EMU_SC_INVALID_FIELD;
+	}
+	cpl->cdw0 = feat.val;
+
+	return 0;
+}
+
+static inline void
+_emu_u128(uint8_t *dst, uint64_t val)
+{
+	memcpy(dst, &val, sizeof(val));
+}
+
+static int
+_emu_log(struct xnvme_be_emu_ns *ns, struct xnvme_spec_cmd *cmd, void *dbuf,
+	 size_t dbuf_nbytes)
+{
+	const uint64_t lpo = ((uint64_t)cmd->log.lpou << 32) | cmd->log.lpol;
+	const uint64_t numd = (((uint64_t)cmd->log.numdu << 16) | \
+			       cmd->log.numdl) + 1;
+	union {
+		struct xnvme_spec_log_health_entry health;
+		uint8_t buf[4096];
+	} page = { 0 };
+	size_t page_nbytes;
+
+	switch (cmd->log.lid) {
+	case XNVME_SPEC_LOG_ERRI:
+		page_nbytes = sizeof(struct xnvme_spec_log_erri_entry);
+		break;
+
+	case XNVME_SPEC_LOG_HEALTH: {
+		const uint64_t nbytes_read = atomic_load(&ns->nbytes_read);
+		const uint64_t nbytes_written = atomic_load(&ns->nbytes_written);
+
+		page.health.comp_temp = 273 + 35;
+		page.health.avail_spare = 100;
+		page.health.avail_spare_thresh = 10;
+
+		// Data units are thousands of 512 byte units, rounded up
+		_emu_u128(page.health.data_units_read,
+			  (nbytes_read + 511999) / 512000);
+		_emu_u128(page.health.data_units_written,
+			  (nbytes_written + 511999) / 512000);
+		_emu_u128(page.health.host_read_cmds,
+			  atomic_load(&ns->ncmds_read));
+		_emu_u128(page.health.host_write_cmds,
+			  atomic_load(&ns->ncmds_written));
+		_emu_u128(page.health.pwr_cycles, 1);
+
+		page_nbytes = sizeof(page.health);
+		break;
+	}
+
+	case ZND_CMD_LOG_CHANGES:
+		if (!ns->zoned) {
+			return EMU_SC_INVALID_FIELD;
+		}
+		page_nbytes = sizeof(struct znd_changes);
+		break;
+
+	default:
+		return EMU_SC_INVALID_FIELD;
+	}
+
+	if (lpo >= page_nbytes) {
+		return EMU_SC_INVALID_FIELD;
+	}
+	if (!dbuf) {
+		XNVME_DEBUG("FAILED: !dbuf");
+		return -EINVAL;
+	}
+
+	memcpy(dbuf, page.buf + lpo, XNVME_MIN(XNVME_MIN(numd * 4, dbuf_nbytes),
+					       page_nbytes - lpo));
+
+	return 0;
+}
+
+/**
+ * Transfer the completion of an executed command to the request
+ *
+ * @return 0 on success, the non-zero status of the command on failure
+ */
+static inline int
+_emu_cpl(struct xnvme_req *req, const struct xnvme_spec_cpl *cpl)
+{
+	const int sc = EMU_SC(cpl->status.sct, cpl->status.sc);
+
+	if (req) {
+		req->cpl.result = cpl->result;
+		req->cpl.status = cpl->status;
+	}
+	if (sc) {
+		XNVME_DEBUG("INFO: sct: 0x%x, sc: 0x%x", cpl->status.sct,
+			    cpl->status.sc);
+	}
+
+	return sc;
+}
+
+int
+xnvme_be_emu_sync_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+			 void *dbuf, size_t dbuf_nbytes,
+			 void *XNVME_UNUSED(mbuf),
+			 size_t XNVME_UNUSED(mbuf_nbytes),
+			 int XNVME_UNUSED(opts), struct xnvme_req *req)
+{
+	static __thread uint64_t rnd;
+	struct xnvme_be_emu_ns *ns = _emu_ns(dev);
+	const uint64_t now = _xnvme_timer_clock_sample();
+	struct xnvme_spec_cpl cpl = { 0 };
+	uint64_t lat;
+	size_t nbytes;
+	int err;
+
+	err = _emu_cmd_exec(ns, cmd, dbuf, dbuf_nbytes, &cpl, &nbytes);
+	if (err) {
+		XNVME_DEBUG("FAILED: _emu_cmd_exec(), err: %d", err);
+		return err;
+	}
+
+	rnd = rnd ? rnd : _emu_rand_seed(&rnd);
+	lat = _emu_lat_nsec(&ns->lat[cmd->common.opcode], &rnd, nbytes);
+	if (lat) {
+		const uint64_t due = now + lat;
+		struct timespec ts = {
+			.tv_sec = due / NSEC_PER_SEC,
+			.tv_nsec = due % NSEC_PER_SEC
+		};
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+				       NULL) == EINTR);
+	}
+
+	return _emu_cpl(req, &cpl);
+}
+
+int
+xnvme_be_emu_sync_cmd_admin(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+			    void *dbuf, size_t dbuf_nbytes,
+			    void *XNVME_UNUSED(mbuf),
+			    size_t XNVME_UNUSED(mbuf_nbytes),
+			    int XNVME_UNUSED(opts), struct xnvme_req *req)
+{
+	struct xnvme_be_emu_ns *ns = _emu_ns(dev);
+	struct xnvme_spec_cpl cpl = { 0 };
+	int err;
+
+	switch (cmd->common.opcode) {
+	case XNVME_SPEC_OPC_IDFY:
+		err = _emu_idfy(ns, cmd, dbuf, dbuf_nbytes);
+		break;
+
+	case XNVME_SPEC_OPC_LOG:
+		err = _emu_log(ns, cmd, dbuf, dbuf_nbytes);
+		break;
+
+	case XNVME_SPEC_OPC_GFEAT:
+		err = _emu_gfeat(cmd, &cpl);
+		break;
+
+	default:
+		XNVME_DEBUG("INFO: unsupported opcode: 0x%x",
+			    cmd->common.opcode);
+		err = EMU_SC_INVALID_OPCODE;
+		break;
+	}
+	if (err < 0) {
+		XNVME_DEBUG("FAILED: admin opcode: 0x%x, err: %d",
+			    cmd->common.opcode, err);
+		return err;
+	}
+	cpl.status.sct = err >> 8;
+	cpl.status.sc = err & 0xFF;
+
+	return _emu_cpl(req, &cpl);
+}
+
+int
+xnvme_be_emu_supported(struct xnvme_dev *XNVME_UNUSED(dev),
+		       uint32_t XNVME_UNUSED(opts))
+{
+	return 1;
+}
+
+int
+xnvme_be_emu_async_init(struct xnvme_dev *dev, struct xnvme_async_ctx **ctx,
+			uint16_t depth, int XNVME_UNUSED(flags))
+{
+	struct xnvme_be_emu_ns *ns = _emu_ns(dev);
+	struct xnvme_async_ctx_emu *actx;
+	struct xnvme_be_emu_wheel *wheel;
+
+	*ctx = calloc(1, sizeof(**ctx));
+	if (!*ctx) {
+		XNVME_DEBUG("FAILED: calloc(ctx), errno: %s", strerror(errno));
+		return -errno;
+	}
+	actx = (void *)*ctx;
+	actx->depth = depth;
+
+	wheel = calloc(1, sizeof(*wheel) + depth * sizeof(*wheel->elm));
+	if (!wheel) {
+		XNVME_DEBUG("FAILED: calloc(wheel), errno: %s",
+			    strerror(errno));
+		free(*ctx);
+		*ctx = NULL;
+		return -errno;
+	}
+	wheel->tick_nsec = ns->tick_nsec;
+	wheel->cur = _xnvme_timer_clock_sample() / wheel->tick_nsec;
+
+	SLIST_INIT(&wheel->pool);
+	for (uint32_t i = 0; i < XNVME_BE_EMU_WHEEL_NSLOTS; ++i) {
+		SLIST_INIT(&wheel->slots[i]);
+	}
+	for (uint32_t i = 0; i < depth; ++i) {
+		SLIST_INSERT_HEAD(&wheel->pool, &wheel->elm[i], link);
+	}
+
+	actx->wheel = wheel;
+	actx->rnd = _emu_rand_seed(actx);
+
+	return 0;
+}
+
+int
+xnvme_be_emu_async_term(struct xnvme_dev *XNVME_UNUSED(dev),
+			struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_async_ctx_emu *actx = (void *)ctx;
+
+	if (!ctx) {
+		XNVME_DEBUG("FAILED: ctx: %p", (void *)ctx);
+		return -EINVAL;
+	}
+
+	free(actx->wheel);
+	free(ctx);
+
+	return 0;
+}
+
+/**
+ * Move the entries of the slot which are due by 'now' onto 'expired'
+ */
+static void
+_emu_wheel_expire(struct xnvme_be_emu_slot *slot, uint64_t now,
+		  struct xnvme_be_emu_slot *expired)
+{
+	struct xnvme_be_emu_entry *entry = SLIST_FIRST(slot);
+
+	SLIST_INIT(slot);
+	while (entry) {
+		struct xnvme_be_emu_entry *next = SLIST_NEXT(entry, link);
+
+		if (entry->due <= now) {
+			SLIST_INSERT_HEAD(expired, entry, link);
+		} else {
+			SLIST_INSERT_HEAD(slot, entry, link);
+		}
+		entry = next;
+	}
+}
+
+int
+xnvme_be_emu_async_poke(struct xnvme_dev *XNVME_UNUSED(dev),
+			struct xnvme_async_ctx *ctx, uint32_t max)
+{
+	struct xnvme_async_ctx_emu *actx = (void *)ctx;
+	struct xnvme_be_emu_wheel *wheel = actx->wheel;
+	uint64_t now, tick, nticks, i;
+	unsigned completed = 0;
+
+	max = max ? max : actx->outstanding;
+	max = max > actx->outstanding ? actx->outstanding : max;
+	if (!max) {
+		return 0;
+	}
+
+	now = _xnvme_timer_clock_sample();
+	tick = now / wheel->tick_nsec;
+	nticks = tick - wheel->cur + 1;
+	nticks = nticks > XNVME_BE_EMU_WHEEL_NSLOTS ? \
+		 XNVME_BE_EMU_WHEEL_NSLOTS : nticks;
+
+	for (i = 0; (i < nticks) && (completed < max); ++i) {
+		struct xnvme_be_emu_slot *slot;
+		struct xnvme_be_emu_slot expired;
+		struct xnvme_be_emu_entry *entry;
+
+		slot = &wheel->slots[(wheel->cur + i) % XNVME_BE_EMU_WHEEL_NSLOTS];
+
+		SLIST_INIT(&expired);
+		_emu_wheel_expire(slot, now, &expired);
+
+		while ((entry = SLIST_FIRST(&expired))) {
+			struct xnvme_req *req = entry->req;
+
+			SLIST_REMOVE_HEAD(&expired, link);
+			if (completed == max) {
+				SLIST_INSERT_HEAD(slot, entry, link);
+				continue;
+			}
+
+			// Release the entry before the callback, it may submit
+			SLIST_INSERT_HEAD(&wheel->pool, entry, link);
+			actx->outstanding -= 1;
+
+			req->async.cb(req, req->async.cb_arg);
+
+			++completed;
+		}
+	}
+
+	// Slots left unvisited, or with entries left due, are visited again
+	wheel->cur = completed == max ? wheel->cur + i - 1 : tick;
+
+	return completed;
+}
+
+int
+xnvme_be_emu_async_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
+{
+	int acc = 0;
+
+	while (ctx->outstanding) {
+		int err;
+
+		err = xnvme_be_emu_async_poke(dev, ctx, 0);
+		if (err >= 0) {
+			acc += err;
+			continue;
+		}
+
+		return err;
+	}
+
+	return acc;
+}
+
+int
+xnvme_be_emu_async_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+			  void *dbuf, size_t dbuf_nbytes,
+			  void *XNVME_UNUSED(mbuf),
+			  size_t XNVME_UNUSED(mbuf_nbytes),
+			  int XNVME_UNUSED(opts), struct xnvme_req *req)
+{
+	struct xnvme_be_emu_ns *ns = _emu_ns(dev);
+	struct xnvme_async_ctx_emu *actx = (void *)req->async.ctx;
+	struct xnvme_be_emu_wheel *wheel = actx->wheel;
+	struct xnvme_spec_cpl cpl = { 0 };
+	struct xnvme_be_emu_entry *entry;
+	uint64_t now;
+	size_t nbytes;
+	int err;
+
+	if (actx->outstanding == actx->depth) {
+		XNVME_DEBUG("FAILED: queue is full");
+		return -EBUSY;
+	}
+
+	now = _xnvme_timer_clock_sample();
+	err = _emu_cmd_exec(ns, cmd, dbuf, dbuf_nbytes, &cpl, &nbytes);
+	if (err) {
+		XNVME_DEBUG("FAILED: _emu_cmd_exec(), err: %d", err);
+		return err;
+	}
+	_emu_cpl(req, &cpl);
+
+	entry = SLIST_FIRST(&wheel->pool);
+	SLIST_REMOVE_HEAD(&wheel->pool, link);
+
+	entry->req = req;
+	entry->due = now + _emu_lat_nsec(&ns->lat[cmd->common.opcode],
+					 &actx->rnd, nbytes);
+
+	SLIST_INSERT_HEAD(&wheel->slots[(entry->due / wheel->tick_nsec) % \
+					XNVME_BE_EMU_WHEEL_NSLOTS],
+			  entry, link);
+	actx->outstanding += 1;
+
+	return 0;
+}
+
+static int
+_emu_ns_map(struct xnvme_be_emu_ns *ns, size_t nbytes)
+{
+	const int prot = PROT_READ | PROT_WRITE;
+	const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+#ifdef MAP_HUGETLB
+	// Without MAP_NORESERVE, such that a short hugepage pool fails here
+	ns->data_nbytes = EMU_ALIGN_UP(nbytes, EMU_HUGEPAGE_NBYTES);
+	ns->data = mmap(NULL, ns->data_nbytes, prot, flags | MAP_HUGETLB, -1, 0);
+	if (ns->data != MAP_FAILED) {
+		ns->page_nbytes = EMU_HUGEPAGE_NBYTES;
+		return 0;
+	}
+	XNVME_DEBUG("INFO: no hugepages, errno: %d", errno);
+#endif
+
+	ns->page_nbytes = getpagesize();
+	ns->data_nbytes = EMU_ALIGN_UP(nbytes, ns->page_nbytes);
+	ns->data = mmap(NULL, ns->data_nbytes, prot, flags | MAP_NORESERVE, -1,
+			0);
+	if (ns->data == MAP_FAILED) {
+		XNVME_DEBUG("FAILED: mmap(), errno: %d", errno);
+		ns->data = NULL;
+		return -errno;
+	}
+#ifdef MADV_HUGEPAGE
+	madvise(ns->data, ns->data_nbytes, MADV_HUGEPAGE);
+#endif
+
+	return 0;
+}
+
+static void
+_emu_ns_free(struct xnvme_be_emu_ns *ns)
+{
+	if (!ns) {
+		return;
+	}
+
+	if (ns->data) {
+		munmap(ns->data, ns->data_nbytes);
+	}
+	if (ns->zones) {
+		pthread_mutex_destroy(&ns->zlock);
+		free(ns->zones);
+	}
+	free(ns);
+}
+
+/**
+ * Setup the latency models from the uri-options, base latencies are given in
+ * usec, bandwidth in MiB/s and the lognormal shape in thousandths; the model of
+ * each opcode is that of its class, unless given by the options of the opcode
+ */
+static void
+_emu_ns_lat_init(struct xnvme_be_emu_ns *ns, const struct xnvme_ident *ident)
+{
+	const char *lat_opts[XNVME_BE_EMU_NOPCLASS] = {"rlat", "wlat", "olat"};
+	struct xnvme_be_emu_lat models[XNVME_BE_EMU_NOPCLASS] = { 0 };
+	uint64_t val;
+
+	for (int i = 0; i < XNVME_BE_EMU_NOPCLASS; ++i) {
+		struct xnvme_be_emu_lat *lat = &models[i];
+
+		if (xnvme_ident_opt_to_u64(ident, lat_opts[i], &val) || \
+		    xnvme_ident_opt_to_u64(ident, "lat", &val)) {
+			lat->nsec = val * 1000;
+		}
+		if (xnvme_ident_opt_to_u64(ident, "sigma", &val)) {
+			lat->sigma = val / 1000.0;
+		}
+		if ((i != XNVME_BE_EMU_OPCLASS_OTHER) && \
+		    xnvme_ident_opt_to_u64(ident, "bw", &val)) {
+			lat->bps = val << 20;
+		}
+	}
+
+	for (int opc = 0; opc < XNVME_BE_EMU_NOPCODES; ++opc) {
+		struct xnvme_be_emu_lat *lat = &ns->lat[opc];
+		char opt[8];
+
+		*lat = models[_emu_opclass(opc)];
+
+		snprintf(opt, sizeof(opt), "lat_%02x", opc);
+		if (xnvme_ident_opt_to_u64(ident, opt, &val)) {
+			lat->nsec = val * 1000;
+		}
+		snprintf(opt, sizeof(opt), "bw_%02x", opc);
+		if (xnvme_ident_opt_to_u64(ident, opt, &val)) {
+			lat->bps = val << 20;
+		}
+	}
+
+	ns->tick_nsec = XNVME_BE_EMU_WHEEL_TICK_NSEC_DEF;
+	if (xnvme_ident_opt_to_u64(ident, "tick", &val) && val) {
+		ns->tick_nsec = val;
+	}
+}
+
+static int
+_emu_ns_zones_init(struct xnvme_be_emu_ns *ns, const struct xnvme_ident *ident)
+{
+	uint64_t val;
+	int err;
+
+	ns->zsze = ((uint64_t)XNVME_BE_EMU_ZSZE_MB_DEF << 20) >> ns->lbads;
+	if (xnvme_ident_opt_to_u64(ident, "zsze", &val)) {
+		ns->zsze = val;
+	}
+	ns->zcap = ns->zsze;
+	if (xnvme_ident_opt_to_u64(ident, "zcap", &val)) {
+		ns->zcap = val;
+	}
+	if (xnvme_ident_opt_to_u64(ident, "mar", &val)) {
+		ns->mar = val;
+	}
+	if (xnvme_ident_opt_to_u64(ident, "mor", &val)) {
+		ns->mor = val;
+	}
+
+	if (!ns->zsze || (ns->zsze > ns->nlb) || !ns->zcap || \
+	    (ns->zcap > ns->zsze)) {
+		XNVME_DEBUG("FAILED: nlb: %zu, zsze: %zu, zcap: %zu", ns->nlb,
+			    ns->zsze, ns->zcap);
+		return -EINVAL;
+	}
+	if (ns->mar && ns->mor > ns->mar) {
+		XNVME_DEBUG("FAILED: mor: %u > mar: %u", ns->mor, ns->mar);
+		return -EINVAL;
+	}
+
+	ns->nzones = ns->nlb / ns->zsze;
+	ns->nlb = ns->nzones * ns->zsze;
+
+	ns->zones = calloc(ns->nzones, sizeof(*ns->zones));
+	if (!ns->zones) {
+		XNVME_DEBUG("FAILED: calloc(zones), errno: %d", errno);
+		return -errno;
+	}
+	for (uint64_t zidx = 0; zidx < ns->nzones; ++zidx) {
+		ns->zones[zidx].zs = ZND_STATE_EMPTY;
+		ns->zones[zidx].wp = zidx * ns->zsze;
+	}
+
+	err = pthread_mutex_init(&ns->zlock, NULL);
+	if (err) {
+		XNVME_DEBUG("FAILED: pthread_mutex_init(), err: %d", err);
+		free(ns->zones);
+		ns->zones = NULL;
+		return -err;
+	}
+
+	return 0;
+}
+
+/**
+ * Setup the emulated namespace from the uri-options:
+ *
+ * size=MiB, lbads=9..16, zoned=1, zsze=nlb, zcap=nlb, mar=nzones, mor=nzones,
+ * lat=usec, rlat=usec, wlat=usec, olat=usec, sigma=thousandths, bw=MiB/s,
+ * lat_<opcode>=usec, bw_<opcode>=MiB/s and tick=nsec
+ */
+int
+xnvme_be_emu_state_init(struct xnvme_dev *dev, void *XNVME_UNUSED(opts))
+{
+	struct xnvme_be_emu_state *state = (void *)dev->be.state;
+	const struct xnvme_ident *ident = &dev->ident;
+	struct xnvme_be_emu_ns *ns;
+	uint64_t size_mb = XNVME_BE_EMU_SIZE_MB_DEF;
+	uint64_t val;
+	int err;
+
+	ns = calloc(1, sizeof(*ns));
+	if (!ns) {
+		XNVME_DEBUG("FAILED: calloc(ns), errno: %d", errno);
+		return -errno;
+	}
+
+	ns->lbads = XNVME_BE_EMU_LBADS_DEF;
+	if (xnvme_ident_opt_to_u64(ident, "lbads", &val)) {
+		ns->lbads = val;
+	}
+	if (xnvme_ident_opt_to_u64(ident, "size", &val)) {
+		size_mb = val;
+	}
+	if ((ns->lbads < 9) || (ns->lbads > 16) || !size_mb) {
+		XNVME_DEBUG("FAILED: lbads: %u, size_mb: %zu", ns->lbads,
+			    size_mb);
+		err = -EINVAL;
+		goto failed;
+	}
+	ns->nlb = (size_mb << 20) >> ns->lbads;
+
+	if (xnvme_ident_opt_to_u64(ident, "zoned", &val) && val) {
+		ns->zoned = 1;
+		err = _emu_ns_zones_init(ns, ident);
+		if (err) {
+			XNVME_DEBUG("FAILED: _emu_ns_zones_init()");
+			goto failed;
+		}
+	}
+
+	_emu_ns_lat_init(ns, ident);
+
+	err = _emu_ns_map(ns, ns->nlb << ns->lbads);
+	if (err) {
+		XNVME_DEBUG("FAILED: _emu_ns_map()");
+		goto failed;
+	}
+
+	atomic_init(&ns->refcount, 1);
+	state->ns = ns;
+
+	return 0;
+
+failed:
+	_emu_ns_free(ns);
+
+	return err;
+}
+
+void
+xnvme_be_emu_state_term(struct xnvme_be_emu_state *state)
+{
+	if (!state) {
+		return;
+	}
+
+	if (state->ns && (atomic_fetch_sub(&state->ns->refcount, 1) == 1)) {
+		_emu_ns_free(state->ns);
+	}
+	state->ns = NULL;
+}
+
+int
+xnvme_be_emu_dev_idfy(struct xnvme_dev *dev)
+{
+	struct xnvme_be_emu_ns *ns = _emu_ns(dev);
+	struct xnvme_spec_idfy *idfy;
+	struct xnvme_req req = { 0 };
+	int err;
+
+	dev->dtype = XNVME_DEV_TYPE_NVME_NAMESPACE;
+	dev->csi = ns->zoned ? XNVME_SPEC_CSI_ZONED : XNVME_SPEC_CSI_LBLK;
+	dev->nsid = 1;
+
+	// The emulated controller is per handle, thus its data is not shared
+	err = xnvme_dev_ctrlr_get(dev, NULL);
+	if (err < 0) {
+		XNVME_DEBUG("FAILED: xnvme_dev_ctrlr_get(), err: %d", err);
+		return err;
+	}
+
+	idfy = xnvme_buf_alloc(dev, sizeof(*idfy), NULL);
+	if (!idfy) {
+		XNVME_DEBUG("FAILED: xnvme_buf_alloc()");
+		return -errno;
+	}
+
+	err = xnvme_cmd_idfy_ctrlr(dev, idfy, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		XNVME_DEBUG("FAILED: identify controller");
+		goto exit;
+	}
+	memcpy(&dev->ctrlr->id, idfy, sizeof(*idfy));
+
+	err = xnvme_cmd_idfy_ns(dev, dev->nsid, idfy, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		XNVME_DEBUG("FAILED: identify namespace");
+		goto exit;
+	}
+	memcpy(&dev->id.ns, idfy, sizeof(*idfy));
+
+	err = xnvme_cmd_idfy_ctrlr_csi(dev, dev->csi, idfy, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		XNVME_DEBUG("FAILED: identify controller, csi: %d", dev->csi);
+		goto exit;
+	}
+	memcpy(&dev->ctrlr->idcss, idfy, sizeof(*idfy));
+
+	err = xnvme_cmd_idfy_ns_csi(dev, dev->nsid, dev->csi, idfy, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		XNVME_DEBUG("FAILED: identify namespace, csi: %d", dev->csi);
+		goto exit;
+	}
+	memcpy(&dev->idcss.ns, idfy, sizeof(*idfy));
+
+exit:
+	xnvme_buf_free(dev, idfy);
+
+	return err ? err : (xnvme_req_cpl_status(&req) ? -EIO : 0);
+}
+
+int
+xnvme_be_emu_dev_from_ident(const struct xnvme_ident *ident,
+			    struct xnvme_dev **dev)
+{
+	int err;
+
+	err = xnvme_dev_alloc(dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_dev_alloc()");
+		return err;
+	}
+	(*dev)->ident = *ident;
+	(*dev)->be = xnvme_be_emu;
+
+	err = xnvme_be_emu_state_init(*dev, NULL);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_emu_state_init()");
+		xnvme_dev_free(*dev);
+		return err;
+	}
+	err = xnvme_be_emu_dev_idfy(*dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_emu_dev_idfy()");
+		xnvme_be_emu_state_term((void *)(*dev)->be.state);
+		xnvme_dev_free(*dev);
+		return err;
+	}
+	err = xnvme_be_dev_derive_geometry(*dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_dev_derive_geometry()");
+		xnvme_be_emu_state_term((void *)(*dev)->be.state);
+		xnvme_dev_free(*dev);
+		return err;
+	}
+
+	return 0;
+}
+
+/**
+ * The duplicate is another handle of the same namespace, thus shares its memory
+ */
+int
+xnvme_be_emu_dev_dup(const struct xnvme_dev *dev, struct xnvme_dev *dup)
+{
+	const struct xnvme_be_emu_state *src = (const void *)dev->be.state;
+	struct xnvme_be_emu_state *state;
+
+	dup->be = xnvme_be_emu;
+
+	state = (void *)dup->be.state;
+	state->ns = src->ns;
+	atomic_fetch_add(&state->ns->refcount, 1);
+
+	return 0;
+}
+
+void
+xnvme_be_emu_dev_close(struct xnvme_dev *dev)
+{
+	if (!dev) {
+		return;
+	}
+
+	xnvme_be_emu_state_term((void *)dev->be.state);
+	memset(&dev->be, 0, sizeof(dev->be));
+}
+
+/**
+ * Emulated devices exist only once opened, thus there is nothing to enumerate
+ */
+int
+xnvme_be_emu_enumerate(struct xnvme_enumeration **XNVME_UNUSED(list),
+		       const char *XNVME_UNUSED(sys_uri),
+		       int XNVME_UNUSED(opts))
+{
+	return 0;
+}
+
+void *
+xnvme_be_emu_buf_alloc(const struct xnvme_dev *XNVME_UNUSED(dev),
+		       size_t nbytes, uint64_t *XNVME_UNUSED(phys))
+{
+	return xnvme_buf_virt_alloc(getpagesize(), nbytes);
+}
+
+void *
+xnvme_be_emu_buf_realloc(const struct xnvme_dev *XNVME_UNUSED(dev),
+			 void *XNVME_UNUSED(buf), size_t XNVME_UNUSED(nbytes),
+			 uint64_t *XNVME_UNUSED(phys))
+{
+	XNVME_DEBUG("FAILED: xnvme_be_emu: does not support realloc");
+	errno = ENOSYS;
+	return NULL;
+}
+
+void
+xnvme_be_emu_buf_free(const struct xnvme_dev *XNVME_UNUSED(dev), void *buf)
+{
+	xnvme_buf_virt_free(buf);
+}
+
+int
+xnvme_be_emu_buf_vtophys(const struct xnvme_dev *XNVME_UNUSED(dev),
+			 void *XNVME_UNUSED(buf), uint64_t *XNVME_UNUSED(phys))
+{
+	XNVME_DEBUG("FAILED: xnvme_be_emu: does not support phys/DMA alloc");
+	return -ENOSYS;
+}
+#endif
+
+static const char *g_schemes[] = {
+	"emu",
+};
+
+struct xnvme_be xnvme_be_emu = {
+#ifdef XNVME_BE_EMU_ENABLED
+	.async = {
+		.cmd_io = xnvme_be_emu_async_cmd_io,
+		.poke = xnvme_be_emu_async_poke,
+		.wait = xnvme_be_emu_async_wait,
+		.init = xnvme_be_emu_async_init,
+		.term = xnvme_be_emu_async_term,
+		.supported = xnvme_be_emu_supported,
+		.cmd_chain = xnvme_be_nosys_async_cmd_chain,
+		.notify = xnvme_be_nosys_async_notify,
+		.bufs_init = xnvme_be_nosys_async_bufs_init,
+		.buf_put = xnvme_be_nosys_async_buf_put,
+		.reap = xnvme_be_nosys_async_reap,
+		.cmd_tmpl = xnvme_be_nosys_async_cmd_tmpl,
+		.cmd_batch = xnvme_be_nosys_async_cmd_batch,
+		.id = "emu",
+		.enabled = 1,
+	},
+	.sync = {
+		.cmd_io = xnvme_be_emu_sync_cmd_io,
+		.cmd_admin = xnvme_be_emu_sync_cmd_admin,
+		.supported = xnvme_be_emu_supported,
+		.id = "emu",
+		.enabled = 1,
+	},
+	.mem = {
+		.buf_alloc = xnvme_be_emu_buf_alloc,
+		.buf_realloc = xnvme_be_emu_buf_realloc,
+		.buf_free = xnvme_be_emu_buf_free,
+		.buf_vtophys = xnvme_be_emu_buf_vtophys,
+	},
+	.dev = {
+		.enumerate = xnvme_be_emu_enumerate,
+		.dev_from_ident = xnvme_be_emu_dev_from_ident,
+		.dev_close = xnvme_be_emu_dev_close,
+		.dev_dup = xnvme_be_emu_dev_dup,
+	},
+#else
+	.async = XNVME_BE_NOSYS_ASYNC,
+	.sync = XNVME_BE_NOSYS_SYNC,
+	.mem = XNVME_BE_NOSYS_MEM,
+	.dev = XNVME_BE_NOSYS_DEV,
+#endif
+	.attr = {
+		.name = "emu",
+#ifdef XNVME_BE_EMU_ENABLED
+		.enabled = 1,
+#else
+		.enabled = 0,
+#endif
+		.schemes = g_schemes,
+		.nschemes = sizeof g_schemes / sizeof(*g_schemes),
+	},
+	.state = { 0 },
+};
@@ -72,30 +72,45 @@ xnvme_be_fbsd_state_init(struct xnvme_dev *dev, void *XNVME_UNUSED(opts))
 int
 xnvme_be_fbsd_dev_idfy(struct xnvme_dev *dev)
 {
-	struct xnvme_be_fbsd_state *state = (void *)dev->be.state;
 	struct xnvme_spec_idfy *idfy = NULL;
 	struct xnvme_req req = { 0 };
+	char key[XNVME_IDENT_TRGT_LEN] = { 0 };
+	char *ns;
+	int shared;
 	int err;
 
 	dev->dtype = XNVME_DEV_TYPE_NVME_NAMESPACE;
 
+	// The controller of e.g. '/dev/nvme0ns1' is '/dev/nvme0'
+	strncpy(key, dev->ident.trgt, sizeof(key) - 1);
+	ns = strstr(key, "ns");
+	if (ns) {
+		*ns = '\0';
+	}
+
+	shared = xnvme_dev_ctrlr_get(dev, key);
+	if (shared < 0) {
+		XNVME_DEBUG("FAILED: xnvme_dev_ctrlr_get(), err: %d", shared);
+		return shared;
+	}
+
 	idfy = xnvme_buf_alloc(dev, sizeof(*idfy), NULL);
 	if (!idfy) {
 		XNVME_DEBUG("FAILED: failed allocing buffer");
 		return -errno;
 	}
 
-	memset(idfy, 0, sizeof(*idfy));
-	memset(&req, 0, sizeof(req));
-	err = xnvme_cmd_idfy_ctrlr(dev, idfy, &req);
-	if (err || xnvme_req_cpl_status(&req)) {
-		XNVME_DEBUG("FAILED: identify controller");
-		xnvme_buf_free(dev, idfy);
-		xnvme_be_fbsd_state_term(state);
-		free(dev);
-		return err;
+	if (!shared) {
+		memset(idfy, 0, sizeof(*idfy));
+		memset(&req, 0, sizeof(req));
+		err = xnvme_cmd_idfy_ctrlr(dev, idfy, &req);
+		if (err || xnvme_req_cpl_status(&req)) {
+			XNVME_DEBUG("FAILED: identify controller");
+			xnvme_buf_free(dev, idfy);
+			return err ? err : -EIO;
+		}
+		memcpy(&dev->ctrlr->id, idfy, sizeof(*idfy));
 	}
-	memcpy(&dev->id.ctrlr, idfy, sizeof(*idfy));
 
 	{
 		int ioctl_nsid = dev->nsid ? dev->nsid : 1;
@@ -106,15 +121,17 @@ xnvme_be_fbsd_dev_idfy(struct xnvme_dev *dev)
 		if (err || xnvme_req_cpl_status(&req)) {
 			XNVME_DEBUG("FAILED: identify namespace, err: %d", err);
 			xnvme_buf_free(dev, idfy);
-			xnvme_be_fbsd_state_term(state);
-			free(dev);
-			return err;
+			return err ? err : -EIO;
 		}
 		memcpy(&dev->id.ns, idfy, sizeof(*idfy));
 	}
 
 	xnvme_buf_free(dev, idfy);
 
+	if (!shared) {
+		xnvme_dev_ctrlr_share(dev, key);
+	}
+
 	return 0;
 }
 
@@ -164,21 +181,38 @@ xnvme_be_fbsd_dev_from_ident(const struct xnvme_ident *ident,
 	err = xnvme_be_fbsd_state_init(*dev, NULL);
 	if (err) {
 		XNVME_DEBUG("FAILED: xnvme_be_fbsd_state_init()");
-		free(*dev);
+		xnvme_dev_free(*dev);
 		return err;
 	}
 	err = xnvme_be_fbsd_dev_idfy(*dev);
 	if (err) {
 		XNVME_DEBUG("FAILED: xnvme_be_fbsd_dev_idfy()");
 		xnvme_be_fbsd_state_term((void *)(*dev)->be.state);
-		free(*dev);
+		xnvme_dev_free(*dev);
 		return err;
 	}
 	err = xnvme_be_dev_derive_geometry(*dev);
 	if (err) {
 		XNVME_DEBUG("FAILED: xnvme_be_dev_derive_geometry()");
 		xnvme_be_fbsd_state_term((void *)(*dev)->be.state);
-		free(*dev);
+		xnvme_dev_free(*dev);
+		return err;
+	}
+
+	return 0;
+}
+
+int
+xnvme_be_fbsd_dev_dup(const struct xnvme_dev *XNVME_UNUSED(dev),
+		      struct xnvme_dev *dup)
+{
+	int err;
+
+	dup->be = xnvme_be_fbsd;
+
+	err = xnvme_be_fbsd_state_init(dup, NULL);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_fbsd_state_init()");
 		return err;
 	}
 
@@ -186,11 +220,15 @@ xnvme_be_fbsd_dev_from_ident(const struct xnvme_ident *ident,
 }
 
 int
-xnvme_be_fbsd_enumerate(struct xnvme_enumeration *list, const char *sys_uri,
+xnvme_be_fbsd_enumerate(struct xnvme_enumeration **list, const char *sys_uri,
 			int XNVME_UNUSED(opts))
 {
+	struct xnvme_ident *idents = NULL;
 	struct dirent **dent = NULL;
+	uint8_t *probed = NULL;
+	uint32_t nidents = 0;
 	int ndev = 0;
+	int err = 0;
 
 	if (sys_uri) {
 		XNVME_DEBUG("FAILED: sys_uri: %s is not supported", sys_uri);
@@ -198,37 +236,60 @@ xnvme_be_fbsd_enumerate(struct xnvme_enumeration *list, const char *sys_uri,
 	}
 
 	ndev = scandir(_PATH_DEV, &dent, _nvme_filter, alphasort);
+	if (ndev <= 0) {
+		free(dent);
+		return 0;
+	}
+
+	idents = calloc(ndev, sizeof(*idents));
+	probed = calloc(ndev, sizeof(*probed));
+	if (!(idents && probed)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		err = -ENOMEM;
+		goto exit;
+	}
 
 	for (int di = 0; di < ndev; ++di) {
 		char uri[XNVME_IDENT_URI_LEN] = { 0 };
-		struct xnvme_ident ident = { 0 };
-		struct xnvme_dev *dev;
 
 		snprintf(uri, XNVME_IDENT_URI_LEN - 1,
 			 XNVME_BE_FBSD_NAME ":" _PATH_DEV "%s",
 			 dent[di]->d_name);
-		if (xnvme_ident_from_uri(uri, &ident)) {
+		if (xnvme_ident_from_uri(uri, &idents[nidents])) {
 			XNVME_DEBUG("uri: '%s'", uri);
 			continue;
 		}
-		if (xnvme_be_fbsd_dev_from_ident(&ident, &dev)) {
-			XNVME_DEBUG("FAILED: xnvme_be_fbsd_dev_from_ident()");
+		nidents += 1;
+	}
+
+	err = xnvme_be_enumerate_probe(&xnvme_be_fbsd, idents, nidents,
+				       probed);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_enumerate_probe(), err: %d", err);
+		goto exit;
+	}
+
+	for (uint32_t i = 0; i < nidents; ++i) {
+		if (!probed[i]) {
 			continue;
 		}
-		xnvme_be_fbsd_dev_close(dev);
-		free(dev);
 
-		if (xnvme_enumeration_append(list, &ident)) {
+		err = xnvme_enumeration_append(list, &idents[i]);
+		if (err) {
 			XNVME_DEBUG("FAILED: adding ident");
+			goto exit;
 		}
 	}
 
+exit:
 	for (int di = 0; di < ndev; ++di) {
 		free(dent[di]);
 	}
 	free(dent);
+	free(probed);
+	free(idents);
 
-	return 0;
+	return err;
 }
 
 void *
@@ -282,6 +343,7 @@ struct xnvme_be xnvme_be_fbsd = {
 		.enumerate = xnvme_be_fbsd_enumerate,
 		.dev_from_ident = xnvme_be_fbsd_dev_from_ident,
 		.dev_close = xnvme_be_fbsd_dev_close,
+		.dev_dup = xnvme_be_fbsd_dev_dup,
 	},
 #else
 	.mem = XNVME_BE_NOSYS_MEM,
@@ -12,6 +12,7 @@
 
 #define XNVME_BE_LINUX_SCHM "file"
 #define XNVME_BE_LINUX_NAME "linux"
+#define XNVME_BE_LINUX_ENUM_CACHE_ENV "XNVME_ENUMERATE_CACHE"
 
 #ifdef XNVME_BE_LINUX_ENABLED
 #include <fcntl.h>
@@ -21,22 +22,32 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <dirent.h>
+#include <limits.h>
 #include <string.h>
+#include <sched.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
+#include <linux/mempolicy.h>
 
 #include <xnvme_be_linux.h>
 #include <xnvme_be_linux_nvme.h>
 
 #include <xnvme_dev.h>
+#include <xnvme_async_probe.h>
 #include <libznd.h>
 
 extern struct xnvme_be_sync g_linux_nvme;
 extern struct xnvme_be_sync g_linux_block;
+extern struct xnvme_be_sync g_linux_block_iou;
+extern struct xnvme_be_sync g_linux_block_hipri;
 
+// Engines following 'block_ioctl' are only used when chosen via '?sync=<id>'
 static struct xnvme_be_sync *g_linux_sync[] = {
 	&g_linux_nvme,
 	&g_linux_block,
+	&g_linux_block_iou,
+	&g_linux_block_hipri,
 	NULL
 };
 static int
@@ -139,14 +150,111 @@ xnvme_be_linux_sysfs_dev_attr_to_num(struct xnvme_dev *dev, const char *attr,
 	return 0;
 }
 
+int
+xnvme_be_linux_numa_cpus(int node, cpu_set_t *cpus)
+{
+	char path[PATH_MAX], buf[0x1000], *tok, *save = NULL;
+	int err;
+
+	if (node < 0) {
+		XNVME_DEBUG("FAILED: node: %d", node);
+		return -EINVAL;
+	}
+
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+		 node);
+	err = _sysfs_path_to_buf(path, buf, sizeof(buf) - 1);
+	if (err) {
+		XNVME_DEBUG("FAILED: _sysfs_path_to_buf(%s), err: %d", path, err);
+		return err;
+	}
+
+	// The list is of ranges, e.g. '0-7,16-23', or of single CPUs
+	CPU_ZERO(cpus);
+	for (tok = strtok_r(buf, ",\n", &save); tok;
+	     tok = strtok_r(NULL, ",\n", &save)) {
+		unsigned int first, last;
+
+		switch (sscanf(tok, "%u-%u", &first, &last)) {
+		case 1:
+			last = first;
+			break;
+		case 2:
+			break;
+		default:
+			continue;
+		}
+		for (unsigned int cpu = first; (cpu <= last) && (cpu < CPU_SETSIZE);
+		     ++cpu) {
+			CPU_SET(cpu, cpus);
+		}
+	}
+
+	return CPU_COUNT(cpus) ? 0 : -ENOENT;
+}
+
+/**
+ * The NUMA node of the device is that of the controller, or, for a namespace of
+ * an NVMe controller, that of the PCIe function backing it
+ */
+static int
+linux_numa_node(struct xnvme_dev *dev)
+{
+	static const char *attrs[] = {
+		"device/numa_node",
+		"device/device/numa_node",
+	};
+
+	for (size_t i = 0; i < sizeof(attrs) / sizeof(*attrs); ++i) {
+		uint64_t val;
+
+		if (xnvme_be_linux_sysfs_dev_attr_to_num(dev, attrs[i], &val)) {
+			continue;
+		}
+		if ((int64_t)val >= LINUX_NUMA_NODES_MAX) {
+			XNVME_DEBUG("INFO: node: %"PRId64" >= max: %d", (int64_t)val,
+				    LINUX_NUMA_NODES_MAX);
+			return -1;
+		}
+
+		return (int)(int64_t)val;
+	}
+
+	return -1;
+}
+
 void *
-xnvme_be_linux_buf_alloc(const struct xnvme_dev *XNVME_UNUSED(dev),
-			 size_t nbytes, uint64_t *XNVME_UNUSED(phys))
+xnvme_be_linux_buf_alloc(const struct xnvme_dev *dev, size_t nbytes,
+			 uint64_t *XNVME_UNUSED(phys))
 {
+	const size_t pagesize = getpagesize();
+	unsigned long nodemask[LINUX_NUMA_NODES_MAX / 64] = { 0 };
+	void *buf;
+
 	// TODO: register buffer when async=iou
 
-	// NOTE: Assign virt to phys?
-	return xnvme_buf_virt_alloc(getpagesize(), nbytes);
+	if ((dev->numa_node < 0) || (dev->numa_node >= LINUX_NUMA_NODES_MAX)) {
+		return xnvme_buf_virt_alloc(pagesize, nbytes);
+	}
+
+	// Round up, such that the buffer does not share pages with others
+	nbytes = ((nbytes + pagesize - 1) / pagesize) * pagesize;
+
+	buf = xnvme_buf_virt_alloc(pagesize, nbytes);
+	if (!buf) {
+		return NULL;
+	}
+
+	// Preferred rather than bound, such that a full node falls back to others
+	// instead of failing at page-fault
+	nodemask[dev->numa_node / 64] = 1UL << (dev->numa_node % 64);
+	if (syscall(SYS_mbind, buf, nbytes, MPOL_PREFERRED, nodemask,
+		    LINUX_NUMA_NODES_MAX + 1, MPOL_MF_MOVE)) {
+		XNVME_DEBUG("INFO: mbind(node: %d), errno: %d", dev->numa_node,
+			    errno);
+	}
+
+	return buf;
 }
 
 void *
@@ -185,6 +293,36 @@ xnvme_be_linux_state_term(struct xnvme_be_linux_state *state)
 	close(state->fd);
 }
 
+/**
+ * Copy the value of the uri-option 'sync' into 'name', not to be confused with
+ * the value of 'async'
+ *
+ * @return true when the identifier has the option, false otherwise
+ */
+static bool
+linux_sync_opt(const struct xnvme_ident *ident, char *name)
+{
+	const char *ofz = ident->opts;
+	size_t len;
+
+	while ((ofz = strstr(ofz, "sync="))) {
+		if ((ofz != ident->opts) && (ofz[-1] == '?' || ofz[-1] == '&')) {
+			break;
+		}
+		ofz += 1;
+	}
+	if (!ofz) {
+		return false;
+	}
+
+	ofz += strlen("sync=");
+	len = strcspn(ofz, "&");
+	memcpy(name, ofz, len);
+	name[len] = '\0';
+
+	return len > 0;
+}
+
 int
 xnvme_be_linux_state_init(struct xnvme_dev *dev, void *XNVME_UNUSED(opts))
 {
@@ -199,6 +337,9 @@ xnvme_be_linux_state_init(struct xnvme_dev *dev, void *XNVME_UNUSED(opts))
 	if (xnvme_ident_opt_to_val(&dev->ident, "poll_sq", &opt_val)) {
 		state->poll_sq = opt_val == 1;
 	}
+	if (xnvme_ident_opt_to_val(&dev->ident, "poll_sync", &opt_val)) {
+		state->poll_sync = opt_val == 1;
+	}
 	// NOTE: Disabling IOPOLL, to avoid lock-up, until fixed
 	if (state->poll_io) {
 		printf("ENOSYS: IORING_SETUP_IOPOLL\n");
@@ -206,6 +347,7 @@ xnvme_be_linux_state_init(struct xnvme_dev *dev, void *XNVME_UNUSED(opts))
 	}
 	XNVME_DEBUG("state->poll_io: %d", state->poll_io);
 	XNVME_DEBUG("state->poll_sq: %d", state->poll_sq);
+	XNVME_DEBUG("state->poll_sync: %d", state->poll_sync);
 
 	state->fd = open(dev->ident.trgt, O_RDWR | O_DIRECT);
 	if (state->fd < 0) {
@@ -222,28 +364,48 @@ xnvme_be_linux_state_init(struct xnvme_dev *dev, void *XNVME_UNUSED(opts))
 		return -ENOTBLK;
 	}
 
-	// Determine sync-engine to use and setup func-pointers
+	// Determine sync-engine to use and setup func-pointers, with
+	// '?sync=<id>' the first engine whose id starts with the given is used
 	{
+		char sname[XNVME_IDENT_OPTS_LEN] = { 0 };
+		uint8_t chosen;
+
+		chosen = linux_sync_opt(&dev->ident, sname);
+
 		for (int i = 0; i < g_linux_sync_count; ++i) {
 			struct xnvme_be_sync *sync = g_linux_sync[i];
 
 			XNVME_DEBUG("id: %s, enabled: %zu", sync->id,
 				    sync->enabled);
 
+			if (chosen && strncmp(sname, sync->id, strlen(sname))) {
+				continue;
+			}
+
 			if (sync->enabled && sync->supported(dev, 0x0)) {
 				dev->be.sync = *sync;
 				XNVME_DEBUG("got: %s", sync->id);
 				break;
 			}
 		}
+
+		if (chosen && strncmp(sname, dev->be.sync.id, strlen(sname))) {
+			XNVME_DEBUG("FAILED: sync: '%s' is not supported", sname);
+			return -ENOSYS;
+		}
 	}
 
-	// Determine async-engine to use and setup the func-pointers
+	// Determine async-engine to use and setup the func-pointers, with
+	// '?async=auto' the first supported is used until the device is probed
 	{
-		char aname[4] = { 0 };
+		char aname[5] = { 0 };
 		uint8_t chosen;
 
-		chosen = sscanf(dev->ident.opts, "?async=%3[a-z]", aname) == 1;
+		chosen = sscanf(dev->ident.opts, "?async=%4[a-z]", aname) == 1;
+		if (chosen && !strcmp(aname, "auto")) {
+			state->async_auto = 1;
+			chosen = 0;
+		}
 
 		for (int i = 0; i < g_linux_async_count; ++i) {
 			struct xnvme_be_async *async = g_linux_async[i];
@@ -270,12 +432,34 @@ xnvme_be_linux_state_init(struct xnvme_dev *dev, void *XNVME_UNUSED(opts))
 	return 0;
 }
 
+/**
+ * Determine the controller of the given namespace, as the path of its device in
+ * sysfs, e.g. '/sys/devices/pci0000:00/0000:00:01.0/nvme/nvme0'
+ */
+static int
+linux_ctrlr_key(const struct xnvme_dev *dev, char *key)
+{
+	const char *name = strrchr(dev->ident.trgt, '/');
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "/sys/block/%s/device",
+		 name ? name + 1 : dev->ident.trgt);
+	if (!realpath(path, key)) {
+		XNVME_DEBUG("INFO: realpath(%s), errno: %d", path, errno);
+		key[0] = '\0';
+		return -errno;
+	}
+
+	return 0;
+}
+
 /**
  * Determine the following:
  *
  * - Determine device-type	(setup: dev->dtype)
  *
- * - Identify controller	(setup: dev->ctrlr)
+ * - Identify controller	(setup: dev->ctrlr), unless shared with another
+ *   handle of a namespace on the same controller
  *
  * - Identify namespace		(setup: dev->ns)
  * - Identify namespace-id	(setup: dev->nsid)
@@ -289,9 +473,11 @@ xnvme_be_linux_dev_idfy(struct xnvme_dev *dev)
 {
 	struct xnvme_spec_idfy *idfy_ctrlr = NULL, *idfy_ns = NULL;
 	struct xnvme_req req = { 0 };
+	char key[PATH_MAX] = { 0 };
+	int shared = 0;
 	int err;
 
-	if (strncmp(dev->be.sync.id, "block_ioctl", 11) == 0) {
+	if (strncmp(dev->be.sync.id, "block_", 6) == 0) {
 		dev->dtype = XNVME_DEV_TYPE_BLOCK_DEVICE;
 		dev->csi = XNVME_SPEC_CSI_LBLK;
 		dev->nsid = 1;
@@ -307,6 +493,14 @@ xnvme_be_linux_dev_idfy(struct xnvme_dev *dev)
 		dev->nsid = err;
 
 		XNVME_DEBUG("INFO: dev->nsid: %d", dev->nsid);
+
+		linux_ctrlr_key(dev, key);
+	}
+
+	shared = xnvme_dev_ctrlr_get(dev, key);
+	if (shared < 0) {
+		XNVME_DEBUG("FAILED: xnvme_dev_ctrlr_get(), err: %d", shared);
+		return shared;
 	}
 
 	// Allocate buffers for idfy
@@ -324,13 +518,16 @@ xnvme_be_linux_dev_idfy(struct xnvme_dev *dev)
 	}
 
 	// Retrieve and store ctrl and ns
-	memset(idfy_ctrlr, 0, sizeof(*idfy_ctrlr));
-	memset(&req, 0, sizeof(req));
-	err = xnvme_cmd_idfy_ctrlr(dev, idfy_ctrlr, &req);
-	if (err || xnvme_req_cpl_status(&req)) {
-		XNVME_DEBUG("FAILED: identify controller");
-		err = err ? err : -EIO;
-		goto exit;
+	if (!shared) {
+		memset(idfy_ctrlr, 0, sizeof(*idfy_ctrlr));
+		memset(&req, 0, sizeof(req));
+		err = xnvme_cmd_idfy_ctrlr(dev, idfy_ctrlr, &req);
+		if (err || xnvme_req_cpl_status(&req)) {
+			XNVME_DEBUG("FAILED: identify controller");
+			err = err ? err : -EIO;
+			goto exit;
+		}
+		memcpy(&dev->ctrlr->id, idfy_ctrlr, sizeof(*idfy_ctrlr));
 	}
 	memset(idfy_ns, 0, sizeof(*idfy_ns));
 	memset(&req, 0, sizeof(req));
@@ -339,7 +536,6 @@ xnvme_be_linux_dev_idfy(struct xnvme_dev *dev)
 		XNVME_DEBUG("FAILED: identify namespace, err: %d", err);
 		goto exit;
 	}
-	memcpy(&dev->id.ctrlr, idfy_ctrlr, sizeof(*idfy_ctrlr));
 	memcpy(&dev->id.ns, idfy_ns, sizeof(*idfy_ns));
 
 	//
@@ -347,17 +543,22 @@ xnvme_be_linux_dev_idfy(struct xnvme_dev *dev)
 	//
 	dev->csi = XNVME_SPEC_CSI_LBLK;		// Assume NVM
 
-	// Attempt to identify Zoned Namespace
+	// Attempt to identify Zoned Namespace, the controller part is stored
+	// when supported, regardless of the namespace, as it is shared
 	{
 		struct znd_idfy_ns *zns = (void *)idfy_ns;
 
-		memset(idfy_ctrlr, 0, sizeof(*idfy_ctrlr));
-		memset(&req, 0, sizeof(req));
-		err = xnvme_cmd_idfy_ctrlr_csi(dev, XNVME_SPEC_CSI_ZONED,
-					       idfy_ctrlr, &req);
-		if (err || xnvme_req_cpl_status(&req)) {
-			XNVME_DEBUG("INFO: !id-ctrlr-zns");
-			goto not_zns;
+		if (!shared) {
+			memset(idfy_ctrlr, 0, sizeof(*idfy_ctrlr));
+			memset(&req, 0, sizeof(req));
+			err = xnvme_cmd_idfy_ctrlr_csi(dev, XNVME_SPEC_CSI_ZONED,
+						       idfy_ctrlr, &req);
+			if (err || xnvme_req_cpl_status(&req)) {
+				XNVME_DEBUG("INFO: !id-ctrlr-zns");
+				goto not_zns;
+			}
+			memcpy(&dev->ctrlr->idcss, idfy_ctrlr,
+			       sizeof(*idfy_ctrlr));
 		}
 
 		memset(idfy_ns, 0, sizeof(*idfy_ns));
@@ -374,7 +575,6 @@ xnvme_be_linux_dev_idfy(struct xnvme_dev *dev)
 			goto not_zns;
 		}
 
-		memcpy(&dev->idcss.ctrlr, idfy_ctrlr, sizeof(*idfy_ctrlr));
 		memcpy(&dev->idcss.ns, idfy_ns, sizeof(*idfy_ns));
 		dev->csi = XNVME_SPEC_CSI_ZONED;
 
@@ -401,9 +601,38 @@ exit:
 	xnvme_buf_free(dev, idfy_ctrlr);
 	xnvme_buf_free(dev, idfy_ns);
 
+	if (!err && !shared) {
+		xnvme_dev_ctrlr_share(dev, key);
+	}
+
 	return err;
 }
 
+/**
+ * Choose the async-engine by a probe of the enabled and supported engines, the
+ * 'nil' engine is left out as it does not do any IO
+ */
+static int
+linux_async_auto(struct xnvme_dev *dev)
+{
+	struct xnvme_be_async *asyncs[XNVME_ASYNC_PROBE_NCANDIDATES];
+	uint32_t nasyncs = 0;
+
+	for (int i = 0; i < g_linux_async_count; ++i) {
+		struct xnvme_be_async *async = g_linux_async[i];
+
+		if (!strcmp(async->id, "nil")) {
+			continue;
+		}
+		if (async->enabled && async->supported(dev, 0x0) && \
+		    (nasyncs < XNVME_ASYNC_PROBE_NCANDIDATES)) {
+			asyncs[nasyncs++] = async;
+		}
+	}
+
+	return xnvme_async_probe(dev, asyncs, nasyncs);
+}
+
 int
 xnvme_be_linux_dev_from_ident(const struct xnvme_ident *ident,
 			      struct xnvme_dev **dev)
@@ -423,21 +652,23 @@ xnvme_be_linux_dev_from_ident(const struct xnvme_ident *ident,
 	err = xnvme_be_linux_state_init(*dev, NULL);
 	if (err) {
 		XNVME_DEBUG("FAILED: xnvme_be_linux_state_init()");
-		free(*dev);
+		xnvme_dev_free(*dev);
 		return err;
 	}
+	(*dev)->numa_node = linux_numa_node(*dev);
+
 	err = xnvme_be_linux_dev_idfy(*dev);
 	if (err) {
 		XNVME_DEBUG("FAILED: xnvme_be_linux_dev_idfy()");
 		xnvme_be_linux_state_term((void *)(*dev)->be.state);
-		free(*dev);
+		xnvme_dev_free(*dev);
 		return err;
 	}
 	err = xnvme_be_dev_derive_geometry(*dev);
 	if (err) {
 		XNVME_DEBUG("FAILED: xnvme_be_dev_derive_geometry()");
 		xnvme_be_linux_state_term((void *)(*dev)->be.state);
-		free(*dev);
+		xnvme_dev_free(*dev);
 		return err;
 	}
 
@@ -446,6 +677,37 @@ xnvme_be_linux_dev_from_ident(const struct xnvme_ident *ident,
 		(*dev)->geo.mdts_nbytes = (*dev)->geo.lba_nbytes * 127;
 	}
 
+	if (((struct xnvme_be_linux_state *)(*dev)->be.state)->async_auto) {
+		err = linux_async_auto(*dev);
+		if (err) {
+			XNVME_DEBUG("INFO: linux_async_auto(), err: %d", err);
+		}
+	}
+
+	return 0;
+}
+
+int
+xnvme_be_linux_dev_dup(const struct xnvme_dev *XNVME_UNUSED(dev),
+		       struct xnvme_dev *dup)
+{
+	int err;
+
+	dup->be = xnvme_be_linux;
+
+	err = xnvme_be_linux_state_init(dup, NULL);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_linux_state_init()");
+		xnvme_be_linux_state_term((void *)dup->be.state);
+		return err;
+	}
+	if (((struct xnvme_be_linux_state *)dup->be.state)->async_auto) {
+		err = linux_async_auto(dup);
+		if (err) {
+			XNVME_DEBUG("INFO: linux_async_auto(), err: %d", err);
+		}
+	}
+
 	return 0;
 }
 
@@ -489,21 +751,194 @@ xnvme_path_nvme_filter(const struct dirent *d)
 	return 0;
 }
 
+/**
+ * What identifies a device node across runs, without identifying it; the serial
+ * number and firmware revision of its controller, and the modification time of
+ * its sysfs entry, which changes when the device is re-attached
+ */
+struct linux_enum_key {
+	char name[64];
+	char sn[64];
+	char fr[32];
+	struct timespec mtime;
+};
+
+static void
+linux_enum_strip(char *buf)
+{
+	size_t len = strlen(buf);
+
+	while (len && ((buf[len - 1] == '\n') || (buf[len - 1] == ' '))) {
+		buf[--len] = '\0';
+	}
+}
+
+static int
+linux_enum_key_read(const char *name, struct linux_enum_key *key)
+{
+	char path[PATH_MAX];
+	struct stat st;
+	int err;
+
+	memset(key, 0, sizeof(*key));
+	snprintf(key->name, sizeof(key->name), "%s", name);
+
+	snprintf(path, sizeof(path), "/sys/block/%s/device/serial", name);
+	err = _sysfs_path_to_buf(path, key->sn, sizeof(key->sn) - 1);
+	if (err) {
+		return err;
+	}
+	snprintf(path, sizeof(path), "/sys/block/%s/device/firmware_rev", name);
+	err = _sysfs_path_to_buf(path, key->fr, sizeof(key->fr) - 1);
+	if (err) {
+		return err;
+	}
+	linux_enum_strip(key->sn);
+	linux_enum_strip(key->fr);
+	if (!strlen(key->sn) || strchr(key->sn, '\t') || strchr(key->fr, '\t')) {
+		return -EINVAL;
+	}
+
+	snprintf(path, sizeof(path), "/sys/block/%s", name);
+	if (stat(path, &st)) {
+		return -errno;
+	}
+	key->mtime = st.st_mtim;
+
+	return 0;
+}
+
+/**
+ * Load the keys of the devices which were enumerated by a previous run, the
+ * cache is a text-file with a line, of tab-separated fields, per device
+ */
+static int
+linux_enum_cache_load(const char *path, struct linux_enum_key **keys,
+		      uint32_t *nkeys)
+{
+	char line[256];
+	uint32_t capacity = 0;
+	FILE *fp;
+
+	*keys = NULL;
+	*nkeys = 0;
+
+	fp = fopen(path, "r");
+	if (!fp) {
+		return -errno;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		struct linux_enum_key key = { 0 };
+		long long sec;
+		long nsec;
+
+		if (sscanf(line, "%63[^\t]\t%63[^\t]\t%31[^\t]\t%lld.%ld", key.name,
+			   key.sn, key.fr, &sec, &nsec) != 5) {
+			XNVME_DEBUG("INFO: skipping line: '%s'", line);
+			continue;
+		}
+		key.mtime.tv_sec = sec;
+		key.mtime.tv_nsec = nsec;
+
+		if (*nkeys == capacity) {
+			struct linux_enum_key *grown;
+
+			capacity = capacity ? capacity * 2 : 64;
+			grown = realloc(*keys, capacity * sizeof(**keys));
+			if (!grown) {
+				free(*keys);
+				*keys = NULL;
+				*nkeys = 0;
+				fclose(fp);
+				return -ENOMEM;
+			}
+			*keys = grown;
+		}
+		(*keys)[(*nkeys)++] = key;
+	}
+
+	fclose(fp);
+
+	return 0;
+}
+
+/**
+ * Store the keys of the devices enumerated, replacing the cache atomically, to
+ * not leave a partial cache behind for concurrent or later runs
+ */
+static int
+linux_enum_cache_save(const char *path, const struct linux_enum_key *keys,
+		      const uint8_t *valid, uint32_t nkeys)
+{
+	char tmp[PATH_MAX];
+	FILE *fp;
+	int err = 0;
+
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+
+	fp = fopen(tmp, "w");
+	if (!fp) {
+		return -errno;
+	}
+	for (uint32_t i = 0; i < nkeys; ++i) {
+		if (!valid[i]) {
+			continue;
+		}
+		fprintf(fp, "%s\t%s\t%s\t%lld.%09ld\n", keys[i].name, keys[i].sn,
+			keys[i].fr, (long long)keys[i].mtime.tv_sec,
+			keys[i].mtime.tv_nsec);
+	}
+	if (fclose(fp) || rename(tmp, path)) {
+		err = -errno;
+		unlink(tmp);
+	}
+
+	return err;
+}
+
+static int
+linux_enum_cache_hit(const struct linux_enum_key *keys, uint32_t nkeys,
+		     const struct linux_enum_key *key)
+{
+	for (uint32_t i = 0; i < nkeys; ++i) {
+		if (strcmp(keys[i].name, key->name) || strcmp(keys[i].sn, key->sn) ||
+		    strcmp(keys[i].fr, key->fr)) {
+			continue;
+		}
+
+		return (keys[i].mtime.tv_sec == key->mtime.tv_sec) &&
+		       (keys[i].mtime.tv_nsec == key->mtime.tv_nsec);
+	}
+
+	return 0;
+}
+
 /**
  * Scanning /sys/class/nvme can give device names, such as "nvme0c65n1", which
  * are linked as virtual devices to the block device. So instead of scanning
  * that dir, then instead /sys/block/ is scanned under the assumption that
  * block-devices with "nvme" in them are NVMe devices with namespaces attached
  *
+ * The devices are identified in parallel, see xnvme_be_enumerate_probe(). When
+ * the environment variable XNVME_ENUMERATE_CACHE gives the path of a cache,
+ * then devices found in it, with unchanged keys, are not identified again
+ *
  * TODO: add enumeration of NS vs CTRLR, actually, replace this with the libnvme
  * topology functions
  */
 int
-xnvme_be_linux_enumerate(struct xnvme_enumeration *list, const char *sys_uri,
+xnvme_be_linux_enumerate(struct xnvme_enumeration **list, const char *sys_uri,
 			 int XNVME_UNUSED(opts))
 {
+	const char *cache = getenv(XNVME_BE_LINUX_ENUM_CACHE_ENV);
+	struct linux_enum_key *cached = NULL, *keys = NULL;
+	struct xnvme_ident *idents = NULL;
+	uint8_t *probed = NULL, *keyed = NULL;
+	uint32_t ncached = 0, nhits = 0, nidents = 0, nkeyed = 0;
 	struct dirent **ns = NULL;
 	int nns = 0;
+	int err = 0;
 
 	if (sys_uri) {
 		XNVME_DEBUG("FAILED: sys_uri: %s is not supported", sys_uri);
@@ -511,36 +946,92 @@ xnvme_be_linux_enumerate(struct xnvme_enumeration *list, const char *sys_uri,
 	}
 
 	nns = scandir("/sys/block", &ns, xnvme_path_nvme_filter, alphasort);
+	if (nns <= 0) {
+		free(ns);
+		return 0;
+	}
+
+	idents = calloc(nns, sizeof(*idents));
+	keys = calloc(nns, sizeof(*keys));
+	probed = calloc(nns, sizeof(*probed));
+	keyed = calloc(nns, sizeof(*keyed));
+	if (!(idents && keys && probed && keyed)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		err = -ENOMEM;
+		goto exit;
+	}
+
+	if (cache && linux_enum_cache_load(cache, &cached, &ncached)) {
+		XNVME_DEBUG("INFO: no cache at: '%s'", cache);
+	}
+
 	for (int ni = 0; ni < nns; ++ni) {
 		char uri[XNVME_IDENT_URI_LEN] = { 0 };
-		struct xnvme_ident ident = { 0 };
-		struct xnvme_dev *dev;
 
 		snprintf(uri, XNVME_IDENT_URI_LEN - 1,
 			 XNVME_BE_LINUX_SCHM ":" _PATH_DEV "%s",
 			 ns[ni]->d_name);
-		if (xnvme_ident_from_uri(uri, &ident)) {
+		if (xnvme_ident_from_uri(uri, &idents[nidents])) {
 			continue;
 		}
 
-		if (xnvme_be_linux_dev_from_ident(&ident, &dev)) {
-			XNVME_DEBUG("FAILED: xnvme_be_linux_dev_from_ident()");
+		if (cache && !linux_enum_key_read(ns[ni]->d_name,
+						  &keys[nidents])) {
+			keyed[nidents] = 1;
+			probed[nidents] = \
+				linux_enum_cache_hit(cached, ncached,
+						     &keys[nidents]) && \
+				!access(idents[nidents].trgt, R_OK | W_OK);
+			nhits += probed[nidents];
+		}
+		nidents += 1;
+	}
+
+	err = xnvme_be_enumerate_probe(&xnvme_be_linux, idents, nidents,
+				       probed);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_enumerate_probe(), err: %d", err);
+		goto exit;
+	}
+
+	for (uint32_t i = 0; i < nidents; ++i) {
+		if (!probed[i]) {
 			continue;
 		}
-		xnvme_be_linux_dev_close(dev);
-		free(dev);
+		nkeyed += keyed[i];
 
-		if (xnvme_enumeration_append(list, &ident)) {
+		err = xnvme_enumeration_append(list, &idents[i]);
+		if (err) {
 			XNVME_DEBUG("FAILED: adding ident");
+			goto exit;
+		}
+	}
+
+	XNVME_DEBUG("INFO: nidents: %u, nkeyed: %u, nhits: %u", nidents,
+		    nkeyed, nhits);
+
+	// Only rewrite the cache when it differs from what was enumerated
+	if (cache && ((nhits != nkeyed) || (ncached != nkeyed))) {
+		for (uint32_t i = 0; i < nidents; ++i) {
+			probed[i] = probed[i] && keyed[i];
+		}
+		if (linux_enum_cache_save(cache, keys, probed, nidents)) {
+			XNVME_DEBUG("FAILED: linux_enum_cache_save(%s)", cache);
 		}
 	}
 
+exit:
 	for (int ni = 0; ni < nns; ++ni) {
 		free(ns[ni]);
 	}
 	free(ns);
+	free(cached);
+	free(keyed);
+	free(probed);
+	free(keys);
+	free(idents);
 
-	return 0;
+	return err;
 }
 #else
 int
@@ -569,6 +1060,7 @@ struct xnvme_be xnvme_be_linux = {
 
 		.dev_from_ident = xnvme_be_linux_dev_from_ident,
 		.dev_close = xnvme_be_linux_dev_close,
+		.dev_dup = xnvme_be_linux_dev_dup,
 	},
 #else
 	.async = XNVME_BE_NOSYS_ASYNC,
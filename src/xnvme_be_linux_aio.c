@@ -23,10 +23,16 @@
 #include <paths.h>
 #include <libaio.h>
 
+// Flag of the Linux aio ABI, telling the kernel that aio_reqprio is an ioprio
+#ifndef IOCB_FLAG_IOPRIO
+#define IOCB_FLAG_IOPRIO (1 << 1)
+#endif
+
 #include <xnvme_async.h>
 #include <xnvme_be_linux.h>
 #include <xnvme_be_linux_aio.h>
 #include <xnvme_dev.h>
+#include <xnvme_cmd_tmpl.h>
 
 int
 _linux_aio_init(struct xnvme_dev *XNVME_UNUSED(dev),
@@ -34,6 +40,7 @@ _linux_aio_init(struct xnvme_dev *XNVME_UNUSED(dev),
 		int XNVME_UNUSED(flags))
 {
 	struct xnvme_async_ctx_aio *actx = NULL;
+	struct xnvme_be_linux_aio_ring *ring;
 	int err = 0;
 
 	(*ctx) = calloc(1, sizeof(**ctx));
@@ -50,15 +57,43 @@ _linux_aio_init(struct xnvme_dev *XNVME_UNUSED(dev),
 	actx->entries = depth;
 	actx->aio_events = calloc(actx->entries, sizeof(struct io_event));
 	actx->iocbs = calloc(actx->entries, sizeof(struct iocb *));
+	actx->slots = calloc(actx->entries, sizeof(struct iocb));
+	actx->free = calloc(actx->entries, sizeof(uint32_t));
+	actx->failed = calloc(actx->entries, sizeof(struct iocb *));
+	if (!(actx->aio_events && actx->iocbs && actx->slots && actx->free &&
+	      actx->failed)) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		err = -errno;
+		goto failed;
+	}
+	for (uint32_t slot = 0; slot < actx->entries; ++slot) {
+		actx->free[actx->nfree++] = slot;
+	}
 
 	err = io_queue_init(actx->entries, &actx->aio_ctx);
 	if (err) {
 		XNVME_DEBUG("FAILED: alloc. qpair");
-		free(*ctx);
-		return err;
+		goto failed;
 	}
 
+	// The layout of the ring is only known when it carries no new features
+	ring = (void *)actx->aio_ctx;
+	actx->user_ring = (ring->magic == XNVME_BE_LINUX_AIO_RING_MAGIC) &&
+			  (!ring->incompat_features);
+
+	XNVME_DEBUG("actx->user_ring: %d", actx->user_ring);
+
 	return 0;
+
+failed:
+	free(actx->aio_events);
+	free(actx->iocbs);
+	free(actx->slots);
+	free(actx->free);
+	free(actx->failed);
+	free(*ctx);
+
+	return err;
 }
 
 int
@@ -77,57 +112,221 @@ _linux_aio_term(struct xnvme_dev *XNVME_UNUSED(dev),
 	io_destroy(actx->aio_ctx);
 	free(actx->aio_events);
 	free(actx->iocbs);
+	free(actx->slots);
+	free(actx->free);
+	free(actx->failed);
 	free(ctx);
 
 	return 0;
 }
 
-int
-_linux_aio_poke(struct xnvme_dev *XNVME_UNUSED(dev),
-		struct xnvme_async_ctx *ctx, uint32_t max)
+static inline void
+_ring_inc(struct xnvme_async_ctx_aio *actx, unsigned int *val, unsigned int add)
+{
+	*val = (*val + add) & (actx->entries - 1);
+}
+
+/**
+ * Take the iocb at the tail of the queue off it, as it failed submission; it is
+ * completed with the error by the next processing of the context
+ */
+static void
+_linux_aio_fail(struct xnvme_async_ctx_aio *actx, int err)
+{
+	struct iocb *iocb = actx->iocbs[actx->tail];
+
+	XNVME_DEBUG("FAILED: io_submit(), err: %d", err);
+
+	xnvme_async_cpl_errno((struct xnvme_req *)(uintptr_t)iocb->data, err);
+	actx->failed[actx->nfailed++] = iocb;
+
+	_ring_inc(actx, &actx->tail, 1);
+	actx->queued -= 1;
+}
+
+/**
+ * Submit the iocbs queued, an iocb stays queued when the Kernel lacks the
+ * resources for it, and is then submitted on a later submission or poke
+ *
+ * An iocb failing otherwise is taken off the queue, and completed with the
+ * error, unless it is 'own', the iocb being submitted by the caller
+ *
+ * @return On success, 0 is returned. On error, negative errno of io_submit()
+ * for 'own'.
+ */
+static int
+_linux_aio_submit(struct xnvme_async_ctx_aio *actx, struct iocb *own)
+{
+	int ret = 0;
+
+	while (actx->queued) {
+		long nr = XNVME_MIN(actx->queued, actx->entries - actx->tail);
+
+		ret = io_submit(actx->aio_ctx, nr, actx->iocbs + actx->tail);
+		if (ret > 0) {
+			actx->queued -= ret;
+			_ring_inc(actx, &actx->tail, ret);
+			ret = 0;
+			continue;
+		}
+
+		switch (ret) {
+		case 0:
+		case -EINTR:
+			continue;
+
+		case -EAGAIN:
+		case -ENOMEM:
+			return 0;
+
+		default:
+			if (actx->iocbs[actx->tail] == own) {
+				XNVME_DEBUG("FAILED: io_submit(), err: %d", ret);
+				return ret;
+			}
+			_linux_aio_fail(actx, ret);
+			ret = 0;
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * Reap at most 'max' completions into actx->aio_events, from the ring mapped
+ * into user-space, thus without entering the Kernel; with 'wait', and nothing
+ * to reap, io_getevents() blocks until at least one command completes
+ *
+ * @return On success, the number of completions reaped is returned. On error,
+ * negative errno is returned.
+ */
+static int
+_linux_aio_getevents(struct xnvme_async_ctx_aio *actx, uint32_t max, int wait)
+{
+	struct xnvme_be_linux_aio_ring *ring = (void *)actx->aio_ctx;
+	struct timespec ts = { 0 };
+	uint32_t nevents = 0;
+	unsigned head, tail;
+	int ret;
+
+	if (actx->user_ring) {
+		head = ring->head;
+		tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+		for (; (head != tail) && (nevents < max); ++nevents) {
+			actx->aio_events[nevents] = ring->io_events[head];
+			head = (head + 1) % ring->nr;
+		}
+
+		// The Kernel may reuse the events, once they are copied
+		__atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+
+		if (nevents || !wait) {
+			return nevents;
+		}
+	}
+
+	ret = io_getevents(actx->aio_ctx, wait ? 1 : 0, max, actx->aio_events,
+			   wait ? NULL : &ts);
+
+	return ret == -EINTR ? 0 : ret;
+}
+
+/**
+ * Submit queued commands and process at most 'max' completions; with 'out',
+ * the completed requests are stored there, instead of invoking their callbacks
+ */
+static int
+_linux_aio_process(struct xnvme_async_ctx *ctx, struct xnvme_req **out,
+		   uint32_t max, int wait)
 {
 	struct xnvme_async_ctx_aio *actx = (void *)ctx;
-	unsigned completed = 0;
-	int ret = 0, event = 0;
+	uint32_t nfailed = 0;
+	int nevents;
+
+	if (actx->queued) {
+		_linux_aio_submit(actx, NULL);
+	}
 
 	max = max ? max : actx->outstanding;
 	max = max > actx->outstanding ? actx->outstanding : max;
+	if (!max) {
+		return 0;
+	}
 
-	do {
-		struct io_event *ev;
-		struct xnvme_req *req;
+	// Completions of commands which failed submission go first
+	for (; actx->nfailed && (nfailed < max); ++nfailed) {
+		struct iocb *iocb = actx->failed[--actx->nfailed];
+		struct xnvme_req *req = (struct xnvme_req *)(uintptr_t)iocb->data;
 
-		ret = io_getevents(actx->aio_ctx, 1, max, actx->aio_events, NULL);
+		actx->free[actx->nfree++] = iocb - actx->slots;
+		actx->outstanding -= 1;
+		if (out) {
+			out[nfailed] = req;
+			continue;
+		}
+		req->async.cb(req, req->async.cb_arg);
+	}
+	if (nfailed) {
+		return nfailed;
+	}
+
+	// Blocking with nothing submitted would never return
+	wait = wait && (actx->outstanding > actx->queued);
 
-		for (event = 0; event < ret; event++) {
-			ev =  actx->aio_events + event;
-			req = (struct xnvme_req *)(uintptr_t)ev->data;
+	nevents = _linux_aio_getevents(actx, max, wait);
+	if (nevents < 0) {
+		XNVME_DEBUG("FAILED: _linux_aio_getevents(), err: %d", nevents);
+		return nevents;
+	}
 
-			if (!req) {
-				XNVME_DEBUG("-{[THIS SHOULD NOT HAPPEN]}-");
-				XNVME_DEBUG("event->data is NULL! => NO REQ!");
-				XNVME_DEBUG("event->res: %ld", ev->res);
+	for (int event = 0; event < nevents; event++) {
+		struct io_event *ev = actx->aio_events + event;
+		struct xnvme_req *req = (struct xnvme_req *)(uintptr_t)ev->data;
 
-				ctx->outstanding -= 1;
+		if (!req) {
+			XNVME_DEBUG("-{[THIS SHOULD NOT HAPPEN]}-");
+			XNVME_DEBUG("event->data is NULL! => NO REQ!");
+			XNVME_DEBUG("event->res: %ld", ev->res);
 
-				return -EIO;
-			}
+			ctx->outstanding -= 1;
+
+			return -EIO;
+		}
 
-			// Map event-result to req-completion
-			req->cpl.status.sc = ev->res;
-			req->async.cb(req, req->async.cb_arg);
+		// Map event-result to req-completion
+		req->cpl.status.sc = ev->res;
 
-			++completed;
+		// Release the slot before the callback, it may submit
+		actx->free[actx->nfree++] = ev->obj - actx->slots;
+		actx->outstanding -= 1;
+		if (out) {
+			out[event] = req;
+			continue;
 		}
+		req->async.cb(req, req->async.cb_arg);
+	}
 
-	} while (completed < max);
+	return nevents;
+}
+
+int
+_linux_aio_poke(struct xnvme_dev *XNVME_UNUSED(dev),
+		struct xnvme_async_ctx *ctx, uint32_t max)
+{
+	return _linux_aio_process(ctx, NULL, max, 0);
+}
 
-	actx->outstanding -= completed;
-	return completed;
+int
+_linux_aio_reap(struct xnvme_dev *XNVME_UNUSED(dev),
+		struct xnvme_async_ctx *ctx, struct xnvme_req **out,
+		uint32_t max)
+{
+	return _linux_aio_process(ctx, out, max, 0);
 }
 
 int
-_linux_aio_wait(struct xnvme_dev *dev,
+_linux_aio_wait(struct xnvme_dev *XNVME_UNUSED(dev),
 		struct xnvme_async_ctx *ctx)
 {
 	int acc = 0;
@@ -136,9 +335,9 @@ _linux_aio_wait(struct xnvme_dev *dev,
 		struct timespec ts1 = {.tv_sec = 0, .tv_nsec = 1000};
 		int err;
 
-		err = _linux_aio_poke(dev, ctx, 0);
-		if (!err) {
-			acc += 1;
+		err = _linux_aio_process(ctx, NULL, 0, 1);
+		if (err >= 0) {
+			acc += err;
 			continue;
 		}
 
@@ -156,10 +355,42 @@ _linux_aio_wait(struct xnvme_dev *dev,
 	return acc;
 }
 
-static inline void
-_ring_inc(struct xnvme_async_ctx_aio *actx, unsigned int *val, unsigned int add)
+/**
+ * Queue the prepared iocb, taken from the top of the stack of free slots, and
+ * submit it along with any left queued
+ *
+ * @return On success, 0 is returned. On error, negative errno of io_submit().
+ */
+static inline int
+_linux_aio_enqueue(struct xnvme_async_ctx_aio *actx, struct iocb *iocb,
+		   struct xnvme_req *req)
 {
-	*val = (*val + add) & (actx->entries - 1);
+	int err;
+
+	iocb->data = (unsigned long *)req;
+	if (req->async.prio) {
+		iocb->u.c.flags |= IOCB_FLAG_IOPRIO;
+		iocb->aio_reqprio = req->async.prio;
+	}
+
+	actx->nfree -= 1;
+	actx->iocbs[actx->head] = iocb;
+	_ring_inc(actx, &actx->head, 1);
+	actx->queued += 1;
+	actx->outstanding += 1;
+
+	err = _linux_aio_submit(actx, iocb);
+	if (err) {
+		// Commands queued before it are submitted, or failed, thus it is
+		// the only one queued
+		_ring_inc(actx, &actx->head, actx->entries - 1);
+		actx->queued -= 1;
+		actx->outstanding -= 1;
+		actx->nfree += 1;
+		return err;
+	}
+
+	return 0;
 }
 
 int
@@ -170,9 +401,19 @@ _linux_aio_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
 {
 	struct xnvme_be_linux_state *state = (void *)dev->be.state;
 	struct xnvme_async_ctx_aio *actx  = (void *)req->async.ctx;
-	struct iocb *iocb = &actx->iocb;
-	struct iocb **iocbs;
-	int ret = 0;
+	struct iocb *iocb;
+
+	if (actx->outstanding == actx->depth) {
+		XNVME_DEBUG("FAILED: queue is full");
+		return -EBUSY;
+	}
+	if (mbuf || mbuf_nbytes) {
+		XNVME_DEBUG("FAILED: mbuf or mbuf_nbytes provided");
+		return -ENOSYS;
+	}
+
+	// A slot is free for every command not outstanding
+	iocb = &actx->slots[actx->free[actx->nfree - 1]];
 
 	switch (cmd->common.opcode) {
 	case XNVME_SPEC_OPC_WRITE:
@@ -183,60 +424,65 @@ _linux_aio_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
 		io_prep_pread(iocb, state->fd, dbuf, dbuf_nbytes, cmd->lblk.slba << dev->ssw);
 		break;
 
+	case XNVME_SPEC_OPC_FLUSH:
+		io_prep_fdsync(iocb, state->fd);
+		break;
+
 	default:
 		return -ENOSYS;
 	}
 
-	if (actx->outstanding < actx->depth) {
-		actx->queued++;
-	}
+	return _linux_aio_enqueue(actx, iocb, req);
+}
+
+XNVME_STATIC_ASSERT(sizeof(struct iocb) <= XNVME_CMD_TMPL_BE_NBYTES,
+		    "Incorrect size")
+
+static int
+_linux_aio_tmpl_submit(struct xnvme_cmd_tmpl *tmpl, uint64_t slba,
+		       uint16_t nlb, void *dbuf, struct xnvme_req *req)
+{
+	struct xnvme_async_ctx_aio *actx = (void *)tmpl->ctx;
+	struct iocb *iocb;
 
 	if (actx->outstanding == actx->depth) {
 		XNVME_DEBUG("FAILED: queue is full");
 		return -EBUSY;
 	}
-	if (mbuf || mbuf_nbytes) {
-		XNVME_DEBUG("FAILED: mbuf or mbuf_nbytes provided");
-		return -ENOSYS;
-	}
 
-	iocb->data = (unsigned long *)req;
-	actx->iocbs[actx->head] = &actx->iocb;
+	iocb = &actx->slots[actx->free[actx->nfree - 1]];
+	memcpy(iocb, tmpl->be_rsvd, sizeof(*iocb));
+	iocb->u.c.buf = dbuf;
+	iocb->u.c.nbytes = (nlb + 1) * tmpl->lba_nbytes;
+	iocb->u.c.offset = slba << tmpl->ssw;
 
-	_ring_inc(actx, &actx->head, 1);
-
-	actx->outstanding += 1;
+	return _linux_aio_enqueue(actx, iocb, req);
+}
 
-	do {
-		long nr = actx->queued;
-		nr = XNVME_MIN((unsigned int) nr, actx->entries - actx->tail);
+/**
+ * Pre-fills the iocb of the template, submission then patches the buffer, the
+ * offset and the length
+ */
+static int
+_linux_aio_cmd_tmpl(struct xnvme_dev *dev, struct xnvme_cmd_tmpl *tmpl)
+{
+	struct xnvme_be_linux_state *state = (void *)dev->be.state;
+	struct iocb *iocb = (void *)tmpl->be_rsvd;
 
-		iocbs = actx->iocbs + actx->tail;
+	switch (tmpl->cmd.common.opcode) {
+	case XNVME_SPEC_OPC_WRITE:
+		io_prep_pwrite(iocb, state->fd, NULL, 0, 0);
+		break;
 
-		ret = io_submit(actx->aio_ctx, nr, iocbs);
+	case XNVME_SPEC_OPC_READ:
+		io_prep_pread(iocb, state->fd, NULL, 0, 0);
+		break;
 
-		if (ret > 0) {
-			actx->queued -= ret;
-			_ring_inc(actx, &actx->tail, ret);
-			ret = 0;
-		} else if (ret == -EINTR || !ret) {
-			continue;
-		} else if (ret == -EAGAIN) {
-			if (actx->queued) {
-				ret = 0;
-				break;
-			}
-			continue;
-		} else if (ret == -ENOMEM) {
+	default:
+		return -ENOSYS;
+	}
 
-			if (actx->queued) {
-				ret = 0;
-			}
-			break;
-		} else {
-			break;
-		}
-	} while (actx->queued);
+	tmpl->submit = _linux_aio_tmpl_submit;
 
 	return 0;
 }
@@ -258,6 +504,13 @@ struct xnvme_be_async g_linux_aio = {
 	.init = _linux_aio_init,
 	.term = _linux_aio_term,
 	.supported = _linux_aio_supported,
+	.cmd_chain = xnvme_be_nosys_async_cmd_chain,
+	.notify = xnvme_be_nosys_async_notify,
+	.bufs_init = xnvme_be_nosys_async_bufs_init,
+	.buf_put = xnvme_be_nosys_async_buf_put,
+	.reap = _linux_aio_reap,
+	.cmd_tmpl = _linux_aio_cmd_tmpl,
+	.cmd_batch = xnvme_be_nosys_async_cmd_batch,
 #else
 	.enabled = 0,
 	.cmd_io = xnvme_be_nosys_async_cmd_io,
@@ -266,6 +519,13 @@ struct xnvme_be_async g_linux_aio = {
 	.init = xnvme_be_nosys_async_init,
 	.term = xnvme_be_nosys_async_term,
 	.supported = xnvme_be_nosys_async_supported,
+	.cmd_chain = xnvme_be_nosys_async_cmd_chain,
+	.notify = xnvme_be_nosys_async_notify,
+	.bufs_init = xnvme_be_nosys_async_bufs_init,
+	.buf_put = xnvme_be_nosys_async_buf_put,
+	.reap = xnvme_be_nosys_async_reap,
+	.cmd_tmpl = xnvme_be_nosys_async_cmd_tmpl,
+	.cmd_batch = xnvme_be_nosys_async_cmd_batch,
 #endif
 };
 
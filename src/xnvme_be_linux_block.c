@@ -9,9 +9,14 @@
 #include <linux/blkzoned.h>
 #endif
 #include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <linux/fs.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
 #include <xnvme_be_linux.h>
+#include <xnvme_be_linux_block.h>
+#include <liblblk.h>
 #include <libznd.h>
 
 #ifdef BLK_ZONE_REP_CAPACITY
@@ -313,6 +318,82 @@ exit:
 	return err;
 }
 
+/**
+ * Zero, or deallocate, the given range of LBAs via the Block Layer, falling
+ * back to fallocate() when the ioctl() is not available e.g. for a file
+ */
+static int
+_lblk_range_clear(struct xnvme_dev *dev, uint64_t slba, uint64_t nlb,
+		  int discard)
+{
+	struct xnvme_be_linux_state *state = (void *)dev->be.state;
+	uint64_t range[2] = { slba << dev->ssw, nlb << dev->ssw };
+	int mode = FALLOC_FL_KEEP_SIZE;
+	int err;
+
+	err = ioctl(state->fd, discard ? BLKDISCARD : BLKZEROOUT, &range);
+	if (!err) {
+		return 0;
+	}
+	if (errno != ENOTTY) {
+		XNVME_DEBUG("FAILED: ioctl(%s), errno: %d",
+			    discard ? "BLKDISCARD" : "BLKZEROOUT", errno);
+		return -errno;
+	}
+
+	mode |= discard ? FALLOC_FL_PUNCH_HOLE : FALLOC_FL_ZERO_RANGE;
+
+	err = fallocate(state->fd, mode, range[0], range[1]);
+	if (err) {
+		XNVME_DEBUG("FAILED: fallocate(), errno: %d", errno);
+		return -errno;
+	}
+
+	return 0;
+}
+
+static int
+_lblk_write_zeroes(struct xnvme_dev *dev, struct lblk_cmd *cmd)
+{
+	return _lblk_range_clear(dev, cmd->write_zeroes.slba,
+				 cmd->write_zeroes.nlb + 1ULL, 0);
+}
+
+static int
+_lblk_dsm(struct xnvme_dev *dev, struct lblk_cmd *cmd, void *dbuf,
+	  size_t dbuf_nbytes)
+{
+	struct lblk_dsm_range *ranges = dbuf;
+	const uint32_t nranges = cmd->dsm.nr + 1;
+
+	if (!ranges || (dbuf_nbytes < nranges * sizeof(*ranges))) {
+		XNVME_DEBUG("FAILED: ranges: %p, dbuf_nbytes: %zu",
+			    dbuf, dbuf_nbytes);
+		return -EINVAL;
+	}
+
+	// Without deallocate, the attributes are hints, nothing to do
+	if (!cmd->dsm.ad) {
+		return 0;
+	}
+
+	for (uint32_t i = 0; i < nranges; ++i) {
+		int err;
+
+		if (!ranges[i].nlb) {
+			continue;
+		}
+
+		err = _lblk_range_clear(dev, ranges[i].slba, ranges[i].nlb, 1);
+		if (err) {
+			XNVME_DEBUG("FAILED: _lblk_range_clear(), range: %u", i);
+			return err;
+		}
+	}
+
+	return 0;
+}
+
 int
 xnvme_be_linux_block_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
 			    void *dbuf, size_t dbuf_nbytes,
@@ -344,6 +425,19 @@ xnvme_be_linux_block_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
 		}
 		return 0;
 
+	case XNVME_SPEC_OPC_FLUSH:
+		if (fdatasync(state->fd)) {
+			XNVME_DEBUG("FAILED: fdatasync(), errno: %d", errno);
+			return -errno;
+		}
+		return 0;
+
+	case LBLK_CMD_OPC_WRITE_ZEROES:
+		return _lblk_write_zeroes(dev, (void *)cmd);
+
+	case LBLK_CMD_OPC_DSM:
+		return _lblk_dsm(dev, (void *)cmd, dbuf, dbuf_nbytes);
+
 	case ZND_CMD_OPC_MGMT_SEND:
 		return _lzbd_zone_mgmt_send(dev, (void *)cmd);
 
@@ -549,6 +643,77 @@ struct xnvme_be_sync g_linux_block = {
 	.enabled = 1,
 	.supported = xnvme_be_linux_block_supported,
 };
+
+#ifndef RWF_HIPRI
+#define RWF_HIPRI 0x00000001
+#endif
+
+/**
+ * Read and write with RWF_HIPRI, that is, the Kernel polls for the completion
+ * rather than sleeping on the interrupt, when the device has poll queues, e.g.
+ * nvme.poll_queues; other commands are passed to the block engine
+ */
+static int
+_linux_block_hipri_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+			  void *dbuf, size_t dbuf_nbytes, void *mbuf,
+			  size_t mbuf_nbytes, int opts, struct xnvme_req *req)
+{
+	struct xnvme_be_linux_state *state = (void *)dev->be.state;
+	struct iovec iov = { .iov_base = dbuf, .iov_len = dbuf_nbytes };
+	ssize_t nbytes;
+
+	switch (cmd->common.opcode) {
+	case XNVME_SPEC_OPC_WRITE:
+		nbytes = pwritev2(state->fd, &iov, 1, cmd->lblk.slba << dev->ssw,
+				  RWF_HIPRI);
+		break;
+
+	case XNVME_SPEC_OPC_READ:
+		nbytes = preadv2(state->fd, &iov, 1, cmd->lblk.slba << dev->ssw,
+				 RWF_HIPRI);
+		break;
+
+	default:
+		return xnvme_be_linux_block_cmd_io(dev, cmd, dbuf, dbuf_nbytes,
+						   mbuf, mbuf_nbytes, opts, req);
+	}
+
+	if (nbytes != (ssize_t)dbuf_nbytes) {
+		XNVME_DEBUG("FAILED: nbytes: %zd != dbuf_nbytes: %zu, errno: %d",
+			    nbytes, dbuf_nbytes, errno);
+		return nbytes < 0 ? -errno : -EIO;
+	}
+
+	return 0;
+}
+
+/**
+ * RWF_HIPRI requires preadv2(), Linux 4.6, an empty read probes for it
+ */
+static int
+_linux_block_hipri_supported(struct xnvme_dev *dev, uint32_t opts)
+{
+	struct xnvme_be_linux_state *state = (void *)dev->be.state;
+	struct iovec iov = { 0 };
+
+	if (!xnvme_be_linux_block_supported(dev, opts)) {
+		return 0;
+	}
+	if (preadv2(state->fd, &iov, 1, 0, RWF_HIPRI) < 0) {
+		XNVME_DEBUG("FAILED: preadv2(RWF_HIPRI), errno: %d", errno);
+		return 0;
+	}
+
+	return 1;
+}
+
+struct xnvme_be_sync g_linux_block_hipri = {
+	.cmd_io = _linux_block_hipri_cmd_io,
+	.cmd_admin = xnvme_be_linux_block_cmd_admin,
+	.id = "block_hipri",
+	.enabled = 1,
+	.supported = _linux_block_hipri_supported,
+};
 #else
 #include <xnvme_be_linux.h>
 #include <xnvme_be_nosys.h>
@@ -559,5 +724,12 @@ struct xnvme_be_sync g_linux_block = {
 	.enabled = 0,
 	.supported = xnvme_be_nosys_sync_supported,
 };
+struct xnvme_be_sync g_linux_block_hipri = {
+	.cmd_io = xnvme_be_nosys_sync_cmd_io,
+	.cmd_admin = xnvme_be_nosys_sync_cmd_admin,
+	.id = "block_hipri",
+	.enabled = 0,
+	.supported = xnvme_be_nosys_sync_supported,
+};
 #endif
 
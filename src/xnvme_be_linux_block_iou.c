@@ -0,0 +1,228 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#if defined(XNVME_BE_LINUX_IOU_ENABLED) && defined(XNVME_BE_LINUX_BLOCK_ENABLED)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <liburing.h>
+#include <libxnvme.h>
+#include <xnvme_be.h>
+#include <xnvme_be_linux.h>
+#include <xnvme_be_linux_block.h>
+#include <xnvme_dev.h>
+
+#define XNVME_BE_LINUX_BLOCK_IOU_DEPTH 4	///< Entries of the ring of a thread
+#define XNVME_BE_LINUX_BLOCK_IOU_SPINS (1 << 16) ///< Peeks before sleeping
+
+/**
+ * The rings of a thread, setup on first use by the thread, and torn down when
+ * it exits; the IOPOLL ring is only setup with '?poll_sync=1'
+ */
+struct xnvme_be_linux_block_iou {
+	struct io_uring ring[2];	///< Indexed by IOPOLL
+	int8_t ready[2];		///< 1: setup, -1: setup failed, 0: not yet
+};
+
+static __thread struct xnvme_be_linux_block_iou *g_block_iou;
+static pthread_key_t g_block_iou_key;
+static pthread_once_t g_block_iou_once = PTHREAD_ONCE_INIT;
+static int g_block_iou_key_err;
+
+static void
+_linux_block_iou_free(void *arg)
+{
+	struct xnvme_be_linux_block_iou *tls = arg;
+
+	for (int i = 0; i < 2; ++i) {
+		if (tls->ready[i] > 0) {
+			io_uring_queue_exit(&tls->ring[i]);
+		}
+	}
+	free(tls);
+}
+
+static void
+_linux_block_iou_key_create(void)
+{
+	g_block_iou_key_err = pthread_key_create(&g_block_iou_key,
+			      _linux_block_iou_free);
+}
+
+/**
+ * Retrieve the ring of the calling thread, setting it up on first use
+ *
+ * @return On success, the ring is returned. On error, NULL is returned.
+ */
+static struct io_uring *
+_linux_block_iou_ring(int poll)
+{
+	struct xnvme_be_linux_block_iou *tls = g_block_iou;
+
+	if (!tls) {
+		pthread_once(&g_block_iou_once, _linux_block_iou_key_create);
+		if (g_block_iou_key_err) {
+			XNVME_DEBUG("FAILED: pthread_key_create(), err: %d",
+				    g_block_iou_key_err);
+			return NULL;
+		}
+
+		tls = calloc(1, sizeof(*tls));
+		if (!tls) {
+			XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+			return NULL;
+		}
+		if (pthread_setspecific(g_block_iou_key, tls)) {
+			XNVME_DEBUG("FAILED: pthread_setspecific()");
+			free(tls);
+			return NULL;
+		}
+		g_block_iou = tls;
+	}
+
+	if (!tls->ready[poll]) {
+		int err;
+
+		err = io_uring_queue_init(XNVME_BE_LINUX_BLOCK_IOU_DEPTH,
+					  &tls->ring[poll],
+					  poll ? IORING_SETUP_IOPOLL : 0);
+		if (err) {
+			XNVME_DEBUG("FAILED: io_uring_queue_init(), err: %d", err);
+		}
+		tls->ready[poll] = err ? -1 : 1;
+	}
+
+	return tls->ready[poll] > 0 ? &tls->ring[poll] : NULL;
+}
+
+/**
+ * Submit a single read or write, and poll for its completion; the CQ-ring is
+ * peeked for a while before sleeping, an IOPOLL ring is polled by the Kernel
+ *
+ * @return On success, the result of the command is returned, that is, number
+ * of bytes transferred or negative errno. On error, negative errno.
+ */
+static int
+_linux_block_iou_rw(struct io_uring *ring, int poll, int op, int fd,
+		    void *dbuf, size_t dbuf_nbytes, uint64_t off)
+{
+	struct io_uring_cqe *cqe = NULL;
+	struct io_uring_sqe *sqe;
+	int err;
+
+	sqe = io_uring_get_sqe(ring);
+	if (!sqe) {
+		XNVME_DEBUG("FAILED: io_uring_get_sqe()");
+		return -EBUSY;
+	}
+	io_uring_prep_rw(op, sqe, fd, dbuf, dbuf_nbytes, off);
+
+	err = io_uring_submit(ring);
+	if (err < 0) {
+		XNVME_DEBUG("FAILED: io_uring_submit(), err: %d", err);
+		return err;
+	}
+
+	for (int spins = 0; poll || io_uring_peek_cqe(ring, &cqe); ++spins) {
+		if (poll || (spins == XNVME_BE_LINUX_BLOCK_IOU_SPINS)) {
+			err = io_uring_wait_cqe(ring, &cqe);
+			if (err) {
+				XNVME_DEBUG("FAILED: io_uring_wait_cqe(), err: %d",
+					    err);
+				return err;
+			}
+			break;
+		}
+	}
+
+	err = cqe->res;
+	io_uring_cqe_seen(ring, cqe);
+
+	return err;
+}
+
+static int
+_linux_block_iou_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+			void *dbuf, size_t dbuf_nbytes, void *mbuf,
+			size_t mbuf_nbytes, int opts, struct xnvme_req *req)
+{
+	struct xnvme_be_linux_state *state = (void *)dev->be.state;
+	uint64_t off = cmd->lblk.slba << dev->ssw;
+	struct io_uring *ring;
+	int poll = state->poll_sync;
+	int op;
+	int res;
+
+	switch (cmd->common.opcode) {
+	case XNVME_SPEC_OPC_WRITE:
+		op = IORING_OP_WRITE;
+		break;
+
+	case XNVME_SPEC_OPC_READ:
+		op = IORING_OP_READ;
+		break;
+
+	default:
+		return xnvme_be_linux_block_cmd_io(dev, cmd, dbuf, dbuf_nbytes,
+						   mbuf, mbuf_nbytes, opts, req);
+	}
+
+	ring = _linux_block_iou_ring(poll);
+	if (!ring) {
+		return -ENOMEM;
+	}
+
+	res = _linux_block_iou_rw(ring, poll, op, state->fd, dbuf,
+				  dbuf_nbytes, off);
+	if (poll && (res == -EOPNOTSUPP)) {
+		XNVME_DEBUG("INFO: IOPOLL is not supported, disabling it");
+		state->poll_sync = 0;
+
+		ring = _linux_block_iou_ring(0);
+		if (!ring) {
+			return -ENOMEM;
+		}
+		res = _linux_block_iou_rw(ring, 0, op, state->fd, dbuf,
+					  dbuf_nbytes, off);
+	}
+	if (res != (int)dbuf_nbytes) {
+		XNVME_DEBUG("FAILED: res: %d != dbuf_nbytes: %zu", res,
+			    dbuf_nbytes);
+		return res < 0 ? res : -EIO;
+	}
+
+	return 0;
+}
+
+static int
+_linux_block_iou_supported(struct xnvme_dev *dev, uint32_t opts)
+{
+	struct xnvme_be_linux_state *state = (void *)dev->be.state;
+
+	if (!xnvme_be_linux_block_supported(dev, opts)) {
+		return 0;
+	}
+
+	return _linux_block_iou_ring(state->poll_sync) != NULL;
+}
+
+struct xnvme_be_sync g_linux_block_iou = {
+	.cmd_io = _linux_block_iou_cmd_io,
+	.cmd_admin = xnvme_be_linux_block_cmd_admin,
+	.id = "block_iou",
+	.enabled = 1,
+	.supported = _linux_block_iou_supported,
+};
+#else
+#include <xnvme_be_linux.h>
+#include <xnvme_be_nosys.h>
+struct xnvme_be_sync g_linux_block_iou = {
+	.cmd_io = xnvme_be_nosys_sync_cmd_io,
+	.cmd_admin = xnvme_be_nosys_sync_cmd_admin,
+	.id = "block_iou",
+	.enabled = 0,
+	.supported = xnvme_be_nosys_sync_supported,
+};
+#endif
@@ -15,20 +15,111 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <paths.h>
+#include <pthread.h>
 #include <liburing.h>
 
 #include <xnvme_async.h>
 #include <xnvme_be_linux.h>
 #include <xnvme_be_linux_iou.h>
 #include <xnvme_dev.h>
+#include <xnvme_cmd_tmpl.h>
 
 // TODO: replace this with liburing 0.7 barriers
 #define _linux_iou_barrier()  __asm__ __volatile__("":::"memory")
 
+// Setup flags of newer Kernels, which the bundled liburing may predate
+#ifndef IORING_SETUP_COOP_TASKRUN
+#define IORING_SETUP_COOP_TASKRUN (1U << 8)
+#endif
+#ifndef IORING_SETUP_TASKRUN_FLAG
+#define IORING_SETUP_TASKRUN_FLAG (1U << 9)
+#endif
+#ifndef IORING_SETUP_SINGLE_ISSUER
+#define IORING_SETUP_SINGLE_ISSUER (1U << 12)
+#endif
+#ifndef IORING_SETUP_DEFER_TASKRUN
+#define IORING_SETUP_DEFER_TASKRUN (1U << 13)
+#endif
+#ifndef IORING_SQ_TASKRUN
+#define IORING_SQ_TASKRUN (1U << 2)
+#endif
+
+// Provided-buffer rings of Linux 5.19, which the bundled liburing may predate
+#define XNVME_BE_LINUX_IOU_REGISTER_PBUF_RING 22
+#define XNVME_BE_LINUX_IOU_UNREGISTER_PBUF_RING 23
+#ifndef IOSQE_BUFFER_SELECT
+#define IOSQE_BUFFER_SELECT (1U << 5)
+#endif
+#ifndef IORING_CQE_F_BUFFER
+#define IORING_CQE_F_BUFFER (1U << 0)
+#endif
+#ifndef IORING_CQE_BUFFER_SHIFT
+#define IORING_CQE_BUFFER_SHIFT 16
+#endif
+#define XNVME_BE_LINUX_IOU_BGID 0	///< The one buffer-group of a context
+
+/**
+ * Registration of a provided-buffer ring, as struct io_uring_buf_reg
+ */
+struct xnvme_be_linux_iou_pbuf_reg {
+	uint64_t ring_addr;
+	uint32_t ring_entries;
+	uint16_t bgid;
+	uint16_t flags;
+	uint64_t resv[3];
+};
+
+#define XNVME_BE_LINUX_IOU_TASKRUN \
+	(IORING_SETUP_COOP_TASKRUN | IORING_SETUP_TASKRUN_FLAG)
+
+/**
+ * Ring setup profiles, the first one which the Kernel accepts is used, the CQ
+ * is sized at twice the SQ such that completions never overflow; with
+ * COOP_TASKRUN / DEFER_TASKRUN completions are posted on entering the Kernel,
+ * which _linux_iou_poke() does when the Kernel flags IORING_SQ_TASKRUN
+ */
+static const uint32_t g_linux_iou_setups[] = {
+	IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER |
+	IORING_SETUP_DEFER_TASKRUN | XNVME_BE_LINUX_IOU_TASKRUN,	// Linux 6.1
+	IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER |
+	XNVME_BE_LINUX_IOU_TASKRUN,					// Linux 6.0
+	IORING_SETUP_CQSIZE | XNVME_BE_LINUX_IOU_TASKRUN,		// Linux 5.19
+	IORING_SETUP_CQSIZE,						// Linux 5.5
+	0,
+};
+static uint32_t g_linux_iou_setup;
+static pthread_once_t g_linux_iou_setup_once = PTHREAD_ONCE_INIT;
+
+static void
+_linux_iou_setup_probe(void)
+{
+	const int nsetups = sizeof g_linux_iou_setups / sizeof(*g_linux_iou_setups);
+
+	for (int i = 0; i < nsetups; ++i) {
+		struct io_uring_params params = { 0 };
+		struct io_uring ring;
+
+		params.flags = g_linux_iou_setups[i];
+		params.cq_entries = 4;
+		if (io_uring_queue_init_params(2, &ring, &params)) {
+			XNVME_DEBUG("INFO: setup: 0x%x, not supported",
+				    g_linux_iou_setups[i]);
+			continue;
+		}
+		io_uring_queue_exit(&ring);
+
+		g_linux_iou_setup = g_linux_iou_setups[i];
+		XNVME_DEBUG("INFO: setup: 0x%x", g_linux_iou_setup);
+		return;
+	}
+}
+
 static int g_linux_iou_opcodes[] = {
 	IORING_OP_READV,
 	IORING_OP_WRITEV,
@@ -36,6 +127,7 @@ static int g_linux_iou_opcodes[] = {
 	IORING_OP_WRITE_FIXED,
 	IORING_OP_READ,
 	IORING_OP_WRITE,
+	IORING_OP_FSYNC,
 };
 int g_linux_iou_nopcodes = sizeof g_linux_iou_opcodes / sizeof(*g_linux_iou_opcodes);
 
@@ -70,9 +162,102 @@ _linux_iou_supported(struct xnvme_dev *XNVME_UNUSED(dev), uint32_t XNVME_UNUSED(
 exit:
 	free(probe);
 
+	pthread_once(&g_linux_iou_setup_once, _linux_iou_setup_probe);
+
 	return err ? 0 : 1;
 }
 
+/**
+ * Setup the ring with the setup profile supported by the Kernel, and, with
+ * SQPOLL, the polling thread on a CPU of the NUMA node of the device; the CPUs
+ * of the node are handed out round-robin, such that the polling threads of
+ * multiple contexts are spread over the node
+ *
+ * @return On success, 0 is returned. On error, negative errno is returned, and
+ * the ring must be setup without the profile.
+ */
+static int
+_linux_iou_ring_init(struct xnvme_dev *dev,
+		     struct xnvme_async_ctx_linux_iou *actx, uint16_t depth,
+		     uint32_t iou_flags, int flags)
+{
+	static _Atomic uint32_t next;
+	struct io_uring_params params = { 0 };
+	cpu_set_t cpus;
+	int err;
+
+	pthread_once(&g_linux_iou_setup_once, _linux_iou_setup_probe);
+
+	params.flags = iou_flags | g_linux_iou_setup;
+	params.cq_entries = 2 * depth;
+
+	// The SQ thread runs the completion task-work, the Kernel rejects the
+	// flags deferring it to the submitter
+	if (iou_flags & IORING_SETUP_SQPOLL) {
+		params.flags &= ~(IORING_SETUP_DEFER_TASKRUN |
+				  XNVME_BE_LINUX_IOU_TASKRUN);
+	}
+	// Any thread may submit on a shared context, though one at a time
+	if (flags & XNVME_BE_ASYNC_ANY_THREAD) {
+		params.flags &= ~(IORING_SETUP_SINGLE_ISSUER |
+				  IORING_SETUP_DEFER_TASKRUN);
+	}
+
+	if ((iou_flags & IORING_SETUP_SQPOLL) && (dev->numa_node >= 0) &&
+	    !xnvme_be_linux_numa_cpus(dev->numa_node, &cpus)) {
+		uint32_t nth = next++ % CPU_COUNT(&cpus);
+
+		for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+			if (!CPU_ISSET(cpu, &cpus) || nth--) {
+				continue;
+			}
+
+			params.flags |= IORING_SETUP_SQ_AFF;
+			params.sq_thread_cpu = cpu;
+			break;
+		}
+	}
+
+	err = io_uring_queue_init_params(depth, &actx->ring, &params);
+	if (err) {
+		XNVME_DEBUG("INFO: io_uring_queue_init_params(0x%x), err: %d",
+			    params.flags, err);
+		return err;
+	}
+
+	actx->taskrun = (params.flags & IORING_SETUP_TASKRUN_FLAG) ? 1 : 0;
+
+	return 0;
+}
+
+/**
+ * Post the completions deferred to the task, when the Kernel flags that there
+ * are some, as they are otherwise not posted until the next system call
+ *
+ * @return 1 when the Kernel was entered, otherwise 0
+ */
+static inline int
+_linux_iou_taskrun(struct xnvme_async_ctx_linux_iou *actx)
+{
+	unsigned sq_flags;
+
+	if (!actx->taskrun) {
+		return 0;
+	}
+
+	sq_flags = __atomic_load_n(actx->ring.sq.kflags, __ATOMIC_ACQUIRE);
+	if (!(sq_flags & IORING_SQ_TASKRUN)) {
+		return 0;
+	}
+
+	if (syscall(__NR_io_uring_enter, actx->ring.ring_fd, 0, 0,
+		    IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+		XNVME_DEBUG("FAILED: io_uring_enter(), errno: %d", errno);
+	}
+
+	return 1;
+}
+
 int
 _linux_iou_init(struct xnvme_dev *dev,
 		struct xnvme_async_ctx **ctx, uint16_t depth,
@@ -118,20 +303,38 @@ _linux_iou_init(struct xnvme_dev *dev,
 		iou_flags |= IORING_SETUP_IOPOLL;
 	}
 
-	err = io_uring_queue_init(depth, &actx->ring, iou_flags);
+	err = _linux_iou_ring_init(dev, actx, depth, iou_flags, flags);
+	if (err) {
+		err = io_uring_queue_init(depth, &actx->ring, iou_flags);
+	}
 	if (err) {
 		XNVME_DEBUG("FAILED: alloc. qpair");
 		free(*ctx);
 		return err;
 	}
 
-	if (actx->poll_sq) {
-		io_uring_register_files(&actx->ring, &(state->fd), 1);
+	// The device is submitted by index, saving the fd lookup on every command
+	err = io_uring_register_files(&actx->ring, &(state->fd), 1);
+	if (err) {
+		XNVME_DEBUG("INFO: io_uring_register_files(), err: %d", err);
+		if (actx->poll_sq) {
+			XNVME_DEBUG("FAILED: SQPOLL requires a registered file");
+			io_uring_queue_exit(&actx->ring);
+			free(*ctx);
+			return err;
+		}
 	}
+	actx->fixed_file = !err;
 
 	return 0;
 }
 
+static inline size_t
+_linux_iou_pbuf_nbytes(struct xnvme_async_ctx_linux_iou *actx)
+{
+	return (actx->pbuf_mask + 1) * sizeof(*actx->pbuf);
+}
+
 int
 _linux_iou_term(struct xnvme_dev *XNVME_UNUSED(dev),
 		struct xnvme_async_ctx *ctx)
@@ -145,13 +348,145 @@ _linux_iou_term(struct xnvme_dev *XNVME_UNUSED(dev),
 
 	actx = (void *)ctx;
 
-	io_uring_unregister_files(&actx->ring);
+	if (actx->fixed_file) {
+		io_uring_unregister_files(&actx->ring);
+	}
 	io_uring_queue_exit(&actx->ring);
+
+	// The Kernel has let go of the buffer ring, along with the ring
+	if (actx->pbuf) {
+		munmap(actx->pbuf, _linux_iou_pbuf_nbytes(actx));
+	}
 	free(ctx);
 
 	return 0;
 }
 
+/**
+ * Add the given buffer to the provided-buffer ring, at 'nth' entry past the
+ * tail, it is not visible to the Kernel until the tail is advanced
+ */
+static inline void
+_linux_iou_pbuf_add(struct xnvme_async_ctx_linux_iou *actx, uint16_t bid,
+		    void *buf, uint32_t nbytes, uint16_t nth)
+{
+	uint16_t tail = actx->pbuf[0].resv;
+	struct xnvme_be_linux_iou_pbuf *entry;
+
+	entry = &actx->pbuf[(uint16_t)(tail + nth) & actx->pbuf_mask];
+	entry->addr = (uintptr_t)buf;
+	entry->len = nbytes;
+	entry->bid = bid;
+}
+
+static inline void
+_linux_iou_pbuf_advance(struct xnvme_async_ctx_linux_iou *actx, uint16_t n)
+{
+	uint16_t tail = actx->pbuf[0].resv;
+
+	__atomic_store_n(&actx->pbuf[0].resv, (uint16_t)(tail + n),
+			 __ATOMIC_RELEASE);
+}
+
+/**
+ * Register a provided-buffer ring, of the given buffers, with the ring of the
+ * context, the ring memory is page-aligned as required by the Kernel, and has
+ * room for every buffer, thus, handing a buffer back never overflows it
+ */
+int
+_linux_iou_bufs_init(struct xnvme_dev *XNVME_UNUSED(dev),
+		     struct xnvme_async_ctx *ctx, void *bufs, uint32_t nbufs,
+		     uint32_t nbytes)
+{
+	struct xnvme_async_ctx_linux_iou *actx = (void *)ctx;
+	struct xnvme_be_linux_iou_pbuf_reg reg = { 0 };
+	uint32_t nentries = 1;
+	int err;
+
+	while (nentries < nbufs) {
+		nentries <<= 1;
+	}
+	actx->pbuf_mask = nentries - 1;
+
+	actx->pbuf = mmap(NULL, _linux_iou_pbuf_nbytes(actx),
+			  PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+			  -1, 0);
+	if (actx->pbuf == MAP_FAILED) {
+		XNVME_DEBUG("FAILED: mmap(pbuf), errno: %d", errno);
+		actx->pbuf = NULL;
+		return -errno;
+	}
+
+	reg.ring_addr = (uintptr_t)actx->pbuf;
+	reg.ring_entries = nentries;
+	reg.bgid = XNVME_BE_LINUX_IOU_BGID;
+
+	err = syscall(__NR_io_uring_register, actx->ring.ring_fd,
+		      XNVME_BE_LINUX_IOU_REGISTER_PBUF_RING, &reg, 1);
+	if (err) {
+		// Kernels predating provided-buffer rings reject the opcode
+		err = errno == EINVAL ? -ENOSYS : -errno;
+		XNVME_DEBUG("FAILED: io_uring_register(PBUF_RING), err: %d",
+			    err);
+		munmap(actx->pbuf, _linux_iou_pbuf_nbytes(actx));
+		actx->pbuf = NULL;
+		return err;
+	}
+
+	for (uint32_t bid = 0; bid < nbufs; ++bid) {
+		_linux_iou_pbuf_add(actx, bid, (uint8_t *)bufs + (size_t)bid * nbytes,
+				    nbytes, bid);
+	}
+	_linux_iou_pbuf_advance(actx, nbufs);
+
+	return 0;
+}
+
+int
+_linux_iou_buf_put(struct xnvme_dev *XNVME_UNUSED(dev),
+		   struct xnvme_async_ctx *ctx, uint16_t bid, void *buf,
+		   uint32_t nbytes)
+{
+	struct xnvme_async_ctx_linux_iou *actx = (void *)ctx;
+
+	if (!actx->pbuf) {
+		XNVME_DEBUG("FAILED: no provided-buffer ring");
+		return -EINVAL;
+	}
+
+	_linux_iou_pbuf_add(actx, bid, buf, nbytes, 0);
+	_linux_iou_pbuf_advance(actx, 1);
+
+	return 0;
+}
+
+/**
+ * The Kernel signals the eventfd when posting a cqe, with IOPOLL nothing is
+ * posted unless the ring is polled, thus it is not supported
+ */
+int
+_linux_iou_notify(struct xnvme_dev *XNVME_UNUSED(dev),
+		  struct xnvme_async_ctx *ctx, int fd)
+{
+	struct xnvme_async_ctx_linux_iou *actx = (void *)ctx;
+	int err;
+
+	if (actx->poll_io) {
+		XNVME_DEBUG("FAILED: eventfd with IOPOLL");
+		return -ENOSYS;
+	}
+
+	err = fd < 0 ? io_uring_unregister_eventfd(&actx->ring) :
+	      io_uring_register_eventfd(&actx->ring, fd);
+	if (err) {
+		XNVME_DEBUG("FAILED: io_uring_[un]register_eventfd(), err: %d",
+			    err);
+		return err;
+	}
+
+	return 0;
+}
+
 int
 _linux_iou_poke(struct xnvme_dev *XNVME_UNUSED(dev),
 		struct xnvme_async_ctx *ctx, uint32_t max)
@@ -161,6 +496,7 @@ _linux_iou_poke(struct xnvme_dev *XNVME_UNUSED(dev),
 	unsigned cq_ring_mask = *ring->kring_mask;
 	unsigned completed = 0;
 	unsigned head;
+	int entered = 0;
 
 	max = max ? max : actx->outstanding;
 	max = max > actx->outstanding ? actx->outstanding : max;
@@ -172,6 +508,10 @@ _linux_iou_poke(struct xnvme_dev *XNVME_UNUSED(dev),
 
 		_linux_iou_barrier();
 		if (head == *ring->ktail) {
+			if (!entered && _linux_iou_taskrun(actx)) {
+				entered = 1;
+				continue;
+			}
 			break;
 		}
 		cqe = &ring->cqes[head & cq_ring_mask];
@@ -191,14 +531,18 @@ _linux_iou_poke(struct xnvme_dev *XNVME_UNUSED(dev),
 
 		// Map cqe-result to req-completion
 		req->cpl.status.sc = cqe->res;
+		if (cqe->flags & IORING_CQE_F_BUFFER) {
+			req->async.bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		}
 
+		// Release the slot before the callback, it may submit
+		actx->outstanding -= 1;
 		req->async.cb(req, req->async.cb_arg);
 
 		++completed;
 		++head;
 	} while (completed < max);
 
-	actx->outstanding -= completed;
 	*ring->khead = head;
 
 	_linux_iou_barrier();
@@ -206,6 +550,53 @@ _linux_iou_poke(struct xnvme_dev *XNVME_UNUSED(dev),
 	return completed;
 }
 
+int
+_linux_iou_reap(struct xnvme_dev *XNVME_UNUSED(dev),
+		struct xnvme_async_ctx *ctx, struct xnvme_req **out,
+		uint32_t max)
+{
+	struct xnvme_async_ctx_linux_iou *actx = (void *)ctx;
+	struct io_uring_cq *ring = &actx->ring.cq;
+	unsigned cq_ring_mask = *ring->kring_mask;
+	unsigned head = *ring->khead;
+	unsigned tail;
+	uint32_t nreaped = 0;
+	int err = 0;
+
+	tail = __atomic_load_n(ring->ktail, __ATOMIC_ACQUIRE);
+	if ((head == tail) && _linux_iou_taskrun(actx)) {
+		tail = __atomic_load_n(ring->ktail, __ATOMIC_ACQUIRE);
+	}
+
+	for (; (head != tail) && (nreaped < max); ++head) {
+		struct io_uring_cqe *cqe = &ring->cqes[head & cq_ring_mask];
+		struct xnvme_req *req;
+
+		req = (struct xnvme_req *)(uintptr_t) cqe->user_data;
+		if (!req) {
+			XNVME_DEBUG("FAILED: cqe->user_data is NULL! => NO REQ!");
+			ctx->outstanding -= 1;
+			++head;
+			err = -EIO;
+			break;
+		}
+
+		// Map cqe-result to req-completion
+		req->cpl.status.sc = cqe->res;
+		if (cqe->flags & IORING_CQE_F_BUFFER) {
+			req->async.bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+		}
+
+		out[nreaped++] = req;
+	}
+
+	// Release the entries in one go, the array is consumed by the caller
+	__atomic_store_n(ring->khead, head, __ATOMIC_RELEASE);
+	actx->outstanding -= nreaped;
+
+	return err ? err : (int)nreaped;
+}
+
 int
 _linux_iou_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
 {
@@ -216,8 +607,8 @@ _linux_iou_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
 		int err;
 
 		err = _linux_iou_poke(dev, ctx, 0);
-		if (!err) {
-			acc += 1;
+		if (err >= 0) {
+			acc += err;
 			continue;
 		}
 
@@ -235,32 +626,77 @@ _linux_iou_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
 	return acc;
 }
 
-int
-_linux_iou_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
-		  void *dbuf, size_t dbuf_nbytes, void *mbuf,
-		  size_t mbuf_nbytes, int XNVME_UNUSED(opts),
-		  struct xnvme_req *req)
+/**
+ * Map the given NVMe command opcode to an io_uring opcode
+ *
+ * @return On success, the io_uring opcode is returned. On error, -ENOSYS.
+ */
+static inline int
+_linux_iou_opcode(struct xnvme_spec_cmd *cmd)
 {
-	struct xnvme_be_linux_state *state = (void *)dev->be.state;
-	struct xnvme_async_ctx_linux_iou *actx = (void *)req->async.ctx;
-	struct io_uring_sqe *sqe = NULL;
-	int opcode;
-	int err = 0;
-
 	switch (cmd->common.opcode) {
 	case XNVME_SPEC_OPC_WRITE:
-		opcode = IORING_OP_WRITE;
-		break;
+		return IORING_OP_WRITE;
 
 	case XNVME_SPEC_OPC_READ:
-		opcode = IORING_OP_READ;
-		break;
+		return IORING_OP_READ;
+
+	case XNVME_SPEC_OPC_FLUSH:
+		return IORING_OP_FSYNC;
 
 	default:
 		XNVME_DEBUG("FAILED: unsupported opcode: %d for async",
 			    cmd->common.opcode);
 		return -ENOSYS;
 	}
+}
+
+static inline void
+_linux_iou_sqe_prep(struct xnvme_dev *dev,
+		    struct xnvme_async_ctx_linux_iou *actx,
+		    struct io_uring_sqe *sqe, int opcode,
+		    struct xnvme_spec_cmd *cmd, void *dbuf, size_t dbuf_nbytes,
+		    struct xnvme_req *req)
+{
+	struct xnvme_be_linux_state *state = (void *)dev->be.state;
+
+	// The trailing fields differ in size across versions of io_uring.h, thus
+	// the sqe is cleared as a whole, rather than by field
+	memset(sqe, 0, sizeof(*sqe));
+
+	sqe->opcode = opcode;
+	sqe->addr = (unsigned long) dbuf;
+	sqe->len = dbuf_nbytes;
+	sqe->off = cmd->lblk.slba << dev->ssw;
+	sqe->flags = actx->fixed_file ? IOSQE_FIXED_FILE : 0;
+	sqe->ioprio = req->async.prio;
+	// NOTE: we only ever register a single file, the raw device, so the
+	// provided index will always be 0
+	sqe->fd = actx->fixed_file ? 0 : state->fd;
+	sqe->user_data = (unsigned long)req;
+
+	if (opcode == IORING_OP_FSYNC) {
+		sqe->addr = 0;
+		sqe->len = 0;
+		sqe->off = 0;
+		sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+	}
+}
+
+int
+_linux_iou_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+		  void *dbuf, size_t dbuf_nbytes, void *mbuf,
+		  size_t mbuf_nbytes, int opts, struct xnvme_req *req)
+{
+	struct xnvme_async_ctx_linux_iou *actx = (void *)req->async.ctx;
+	struct io_uring_sqe *sqe = NULL;
+	int opcode;
+	int err = 0;
+
+	opcode = _linux_iou_opcode(cmd);
+	if (opcode < 0) {
+		return opcode;
+	}
 
 	if (actx->outstanding == actx->depth) {
 		XNVME_DEBUG("FAILED: queue is full");
@@ -276,22 +712,218 @@ _linux_iou_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
 		return -EAGAIN;
 	}
 
-	sqe->opcode = opcode;
+	_linux_iou_sqe_prep(dev, actx, sqe, opcode, cmd, dbuf, dbuf_nbytes,
+			    req);
+
+	// The Kernel selects the buffer once the read is issued
+	if (opts & XNVME_CMD_BUFSEL) {
+		sqe->flags |= IOSQE_BUFFER_SELECT;
+		sqe->buf_group = XNVME_BE_LINUX_IOU_BGID;
+	}
+
+	// A flush on its own must not start before the commands in-flight
+	if (opcode == IORING_OP_FSYNC) {
+		sqe->flags |= IOSQE_IO_DRAIN;
+	}
+
+	err = io_uring_submit(&actx->ring);
+	if (err < 0) {
+		XNVME_DEBUG("io_uring_submit(%d), err: %d", opcode, err);
+		return err;
+	}
+
+	actx->outstanding += 1;
+
+	return 0;
+}
+
+/**
+ * Take back the last 'nsqes' sqes from the SQ, also when flushed to the Kernel
+ * by a failed io_uring_submit(); without the SQ thread, the Kernel does not
+ * consume the SQ until entered, and a failed enter consumes nothing
+ */
+static void
+_linux_iou_sq_rewind(struct xnvme_async_ctx_linux_iou *actx, unsigned nsqes)
+{
+	struct io_uring_sq *sq = &actx->ring.sq;
+
+	if (sq->sqe_head == sq->sqe_tail) {
+		io_uring_smp_store_release(sq->ktail, *sq->ktail - nsqes);
+		sq->sqe_head -= nsqes;
+	}
+	sq->sqe_tail -= nsqes;
+}
+
+/**
+ * Submits the chain with all but the last sqe flagged IOSQE_IO_LINK, the
+ * Kernel then starts a link once the previous has completed, and cancels the
+ * remainder of the chain when a link fails
+ *
+ * Once submitted, the sqes of the chain refer to the links, thus on error none
+ * of them are left in the SQ
+ */
+int
+_linux_iou_cmd_chain(struct xnvme_dev *dev, struct xnvme_cmd_link *links,
+		     uint16_t nlinks, int XNVME_UNUSED(opts))
+{
+	struct xnvme_async_ctx_linux_iou *actx = (void *)links[0].req.async.ctx;
+	int err;
+
+	if ((actx->depth - actx->outstanding) < nlinks) {
+		XNVME_DEBUG("FAILED: queue cannot fit nlinks: %u", nlinks);
+		return -EBUSY;
+	}
+
+	// Check every link before taking any sqe, the chain is all-or-nothing
+	for (uint16_t i = 0; i < nlinks; ++i) {
+		if (_linux_iou_opcode(&links[i].cmd) < 0) {
+			return -ENOSYS;
+		}
+	}
+
+	// With the SQ thread behind, the SQ may be full of consumed commands
+	if (io_uring_sq_space_left(&actx->ring) < nlinks) {
+		XNVME_DEBUG("FAILED: SQ cannot fit nlinks: %u", nlinks);
+		return -EAGAIN;
+	}
+
+	for (uint16_t i = 0; i < nlinks; ++i) {
+		struct xnvme_cmd_link *link = &links[i];
+		struct io_uring_sqe *sqe;
+
+		sqe = io_uring_get_sqe(&actx->ring);
+		if (!sqe) {
+			XNVME_DEBUG("FAILED: io_uring_get_sqe(), link: %u", i);
+			_linux_iou_sq_rewind(actx, i);
+			return -EAGAIN;
+		}
+
+		_linux_iou_sqe_prep(dev, actx, sqe, _linux_iou_opcode(&link->cmd),
+				    &link->cmd, link->dbuf, link->dbuf_nbytes,
+				    &link->req);
+		if (i < (nlinks - 1)) {
+			sqe->flags |= IOSQE_IO_LINK;
+		}
+	}
+
+	err = io_uring_submit(&actx->ring);
+	if (err < 0) {
+		// The SQ thread consumes the flushed sqes regardless of the error
+		// of waking it up, thus the chain is then submitted
+		if (!actx->poll_sq) {
+			XNVME_DEBUG("FAILED: io_uring_submit(), err: %d", err);
+			_linux_iou_sq_rewind(actx, nlinks);
+			return err;
+		}
+		XNVME_DEBUG("INFO: io_uring_submit(), err: %d, with poll_sq", err);
+	}
+
+	actx->outstanding += nlinks;
+
+	return 0;
+}
+
+/**
+ * Prepares an sqe for each command, up to the room in the context and the SQ,
+ * and submits them with a single io_uring_submit(); as for the chain, on error
+ * none of the sqes are left in the SQ
+ */
+int
+_linux_iou_cmd_batch(struct xnvme_dev *dev, struct xnvme_cmd_link **cmds,
+		     uint16_t ncmds, int opts)
+{
+	struct xnvme_async_ctx_linux_iou *actx = (void *)cmds[0]->req.async.ctx;
+	unsigned nsqes;
+	int err;
+
+	nsqes = XNVME_MIN(ncmds, actx->depth - actx->outstanding);
+	if (!nsqes) {
+		XNVME_DEBUG("FAILED: queue is full");
+		return -EBUSY;
+	}
+	nsqes = XNVME_MIN(nsqes, io_uring_sq_space_left(&actx->ring));
+	if (!nsqes) {
+		return -EAGAIN;
+	}
+
+	for (unsigned i = 0; i < nsqes; ++i) {
+		struct xnvme_cmd_link *cmd = cmds[i];
+		struct io_uring_sqe *sqe;
+		int opcode;
+
+		opcode = _linux_iou_opcode(&cmd->cmd);
+		if (opcode < 0) {
+			if (!i) {
+				return opcode;
+			}
+			nsqes = i;
+			break;
+		}
+
+		sqe = io_uring_get_sqe(&actx->ring);
+		if (!sqe) {
+			XNVME_DEBUG("FAILED: io_uring_get_sqe(), cmd: %u", i);
+			_linux_iou_sq_rewind(actx, i);
+			return -EAGAIN;
+		}
+
+		_linux_iou_sqe_prep(dev, actx, sqe, opcode, &cmd->cmd, cmd->dbuf,
+				    cmd->dbuf_nbytes, &cmd->req);
+		if (opts & XNVME_CMD_BUFSEL) {
+			sqe->flags |= IOSQE_BUFFER_SELECT;
+			sqe->buf_group = XNVME_BE_LINUX_IOU_BGID;
+		}
+		if (opcode == IORING_OP_FSYNC) {
+			sqe->flags |= IOSQE_IO_DRAIN;
+		}
+	}
+
+	err = io_uring_submit(&actx->ring);
+	if (err < 0) {
+		if (!actx->poll_sq) {
+			XNVME_DEBUG("FAILED: io_uring_submit(), err: %d", err);
+			_linux_iou_sq_rewind(actx, nsqes);
+			return err;
+		}
+		XNVME_DEBUG("INFO: io_uring_submit(), err: %d, with poll_sq", err);
+	}
+
+	actx->outstanding += nsqes;
+
+	return nsqes;
+}
+
+XNVME_STATIC_ASSERT(sizeof(struct io_uring_sqe) <= XNVME_CMD_TMPL_BE_NBYTES,
+		    "Incorrect size")
+
+static int
+_linux_iou_tmpl_submit(struct xnvme_cmd_tmpl *tmpl, uint64_t slba,
+		       uint16_t nlb, void *dbuf, struct xnvme_req *req)
+{
+	struct xnvme_async_ctx_linux_iou *actx = (void *)tmpl->ctx;
+	struct io_uring_sqe *sqe;
+	int err;
+
+	if (actx->outstanding == actx->depth) {
+		XNVME_DEBUG("FAILED: queue is full");
+		return -EBUSY;
+	}
+
+	sqe = io_uring_get_sqe(&actx->ring);
+	if (!sqe) {
+		return -EAGAIN;
+	}
+
+	memcpy(sqe, tmpl->be_rsvd, sizeof(*sqe));
 	sqe->addr = (unsigned long) dbuf;
-	sqe->len = dbuf_nbytes;
-	sqe->off = cmd->lblk.slba << dev->ssw;
-	sqe->flags = actx->poll_sq ? IOSQE_FIXED_FILE : 0;
-	sqe->ioprio = 0;
-	// NOTE: we only ever register a single file, the raw device, so the
-	// provided index will always be 0
-	sqe->fd = actx->poll_sq ? 0 : state->fd;
-	sqe->rw_flags = 0;
+	sqe->len = (nlb + 1) * tmpl->lba_nbytes;
+	sqe->off = slba << tmpl->ssw;
+	sqe->ioprio = req->async.prio;
 	sqe->user_data = (unsigned long)req;
-	sqe->__pad2[0] = sqe->__pad2[1] = sqe->__pad2[2] = 0;
 
 	err = io_uring_submit(&actx->ring);
 	if (err < 0) {
-		XNVME_DEBUG("io_uring_submit(%d), err: %d", opcode, err);
+		XNVME_DEBUG("io_uring_submit(), err: %d", err);
 		return err;
 	}
 
@@ -300,6 +932,33 @@ _linux_iou_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
 	return 0;
 }
 
+/**
+ * Pre-fills the sqe of the template, submission then patches the buffer, the
+ * offset and the length
+ */
+static int
+_linux_iou_cmd_tmpl(struct xnvme_dev *dev, struct xnvme_cmd_tmpl *tmpl)
+{
+	struct xnvme_async_ctx_linux_iou *actx = (void *)tmpl->ctx;
+	struct xnvme_be_linux_state *state = (void *)dev->be.state;
+	struct io_uring_sqe *sqe = (void *)tmpl->be_rsvd;
+	int opcode;
+
+	opcode = _linux_iou_opcode(&tmpl->cmd);
+	if (opcode < 0) {
+		return opcode;
+	}
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = opcode;
+	sqe->flags = actx->fixed_file ? IOSQE_FIXED_FILE : 0;
+	sqe->fd = actx->fixed_file ? 0 : state->fd;
+
+	tmpl->submit = _linux_iou_tmpl_submit;
+
+	return 0;
+}
+
 struct xnvme_be_async g_linux_iou = {
 	.id = "iou",
 #ifdef XNVME_BE_LINUX_IOU_ENABLED
@@ -310,6 +969,13 @@ struct xnvme_be_async g_linux_iou = {
 	.init = _linux_iou_init,
 	.term = _linux_iou_term,
 	.supported = _linux_iou_supported,
+	.cmd_chain = _linux_iou_cmd_chain,
+	.notify = _linux_iou_notify,
+	.bufs_init = _linux_iou_bufs_init,
+	.buf_put = _linux_iou_buf_put,
+	.reap = _linux_iou_reap,
+	.cmd_tmpl = _linux_iou_cmd_tmpl,
+	.cmd_batch = _linux_iou_cmd_batch,
 #else
 	.enabled = 0,
 	.cmd_io = xnvme_be_nosys_async_cmd_io,
@@ -318,6 +984,13 @@ struct xnvme_be_async g_linux_iou = {
 	.init = xnvme_be_nosys_async_init,
 	.term = xnvme_be_nosys_async_term,
 	.supported = xnvme_be_nosys_async_supported,
+	.cmd_chain = xnvme_be_nosys_async_cmd_chain,
+	.notify = xnvme_be_nosys_async_notify,
+	.bufs_init = xnvme_be_nosys_async_bufs_init,
+	.buf_put = xnvme_be_nosys_async_buf_put,
+	.reap = xnvme_be_nosys_async_reap,
+	.cmd_tmpl = xnvme_be_nosys_async_cmd_tmpl,
+	.cmd_batch = xnvme_be_nosys_async_cmd_batch,
 #endif
 };
 
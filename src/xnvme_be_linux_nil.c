@@ -27,6 +27,7 @@
 #include <xnvme_be_linux.h>
 #include <xnvme_be_linux_nil.h>
 #include <xnvme_dev.h>
+#include <xnvme_cmd_tmpl.h>
 
 int
 _linux_nil_init(struct xnvme_dev *XNVME_UNUSED(dev),
@@ -68,29 +69,54 @@ _linux_nil_poke(struct xnvme_dev *XNVME_UNUSED(dev),
 	max = max > actx->outstanding ? actx->outstanding : max;
 
 	while (completed < max) {
-		unsigned cur = actx->outstanding - completed - 1;
 		struct xnvme_req *req;
 
-		req = actx->reqs[cur];
+		// Release the slot before the callback, it may submit
+		actx->outstanding -= 1;
+		req = actx->reqs[actx->outstanding];
+		actx->reqs[actx->outstanding] = NULL;
 		if (!req) {
 			XNVME_DEBUG("-{[THIS SHOULD NOT HAPPEN]}-");
-
-			++completed;
-			ctx->outstanding -= completed;
 			return -EIO;
 		}
 
 		req->cpl.status.sc = 0;
 		req->async.cb(req, req->async.cb_arg);
-		actx->reqs[cur] = NULL;
 
 		++completed;
 	};
 
-	actx->outstanding -= completed;
 	return completed;
 }
 
+int
+_linux_nil_reap(struct xnvme_dev *XNVME_UNUSED(dev),
+		struct xnvme_async_ctx *ctx, struct xnvme_req **out,
+		uint32_t max)
+{
+	struct xnvme_async_ctx_nil *actx = (void *)ctx;
+	unsigned nreaped = 0;
+
+	max = max > actx->outstanding ? actx->outstanding : max;
+
+	while (nreaped < max) {
+		struct xnvme_req *req;
+
+		actx->outstanding -= 1;
+		req = actx->reqs[actx->outstanding];
+		actx->reqs[actx->outstanding] = NULL;
+		if (!req) {
+			XNVME_DEBUG("-{[THIS SHOULD NOT HAPPEN]}-");
+			return -EIO;
+		}
+
+		req->cpl.status.sc = 0;
+		out[nreaped++] = req;
+	}
+
+	return nreaped;
+}
+
 int
 _linux_nil_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
 {
@@ -101,8 +127,8 @@ _linux_nil_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
 		int err;
 
 		err = _linux_nil_poke(dev, ctx, 0);
-		if (!err) {
-			acc += 1;
+		if (err >= 0) {
+			acc += err;
 			continue;
 		}
 
@@ -139,6 +165,32 @@ _linux_nil_cmd_io(struct xnvme_dev *XNVME_UNUSED(dev),
 	return 0;
 }
 
+static inline int
+_linux_nil_tmpl_submit(struct xnvme_cmd_tmpl *tmpl,
+		       uint64_t XNVME_UNUSED(slba), uint16_t XNVME_UNUSED(nlb),
+		       void *XNVME_UNUSED(dbuf), struct xnvme_req *req)
+{
+	struct xnvme_async_ctx_nil *actx = (void *)tmpl->ctx;
+
+	if (actx->outstanding == actx->depth) {
+		XNVME_DEBUG("FAILED: queue is full");
+		return -EBUSY;
+	}
+
+	actx->reqs[actx->outstanding++] = req;
+
+	return 0;
+}
+
+int
+_linux_nil_cmd_tmpl(struct xnvme_dev *XNVME_UNUSED(dev),
+		    struct xnvme_cmd_tmpl *tmpl)
+{
+	tmpl->submit = _linux_nil_tmpl_submit;
+
+	return 0;
+}
+
 int
 _linux_nil_supported(struct xnvme_dev *XNVME_UNUSED(dev),
 		     uint32_t XNVME_UNUSED(opts))
@@ -156,6 +208,13 @@ struct xnvme_be_async g_linux_nil = {
 	.init = _linux_nil_init,
 	.term = _linux_nil_term,
 	.supported = _linux_nil_supported,
+	.cmd_chain = xnvme_be_nosys_async_cmd_chain,
+	.notify = xnvme_be_nosys_async_notify,
+	.bufs_init = xnvme_be_nosys_async_bufs_init,
+	.buf_put = xnvme_be_nosys_async_buf_put,
+	.reap = _linux_nil_reap,
+	.cmd_tmpl = _linux_nil_cmd_tmpl,
+	.cmd_batch = xnvme_be_nosys_async_cmd_batch,
 #else
 	.enabled = 0,
 	.cmd_io = xnvme_be_nosys_async_cmd_io,
@@ -164,6 +223,13 @@ struct xnvme_be_async g_linux_nil = {
 	.init = xnvme_be_nosys_async_init,
 	.term = xnvme_be_nosys_async_term,
 	.supported = xnvme_be_nosys_async_supported,
+	.cmd_chain = xnvme_be_nosys_async_cmd_chain,
+	.notify = xnvme_be_nosys_async_notify,
+	.bufs_init = xnvme_be_nosys_async_bufs_init,
+	.buf_put = xnvme_be_nosys_async_buf_put,
+	.reap = xnvme_be_nosys_async_reap,
+	.cmd_tmpl = xnvme_be_nosys_async_cmd_tmpl,
+	.cmd_batch = xnvme_be_nosys_async_cmd_batch,
 #endif
 
 };
@@ -47,7 +47,9 @@ _qp_alloc(struct _qp **qp, uint32_t capacity)
 	}
 	memset((*qp), 0, nbytes);
 
-	STAILQ_INIT(&(*qp)->sq);
+	for (int i = 0; i < XNVME_BE_LINUX_THR_NRANKS; ++i) {
+		STAILQ_INIT(&(*qp)->sq[i]);
+	}
 	STAILQ_INIT(&(*qp)->cq);
 	STAILQ_INIT(&(*qp)->rp);
 
@@ -123,6 +125,25 @@ failed:
 	return 1;
 }
 
+/**
+ * Rank of the given priority, lower ranks are served first; no priority is
+ * ranked as best-effort at the default level, as done by Linux
+ */
+static inline uint32_t
+_linux_thr_prio_rank(uint16_t prio)
+{
+	uint32_t pclass = XNVME_PRIO_CLASS(prio);
+
+	if (pclass == XNVME_PRIO_CLASS_NONE) {
+		return XNVME_PRIO_CLASS_BE * 8 + 4;
+	}
+	if (pclass > XNVME_PRIO_CLASS_IDLE) {
+		return XNVME_BE_LINUX_THR_NRANKS - 1;
+	}
+
+	return pclass * 8 + XNVME_PRIO_LEVEL(prio);
+}
+
 int
 _linux_thr_poke(struct xnvme_dev *dev,
 		struct xnvme_async_ctx *ctx, uint32_t max)
@@ -135,10 +156,14 @@ _linux_thr_poke(struct xnvme_dev *dev,
 	max = max > actx->outstanding ? actx->outstanding : max;
 
 	while (completed < max) {
-		struct _entry *entry = STAILQ_FIRST(&qp->sq);
+		const uint32_t rank = __builtin_ctz(qp->sq_ranks);
+		struct _entry *entry = STAILQ_FIRST(&qp->sq[rank]);
 		int err;
 
-		STAILQ_REMOVE_HEAD(&qp->sq, link);
+		STAILQ_REMOVE_HEAD(&qp->sq[rank], link);
+		if (STAILQ_EMPTY(&qp->sq[rank])) {
+			qp->sq_ranks &= ~(1U << rank);
+		}
 
 		err = dev->be.sync.cmd_io(entry->dev, &entry->cmd, entry->dbuf,
 					  entry->dbuf_nbytes, entry->mbuf,
@@ -149,12 +174,14 @@ _linux_thr_poke(struct xnvme_dev *dev,
 			entry->req->cpl.status.sc = err;
 		}
 		STAILQ_INSERT_TAIL(&qp->rp, entry, link);
+
+		// Release the slot before the callback, it may submit
+		actx->outstanding -= 1;
 		entry->req->async.cb(entry->req, entry->req->async.cb_arg);
 
 		++completed;
 	};
 
-	actx->outstanding -= completed;
 	return completed;
 }
 
@@ -168,8 +195,8 @@ _linux_thr_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
 		int err;
 
 		err = _linux_thr_poke(dev, ctx, 0);
-		if (!err) {
-			acc += 1;
+		if (err >= 0) {
+			acc += err;
 			continue;
 		}
 
@@ -195,6 +222,7 @@ _linux_thr_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd, void *dbuf,
 	struct xnvme_async_ctx_thr *actx = (void *)req->async.ctx;
 	struct _qp *qp = actx->qp;
 	struct _entry *entry;
+	uint32_t rank;
 
 	if (actx->outstanding == actx->depth) {
 		XNVME_DEBUG("FAILED: queue is full");
@@ -217,7 +245,10 @@ _linux_thr_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd, void *dbuf,
 	entry->mbuf_nbytes = mbuf_nbytes;
 	entry->req = req;
 
-	STAILQ_INSERT_TAIL(&qp->sq, entry, link);
+	// Higher priority requests jump the line, FIFO within the same rank
+	rank = _linux_thr_prio_rank(req->async.prio);
+	STAILQ_INSERT_TAIL(&qp->sq[rank], entry, link);
+	qp->sq_ranks |= 1U << rank;
 
 	actx->outstanding += 1;
 
@@ -241,6 +272,13 @@ struct xnvme_be_async g_linux_thr = {
 	.init = _linux_thr_init,
 	.term = _linux_thr_term,
 	.supported = _linux_thr_supported,
+	.cmd_chain = xnvme_be_nosys_async_cmd_chain,
+	.notify = xnvme_be_nosys_async_notify,
+	.bufs_init = xnvme_be_nosys_async_bufs_init,
+	.buf_put = xnvme_be_nosys_async_buf_put,
+	.reap = xnvme_be_nosys_async_reap,
+	.cmd_tmpl = xnvme_be_nosys_async_cmd_tmpl,
+	.cmd_batch = xnvme_be_nosys_async_cmd_batch,
 #else
 	.enabled = 0,
 	.cmd_io = xnvme_be_nosys_async_cmd_io,
@@ -249,6 +287,13 @@ struct xnvme_be_async g_linux_thr = {
 	.init = xnvme_be_nosys_async_init,
 	.term = xnvme_be_nosys_async_term,
 	.supported = xnvme_be_nosys_async_supported,
+	.cmd_chain = xnvme_be_nosys_async_cmd_chain,
+	.notify = xnvme_be_nosys_async_notify,
+	.bufs_init = xnvme_be_nosys_async_bufs_init,
+	.buf_put = xnvme_be_nosys_async_buf_put,
+	.reap = xnvme_be_nosys_async_reap,
+	.cmd_tmpl = xnvme_be_nosys_async_cmd_tmpl,
+	.cmd_batch = xnvme_be_nosys_async_cmd_batch,
 #endif
 
 };
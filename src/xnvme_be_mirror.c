@@ -0,0 +1,851 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <libxnvme.h>
+#include <xnvme_be.h>
+#include <xnvme_be_nosys.h>
+
+#ifdef XNVME_BE_MIRROR_ENABLED
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xnvme_async.h>
+#include <xnvme_be_mirror.h>
+#include <xnvme_be_vdev.h>
+#include <xnvme_dev.h>
+
+extern struct xnvme_be xnvme_be_mirror;
+
+static const char *g_keys[] = { "quorum", "hedge", NULL };
+
+static inline struct xnvme_be_mirror *
+_mirror(const struct xnvme_dev *dev)
+{
+	return (void *)xnvme_be_vdev(dev);
+}
+
+static inline size_t
+_mirror_cmd_nbytes(const struct xnvme_dev *dev,
+		   const struct xnvme_spec_cmd *cmd)
+{
+	switch (cmd->common.opcode) {
+	case XNVME_SPEC_OPC_READ:
+	case XNVME_SPEC_OPC_WRITE:
+		return (cmd->lblk.nlb + 1ULL) * dev->geo.lba_nbytes;
+
+	default:
+		return 0;
+	}
+}
+
+/**
+ * Check that the command is one which can be mirrored, see
+ * xnvme_be_vdev_cmd_check(), and that its payload fits in the given buffer
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+static int
+_mirror_cmd_check(const struct xnvme_dev *dev,
+		  const struct xnvme_spec_cmd *cmd, size_t dbuf_nbytes,
+		  const void *mbuf)
+{
+	int err;
+
+	err = xnvme_be_vdev_cmd_check(dev, cmd, mbuf);
+	if (err) {
+		return err;
+	}
+	if (_mirror_cmd_nbytes(dev, cmd) > dbuf_nbytes) {
+		XNVME_DEBUG("FAILED: dbuf_nbytes: %zu, too small", dbuf_nbytes);
+		return -EINVAL;
+	}
+	if (_mirror_cmd_nbytes(dev, cmd) > dev->geo.mdts_nbytes) {
+		XNVME_DEBUG("FAILED: nbytes > mdts_nbytes: %u",
+			    dev->geo.mdts_nbytes);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/**
+ * Reads go to the members in turn, on failure the next member is tried; writes
+ * go to all members and succeed when 'quorum' members succeed
+ */
+int
+xnvme_be_mirror_sync_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+			    void *dbuf, size_t dbuf_nbytes, void *mbuf,
+			    size_t XNVME_UNUSED(mbuf_nbytes),
+			    int XNVME_UNUSED(opts), struct xnvme_req *req)
+{
+	static __thread uint32_t rr;
+	struct xnvme_be_mirror *mirror = _mirror(dev);
+	const size_t nbytes = _mirror_cmd_nbytes(dev, cmd);
+	uint32_t nsucceeded = 0;
+	int err;
+
+	err = _mirror_cmd_check(dev, cmd, dbuf_nbytes, mbuf);
+	if (err) {
+		XNVME_DEBUG("FAILED: _mirror_cmd_check(), err: %d", err);
+		return err;
+	}
+
+	if (cmd->common.opcode == XNVME_SPEC_OPC_READ) {
+		rr += 1;
+		for (uint32_t i = 0; i < mirror->vdev.nmembers; ++i) {
+			struct xnvme_dev *member;
+			struct xnvme_spec_cmd ccmd = *cmd;
+
+			member = mirror->vdev.members[(rr + i) % mirror->vdev.nmembers];
+			ccmd.common.nsid = xnvme_dev_get_nsid(member);
+
+			err = xnvme_cmd_pass(member, &ccmd, dbuf, nbytes, NULL, 0,
+					     XNVME_CMD_SYNC, req);
+			if (!err) {
+				return 0;
+			}
+		}
+
+		return err;
+	}
+
+	for (uint32_t i = 0; i < mirror->vdev.nmembers; ++i) {
+		struct xnvme_dev *member = mirror->vdev.members[i];
+		struct xnvme_spec_cmd ccmd = *cmd;
+		int cerr;
+
+		ccmd.common.nsid = xnvme_dev_get_nsid(member);
+
+		cerr = xnvme_cmd_pass(member, &ccmd, nbytes ? dbuf : NULL, nbytes,
+				      NULL, 0, XNVME_CMD_SYNC, req);
+		if (cerr) {
+			XNVME_DEBUG("INFO: member: %u, err: %d", i, cerr);
+			err = cerr;
+			continue;
+		}
+		nsucceeded += 1;
+	}
+	if (nsucceeded < mirror->quorum) {
+		return err;
+	}
+	if (req) {
+		memset(&req->cpl, 0, sizeof(req->cpl));
+	}
+
+	return 0;
+}
+
+static void
+_mirror_queue_free(struct xnvme_be_mirror_queue *queue)
+{
+	if (!queue) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < queue->mirror->vdev.nmembers; ++i) {
+		if (queue->ctxs[i]) {
+			xnvme_async_term(queue->members[i], queue->ctxs[i]);
+		}
+	}
+	for (uint32_t i = 0; queue->pelm && (i < queue->depth); ++i) {
+		for (uint32_t j = 0; j < 2; ++j) {
+			if (queue->pelm[i].bounce[j]) {
+				xnvme_buf_free(queue->dev,
+					       queue->pelm[i].bounce[j]);
+			}
+		}
+	}
+	free(queue->celm);
+	free(queue->pelm);
+	free(queue);
+}
+
+/**
+ * Setup the slots of parent commands, with bounce-buffers for those parents
+ * which may complete before all of their children: reads when hedging, and
+ * writes when the quorum is less than all members
+ */
+static int
+_mirror_queue_parents_init(struct xnvme_be_mirror_queue *queue)
+{
+	const struct xnvme_be_mirror *mirror = queue->mirror;
+	const size_t nbytes = queue->dev->geo.mdts_nbytes;
+	const uint32_t nbounce = mirror->hedge ? 2 : \
+				 (mirror->quorum < mirror->vdev.nmembers);
+
+	SLIST_INIT(&queue->parents);
+	TAILQ_INIT(&queue->reads);
+
+	for (uint32_t i = 0; i < queue->depth; ++i) {
+		struct xnvme_be_mirror_parent *parent = &queue->pelm[i];
+
+		for (uint32_t j = 0; j < nbounce; ++j) {
+			parent->bounce[j] = xnvme_buf_alloc(queue->dev, nbytes,
+							    NULL);
+			if (!parent->bounce[j]) {
+				XNVME_DEBUG("FAILED: xnvme_buf_alloc()");
+				return -ENOMEM;
+			}
+		}
+		SLIST_INSERT_HEAD(&queue->parents, parent, link);
+	}
+
+	return 0;
+}
+
+int
+xnvme_be_mirror_async_init(struct xnvme_dev *dev, struct xnvme_async_ctx **ctx,
+			   uint16_t depth, int flags)
+{
+	struct xnvme_be_mirror *mirror = _mirror(dev);
+	struct xnvme_async_ctx_mirror *actx;
+	struct xnvme_be_mirror_queue *queue;
+	int err;
+
+	*ctx = calloc(1, sizeof(**ctx));
+	if (!*ctx) {
+		XNVME_DEBUG("FAILED: calloc(ctx), errno: %s", strerror(errno));
+		return -errno;
+	}
+	actx = (void *)*ctx;
+	actx->depth = depth;
+
+	queue = calloc(1, sizeof(*queue));
+	if (!queue) {
+		XNVME_DEBUG("FAILED: calloc(queue), errno: %s",
+			    strerror(errno));
+		err = -errno;
+		free(*ctx);
+		*ctx = NULL;
+		return err;
+	}
+	queue->mirror = mirror;
+	queue->dev = dev;
+	queue->depth = depth;
+
+	queue->pelm = calloc(depth, sizeof(*queue->pelm));
+	queue->celm = calloc(depth * mirror->vdev.nmembers, sizeof(*queue->celm));
+	if (!(queue->pelm && queue->celm)) {
+		XNVME_DEBUG("FAILED: calloc(elm), errno: %s", strerror(errno));
+		err = -errno;
+		goto failed;
+	}
+
+	err = _mirror_queue_parents_init(queue);
+	if (err) {
+		XNVME_DEBUG("FAILED: _mirror_queue_parents_init()");
+		goto failed;
+	}
+
+	for (uint32_t i = 0; i < mirror->vdev.nmembers; ++i) {
+		queue->members[i] = mirror->vdev.members[i];
+
+		err = xnvme_async_init(queue->members[i], &queue->ctxs[i],
+				       depth, flags);
+		if (err) {
+			XNVME_DEBUG("FAILED: xnvme_async_init(member: %u)", i);
+			queue->ctxs[i] = NULL;
+			goto failed;
+		}
+
+		SLIST_INIT(&queue->children[i]);
+		for (uint32_t j = 0; j < depth; ++j) {
+			struct xnvme_be_mirror_child *child;
+
+			child = &queue->celm[i * depth + j];
+			child->queue = queue;
+			child->member = i;
+			SLIST_INSERT_HEAD(&queue->children[i], child, link);
+		}
+		queue->nfree[i] = depth;
+	}
+
+	actx->queue = queue;
+
+	return 0;
+
+failed:
+	_mirror_queue_free(queue);
+	free(*ctx);
+	*ctx = NULL;
+
+	return err;
+}
+
+int
+xnvme_be_mirror_async_term(struct xnvme_dev *XNVME_UNUSED(dev),
+			   struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_async_ctx_mirror *actx = (void *)ctx;
+
+	if (!ctx) {
+		XNVME_DEBUG("FAILED: ctx: %p", (void *)ctx);
+		return -EINVAL;
+	}
+
+	_mirror_queue_free(actx->queue);
+	free(ctx);
+
+	return 0;
+}
+
+static int
+_mirror_lat_cmp(const void *a, const void *b)
+{
+	const uint64_t x = *(const uint64_t *)a;
+	const uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/**
+ * Record the latency of a read; the hedging threshold is re-derived, from the
+ * most recent reads, every XNVME_BE_MIRROR_NSAMPLES_MIN reads
+ */
+static void
+_mirror_lat_record(struct xnvme_be_mirror_lat *lat, uint32_t pct,
+		   uint64_t nsec)
+{
+	uint64_t nsamples;
+
+	lat->samples[lat->nsamples % XNVME_BE_MIRROR_NSAMPLES] = nsec;
+	lat->nsamples += 1;
+	if (lat->nsamples % XNVME_BE_MIRROR_NSAMPLES_MIN) {
+		return;
+	}
+
+	nsamples = XNVME_MIN(lat->nsamples, XNVME_BE_MIRROR_NSAMPLES);
+	memcpy(lat->sorted, lat->samples, nsamples * sizeof(*lat->sorted));
+	qsort(lat->sorted, nsamples, sizeof(*lat->sorted), _mirror_lat_cmp);
+
+	lat->thr_nsec = lat->sorted[(nsamples * pct) / 100];
+}
+
+/**
+ * Select the member to read from, among those not yet tried: the one with the
+ * fewest outstanding commands
+ *
+ * @return The index of the member, or -1 when there is none to read from
+ */
+static int
+_mirror_read_member(struct xnvme_be_mirror_queue *queue, uint32_t tried)
+{
+	const uint32_t nmembers = queue->mirror->vdev.nmembers;
+	uint32_t nmin = UINT32_MAX;
+	int midx = -1;
+
+	for (uint32_t i = 0; i < nmembers; ++i) {
+		const uint32_t cand = (queue->rr + i) % nmembers;
+		uint32_t noutstanding;
+
+		if ((tried & (1U << cand)) || !queue->nfree[cand]) {
+			continue;
+		}
+
+		noutstanding = xnvme_async_get_outstanding(queue->ctxs[cand]);
+		if (noutstanding < nmin) {
+			nmin = noutstanding;
+			midx = cand;
+		}
+	}
+
+	return midx;
+}
+
+static inline void
+_mirror_parent_put(struct xnvme_be_mirror_queue *queue,
+		   struct xnvme_be_mirror_parent *parent)
+{
+	if (parent->queued) {
+		TAILQ_REMOVE(&queue->reads, parent, rlink);
+		parent->queued = 0;
+	}
+	SLIST_INSERT_HEAD(&queue->parents, parent, link);
+}
+
+static void
+_mirror_child_cb(struct xnvme_req *creq, void *cb_arg);
+
+static int
+_mirror_child_submit(struct xnvme_be_mirror_queue *queue,
+		     struct xnvme_be_mirror_parent *parent, uint32_t midx,
+		     void *dbuf)
+{
+	struct xnvme_be_mirror_child *child;
+	struct xnvme_spec_cmd ccmd = parent->cmd;
+	int err;
+
+	child = SLIST_FIRST(&queue->children[midx]);
+	SLIST_REMOVE_HEAD(&queue->children[midx], link);
+	queue->nfree[midx] -= 1;
+
+	xnvme_req_clear(&child->req);
+	child->req.async.ctx = queue->ctxs[midx];
+	child->req.async.cb = _mirror_child_cb;
+	child->req.async.cb_arg = child;
+	child->req.async.prio = parent->req->async.prio;
+	child->parent = parent;
+	child->dbuf = dbuf;
+	child->tsubmit = _xnvme_timer_clock_sample();
+
+	ccmd.common.nsid = xnvme_dev_get_nsid(queue->members[midx]);
+
+	err = xnvme_cmd_pass(queue->members[midx], &ccmd, dbuf,
+			     dbuf ? parent->dbuf_nbytes : 0, NULL, 0,
+			     XNVME_CMD_ASYNC, &child->req);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_cmd_pass(member: %u), err: %d",
+			    midx, err);
+		SLIST_INSERT_HEAD(&queue->children[midx], child, link);
+		queue->nfree[midx] += 1;
+		return err;
+	}
+	parent->tried |= 1U << midx;
+	parent->npending += 1;
+
+	return 0;
+}
+
+/**
+ * Complete the parent; its slot is released when none of its children are
+ * pending, otherwise once the lagging children complete
+ */
+static void
+_mirror_parent_complete(struct xnvme_be_mirror_queue *queue,
+			struct xnvme_be_mirror_parent *parent,
+			const struct xnvme_spec_cpl *cpl)
+{
+	struct xnvme_req *req = parent->req;
+	struct xnvme_async_ctx_mirror *actx = (void *)req->async.ctx;
+
+	req->cpl = *cpl;
+	parent->req = NULL;
+
+	// Release the parent before the callback, it may submit
+	if (parent->npending) {
+		if (parent->queued) {
+			TAILQ_REMOVE(&queue->reads, parent, rlink);
+			parent->queued = 0;
+		}
+		queue->nlagging += 1;
+	} else {
+		_mirror_parent_put(queue, parent);
+	}
+	actx->outstanding -= 1;
+	queue->ncompleted += 1;
+
+	req->async.cb(req, req->async.cb_arg);
+}
+
+static void
+_mirror_child_cb(struct xnvme_req *creq, void *cb_arg)
+{
+	struct xnvme_be_mirror_child *child = cb_arg;
+	struct xnvme_be_mirror_queue *queue = child->queue;
+	struct xnvme_be_mirror_parent *parent = child->parent;
+	const struct xnvme_spec_cpl cpl = creq->cpl;
+	const bool failed = xnvme_req_cpl_status(creq);
+	const bool read = parent->cmd.common.opcode == XNVME_SPEC_OPC_READ;
+	void *dbuf = child->dbuf;
+	int midx;
+
+	SLIST_INSERT_HEAD(&queue->children[child->member], child, link);
+	queue->nfree[child->member] += 1;
+	parent->npending -= 1;
+
+	if (failed) {
+		XNVME_DEBUG("INFO: member: %u, sct: 0x%x, sc: 0x%x",
+			    child->member, cpl.status.sct, cpl.status.sc);
+		if (!parent->nfailed) {
+			parent->cpl = cpl;
+		}
+		parent->nfailed += 1;
+	} else {
+		parent->nsucceeded += 1;
+	}
+	if (read && !failed && queue->mirror->hedge) {
+		_mirror_lat_record(&queue->lat, queue->mirror->hedge,
+				   _xnvme_timer_clock_sample() - child->tsubmit);
+	}
+
+	if (!parent->req) {
+		if (!parent->npending) {
+			_mirror_parent_put(queue, parent);
+			queue->nlagging -= 1;
+		}
+		return;
+	}
+
+	if (read) {
+		if (!failed) {
+			if (dbuf != parent->dbuf) {
+				memcpy(parent->dbuf, dbuf, parent->dbuf_nbytes);
+			}
+			_mirror_parent_complete(queue, parent, &cpl);
+			return;
+		}
+		if (parent->npending) {
+			return;
+		}
+
+		// Read from another member, the slot is not in use by others
+		midx = _mirror_read_member(queue, parent->tried);
+		if ((midx >= 0) && \
+		    !_mirror_child_submit(queue, parent, midx,
+					  parent->bounce[0] ? parent->bounce[0] :
+					  parent->dbuf)) {
+			return;
+		}
+		_mirror_parent_complete(queue, parent, &parent->cpl);
+		return;
+	}
+
+	if (parent->nsucceeded == parent->nrequired) {
+		const struct xnvme_spec_cpl ok = { 0 };
+
+		_mirror_parent_complete(queue, parent, &ok);
+	} else if (parent->nfailed > queue->mirror->vdev.nmembers - parent->nrequired) {
+		_mirror_parent_complete(queue, parent, &parent->cpl);
+	}
+}
+
+/**
+ * Submit a duplicate read, to another member, of the reads outstanding for
+ * longer than the hedging threshold
+ */
+static void
+_mirror_hedge(struct xnvme_async_ctx *ctx, struct xnvme_be_mirror_queue *queue)
+{
+	const uint64_t thr_nsec = queue->lat.thr_nsec;
+	struct xnvme_be_mirror_parent *parent;
+	uint64_t now;
+
+	if (!thr_nsec || TAILQ_EMPTY(&queue->reads)) {
+		return;
+	}
+
+	now = _xnvme_timer_clock_sample();
+	while ((parent = TAILQ_FIRST(&queue->reads))) {
+		int midx;
+
+		if ((now - parent->tsubmit) < thr_nsec) {
+			break;
+		}
+		TAILQ_REMOVE(&queue->reads, parent, rlink);
+		parent->queued = 0;
+
+		midx = _mirror_read_member(queue, parent->tried);
+		if (midx < 0) {
+			continue;
+		}
+		if (_mirror_child_submit(queue, parent, midx,
+					 parent->bounce[1])) {
+			continue;
+		}
+		parent->hedged = 1;
+		ctx->nhedged += 1;
+	}
+}
+
+int
+xnvme_be_mirror_async_poke(struct xnvme_dev *XNVME_UNUSED(dev),
+			   struct xnvme_async_ctx *ctx, uint32_t max)
+{
+	struct xnvme_async_ctx_mirror *actx = (void *)ctx;
+	struct xnvme_be_mirror_queue *queue = actx->queue;
+	const uint32_t nmembers = queue->mirror->vdev.nmembers;
+	const uint32_t ncompleted = queue->ncompleted;
+	uint32_t completed = 0;
+
+	max = max ? max : actx->outstanding;
+	max = max > actx->outstanding ? actx->outstanding : max;
+	if (!(max || queue->nlagging)) {
+		return 0;
+	}
+
+	// Without any outstanding, the members are poked for lagging children
+	for (uint32_t i = 0; (i < nmembers) && (!max || (completed < max));
+	     ++i) {
+		const uint32_t midx = (queue->rr + i) % nmembers;
+		int err;
+
+		err = xnvme_async_poke(queue->members[midx], queue->ctxs[midx],
+				       max ? max - completed : 0);
+		if (err < 0) {
+			XNVME_DEBUG("FAILED: xnvme_async_poke(member: %u)",
+				    midx);
+			return err;
+		}
+		completed = queue->ncompleted - ncompleted;
+	}
+	queue->rr = (queue->rr + 1) % nmembers;
+
+	if (queue->mirror->hedge) {
+		_mirror_hedge(ctx, queue);
+	}
+
+	return completed;
+}
+
+/**
+ * Wait for completion of the outstanding commands, and of the lagging children
+ * of completed commands
+ */
+int
+xnvme_be_mirror_async_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_async_ctx_mirror *actx = (void *)ctx;
+	int acc = 0;
+
+	while (ctx->outstanding || actx->queue->nlagging) {
+		int err;
+
+		err = xnvme_be_mirror_async_poke(dev, ctx, 0);
+		if (err >= 0) {
+			acc += err;
+			continue;
+		}
+
+		return err;
+	}
+
+	return acc;
+}
+
+int
+xnvme_be_mirror_async_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+			     void *dbuf, size_t dbuf_nbytes, void *mbuf,
+			     size_t XNVME_UNUSED(mbuf_nbytes),
+			     int XNVME_UNUSED(opts), struct xnvme_req *req)
+{
+	struct xnvme_be_mirror *mirror = _mirror(dev);
+	struct xnvme_async_ctx_mirror *actx = (void *)req->async.ctx;
+	struct xnvme_be_mirror_queue *queue = actx->queue;
+	struct xnvme_be_mirror_parent *parent;
+	const bool read = cmd->common.opcode == XNVME_SPEC_OPC_READ;
+	const size_t nbytes = _mirror_cmd_nbytes(dev, cmd);
+	void *buf = nbytes ? dbuf : NULL;
+	int midx = -1;
+	int err;
+
+	if (actx->outstanding == actx->depth) {
+		XNVME_DEBUG("FAILED: queue is full");
+		return -EBUSY;
+	}
+
+	err = _mirror_cmd_check(dev, cmd, dbuf_nbytes, mbuf);
+	if (err) {
+		XNVME_DEBUG("FAILED: _mirror_cmd_check(), err: %d", err);
+		return err;
+	}
+
+	if (read) {
+		midx = _mirror_read_member(queue, 0);
+		if (midx < 0) {
+			XNVME_DEBUG("FAILED: members are full");
+			return -EBUSY;
+		}
+	}
+	for (uint32_t i = 0; !read && (i < mirror->vdev.nmembers); ++i) {
+		if (!queue->nfree[i]) {
+			XNVME_DEBUG("FAILED: member: %u, is full", i);
+			return -EBUSY;
+		}
+	}
+
+	// Slots of completed parents, with lagging children, are not free
+	parent = SLIST_FIRST(&queue->parents);
+	if (!parent) {
+		XNVME_DEBUG("FAILED: no free slots, nlagging: %u",
+			    queue->nlagging);
+		return -EBUSY;
+	}
+	SLIST_REMOVE_HEAD(&queue->parents, link);
+
+	parent->req = req;
+	parent->cmd = *cmd;
+	parent->dbuf = dbuf;
+	parent->dbuf_nbytes = nbytes;
+	parent->tsubmit = _xnvme_timer_clock_sample();
+	parent->tried = 0;
+	parent->npending = 0;
+	parent->nsucceeded = 0;
+	parent->nfailed = 0;
+	parent->hedged = 0;
+	memset(&parent->cpl, 0, sizeof(parent->cpl));
+
+	if (read) {
+		parent->nrequired = 1;
+		queue->rr = (queue->rr + 1) % mirror->vdev.nmembers;
+
+		err = _mirror_child_submit(queue, parent, midx, mirror->hedge ?
+					   parent->bounce[0] : buf);
+		if (err) {
+			_mirror_parent_put(queue, parent);
+			return err;
+		}
+		if (mirror->hedge) {
+			TAILQ_INSERT_TAIL(&queue->reads, parent, rlink);
+			parent->queued = 1;
+		}
+
+		actx->outstanding += 1;
+		return 0;
+	}
+
+	parent->nrequired = mirror->quorum;
+	if (buf && parent->bounce[0]) {
+		memcpy(parent->bounce[0], buf, nbytes);
+		buf = parent->bounce[0];
+	}
+	for (uint32_t i = 0; i < mirror->vdev.nmembers; ++i) {
+		if (_mirror_child_submit(queue, parent, i, buf)) {
+			parent->nfailed += 1;
+			parent->cpl.status.sct = 0x0;
+			parent->cpl.status.sc = XNVME_ASYNC_SC_INTERNAL_ERROR;
+		}
+	}
+	if (!parent->npending) {
+		_mirror_parent_put(queue, parent);
+		return -EIO;
+	}
+	actx->outstanding += 1;
+
+	return 0;
+}
+
+/**
+ * Setup the quorum and hedging from the options
+ */
+static int
+_mirror_init(struct xnvme_be_mirror *mirror, const struct xnvme_ident *ident)
+{
+	uint64_t quorum = mirror->vdev.nmembers;
+	uint64_t hedge = 0;
+
+	xnvme_ident_opt_to_u64(ident, "quorum", &quorum);
+	if (!quorum || (quorum > mirror->vdev.nmembers)) {
+		XNVME_DEBUG("FAILED: quorum: %lu, nmembers: %u", quorum,
+			    mirror->vdev.nmembers);
+		return -EINVAL;
+	}
+	xnvme_ident_opt_to_u64(ident, "hedge", &hedge);
+	if (hedge > 99) {
+		XNVME_DEBUG("FAILED: hedge: %lu, not a percentile", hedge);
+		return -EINVAL;
+	}
+
+	mirror->quorum = quorum;
+	mirror->hedge = mirror->vdev.nmembers > 1 ? hedge : 0;
+
+	return 0;
+}
+
+int
+xnvme_be_mirror_dev_from_ident(const struct xnvme_ident *ident,
+			       struct xnvme_dev **dev)
+{
+	struct xnvme_be_mirror *mirror;
+	uint64_t nlb;
+	int err;
+
+	mirror = xnvme_be_vdev_alloc(sizeof(*mirror));
+	if (!mirror) {
+		return -errno;
+	}
+
+	err = xnvme_be_vdev_open(&mirror->vdev, ident, g_keys,
+				 XNVME_BE_MIRROR_NMEMBERS_MAX);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_vdev_open()");
+		xnvme_be_vdev_free(&mirror->vdev);
+		return err;
+	}
+	err = _mirror_init(mirror, ident);
+	if (err) {
+		XNVME_DEBUG("FAILED: _mirror_init()");
+		xnvme_be_vdev_free(&mirror->vdev);
+		return err;
+	}
+
+	// The capacity of the mirror is that of the smallest member
+	nlb = mirror->vdev.members[0]->geo.nsect;
+	for (uint32_t i = 1; i < mirror->vdev.nmembers; ++i) {
+		nlb = XNVME_MIN(nlb, mirror->vdev.members[i]->geo.nsect);
+	}
+
+	err = xnvme_be_vdev_dev_alloc(&mirror->vdev, ident, &xnvme_be_mirror,
+				      "xNVMe mirrored device", nlb, dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_vdev_dev_alloc()");
+		xnvme_be_vdev_free(&mirror->vdev);
+		return err;
+	}
+
+	return 0;
+}
+#endif
+
+static const char *g_schemes[] = {
+	"mirror",
+};
+
+struct xnvme_be xnvme_be_mirror = {
+#ifdef XNVME_BE_MIRROR_ENABLED
+	.async = {
+		.cmd_io = xnvme_be_mirror_async_cmd_io,
+		.poke = xnvme_be_mirror_async_poke,
+		.wait = xnvme_be_mirror_async_wait,
+		.init = xnvme_be_mirror_async_init,
+		.term = xnvme_be_mirror_async_term,
+		.supported = xnvme_be_vdev_supported,
+		.cmd_chain = xnvme_be_nosys_async_cmd_chain,
+		.notify = xnvme_be_nosys_async_notify,
+		.bufs_init = xnvme_be_nosys_async_bufs_init,
+		.buf_put = xnvme_be_nosys_async_buf_put,
+		.reap = xnvme_be_nosys_async_reap,
+		.cmd_tmpl = xnvme_be_nosys_async_cmd_tmpl,
+		.cmd_batch = xnvme_be_nosys_async_cmd_batch,
+		.id = "mirror",
+		.enabled = 1,
+	},
+	.sync = {
+		.cmd_io = xnvme_be_mirror_sync_cmd_io,
+		.cmd_admin = xnvme_be_vdev_sync_cmd_admin,
+		.supported = xnvme_be_vdev_supported,
+		.id = "mirror",
+		.enabled = 1,
+	},
+	.mem = {
+		.buf_alloc = xnvme_be_vdev_buf_alloc,
+		.buf_realloc = xnvme_be_vdev_buf_realloc,
+		.buf_free = xnvme_be_vdev_buf_free,
+		.buf_vtophys = xnvme_be_vdev_buf_vtophys,
+	},
+	.dev = {
+		.enumerate = xnvme_be_vdev_enumerate,
+		.dev_from_ident = xnvme_be_mirror_dev_from_ident,
+		.dev_close = xnvme_be_vdev_dev_close,
+		.dev_dup = xnvme_be_vdev_dev_dup,
+	},
+#else
+	.async = XNVME_BE_NOSYS_ASYNC,
+	.sync = XNVME_BE_NOSYS_SYNC,
+	.mem = XNVME_BE_NOSYS_MEM,
+	.dev = XNVME_BE_NOSYS_DEV,
+#endif
+	.attr = {
+		.name = "mirror",
+#ifdef XNVME_BE_MIRROR_ENABLED
+		.enabled = 1,
+#else
+		.enabled = 0,
+#endif
+		.schemes = g_schemes,
+		.nschemes = sizeof g_schemes / sizeof(*g_schemes),
+	},
+	.state = { 0 },
+};
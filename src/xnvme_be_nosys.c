@@ -49,6 +49,75 @@ xnvme_be_nosys_async_supported(struct xnvme_dev *XNVME_UNUSED(dev),
 	return -ENOSYS;
 }
 
+int
+xnvme_be_nosys_async_cmd_chain(struct xnvme_dev *XNVME_UNUSED(dev),
+			       struct xnvme_cmd_link *XNVME_UNUSED(links),
+			       uint16_t XNVME_UNUSED(nlinks),
+			       int XNVME_UNUSED(opts))
+{
+	XNVME_DEBUG("FAILED: not implemented(possibly intentional)");
+	return -ENOSYS;
+}
+
+int
+xnvme_be_nosys_async_notify(struct xnvme_dev *XNVME_UNUSED(dev),
+			    struct xnvme_async_ctx *XNVME_UNUSED(ctx),
+			    int XNVME_UNUSED(fd))
+{
+	XNVME_DEBUG("FAILED: not implemented(possibly intentional)");
+	return -ENOSYS;
+}
+
+int
+xnvme_be_nosys_async_bufs_init(struct xnvme_dev *XNVME_UNUSED(dev),
+			       struct xnvme_async_ctx *XNVME_UNUSED(ctx),
+			       void *XNVME_UNUSED(bufs),
+			       uint32_t XNVME_UNUSED(nbufs),
+			       uint32_t XNVME_UNUSED(nbytes))
+{
+	XNVME_DEBUG("FAILED: not implemented(possibly intentional)");
+	return -ENOSYS;
+}
+
+int
+xnvme_be_nosys_async_buf_put(struct xnvme_dev *XNVME_UNUSED(dev),
+			     struct xnvme_async_ctx *XNVME_UNUSED(ctx),
+			     uint16_t XNVME_UNUSED(bid),
+			     void *XNVME_UNUSED(buf),
+			     uint32_t XNVME_UNUSED(nbytes))
+{
+	XNVME_DEBUG("FAILED: not implemented(possibly intentional)");
+	return -ENOSYS;
+}
+
+int
+xnvme_be_nosys_async_cmd_tmpl(struct xnvme_dev *XNVME_UNUSED(dev),
+			      struct xnvme_cmd_tmpl *XNVME_UNUSED(tmpl))
+{
+	XNVME_DEBUG("FAILED: not implemented(possibly intentional)");
+	return -ENOSYS;
+}
+
+int
+xnvme_be_nosys_async_reap(struct xnvme_dev *XNVME_UNUSED(dev),
+			  struct xnvme_async_ctx *XNVME_UNUSED(ctx),
+			  struct xnvme_req **XNVME_UNUSED(out),
+			  uint32_t XNVME_UNUSED(max))
+{
+	XNVME_DEBUG("FAILED: not implemented(possibly intentional)");
+	return -ENOSYS;
+}
+
+int
+xnvme_be_nosys_async_cmd_batch(struct xnvme_dev *XNVME_UNUSED(dev),
+			       struct xnvme_cmd_link **XNVME_UNUSED(cmds),
+			       uint16_t XNVME_UNUSED(ncmds),
+			       int XNVME_UNUSED(opts))
+{
+	XNVME_DEBUG("FAILED: not implemented(possibly intentional)");
+	return -ENOSYS;
+}
+
 int
 xnvme_be_nosys_async_cmd_io(struct xnvme_dev *XNVME_UNUSED(dev),
 			    struct xnvme_spec_cmd *XNVME_UNUSED(cmd),
@@ -134,7 +203,7 @@ xnvme_be_nosys_buf_vtophys(const struct xnvme_dev *XNVME_UNUSED(dev),
 }
 
 int
-xnvme_be_nosys_enumerate(struct xnvme_enumeration *XNVME_UNUSED(list),
+xnvme_be_nosys_enumerate(struct xnvme_enumeration **XNVME_UNUSED(list),
 			 const char *XNVME_UNUSED(sys_uri),
 			 int XNVME_UNUSED(opts))
 {
@@ -158,6 +227,14 @@ xnvme_be_nosys_dev_close(struct xnvme_dev *XNVME_UNUSED(dev))
 	return;
 }
 
+int
+xnvme_be_nosys_dev_dup(const struct xnvme_dev *XNVME_UNUSED(dev),
+		       struct xnvme_dev *XNVME_UNUSED(dup))
+{
+	XNVME_DEBUG("FAILED: not implemented(possibly intentional)");
+	return -ENOSYS;
+}
+
 static const char *g_schemes[] = {
 	"nosys",
 };
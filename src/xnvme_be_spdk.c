@@ -475,6 +475,9 @@ probe_cb(void *cb_ctx, const struct spdk_nvme_transport_id *probed,
 
 	// Setup controller options, general as well as trtype-specific
 	ctrlr_opts->command_set = state->css ? state->css : SPDK_NVME_CC_CSS_IOCS;
+	if (state->wrr) {
+		ctrlr_opts->arb_mechanism = SPDK_NVME_CC_AMS_WRR;
+	}
 
 	switch (req.trtype) {
 	case SPDK_NVME_TRANSPORT_PCIE:
@@ -568,7 +571,7 @@ xnvme_be_spdk_dev_close(struct xnvme_dev *dev)
 }
 
 struct xnvme_be_spdk_enumerate_ctx {
-	struct xnvme_enumeration *list;
+	struct xnvme_enumeration **list;
 	uint8_t cmb_sqs;
 	uint8_t css;
 };
@@ -705,7 +708,7 @@ enumerate_attach_cb(void *cb_ctx, const struct spdk_nvme_transport_id *probed,
  * - Consider how to support enumerating custom transports
  */
 int
-xnvme_be_spdk_enumerate(struct xnvme_enumeration *list, const char *sys_uri,
+xnvme_be_spdk_enumerate(struct xnvme_enumeration **list, const char *sys_uri,
 			int opts)
 {
 	struct xnvme_be_spdk_enumerate_ctx ectx = { 0 };
@@ -792,7 +795,9 @@ xnvme_be_spdk_enumerate(struct xnvme_enumeration *list, const char *sys_uri,
  *
  * - Determine device-type	(setup: dev->dtype)
  *
- * - Identify controller	(setup: dev->ctrlr)
+ * - Identify controller	(setup: dev->ctrlr), unless shared with another
+ *   handle of a namespace on the same controller, as with the g_cref table,
+ *   by the controller identifier
  *
  * - Identify namespace		(setup: dev->ns)
  * - Identify namespace-id	(setup: dev->nsid)
@@ -808,11 +813,18 @@ xnvme_be_spdk_dev_idfy(struct xnvme_dev *dev)
 	const struct spdk_nvme_ctrlr_data *ctrlr_data;
 	const struct spdk_nvme_ns_data *ns_data;
 	struct xnvme_req req = { 0 };
+	int shared;
 	int err;
 
 	dev->dtype = XNVME_DEV_TYPE_NVME_NAMESPACE;
 	dev->csi = XNVME_SPEC_CSI_NOCHECK;
 
+	shared = xnvme_dev_ctrlr_get(dev, dev->ident.trgt);
+	if (shared < 0) {
+		XNVME_DEBUG("FAILED: xnvme_dev_ctrlr_get(), err: %d", shared);
+		return shared;
+	}
+
 	// Allocate buffers for idfy
 	idfy_ctrlr = spdk_dma_malloc(sizeof(*idfy_ctrlr), 0x1000, NULL);
 	if (!idfy_ctrlr) {
@@ -840,7 +852,9 @@ xnvme_be_spdk_dev_idfy(struct xnvme_dev *dev)
 		err = -ENOMEM;
 		goto exit;
 	}
-	memcpy(&dev->id.ctrlr, ctrlr_data, sizeof(dev->id.ctrlr));
+	if (!shared) {
+		memcpy(&dev->ctrlr->id, ctrlr_data, sizeof(dev->ctrlr->id));
+	}
 	memcpy(&dev->id.ns, ns_data, sizeof(dev->id.ns));
 
 	//
@@ -848,17 +862,22 @@ xnvme_be_spdk_dev_idfy(struct xnvme_dev *dev)
 	//
 	dev->csi = XNVME_SPEC_CSI_LBLK;		// Assume NVM
 
-	// Attempt to identify Zoned Namespace
+	// Attempt to identify Zoned Namespace, the controller part is stored
+	// when supported, regardless of the namespace, as it is shared
 	{
 		struct znd_idfy_ns *zns = (void *)idfy_ns;
 
-		memset(idfy_ctrlr, 0, sizeof(*idfy_ctrlr));
-		memset(&req, 0, sizeof(req));
-		err = xnvme_cmd_idfy_ctrlr_csi(dev, XNVME_SPEC_CSI_ZONED,
-					       idfy_ctrlr, &req);
-		if (err || xnvme_req_cpl_status(&req)) {
-			XNVME_DEBUG("INFO: !id-ctrlr-zns");
-			goto not_zns;
+		if (!shared) {
+			memset(idfy_ctrlr, 0, sizeof(*idfy_ctrlr));
+			memset(&req, 0, sizeof(req));
+			err = xnvme_cmd_idfy_ctrlr_csi(dev, XNVME_SPEC_CSI_ZONED,
+						       idfy_ctrlr, &req);
+			if (err || xnvme_req_cpl_status(&req)) {
+				XNVME_DEBUG("INFO: !id-ctrlr-zns");
+				goto not_zns;
+			}
+			memcpy(&dev->ctrlr->idcss, idfy_ctrlr,
+			       sizeof(*idfy_ctrlr));
 		}
 
 		memset(idfy_ns, 0, sizeof(*idfy_ns));
@@ -875,7 +894,6 @@ xnvme_be_spdk_dev_idfy(struct xnvme_dev *dev)
 			goto not_zns;
 		}
 
-		memcpy(&dev->idcss.ctrlr, idfy_ctrlr, sizeof(*idfy_ctrlr));
 		memcpy(&dev->idcss.ns, idfy_ns, sizeof(*idfy_ns));
 		dev->csi = XNVME_SPEC_CSI_ZONED;
 
@@ -902,6 +920,10 @@ exit:
 	xnvme_buf_free(dev, idfy_ctrlr);
 	xnvme_buf_free(dev, idfy_ns);
 
+	if (!err && !shared) {
+		xnvme_dev_ctrlr_share(dev, dev->ident.trgt);
+	}
+
 	return err;
 }
 
@@ -919,6 +941,7 @@ xnvme_be_spdk_state_init(struct xnvme_dev *dev)
 	uint32_t nsid;
 	uint32_t cmb_sqs = 0x0;
 	uint32_t css = 0x0;
+	uint32_t wrr = 0x0;
 	int err;
 
 	struct spdk_env_opts env_opts;
@@ -938,11 +961,16 @@ xnvme_be_spdk_state_init(struct xnvme_dev *dev)
 	if (!xnvme_ident_opt_to_val(&dev->ident, "css", &css)) {
 		XNVME_DEBUG("!xnvme_ident_opt_to_val(opt:css)");
 	}
+	if (!xnvme_ident_opt_to_val(&dev->ident, "wrr", &wrr)) {
+		XNVME_DEBUG("!xnvme_ident_opt_to_val(opt:wrr)");
+	}
 	state->cmb_sqs = cmb_sqs ? true : false;
 	state->css = css & 0x7;		// Assign only the relevant bits
+	state->wrr = wrr ? true : false;
 
 	XNVME_DEBUG("INFO: dev->nsid: %d, state->cmb_sqs: %d, state->css: %d",
 		    nsid, state->cmb_sqs, state->css);
+	XNVME_DEBUG("INFO: state->wrr: %d", state->wrr);
 
 	spdk_env_opts_init(&env_opts);
 	if (strcmp(dev->ident.schm, "fab") == 0) {
@@ -1051,27 +1079,44 @@ xnvme_be_spdk_dev_from_ident(const struct xnvme_ident *ident,
 	err = xnvme_be_spdk_state_init(*dev);
 	if (err) {
 		XNVME_DEBUG("FAILED: xnvme_be_spdk_state_init()");
-		free(*dev);
+		xnvme_dev_free(*dev);
 		return err;
 	}
 	err = xnvme_be_spdk_dev_idfy(*dev);
 	if (err) {
 		XNVME_DEBUG("FAILED: xnvme_be_spdk_dev_idfy()");
 		xnvme_be_spdk_state_term((void *)(*dev)->be.state);
-		free(*dev);
+		xnvme_dev_free(*dev);
 		return err;
 	}
 	err = xnvme_be_dev_derive_geometry(*dev);
 	if (err) {
 		XNVME_DEBUG("FAILED: xnvme_be_dev_derive_geometry()");
 		xnvme_be_spdk_state_term((void *)(*dev)->be.state);
-		free(*dev);
+		xnvme_dev_free(*dev);
 		return err;
 	}
 
 	return err;
 }
 
+int
+xnvme_be_spdk_dev_dup(const struct xnvme_dev *XNVME_UNUSED(dev),
+		      struct xnvme_dev *dup)
+{
+	int err;
+
+	dup->be = xnvme_be_spdk;
+
+	err = xnvme_be_spdk_state_init(dup);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_spdk_state_init()");
+		return err;
+	}
+
+	return 0;
+}
+
 /**
  * Context for asynchronous command submission and completion
  *
@@ -1088,7 +1133,7 @@ xnvme_be_spdk_dev_from_ident(const struct xnvme_ident *ident,
  */
 int
 xnvme_be_spdk_async_init(struct xnvme_dev *dev, struct xnvme_async_ctx **ctx,
-			 uint16_t depth, int XNVME_UNUSED(flags))
+			 uint16_t depth, int flags)
 {
 	struct xnvme_be_spdk_state *state = (void *)dev->be.state;
 	struct xnvme_async_ctx_spdk *sctx = NULL;
@@ -1109,6 +1154,18 @@ xnvme_be_spdk_async_init(struct xnvme_dev *dev, struct xnvme_async_ctx **ctx,
 	qopts.io_queue_size = XNVME_MAX(depth, qopts.io_queue_size);
 	qopts.io_queue_requests = qopts.io_queue_size * 2;
 
+	// Queue priority requires Weighted Round Robin arbitration, that is,
+	// the "?wrr=1" option, SPDK rejects the qpair without it
+	if ((flags & XNVME_ASYNC_QPRIO_MASK) && (!state->wrr)) {
+		XNVME_DEBUG("INFO: ignoring qprio, wrr is not enabled");
+	} else if (flags & XNVME_ASYNC_QPRIO_HIGH) {
+		qopts.qprio = SPDK_NVME_QPRIO_HIGH;
+	} else if (flags & XNVME_ASYNC_QPRIO_MEDIUM) {
+		qopts.qprio = SPDK_NVME_QPRIO_MEDIUM;
+	} else if (flags & XNVME_ASYNC_QPRIO_LOW) {
+		qopts.qprio = SPDK_NVME_QPRIO_LOW;
+	}
+
 	sctx->qpair = spdk_nvme_ctrlr_alloc_io_qpair(state->ctrlr, &qopts, sizeof(qopts));
 	if (!sctx->qpair) {
 		XNVME_DEBUG("FAILED: alloc. qpair");
@@ -1168,6 +1225,34 @@ xnvme_be_spdk_async_poke(struct xnvme_dev *XNVME_UNUSED(dev),
 	return err;
 }
 
+int
+xnvme_be_spdk_async_reap(struct xnvme_dev *XNVME_UNUSED(dev),
+			 struct xnvme_async_ctx *ctx, struct xnvme_req **out,
+			 uint32_t max)
+{
+	struct xnvme_async_ctx_spdk *sctx = (void *)ctx;
+	int err;
+
+	if (!sctx->outstanding) {
+		return 0;
+	}
+
+	// cmd_async_cb() stores into 'reaped' while it is set
+	sctx->reaped = out;
+	sctx->nreaped = 0;
+
+	err = spdk_nvme_qpair_process_completions(sctx->qpair, max);
+
+	sctx->reaped = NULL;
+	if (err < 0) {
+		XNVME_DEBUG("FAILED: spdk_nvme_qpair_process_completion(), "
+			    "err: %d", err);
+		return err;
+	}
+
+	return sctx->nreaped;
+}
+
 int
 xnvme_be_spdk_async_wait(struct xnvme_dev *dev,
 			 struct xnvme_async_ctx *ctx)
@@ -1202,9 +1287,14 @@ static void
 cmd_async_cb(void *cb_arg, const struct spdk_nvme_cpl *cpl)
 {
 	struct xnvme_req *req = cb_arg;
+	struct xnvme_async_ctx_spdk *sctx = (void *)req->async.ctx;
 
-	req->async.ctx->outstanding -= 1;
+	sctx->outstanding -= 1;
 	req->cpl = *(const struct xnvme_spec_cpl *)cpl;
+	if (sctx->reaped) {
+		sctx->reaped[sctx->nreaped++] = req;
+		return;
+	}
 	req->async.cb(req, req->async.cb_arg);
 }
 
@@ -1366,6 +1456,13 @@ struct xnvme_be xnvme_be_spdk = {
 		.wait = xnvme_be_spdk_async_wait,
 		.init = xnvme_be_spdk_async_init,
 		.term = xnvme_be_spdk_async_term,
+		.cmd_chain = xnvme_be_nosys_async_cmd_chain,
+		.notify = xnvme_be_nosys_async_notify,
+		.bufs_init = xnvme_be_nosys_async_bufs_init,
+		.buf_put = xnvme_be_nosys_async_buf_put,
+		.reap = xnvme_be_spdk_async_reap,
+		.cmd_tmpl = xnvme_be_nosys_async_cmd_tmpl,
+		.cmd_batch = xnvme_be_nosys_async_cmd_batch,
 		.enabled = 1,
 		.id = "nvme_driver"
 	},
@@ -1379,6 +1476,7 @@ struct xnvme_be xnvme_be_spdk = {
 		.enumerate = xnvme_be_spdk_enumerate,
 		.dev_from_ident = xnvme_be_spdk_dev_from_ident,
 		.dev_close = xnvme_be_spdk_dev_close,
+		.dev_dup = xnvme_be_spdk_dev_dup,
 	},
 #else
 	.async = XNVME_BE_NOSYS_ASYNC,
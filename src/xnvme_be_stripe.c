@@ -0,0 +1,623 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <libxnvme.h>
+#include <xnvme_be.h>
+#include <xnvme_be_nosys.h>
+
+#ifdef XNVME_BE_STRIPE_ENABLED
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xnvme_async.h>
+#include <xnvme_be_stripe.h>
+#include <xnvme_be_vdev.h>
+#include <xnvme_dev.h>
+
+extern struct xnvme_be xnvme_be_stripe;
+
+static const char *g_keys[] = { "chunk", NULL };
+
+static inline struct xnvme_be_stripe *
+_stripe(const struct xnvme_dev *dev)
+{
+	return (void *)xnvme_be_vdev(dev);
+}
+
+/**
+ * Map the stripe LBA 'slba' to its member and the LBA on the member
+ *
+ * @return The number of LBAs, of at most 'nlb', which are contiguous on the
+ * member, that is, up to the end of the chunk
+ */
+static inline uint64_t
+_stripe_map(const struct xnvme_be_stripe *stripe, uint64_t slba, uint64_t nlb,
+	    uint32_t *member, uint64_t *mlba)
+{
+	const uint64_t chunk = slba / stripe->chunk_nlb;
+	const uint64_t ofz = slba % stripe->chunk_nlb;
+	const uint64_t left = stripe->chunk_nlb - ofz;
+
+	*member = chunk % stripe->vdev.nmembers;
+	*mlba = (chunk / stripe->vdev.nmembers) * stripe->chunk_nlb + ofz;
+
+	return nlb < left ? nlb : left;
+}
+
+/**
+ * Setup the command, covering 'nlb' LBAs at 'mlba' on the given member, of a
+ * part of the given stripe command
+ */
+static inline void
+_stripe_cmd_child(const struct xnvme_spec_cmd *cmd, struct xnvme_dev *member,
+		  uint64_t mlba, uint64_t nlb, struct xnvme_spec_cmd *child)
+{
+	*child = *cmd;
+	child->common.nsid = xnvme_dev_get_nsid(member);
+	if (cmd->common.opcode != XNVME_SPEC_OPC_FLUSH) {
+		child->lblk.slba = mlba;
+		child->lblk.nlb = nlb - 1;
+	}
+}
+
+static inline size_t
+_stripe_cmd_nbytes(const struct xnvme_dev *dev,
+		   const struct xnvme_spec_cmd *cmd, uint64_t nlb)
+{
+	switch (cmd->common.opcode) {
+	case XNVME_SPEC_OPC_READ:
+	case XNVME_SPEC_OPC_WRITE:
+		return nlb * dev->geo.lba_nbytes;
+
+	default:
+		return 0;
+	}
+}
+
+int
+xnvme_be_stripe_sync_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+			    void *dbuf, size_t dbuf_nbytes, void *mbuf,
+			    size_t XNVME_UNUSED(mbuf_nbytes),
+			    int XNVME_UNUSED(opts), struct xnvme_req *req)
+{
+	struct xnvme_be_stripe *stripe = _stripe(dev);
+	struct xnvme_spec_cmd child;
+	uint8_t *buf = dbuf;
+	uint64_t slba, nlb;
+	int err;
+
+	err = xnvme_be_vdev_cmd_check(dev, cmd, mbuf);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_vdev_cmd_check(), err: %d", err);
+		return err;
+	}
+
+	if (cmd->common.opcode == XNVME_SPEC_OPC_FLUSH) {
+		for (uint32_t i = 0; i < stripe->vdev.nmembers; ++i) {
+			_stripe_cmd_child(cmd, stripe->vdev.members[i], 0, 0,
+					  &child);
+			err = xnvme_cmd_pass(stripe->vdev.members[i], &child, NULL, 0,
+					     NULL, 0, XNVME_CMD_SYNC, req);
+			if (err) {
+				return err;
+			}
+		}
+
+		return 0;
+	}
+
+	if (_stripe_cmd_nbytes(dev, cmd, cmd->lblk.nlb + 1ULL) > dbuf_nbytes) {
+		XNVME_DEBUG("FAILED: dbuf_nbytes: %zu, too small", dbuf_nbytes);
+		return -EINVAL;
+	}
+
+	slba = cmd->lblk.slba;
+	nlb = cmd->lblk.nlb + 1ULL;
+	while (nlb) {
+		struct xnvme_dev *member;
+		uint32_t midx;
+		uint64_t mlba, mnlb;
+		size_t nbytes;
+
+		mnlb = _stripe_map(stripe, slba, nlb, &midx, &mlba);
+		member = stripe->vdev.members[midx];
+		nbytes = _stripe_cmd_nbytes(dev, cmd, mnlb);
+
+		_stripe_cmd_child(cmd, member, mlba, mnlb, &child);
+		err = xnvme_cmd_pass(member, &child, nbytes ? buf : NULL, nbytes,
+				     NULL, 0, XNVME_CMD_SYNC, req);
+		if (err) {
+			return err;
+		}
+
+		buf += nbytes;
+		slba += mnlb;
+		nlb -= mnlb;
+	}
+
+	return 0;
+}
+
+/**
+ * Depth of the member contexts of a stripe context of the given depth; a
+ * command of the maximum transfer size has at most 'nchunks / nmembers + 2'
+ * children on a member
+ */
+static uint32_t
+_stripe_mdepth(const struct xnvme_dev *dev, uint32_t depth)
+{
+	const struct xnvme_be_stripe *stripe = _stripe(dev);
+	const uint64_t nchunks = dev->geo.mdts_nbytes / dev->geo.lba_nbytes / \
+				 stripe->chunk_nlb;
+	const uint64_t nchildren = depth * (nchunks / stripe->vdev.nmembers + 2);
+	uint32_t mdepth = depth;
+
+	while ((mdepth < nchildren) && (mdepth < XNVME_BE_STRIPE_MDEPTH_MAX)) {
+		mdepth <<= 1;
+	}
+
+	return mdepth;
+}
+
+static void
+_stripe_queue_free(struct xnvme_be_stripe_queue *queue)
+{
+	if (!queue) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < queue->nmembers; ++i) {
+		if (queue->ctxs[i]) {
+			xnvme_async_term(queue->members[i], queue->ctxs[i]);
+		}
+	}
+	free(queue->celm);
+	free(queue->pelm);
+	free(queue);
+}
+
+int
+xnvme_be_stripe_async_init(struct xnvme_dev *dev, struct xnvme_async_ctx **ctx,
+			   uint16_t depth, int flags)
+{
+	struct xnvme_be_stripe *stripe = _stripe(dev);
+	struct xnvme_async_ctx_stripe *actx;
+	struct xnvme_be_stripe_queue *queue;
+	int err;
+
+	*ctx = calloc(1, sizeof(**ctx));
+	if (!*ctx) {
+		XNVME_DEBUG("FAILED: calloc(ctx), errno: %s", strerror(errno));
+		return -errno;
+	}
+	actx = (void *)*ctx;
+	actx->depth = depth;
+
+	queue = calloc(1, sizeof(*queue));
+	if (!queue) {
+		XNVME_DEBUG("FAILED: calloc(queue), errno: %s",
+			    strerror(errno));
+		err = -errno;
+		goto failed;
+	}
+	queue->nmembers = stripe->vdev.nmembers;
+	queue->mdepth = _stripe_mdepth(dev, depth);
+
+	queue->pelm = calloc(depth, sizeof(*queue->pelm));
+	queue->celm = calloc(queue->mdepth * stripe->vdev.nmembers,
+			     sizeof(*queue->celm));
+	if (!(queue->pelm && queue->celm)) {
+		XNVME_DEBUG("FAILED: calloc(elm), errno: %s", strerror(errno));
+		err = -errno;
+		goto failed;
+	}
+
+	SLIST_INIT(&queue->parents);
+	for (uint32_t i = 0; i < depth; ++i) {
+		SLIST_INSERT_HEAD(&queue->parents, &queue->pelm[i], link);
+	}
+
+	for (uint32_t i = 0; i < stripe->vdev.nmembers; ++i) {
+		queue->members[i] = stripe->vdev.members[i];
+
+		err = xnvme_async_init(queue->members[i], &queue->ctxs[i],
+				       queue->mdepth, flags);
+		if (err) {
+			XNVME_DEBUG("FAILED: xnvme_async_init(member: %u)", i);
+			queue->ctxs[i] = NULL;
+			goto failed;
+		}
+
+		SLIST_INIT(&queue->children[i]);
+		for (uint32_t j = 0; j < queue->mdepth; ++j) {
+			struct xnvme_be_stripe_child *child;
+
+			child = &queue->celm[i * queue->mdepth + j];
+			child->member = i;
+			SLIST_INSERT_HEAD(&queue->children[i], child, link);
+		}
+		queue->nfree[i] = queue->mdepth;
+	}
+
+	actx->queue = queue;
+
+	return 0;
+
+failed:
+	_stripe_queue_free(queue);
+	free(*ctx);
+	*ctx = NULL;
+
+	return err;
+}
+
+int
+xnvme_be_stripe_async_term(struct xnvme_dev *XNVME_UNUSED(dev),
+			   struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_async_ctx_stripe *actx = (void *)ctx;
+
+	if (!ctx) {
+		XNVME_DEBUG("FAILED: ctx: %p", (void *)ctx);
+		return -EINVAL;
+	}
+
+	_stripe_queue_free(actx->queue);
+	free(ctx);
+
+	return 0;
+}
+
+static inline void
+_stripe_child_put(struct xnvme_be_stripe_queue *queue,
+		  struct xnvme_be_stripe_child *child)
+{
+	SLIST_INSERT_HEAD(&queue->children[child->member], child, link);
+	queue->nfree[child->member] += 1;
+}
+
+/**
+ * Completion of a child; the first failure of a child is kept as the
+ * completion of the parent, which completes along with its last child
+ */
+static void
+_stripe_child_cb(struct xnvme_req *creq, void *cb_arg)
+{
+	struct xnvme_be_stripe_child *child = cb_arg;
+	struct xnvme_be_stripe_parent *parent = child->parent;
+	struct xnvme_req *req = parent->req;
+	struct xnvme_async_ctx_stripe *actx = (void *)req->async.ctx;
+	struct xnvme_be_stripe_queue *queue = actx->queue;
+
+	if (xnvme_req_cpl_status(creq) && \
+	    !(parent->cpl.status.sct || parent->cpl.status.sc)) {
+		parent->cpl = creq->cpl;
+	}
+	_stripe_child_put(queue, child);
+
+	parent->npending -= 1;
+	if (parent->npending) {
+		return;
+	}
+
+	// Release the parent before the callback, it may submit
+	req->cpl = parent->cpl;
+	SLIST_INSERT_HEAD(&queue->parents, parent, link);
+	actx->outstanding -= 1;
+	queue->ncompleted += 1;
+
+	req->async.cb(req, req->async.cb_arg);
+}
+
+int
+xnvme_be_stripe_async_poke(struct xnvme_dev *XNVME_UNUSED(dev),
+			   struct xnvme_async_ctx *ctx, uint32_t max)
+{
+	struct xnvme_async_ctx_stripe *actx = (void *)ctx;
+	struct xnvme_be_stripe_queue *queue = actx->queue;
+	const uint32_t ncompleted = queue->ncompleted;
+	uint32_t completed = 0;
+
+	max = max ? max : actx->outstanding;
+	max = max > actx->outstanding ? actx->outstanding : max;
+	if (!max) {
+		return 0;
+	}
+
+	// Child completions are at least as many as the parents they complete
+	for (uint32_t i = 0; (i < queue->nmembers) && (completed < max); ++i) {
+		const uint32_t midx = (queue->rr + i) % queue->nmembers;
+		int err;
+
+		err = xnvme_async_poke(queue->members[midx], queue->ctxs[midx],
+				       max - completed);
+		if (err < 0) {
+			XNVME_DEBUG("FAILED: xnvme_async_poke(member: %u)",
+				    midx);
+			return err;
+		}
+		completed = queue->ncompleted - ncompleted;
+	}
+	queue->rr = (queue->rr + 1) % queue->nmembers;
+
+	return completed;
+}
+
+int
+xnvme_be_stripe_async_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
+{
+	int acc = 0;
+
+	while (ctx->outstanding) {
+		int err;
+
+		err = xnvme_be_stripe_async_poke(dev, ctx, 0);
+		if (err >= 0) {
+			acc += err;
+			continue;
+		}
+
+		return err;
+	}
+
+	return acc;
+}
+
+int
+xnvme_be_stripe_async_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+			     void *dbuf, size_t dbuf_nbytes, void *mbuf,
+			     size_t XNVME_UNUSED(mbuf_nbytes),
+			     int XNVME_UNUSED(opts), struct xnvme_req *req)
+{
+	struct xnvme_be_stripe *stripe = _stripe(dev);
+	struct xnvme_async_ctx_stripe *actx = (void *)req->async.ctx;
+	struct xnvme_be_stripe_queue *queue = actx->queue;
+	uint32_t nchildren[XNVME_BE_STRIPE_NMEMBERS_MAX] = { 0 };
+	struct xnvme_be_stripe_parent *parent;
+	const bool flush = cmd->common.opcode == XNVME_SPEC_OPC_FLUSH;
+	uint32_t nsubmitted = 0, ntotal = 0;
+	uint8_t *buf = dbuf;
+	uint64_t slba, nlb;
+	int err;
+
+	if (actx->outstanding == actx->depth) {
+		XNVME_DEBUG("FAILED: queue is full");
+		return -EBUSY;
+	}
+
+	err = xnvme_be_vdev_cmd_check(dev, cmd, mbuf);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_vdev_cmd_check(), err: %d", err);
+		return err;
+	}
+	if (!flush && \
+	    (_stripe_cmd_nbytes(dev, cmd, cmd->lblk.nlb + 1ULL) > dbuf_nbytes)) {
+		XNVME_DEBUG("FAILED: dbuf_nbytes: %zu, too small", dbuf_nbytes);
+		return -EINVAL;
+	}
+
+	// Count the children of each member, such that all or none are taken
+	slba = cmd->lblk.slba;
+	nlb = flush ? 0 : cmd->lblk.nlb + 1ULL;
+	for (uint32_t i = 0; flush && (i < stripe->vdev.nmembers); ++i) {
+		nchildren[i] = 1;
+	}
+	while (nlb) {
+		uint32_t midx;
+		uint64_t mlba, mnlb;
+
+		mnlb = _stripe_map(stripe, slba, nlb, &midx, &mlba);
+		nchildren[midx] += 1;
+		slba += mnlb;
+		nlb -= mnlb;
+	}
+	for (uint32_t i = 0; i < stripe->vdev.nmembers; ++i) {
+		if (nchildren[i] > queue->mdepth) {
+			XNVME_DEBUG("FAILED: nchildren: %u > mdepth: %u",
+				    nchildren[i], queue->mdepth);
+			return -EINVAL;
+		}
+		if (nchildren[i] > queue->nfree[i]) {
+			XNVME_DEBUG("FAILED: member: %u, is full", i);
+			return -EBUSY;
+		}
+		ntotal += nchildren[i];
+	}
+
+	parent = SLIST_FIRST(&queue->parents);
+	SLIST_REMOVE_HEAD(&queue->parents, link);
+	memset(&parent->cpl, 0, sizeof(parent->cpl));
+	parent->req = req;
+	parent->npending = ntotal;
+
+	slba = cmd->lblk.slba;
+	nlb = cmd->lblk.nlb + 1ULL;
+	for (nsubmitted = 0; nsubmitted < ntotal; ++nsubmitted) {
+		struct xnvme_be_stripe_child *child;
+		struct xnvme_spec_cmd ccmd;
+		uint32_t midx = nsubmitted;
+		uint64_t mlba = 0, mnlb = 0;
+		size_t nbytes;
+
+		if (!flush) {
+			mnlb = _stripe_map(stripe, slba, nlb, &midx, &mlba);
+		}
+		nbytes = _stripe_cmd_nbytes(dev, cmd, mnlb);
+
+		child = SLIST_FIRST(&queue->children[midx]);
+		SLIST_REMOVE_HEAD(&queue->children[midx], link);
+		queue->nfree[midx] -= 1;
+
+		xnvme_req_clear(&child->req);
+		child->req.async.ctx = queue->ctxs[midx];
+		child->req.async.cb = _stripe_child_cb;
+		child->req.async.cb_arg = child;
+		child->req.async.prio = req->async.prio;
+		child->parent = parent;
+
+		_stripe_cmd_child(cmd, queue->members[midx], mlba, mnlb, &ccmd);
+		err = xnvme_cmd_pass(queue->members[midx], &ccmd,
+				     nbytes ? buf : NULL, nbytes, NULL, 0,
+				     XNVME_CMD_ASYNC, &child->req);
+		if (err) {
+			XNVME_DEBUG("FAILED: xnvme_cmd_pass(member: %u), err: %d",
+				    midx, err);
+			_stripe_child_put(queue, child);
+			break;
+		}
+
+		buf += nbytes;
+		slba += mnlb;
+		nlb -= mnlb;
+	}
+	if (!nsubmitted) {
+		SLIST_INSERT_HEAD(&queue->parents, parent, link);
+		return err;
+	}
+	if (nsubmitted < ntotal) {
+		// The children submitted complete the parent, as failed
+		parent->npending = nsubmitted;
+		parent->cpl.status.sct = 0x0;
+		parent->cpl.status.sc = XNVME_ASYNC_SC_INTERNAL_ERROR;
+	}
+	actx->outstanding += 1;
+
+	return 0;
+}
+
+/**
+ * Derive the stripe from its members; the capacity used of each member is that
+ * of the smallest member, rounded down to a multiple of the chunk size
+ */
+static int
+_stripe_init(struct xnvme_be_stripe *stripe, const struct xnvme_ident *ident)
+{
+	const struct xnvme_geo *geo = xnvme_dev_get_geo(stripe->vdev.members[0]);
+	uint64_t chunk_kb = XNVME_BE_STRIPE_CHUNK_KB_DEF;
+	uint64_t member_nlb = geo->nsect;
+
+	xnvme_ident_opt_to_u64(ident, "chunk", &chunk_kb);
+	if (!chunk_kb || ((chunk_kb << 10) % geo->lba_nbytes)) {
+		XNVME_DEBUG("FAILED: chunk: %lu KiB, lba_nbytes: %u", chunk_kb,
+			    geo->lba_nbytes);
+		return -EINVAL;
+	}
+
+	for (uint32_t i = 1; i < stripe->vdev.nmembers; ++i) {
+		member_nlb = XNVME_MIN(member_nlb,
+				       stripe->vdev.members[i]->geo.nsect);
+	}
+
+	stripe->chunk_nlb = (chunk_kb << 10) / geo->lba_nbytes;
+	stripe->member_nlb = member_nlb - (member_nlb % stripe->chunk_nlb);
+	if (!stripe->member_nlb) {
+		XNVME_DEBUG("FAILED: members are smaller than a chunk");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int
+xnvme_be_stripe_dev_from_ident(const struct xnvme_ident *ident,
+			       struct xnvme_dev **dev)
+{
+	struct xnvme_be_stripe *stripe;
+	int err;
+
+	stripe = xnvme_be_vdev_alloc(sizeof(*stripe));
+	if (!stripe) {
+		return -errno;
+	}
+
+	err = xnvme_be_vdev_open(&stripe->vdev, ident, g_keys,
+				 XNVME_BE_STRIPE_NMEMBERS_MAX);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_vdev_open()");
+		xnvme_be_vdev_free(&stripe->vdev);
+		return err;
+	}
+	err = _stripe_init(stripe, ident);
+	if (err) {
+		XNVME_DEBUG("FAILED: _stripe_init()");
+		xnvme_be_vdev_free(&stripe->vdev);
+		return err;
+	}
+
+	err = xnvme_be_vdev_dev_alloc(&stripe->vdev, ident, &xnvme_be_stripe,
+				      "xNVMe striped device",
+				      stripe->member_nlb * stripe->vdev.nmembers,
+				      dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_vdev_dev_alloc()");
+		xnvme_be_vdev_free(&stripe->vdev);
+		return err;
+	}
+
+	return 0;
+}
+#endif
+
+static const char *g_schemes[] = {
+	"stripe",
+};
+
+struct xnvme_be xnvme_be_stripe = {
+#ifdef XNVME_BE_STRIPE_ENABLED
+	.async = {
+		.cmd_io = xnvme_be_stripe_async_cmd_io,
+		.poke = xnvme_be_stripe_async_poke,
+		.wait = xnvme_be_stripe_async_wait,
+		.init = xnvme_be_stripe_async_init,
+		.term = xnvme_be_stripe_async_term,
+		.supported = xnvme_be_vdev_supported,
+		.cmd_chain = xnvme_be_nosys_async_cmd_chain,
+		.notify = xnvme_be_nosys_async_notify,
+		.bufs_init = xnvme_be_nosys_async_bufs_init,
+		.buf_put = xnvme_be_nosys_async_buf_put,
+		.reap = xnvme_be_nosys_async_reap,
+		.cmd_tmpl = xnvme_be_nosys_async_cmd_tmpl,
+		.cmd_batch = xnvme_be_nosys_async_cmd_batch,
+		.id = "stripe",
+		.enabled = 1,
+	},
+	.sync = {
+		.cmd_io = xnvme_be_stripe_sync_cmd_io,
+		.cmd_admin = xnvme_be_vdev_sync_cmd_admin,
+		.supported = xnvme_be_vdev_supported,
+		.id = "stripe",
+		.enabled = 1,
+	},
+	.mem = {
+		.buf_alloc = xnvme_be_vdev_buf_alloc,
+		.buf_realloc = xnvme_be_vdev_buf_realloc,
+		.buf_free = xnvme_be_vdev_buf_free,
+		.buf_vtophys = xnvme_be_vdev_buf_vtophys,
+	},
+	.dev = {
+		.enumerate = xnvme_be_vdev_enumerate,
+		.dev_from_ident = xnvme_be_stripe_dev_from_ident,
+		.dev_close = xnvme_be_vdev_dev_close,
+		.dev_dup = xnvme_be_vdev_dev_dup,
+	},
+#else
+	.async = XNVME_BE_NOSYS_ASYNC,
+	.sync = XNVME_BE_NOSYS_SYNC,
+	.mem = XNVME_BE_NOSYS_MEM,
+	.dev = XNVME_BE_NOSYS_DEV,
+#endif
+	.attr = {
+		.name = "stripe",
+#ifdef XNVME_BE_STRIPE_ENABLED
+		.enabled = 1,
+#else
+		.enabled = 0,
+#endif
+		.schemes = g_schemes,
+		.nschemes = sizeof g_schemes / sizeof(*g_schemes),
+	},
+	.state = { 0 },
+};
@@ -0,0 +1,465 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <libxnvme.h>
+#include <xnvme_be.h>
+
+#if defined(XNVME_BE_STRIPE_ENABLED) || defined(XNVME_BE_MIRROR_ENABLED)
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <liblblk.h>
+#include <xnvme_be_vdev.h>
+#include <xnvme_dev.h>
+
+void *
+xnvme_be_vdev_alloc(size_t nbytes)
+{
+	struct xnvme_be_vdev *vdev;
+
+	vdev = calloc(1, nbytes);
+	if (!vdev) {
+		XNVME_DEBUG("FAILED: calloc(vdev), errno: %s", strerror(errno));
+		return NULL;
+	}
+	vdev->nbytes = nbytes;
+
+	return vdev;
+}
+
+void
+xnvme_be_vdev_free(struct xnvme_be_vdev *vdev)
+{
+	if (!vdev) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < vdev->nmembers; ++i) {
+		xnvme_dev_close(vdev->members[i]);
+	}
+	free(vdev);
+}
+
+static bool
+_vdev_key(const char *tok, const char *keys[])
+{
+	for (uint32_t i = 0; keys[i]; ++i) {
+		const size_t len = strlen(keys[i]);
+
+		if (!strncmp(tok, keys[i], len) && (tok[len] == '=')) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Get the member, 'n', of an option given as 'key.n=val', and its length up
+ * to the '.'
+ *
+ * @return The member on success, -1 when the option is for all members
+ */
+static int
+_vdev_opt_member(const char *tok, size_t *key_len)
+{
+	const char *eq = strchr(tok, '=');
+	const char *dot;
+	char *end = NULL;
+	long member;
+
+	dot = eq ? memrchr(tok, '.', eq - tok) : NULL;
+	if (!dot || (dot == tok) || !isdigit((unsigned char)dot[1])) {
+		return -1;
+	}
+	member = strtol(dot + 1, &end, 10);
+	if ((end != eq) || (member >= XNVME_BE_VDEV_NMEMBERS_MAX)) {
+		return -1;
+	}
+	*key_len = dot - tok;
+
+	return member;
+}
+
+/**
+ * Produce the options of the given member from the options of the virtual
+ * device; all but 'inject', and those in 'keys', are passed on, and an option
+ * given as 'key.n=val' is passed on, as 'key=val', to member 'n' only
+ */
+static void
+_vdev_member_opts(const char *opts, const char *keys[], uint32_t member,
+		  char *buf, size_t buf_len)
+{
+	const char *inject[] = { "inject", NULL };
+	char tmp[XNVME_IDENT_OPTS_LEN] = { 0 };
+	char *save = NULL;
+	size_t len = 0;
+
+	buf[0] = '\0';
+	if (opts[0] != XNVME_IDENT_OPTS_SEP) {
+		return;
+	}
+	snprintf(tmp, sizeof(tmp), "%s", opts + 1);
+
+	for (char *tok = strtok_r(tmp, "&", &save); tok && (len < buf_len);
+	     tok = strtok_r(NULL, "&", &save)) {
+		const char sep = len ? '&' : XNVME_IDENT_OPTS_SEP;
+		size_t key_len = 0;
+		int opt_member;
+
+		opt_member = _vdev_opt_member(tok, &key_len);
+		if (opt_member >= 0) {
+			if ((uint32_t)opt_member == member) {
+				len += snprintf(buf + len, buf_len - len,
+						"%c%.*s%s", sep, (int)key_len,
+						tok, strchr(tok, '='));
+			}
+			continue;
+		}
+		if (_vdev_key(tok, inject) || _vdev_key(tok, keys)) {
+			continue;
+		}
+		len += snprintf(buf + len, buf_len - len, "%c%s", sep, tok);
+	}
+}
+
+int
+xnvme_be_vdev_open(struct xnvme_be_vdev *vdev, const struct xnvme_ident *ident,
+		   const char *keys[], uint32_t nmembers_max)
+{
+	char trgt[XNVME_IDENT_TRGT_LEN] = { 0 };
+	char opts[XNVME_IDENT_OPTS_LEN] = { 0 };
+	const struct xnvme_geo *geo;
+	char *save = NULL;
+
+	nmembers_max = XNVME_MIN(nmembers_max, XNVME_BE_VDEV_NMEMBERS_MAX);
+
+	snprintf(trgt, sizeof(trgt), "%s", ident->trgt);
+
+	for (char *tok = strtok_r(trgt, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save)) {
+		char uri[XNVME_IDENT_URI_LEN] = { 0 };
+		struct xnvme_dev *member;
+
+		if (vdev->nmembers == nmembers_max) {
+			XNVME_DEBUG("FAILED: nmembers > %u", nmembers_max);
+			return -EINVAL;
+		}
+
+		_vdev_member_opts(ident->opts, keys, vdev->nmembers, opts,
+				  sizeof(opts));
+		snprintf(uri, sizeof(uri), "%s%s", tok, opts);
+		member = xnvme_dev_open(uri);
+		if (!member) {
+			XNVME_DEBUG("FAILED: xnvme_dev_open(%s)", uri);
+			return errno ? -errno : -ENXIO;
+		}
+		vdev->members[vdev->nmembers++] = member;
+	}
+
+	if (!vdev->nmembers) {
+		XNVME_DEBUG("FAILED: no members");
+		return -EINVAL;
+	}
+
+	geo = xnvme_dev_get_geo(vdev->members[0]);
+	for (uint32_t i = 0; i < vdev->nmembers; ++i) {
+		const struct xnvme_geo *mgeo;
+
+		mgeo = xnvme_dev_get_geo(vdev->members[i]);
+		if ((mgeo->type != XNVME_GEO_CONVENTIONAL) || \
+		    (mgeo->lba_nbytes != geo->lba_nbytes) || \
+		    (mgeo->nbytes_oob != geo->nbytes_oob)) {
+			XNVME_DEBUG("FAILED: member: %u, mismatching geometry",
+				    i);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * The identify data of the virtual device is that of the first member, with
+ * the given capacity and the smallest transfer size of the members
+ */
+static int
+_vdev_idfy(struct xnvme_dev *dev, const char *mn, uint64_t nlb)
+{
+	struct xnvme_be_vdev *vdev = xnvme_be_vdev(dev);
+	const struct xnvme_dev *first = vdev->members[0];
+	struct xnvme_spec_idfy_ctrlr *ctrlr;
+	int err;
+
+	dev->dtype = XNVME_DEV_TYPE_NVME_NAMESPACE;
+	dev->csi = XNVME_SPEC_CSI_LBLK;
+	dev->nsid = 1;
+
+	// The controller data is rewritten, thus not shared with the members
+	err = xnvme_dev_ctrlr_get(dev, NULL);
+	if (err < 0) {
+		XNVME_DEBUG("FAILED: xnvme_dev_ctrlr_get(), err: %d", err);
+		return err;
+	}
+	dev->ctrlr->id = first->ctrlr->id;
+	dev->ctrlr->idcss = first->ctrlr->idcss;
+	ctrlr = &dev->ctrlr->id;
+
+	dev->id = first->id;
+	dev->idcss = first->idcss;
+
+	memset(ctrlr->mn, ' ', sizeof(ctrlr->mn));
+	memcpy(ctrlr->mn, mn, XNVME_MIN(strlen(mn), sizeof(ctrlr->mn)));
+	ctrlr->nn = 1;
+	for (uint32_t i = 1; i < vdev->nmembers; ++i) {
+		const uint8_t mdts = vdev->members[i]->ctrlr->id.mdts;
+
+		if (mdts && (!ctrlr->mdts || (mdts < ctrlr->mdts))) {
+			ctrlr->mdts = mdts;
+		}
+	}
+
+	dev->id.ns.nsze = nlb;
+	dev->id.ns.ncap = nlb;
+	dev->id.ns.nuse = nlb;
+
+	return 0;
+}
+
+int
+xnvme_be_vdev_dev_alloc(struct xnvme_be_vdev *vdev,
+			const struct xnvme_ident *ident,
+			const struct xnvme_be *be, const char *mn, uint64_t nlb,
+			struct xnvme_dev **dev)
+{
+	struct xnvme_be_vdev_state *state;
+	uint32_t mdts_nbytes;
+	int err;
+
+	err = xnvme_dev_alloc(dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_dev_alloc()");
+		return err;
+	}
+	(*dev)->ident = *ident;
+	(*dev)->be = *be;
+	vdev->be = be;
+
+	state = (void *)(*dev)->be.state;
+	state->vdev = vdev;
+
+	err = _vdev_idfy(*dev, mn, nlb);
+	if (err) {
+		XNVME_DEBUG("FAILED: _vdev_idfy()");
+		xnvme_dev_free(*dev);
+		return err;
+	}
+	err = xnvme_be_dev_derive_geometry(*dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_dev_derive_geometry()");
+		xnvme_dev_free(*dev);
+		return err;
+	}
+
+	mdts_nbytes = vdev->members[0]->geo.mdts_nbytes;
+	for (uint32_t i = 1; i < vdev->nmembers; ++i) {
+		mdts_nbytes = XNVME_MIN(mdts_nbytes,
+					vdev->members[i]->geo.mdts_nbytes);
+	}
+	(*dev)->geo.mdts_nbytes = mdts_nbytes;
+
+	return 0;
+}
+
+int
+xnvme_be_vdev_cmd_check(const struct xnvme_dev *dev,
+			const struct xnvme_spec_cmd *cmd, const void *mbuf)
+{
+	uint64_t nlb;
+
+	if (mbuf) {
+		XNVME_DEBUG("FAILED: metadata-buffers are not supported");
+		return -ENOSYS;
+	}
+
+	switch (cmd->common.opcode) {
+	case XNVME_SPEC_OPC_FLUSH:
+		return 0;
+
+	case XNVME_SPEC_OPC_READ:
+	case XNVME_SPEC_OPC_WRITE:
+	case LBLK_CMD_OPC_WRITE_ZEROES:
+		break;
+
+	default:
+		XNVME_DEBUG("FAILED: unsupported opcode: 0x%x",
+			    cmd->common.opcode);
+		return -ENOSYS;
+	}
+
+	nlb = cmd->lblk.nlb + 1ULL;
+	if ((cmd->lblk.slba >= dev->geo.nsect) || \
+	    (nlb > dev->geo.nsect - cmd->lblk.slba)) {
+		XNVME_DEBUG("FAILED: slba: 0x%lx, nlb: %lu, out of range",
+			    cmd->lblk.slba, nlb);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/**
+ * Identify is answered with the identify data of the virtual device, other
+ * admin commands are passed to the first member
+ */
+int
+xnvme_be_vdev_sync_cmd_admin(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+			     void *dbuf, size_t dbuf_nbytes, void *mbuf,
+			     size_t mbuf_nbytes, int opts,
+			     struct xnvme_req *req)
+{
+	struct xnvme_be_vdev *vdev = xnvme_be_vdev(dev);
+	struct xnvme_spec_cmd child = *cmd;
+	const void *idfy = NULL;
+
+	if (cmd->common.opcode == XNVME_SPEC_OPC_IDFY) {
+		switch (cmd->idfy.cns) {
+		case XNVME_SPEC_IDFY_CTRLR:
+			idfy = &dev->ctrlr->id;
+			break;
+		case XNVME_SPEC_IDFY_NS:
+			idfy = &dev->id.ns;
+			break;
+		case XNVME_SPEC_IDFY_CTRLR_IOCS:
+			idfy = &dev->ctrlr->idcss;
+			break;
+		case XNVME_SPEC_IDFY_NS_IOCS:
+			idfy = &dev->idcss.ns;
+			break;
+		default:
+			break;
+		}
+	}
+	if (idfy) {
+		if (!dbuf || (dbuf_nbytes < sizeof(struct xnvme_spec_idfy))) {
+			XNVME_DEBUG("FAILED: dbuf: %p, dbuf_nbytes: %zu", dbuf,
+				    dbuf_nbytes);
+			return -EINVAL;
+		}
+		memcpy(dbuf, idfy, sizeof(struct xnvme_spec_idfy));
+		if (req) {
+			memset(&req->cpl, 0, sizeof(req->cpl));
+		}
+
+		return 0;
+	}
+
+	if (cmd->common.nsid == dev->nsid) {
+		child.common.nsid = xnvme_dev_get_nsid(vdev->members[0]);
+	}
+
+	return xnvme_cmd_pass_admin(vdev->members[0], &child, dbuf,
+				    dbuf_nbytes, mbuf, mbuf_nbytes, opts, req);
+}
+
+int
+xnvme_be_vdev_supported(struct xnvme_dev *XNVME_UNUSED(dev),
+			uint32_t XNVME_UNUSED(opts))
+{
+	return 1;
+}
+
+/**
+ * Virtual devices exist only once opened, thus there is nothing to enumerate
+ */
+int
+xnvme_be_vdev_enumerate(struct xnvme_enumeration **XNVME_UNUSED(list),
+			const char *XNVME_UNUSED(sys_uri),
+			int XNVME_UNUSED(opts))
+{
+	return 0;
+}
+
+/**
+ * The duplicate has duplicates of the members, thus shares their identify data
+ */
+int
+xnvme_be_vdev_dev_dup(const struct xnvme_dev *dev, struct xnvme_dev *dup)
+{
+	const struct xnvme_be_vdev *src = xnvme_be_vdev(dev);
+	struct xnvme_be_vdev_state *state;
+	struct xnvme_be_vdev *vdev;
+
+	vdev = xnvme_be_vdev_alloc(src->nbytes);
+	if (!vdev) {
+		return -errno;
+	}
+	memcpy(vdev, src, src->nbytes);
+	vdev->nmembers = 0;
+
+	for (uint32_t i = 0; i < src->nmembers; ++i) {
+		struct xnvme_dev *member;
+
+		member = xnvme_dev_dup(src->members[i]);
+		if (!member) {
+			XNVME_DEBUG("FAILED: xnvme_dev_dup(), member: %u", i);
+			xnvme_be_vdev_free(vdev);
+			return errno ? -errno : -ENXIO;
+		}
+		vdev->members[vdev->nmembers++] = member;
+	}
+
+	dup->be = *src->be;
+
+	state = (void *)dup->be.state;
+	state->vdev = vdev;
+
+	return 0;
+}
+
+void
+xnvme_be_vdev_dev_close(struct xnvme_dev *dev)
+{
+	if (!dev) {
+		return;
+	}
+
+	xnvme_be_vdev_free(xnvme_be_vdev(dev));
+	memset(&dev->be, 0, sizeof(dev->be));
+}
+
+/**
+ * Buffers are allocated by the first member and are used with all members
+ */
+void *
+xnvme_be_vdev_buf_alloc(const struct xnvme_dev *dev, size_t nbytes,
+			uint64_t *phys)
+{
+	return xnvme_buf_alloc(xnvme_be_vdev(dev)->members[0], nbytes, phys);
+}
+
+void *
+xnvme_be_vdev_buf_realloc(const struct xnvme_dev *dev, void *buf,
+			  size_t nbytes, uint64_t *phys)
+{
+	return xnvme_buf_realloc(xnvme_be_vdev(dev)->members[0], buf, nbytes,
+				 phys);
+}
+
+void
+xnvme_be_vdev_buf_free(const struct xnvme_dev *dev, void *buf)
+{
+	xnvme_buf_free(xnvme_be_vdev(dev)->members[0], buf);
+}
+
+int
+xnvme_be_vdev_buf_vtophys(const struct xnvme_dev *dev, void *buf,
+			  uint64_t *phys)
+{
+	return xnvme_buf_vtophys(xnvme_be_vdev(dev)->members[0], buf, phys);
+}
+#endif
@@ -1,10 +1,17 @@
 // Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
 // SPDX-License-Identifier: Apache-2.0
 #include <errno.h>
+#include <stdlib.h>
 #include <libxnvme.h>
 #include <xnvme_be.h>
 #include <xnvme_dev.h>
 #include <xnvme_sgl.h>
+#include <xnvme_async.h>
+#include <xnvme_qos.h>
+#include <xnvme_async_group.h>
+#include <xnvme_async_shared.h>
+#include <xnvme_async_ordered.h>
+#include <xnvme_dispatcher.h>
 
 /**
  * Calling this requires that opts at least has `XNVME_CMD_SGL_DATA`
@@ -48,6 +55,66 @@ cmd_setup_sgl(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd, void *data,
 	}
 }
 
+/**
+ * Submit on an ordered context, the command takes a slot of the reorder-ring,
+ * which is handed back when submission fails
+ */
+static int
+cmd_pass_ordered(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd, void *dbuf,
+		 size_t dbuf_nbytes, void *mbuf, size_t mbuf_nbytes, int opts,
+		 struct xnvme_req *req)
+{
+	struct xnvme_async_ctx *ctx = req->async.ctx;
+	int err;
+
+	err = xnvme_async_ordered_enter(req);
+	if (err) {
+		return err;
+	}
+
+	xnvme_async_group_mark(ctx);
+	err = ctx->qos ?
+	      xnvme_async_qos_cmd_io(dev, cmd, dbuf, dbuf_nbytes, mbuf,
+				     mbuf_nbytes, opts, req) :
+	      dev->be.async.cmd_io(dev, cmd, dbuf, dbuf_nbytes, mbuf,
+				   mbuf_nbytes, opts, req);
+	if (err) {
+		xnvme_async_ordered_cancel(req);
+	}
+
+	return err;
+}
+
+/**
+ * Submit on a context with a dispatcher, the command takes a slot of the
+ * context, which is handed back when submission fails
+ */
+static int
+cmd_pass_dispatch(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd, void *dbuf,
+		  size_t dbuf_nbytes, void *mbuf, size_t mbuf_nbytes, int opts,
+		  struct xnvme_req *req)
+{
+	struct xnvme_async_ctx *ctx = req->async.ctx;
+	int err;
+
+	err = xnvme_async_dispatch_enter(req);
+	if (err) {
+		return err;
+	}
+
+	xnvme_async_group_mark(ctx);
+	err = ctx->qos ?
+	      xnvme_async_qos_cmd_io(dev, cmd, dbuf, dbuf_nbytes, mbuf,
+				     mbuf_nbytes, opts, req) :
+	      dev->be.async.cmd_io(dev, cmd, dbuf, dbuf_nbytes, mbuf,
+				   mbuf_nbytes, opts, req);
+	if (err) {
+		xnvme_async_dispatch_cancel(req);
+	}
+
+	return err;
+}
+
 int
 xnvme_cmd_pass(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd, void *dbuf,
 	       size_t dbuf_nbytes, void *mbuf, size_t mbuf_nbytes, int opts,
@@ -59,8 +126,50 @@ xnvme_cmd_pass(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd, void *dbuf,
 		cmd_setup_sgl(dev, cmd, dbuf, mbuf, opts);
 	}
 
+	// The buffer is selected by the backend, from those of the context
+	if (cmd_opts & XNVME_CMD_BUFSEL) {
+		struct xnvme_async_bufs *bufs;
+
+		if (!((cmd_opts & XNVME_CMD_ASYNC) && req->async.ctx &&
+		      req->async.ctx->bufs)) {
+			XNVME_DEBUG("FAILED: XNVME_CMD_BUFSEL without buffers");
+			return -EINVAL;
+		}
+		bufs = req->async.ctx->bufs;
+
+		if (dbuf || (cmd->common.opcode != XNVME_SPEC_OPC_READ) ||
+		    (dbuf_nbytes > bufs->nbytes)) {
+			XNVME_DEBUG("FAILED: XNVME_CMD_BUFSEL, opc: 0x%x, "
+				    "dbuf_nbytes: %zu", cmd->common.opcode,
+				    dbuf_nbytes);
+			return -EINVAL;
+		}
+		req->async.bid = -1;
+	}
+
 	switch (cmd_opts & XNVME_CMD_MASK_IOMD) {
 	case XNVME_CMD_ASYNC:
+		if (req->async.ctx && req->async.ctx->shared) {
+			return xnvme_async_shared_cmd_io(dev, cmd, dbuf,
+							 dbuf_nbytes, mbuf,
+							 mbuf_nbytes, opts, req);
+		}
+		if (req->async.ctx && req->async.ctx->ordered) {
+			return cmd_pass_ordered(dev, cmd, dbuf, dbuf_nbytes,
+						mbuf, mbuf_nbytes, opts, req);
+		}
+		if (req->async.ctx && req->async.ctx->dispatch) {
+			return cmd_pass_dispatch(dev, cmd, dbuf, dbuf_nbytes,
+						 mbuf, mbuf_nbytes, opts, req);
+		}
+		if (req->async.ctx) {
+			xnvme_async_group_mark(req->async.ctx);
+		}
+		if (req->async.ctx && req->async.ctx->qos) {
+			return xnvme_async_qos_cmd_io(dev, cmd, dbuf,
+						      dbuf_nbytes, mbuf,
+						      mbuf_nbytes, opts, req);
+		}
 		return dev->be.async.cmd_io(dev, cmd, dbuf, dbuf_nbytes, mbuf,
 					    mbuf_nbytes, opts, req);
 
@@ -290,7 +399,8 @@ xnvme_cmd_read(struct xnvme_dev *dev, uint32_t nsid, uint64_t slba,
 	       uint16_t nlb, void *dbuf, void *mbuf, int opts,
 	       struct xnvme_req *ret)
 {
-	size_t dbuf_nbytes = dbuf ? dev->geo.lba_nbytes * (nlb + 1) : 0;
+	size_t dbuf_nbytes = (dbuf || (opts & XNVME_CMD_BUFSEL)) ?
+			     dev->geo.lba_nbytes * (nlb + 1) : 0;
 	size_t mbuf_nbytes = mbuf ? dev->geo.nbytes_oob * (nlb + 1) : 0;
 	struct xnvme_spec_cmd cmd = { 0 };
 
@@ -329,3 +439,200 @@ xnvme_cmd_write(struct xnvme_dev *dev, uint32_t nsid, uint64_t slba,
 	return xnvme_cmd_pass(dev, &cmd, cdbuf, dbuf_nbytes, cmbuf, mbuf_nbytes,
 			      opts, ret);
 }
+
+int
+xnvme_cmd_flush(struct xnvme_dev *dev, uint32_t nsid, int opts,
+		struct xnvme_req *ret)
+{
+	struct xnvme_spec_cmd cmd = { 0 };
+
+	cmd.common.opcode = XNVME_SPEC_OPC_FLUSH;
+	cmd.common.nsid = nsid;
+
+	return xnvme_cmd_pass(dev, &cmd, NULL, 0, NULL, 0, opts, ret);
+}
+
+/**
+ * State of an asynchronous chain of commands, lives until the chain completes
+ */
+struct cmd_chain {
+	struct xnvme_dev *dev;
+	struct xnvme_cmd_link *links;
+	struct xnvme_req *req;		///< Completion of the chain as a unit
+	struct xnvme_req *failed;	///< Completion of the first failed link
+	uint16_t nlinks;
+	uint16_t ncompleted;
+	uint16_t native;		///< Chain is linked by the backend
+	int opts;
+};
+
+static void
+cmd_chain_complete(struct cmd_chain *chain)
+{
+	struct xnvme_req *req = chain->req;
+
+	if (chain->failed) {
+		req->cpl = chain->failed->cpl;
+	} else {
+		req->cpl = chain->links[chain->nlinks - 1].req.cpl;
+	}
+
+	free(chain);
+
+	req->async.cb(req, req->async.cb_arg);
+}
+
+static inline int
+cmd_chain_submit_next(struct cmd_chain *chain)
+{
+	struct xnvme_cmd_link *link = &chain->links[chain->ncompleted];
+
+	return xnvme_cmd_pass(chain->dev, &link->cmd, link->dbuf,
+			      link->dbuf_nbytes, NULL, 0, chain->opts,
+			      &link->req);
+}
+
+/**
+ * Completion of a single link, when the backend is not linking the chain, then
+ * this is where the next link is submitted
+ */
+static void
+cmd_chain_cb(struct xnvme_req *lreq, void *cb_arg)
+{
+	struct cmd_chain *chain = cb_arg;
+	int err;
+
+	chain->ncompleted += 1;
+
+	if ((!chain->failed) && xnvme_req_cpl_status(lreq)) {
+		chain->failed = lreq;
+	}
+
+	if (chain->native) {
+		if (chain->ncompleted == chain->nlinks) {
+			cmd_chain_complete(chain);
+		}
+		return;
+	}
+
+	if (chain->failed || (chain->ncompleted == chain->nlinks)) {
+		cmd_chain_complete(chain);
+		return;
+	}
+
+	err = cmd_chain_submit_next(chain);
+	if (err) {
+		XNVME_DEBUG("FAILED: cmd_chain_submit_next(), err: %d", err);
+		lreq = &chain->links[chain->ncompleted].req;
+		xnvme_async_cpl_errno(lreq, err);
+		chain->failed = lreq;
+		cmd_chain_complete(chain);
+	}
+}
+
+static int
+cmd_chain_sync(struct xnvme_dev *dev, struct xnvme_cmd_link *links,
+	       uint16_t nlinks, int opts, struct xnvme_req *req)
+{
+	for (uint16_t i = 0; i < nlinks; ++i) {
+		struct xnvme_cmd_link *link = &links[i];
+		int err;
+
+		xnvme_req_clear(&link->req);
+
+		err = xnvme_cmd_pass(dev, &link->cmd, link->dbuf,
+				     link->dbuf_nbytes, NULL, 0, opts,
+				     &link->req);
+		if (req) {
+			req->cpl = link->req.cpl;
+		}
+		if (err || xnvme_req_cpl_status(&link->req)) {
+			XNVME_DEBUG("FAILED: link: %u, err: %d", i, err);
+			return err ? err : -EIO;
+		}
+	}
+
+	return 0;
+}
+
+int
+xnvme_cmd_chain(struct xnvme_dev *dev, struct xnvme_cmd_link *links,
+		uint16_t nlinks, int opts, struct xnvme_req *req)
+{
+	struct cmd_chain *chain;
+	int err;
+
+	if (!(links && nlinks)) {
+		XNVME_DEBUG("FAILED: links: %p, nlinks: %u", (void *)links,
+			    nlinks);
+		return -EINVAL;
+	}
+
+	switch (opts & XNVME_CMD_MASK_IOMD) {
+	case XNVME_CMD_SYNC:
+		return cmd_chain_sync(dev, links, nlinks, opts, req);
+
+	case XNVME_CMD_ASYNC:
+		break;
+
+	default:
+		XNVME_DEBUG("FAILED: command-mode not provided");
+		return -EINVAL;
+	}
+
+	if (!(req && req->async.ctx && req->async.cb)) {
+		XNVME_DEBUG("FAILED: req without async. context or callback");
+		return -EINVAL;
+	}
+	if (req->async.ctx->dispatch) {
+		XNVME_DEBUG("FAILED: not supported on a context with a dispatcher");
+		return -ENOSYS;
+	}
+
+	chain = calloc(1, sizeof(*chain));
+	if (!chain) {
+		XNVME_DEBUG("FAILED: calloc(chain), errno: %d", errno);
+		return -errno;
+	}
+	chain->dev = dev;
+	chain->links = links;
+	chain->nlinks = nlinks;
+	chain->req = req;
+	chain->opts = opts;
+
+	for (uint16_t i = 0; i < nlinks; ++i) {
+		struct xnvme_req *lreq = &links[i].req;
+
+		xnvme_req_clear(lreq);
+		lreq->async.ctx = req->async.ctx;
+		lreq->async.cb = cmd_chain_cb;
+		lreq->async.cb_arg = chain;
+		lreq->async.prio = req->async.prio;
+	}
+
+	// Let the backend link the commands, fall back to submitting each link
+	// from the completion of the previous, as does a rate-limited context,
+	// an ordered context and a producer of a shared context
+	xnvme_async_group_mark(req->async.ctx);
+	chain->native = 1;
+	err = ((!req->async.ctx->qos) && (!req->async.ctx->shared) &&
+	       (!req->async.ctx->ordered)) ?
+	      dev->be.async.cmd_chain(dev, links, nlinks, opts) : -ENOSYS;
+	if (err != -ENOSYS) {
+		if (err) {
+			XNVME_DEBUG("FAILED: be.async.cmd_chain(), err: %d", err);
+			free(chain);
+		}
+		return err;
+	}
+
+	chain->native = 0;
+	err = cmd_chain_submit_next(chain);
+	if (err) {
+		XNVME_DEBUG("FAILED: cmd_chain_submit_next(), err: %d", err);
+		free(chain);
+		return err;
+	}
+
+	return 0;
+}
@@ -0,0 +1,212 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libxnvme.h>
+#include <xnvme_async.h>
+#include <xnvme_be.h>
+#include <xnvme_cmd_batch.h>
+#include <xnvme_dev.h>
+
+static pthread_mutex_t g_batch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Retrieve the batch-context of the calling thread, setting it up on first use
+ *
+ * @return On success, 0 is returned. On error, negative `errno` is returned.
+ */
+static int
+cmd_batch_get(struct xnvme_dev *dev, struct xnvme_cmd_batch **batch)
+{
+	pthread_t self = pthread_self();
+	struct xnvme_cmd_batch *entry;
+	int err;
+
+	pthread_mutex_lock(&g_batch_lock);
+	for (entry = dev->batch; entry; entry = entry->next) {
+		if (pthread_equal(entry->thread, self)) {
+			pthread_mutex_unlock(&g_batch_lock);
+			*batch = entry;
+			return 0;
+		}
+	}
+	pthread_mutex_unlock(&g_batch_lock);
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	entry->thread = self;
+
+	err = xnvme_async_init(dev, &entry->ctx, XNVME_CMD_BATCH_QDEPTH, 0);
+	if (err == -ENOSYS) {
+		XNVME_DEBUG("INFO: no async. interface, submitting one by one");
+		entry->ctx = NULL;
+	} else if (err) {
+		XNVME_DEBUG("FAILED: xnvme_async_init(), err: %d", err);
+		free(entry);
+		return err;
+	}
+
+	pthread_mutex_lock(&g_batch_lock);
+	entry->next = dev->batch;
+	dev->batch = entry;
+	pthread_mutex_unlock(&g_batch_lock);
+
+	*batch = entry;
+
+	return 0;
+}
+
+void
+xnvme_cmd_batch_teardown(struct xnvme_dev *dev)
+{
+	struct xnvme_cmd_batch *entry;
+
+	pthread_mutex_lock(&g_batch_lock);
+	entry = dev->batch;
+	dev->batch = NULL;
+	pthread_mutex_unlock(&g_batch_lock);
+
+	while (entry) {
+		struct xnvme_cmd_batch *next = entry->next;
+
+		if (entry->ctx) {
+			xnvme_async_term(dev, entry->ctx);
+		}
+		free(entry);
+		entry = next;
+	}
+}
+
+static void
+cmd_batch_cb(struct xnvme_req *XNVME_UNUSED(req), void *cb_arg)
+{
+	uint32_t *ncompleted = cb_arg;
+
+	*ncompleted += 1;
+}
+
+/**
+ * Complete the commands, from 'first', which were not submitted, with the given
+ * negative 'errno'
+ */
+static void
+cmd_batch_fail(struct xnvme_cmd_link *cmds, uint16_t ncmds, uint16_t first,
+	       int err)
+{
+	for (uint16_t i = first; i < ncmds; ++i) {
+		memset(&cmds[i].req, 0, sizeof(cmds[i].req));
+		xnvme_async_cpl_errno(&cmds[i].req, err);
+	}
+}
+
+static int
+cmd_batch_loop(struct xnvme_dev *dev, struct xnvme_cmd_link *cmds,
+	       uint16_t ncmds)
+{
+	int nerrs = 0;
+
+	for (uint16_t i = 0; i < ncmds; ++i) {
+		struct xnvme_cmd_link *link = &cmds[i];
+		int err;
+
+		memset(&link->req, 0, sizeof(link->req));
+
+		err = xnvme_cmd_pass(dev, &link->cmd, link->dbuf,
+				     link->dbuf_nbytes, NULL, 0, XNVME_CMD_SYNC,
+				     &link->req);
+		if (err && !xnvme_req_cpl_status(&link->req)) {
+			xnvme_async_cpl_errno(&link->req, err);
+		}
+		if (err || xnvme_req_cpl_status(&link->req)) {
+			XNVME_DEBUG("FAILED: xnvme_cmd_pass(), i: %u, err: %d",
+				    i, err);
+			nerrs += 1;
+		}
+	}
+
+	return nerrs ? -EIO : 0;
+}
+
+int
+xnvme_cmd_batch_sync(struct xnvme_dev *dev, struct xnvme_cmd_link *cmds,
+		     uint16_t ncmds)
+{
+	struct xnvme_cmd_batch *batch = NULL;
+	uint32_t nsubmitted = 0, ncompleted = 0;
+	int nerrs = 0;
+	int err;
+
+	if (!(cmds && ncmds)) {
+		XNVME_DEBUG("FAILED: invalid cmds: %p, ncmds: %u",
+			    (void *)cmds, ncmds);
+		return -EINVAL;
+	}
+
+	err = cmd_batch_get(dev, &batch);
+	if (err) {
+		XNVME_DEBUG("FAILED: cmd_batch_get(), err: %d", err);
+		cmd_batch_fail(cmds, ncmds, 0, err);
+		return err;
+	}
+	if (!batch->ctx) {
+		return cmd_batch_loop(dev, cmds, ncmds);
+	}
+
+	while (nsubmitted < ncmds) {
+		struct xnvme_cmd_link *link = &cmds[nsubmitted];
+
+		memset(&link->req, 0, sizeof(link->req));
+		link->req.async.ctx = batch->ctx;
+		link->req.async.cb = cmd_batch_cb;
+		link->req.async.cb_arg = &ncompleted;
+
+		err = xnvme_cmd_pass(dev, &link->cmd, link->dbuf,
+				     link->dbuf_nbytes, NULL, 0, XNVME_CMD_ASYNC,
+				     &link->req);
+		switch (err) {
+		case 0:
+			nsubmitted += 1;
+			continue;
+
+		case -EBUSY:
+		case -EAGAIN:
+			err = xnvme_async_poke(dev, batch->ctx, 0);
+			if (err >= 0) {
+				continue;
+			}
+			XNVME_DEBUG("FAILED: xnvme_async_poke(), err: %d", err);
+			break;
+
+		default:
+			XNVME_DEBUG("FAILED: xnvme_cmd_pass(), err: %d", err);
+			break;
+		}
+
+		// Reap what is in flight, as it refers to the batch
+		xnvme_async_wait(dev, batch->ctx);
+		cmd_batch_fail(cmds, ncmds, nsubmitted, err);
+		return err;
+	}
+
+	err = xnvme_async_wait(dev, batch->ctx);
+	if (err < 0) {
+		XNVME_DEBUG("FAILED: xnvme_async_wait(), err: %d", err);
+		return err;
+	}
+	if (ncompleted != nsubmitted) {
+		XNVME_DEBUG("FAILED: ncompleted: %u != nsubmitted: %u",
+			    ncompleted, nsubmitted);
+		return -EIO;
+	}
+
+	for (uint16_t i = 0; i < ncmds; ++i) {
+		nerrs += xnvme_req_cpl_status(&cmds[i].req) ? 1 : 0;
+	}
+
+	return nerrs ? -EIO : 0;
+}
@@ -0,0 +1,88 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <errno.h>
+#include <stdlib.h>
+#include <libxnvme.h>
+#include <xnvme_async.h>
+#include <xnvme_be.h>
+#include <xnvme_dev.h>
+#include <xnvme_cmd_tmpl.h>
+
+int
+xnvme_cmd_tmpl_create(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+		      uint8_t opcode, uint32_t nsid, int opts,
+		      struct xnvme_cmd_tmpl **tmpl)
+{
+	const int cmd_opts = opts & XNVME_CMD_MASK;
+	struct xnvme_cmd_tmpl *t;
+
+	if ((opcode != XNVME_SPEC_OPC_READ) && (opcode != XNVME_SPEC_OPC_WRITE)) {
+		XNVME_DEBUG("FAILED: unsupported opcode: 0x%x", opcode);
+		return -EINVAL;
+	}
+	if ((cmd_opts & XNVME_CMD_ASYNC) && !ctx) {
+		XNVME_DEBUG("FAILED: XNVME_CMD_ASYNC without ctx");
+		return -EINVAL;
+	}
+
+	t = calloc(1, sizeof(*t));
+	if (!t) {
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		return -errno;
+	}
+	t->dev = dev;
+	t->ctx = (cmd_opts & XNVME_CMD_ASYNC) ? ctx : NULL;
+	t->cmd.common.opcode = opcode;
+	t->cmd.common.nsid = nsid;
+	t->ssw = dev->ssw;
+	t->lba_nbytes = dev->geo.lba_nbytes;
+	t->opts = opts;
+
+	// Native submission covers plain commands, on a context of the backend,
+	// anything else, including a producer of a shared context, is passed
+	if ((cmd_opts == XNVME_CMD_ASYNC) && (!ctx->shared)) {
+		int err = dev->be.async.cmd_tmpl(dev, t);
+
+		if (err) {
+			XNVME_DEBUG("INFO: no native submission, err: %d", err);
+			t->submit = NULL;
+		}
+	}
+
+	*tmpl = t;
+
+	return 0;
+}
+
+void
+xnvme_cmd_tmpl_destroy(struct xnvme_cmd_tmpl *tmpl)
+{
+	free(tmpl);
+}
+
+int
+xnvme_cmd_tmpl_submit(struct xnvme_cmd_tmpl *tmpl, uint64_t slba,
+		      uint16_t nlb, void *dbuf, struct xnvme_req *req)
+{
+	struct xnvme_async_ctx *ctx = tmpl->ctx;
+	struct xnvme_spec_cmd cmd;
+
+	if (ctx) {
+		req->async.ctx = ctx;
+
+		// Rate-limiting, groups, fault-injection, ordering and dispatch
+		// are left to xnvme_cmd_pass()
+		if (tmpl->submit && !(ctx->qos || ctx->group || ctx->inject ||
+				      ctx->ordered || ctx->dispatch)) {
+			return tmpl->submit(tmpl, slba, nlb, dbuf, req);
+		}
+	}
+
+	cmd = tmpl->cmd;
+	cmd.lblk.slba = slba;
+	cmd.lblk.nlb = nlb;
+
+	return xnvme_cmd_pass(tmpl->dev, &cmd, dbuf,
+			      (size_t)tmpl->lba_nbytes * (nlb + 1), NULL, 0,
+			      tmpl->opts, req);
+}
@@ -1,13 +1,122 @@
 // Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
 // SPDX-License-Identifier: Apache-2.0
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <pthread.h>
 #include <libxnvme.h>
 #include <xnvme_be.h>
 #include <xnvme_dev.h>
 #include <xnvme_geo.h>
+#include <xnvme_inject.h>
+#include <xnvme_cmd_batch.h>
+#ifdef XNVME_BE_LINUX_ENABLED
+#include <sched.h>
+#include <xnvme_be_linux.h>
+#endif
+#include <xnvme_async_probe.h>
+
+/**
+ * Controller data shared by device handles, by key, a slot is NULL when free
+ */
+static struct xnvme_dev_ctrlr *g_ctrlr[XNVME_DEV_CTRLR_SHARED_LEN];
+static pthread_mutex_t g_ctrlr_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct xnvme_dev_ctrlr *
+_ctrlr_lookup(const char *key)
+{
+	for (int i = 0; i < XNVME_DEV_CTRLR_SHARED_LEN; ++i) {
+		if (g_ctrlr[i] && !strcmp(g_ctrlr[i]->key, key)) {
+			return g_ctrlr[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void
+_ctrlr_put(struct xnvme_dev_ctrlr *ctrlr)
+{
+	if (!ctrlr) {
+		return;
+	}
+
+	pthread_mutex_lock(&g_ctrlr_lock);
+	ctrlr->refcount -= 1;
+	if (ctrlr->refcount) {
+		pthread_mutex_unlock(&g_ctrlr_lock);
+		return;
+	}
+	for (int i = 0; ctrlr->key[0] && (i < XNVME_DEV_CTRLR_SHARED_LEN); ++i) {
+		if (g_ctrlr[i] == ctrlr) {
+			g_ctrlr[i] = NULL;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&g_ctrlr_lock);
+
+	free(ctrlr);
+}
+
+int
+xnvme_dev_ctrlr_get(struct xnvme_dev *dev, const char *key)
+{
+	if (key && key[0]) {
+		pthread_mutex_lock(&g_ctrlr_lock);
+		dev->ctrlr = _ctrlr_lookup(key);
+		if (dev->ctrlr) {
+			dev->ctrlr->refcount += 1;
+		}
+		pthread_mutex_unlock(&g_ctrlr_lock);
+
+		if (dev->ctrlr) {
+			XNVME_DEBUG("INFO: shared ctrlr, key: '%s'", key);
+			return 1;
+		}
+	}
+
+	dev->ctrlr = calloc(1, sizeof(*dev->ctrlr));
+	if (!dev->ctrlr) {
+		XNVME_DEBUG("FAILED: calloc(ctrlr), errno: %d", errno);
+		return -errno;
+	}
+	dev->ctrlr->refcount = 1;
+
+	return 0;
+}
+
+void
+xnvme_dev_ctrlr_share(struct xnvme_dev *dev, const char *key)
+{
+	struct xnvme_dev_ctrlr *shared;
+
+	if (!(key && key[0]) || (strlen(key) >= XNVME_DEV_CTRLR_KEY_LEN)) {
+		return;
+	}
+
+	pthread_mutex_lock(&g_ctrlr_lock);
+	shared = _ctrlr_lookup(key);
+	if (shared) {
+		shared->refcount += 1;
+		pthread_mutex_unlock(&g_ctrlr_lock);
+
+		_ctrlr_put(dev->ctrlr);
+		dev->ctrlr = shared;
+		return;
+	}
+	for (int i = 0; i < XNVME_DEV_CTRLR_SHARED_LEN; ++i) {
+		if (!g_ctrlr[i]) {
+			strncpy(dev->ctrlr->key, key, XNVME_DEV_CTRLR_KEY_LEN - 1);
+			g_ctrlr[i] = dev->ctrlr;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&g_ctrlr_lock);
+}
 
 static inline int
 xnvme_dev_cmd_opts_yaml(FILE *stream, const struct xnvme_dev *dev, int indent,
@@ -45,7 +154,8 @@ xnvme_dev_cmd_opts_yaml(FILE *stream, const struct xnvme_dev *dev, int indent,
 	wrtn += fprintf(stream, "%*scsi: 0x%x%s", indent, "", dev->csi, sep);
 	wrtn += fprintf(stream, "%*snsid: 0x%u%s", indent, "", dev->nsid, sep);
 
-	wrtn += fprintf(stream, "%*sssw: %"PRIu64"", indent, "", dev->ssw);
+	wrtn += fprintf(stream, "%*sssw: %"PRIu64"%s", indent, "", dev->ssw, sep);
+	wrtn += fprintf(stream, "%*snuma_node: %d", indent, "", dev->numa_node);
 
 	return 0;
 }
@@ -80,6 +190,11 @@ xnvme_dev_fpr(FILE *stream, const struct xnvme_dev *dev, int opts)
 	wrtn += xnvme_be_yaml(stream, &dev->be, 2, "\n", 1);
 	wrtn += fprintf(stream, "\n");
 
+	if (dev->aprobe) {
+		wrtn += xnvme_async_probe_yaml(stream, dev->aprobe, 2, "\n", 1);
+		wrtn += fprintf(stream, "\n");
+	}
+
 	wrtn += xnvme_dev_cmd_opts_yaml(stream, dev, 2, "\n", 1);
 	wrtn += fprintf(stream, "\n");
 
@@ -104,13 +219,13 @@ xnvme_dev_get_geo(const struct xnvme_dev *dev)
 const struct xnvme_spec_idfy_ctrlr *
 xnvme_dev_get_ctrlr(const struct xnvme_dev *dev)
 {
-	return &dev->id.ctrlr;
+	return &dev->ctrlr->id;
 }
 
 const struct xnvme_spec_idfy_ctrlr *
 xnvme_dev_get_ctrlr_css(const struct xnvme_dev *dev)
 {
-	return &dev->idcss.ctrlr;
+	return &dev->ctrlr->idcss;
 }
 
 const struct xnvme_spec_idfy_ns *
@@ -143,6 +258,45 @@ xnvme_dev_get_ssw(const struct xnvme_dev *dev)
 	return dev->ssw;
 }
 
+int
+xnvme_dev_get_numa_node(const struct xnvme_dev *dev)
+{
+	return dev->numa_node;
+}
+
+#ifdef XNVME_BE_LINUX_ENABLED
+int
+xnvme_dev_bind_thread(const struct xnvme_dev *dev)
+{
+	cpu_set_t cpus;
+	int err;
+
+	if (dev->numa_node < 0) {
+		XNVME_DEBUG("FAILED: NUMA node of the device is unknown");
+		return -ENOENT;
+	}
+
+	err = xnvme_be_linux_numa_cpus(dev->numa_node, &cpus);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_be_linux_numa_cpus(), err: %d", err);
+		return err;
+	}
+	if (sched_setaffinity(0, sizeof(cpus), &cpus)) {
+		XNVME_DEBUG("FAILED: sched_setaffinity(), errno: %d", errno);
+		return -errno;
+	}
+
+	return 0;
+}
+#else
+int
+xnvme_dev_bind_thread(const struct xnvme_dev *XNVME_UNUSED(dev))
+{
+	XNVME_DEBUG("FAILED: not supported on this platform");
+	return -ENOSYS;
+}
+#endif
+
 const void *
 xnvme_dev_get_be_state(const struct xnvme_dev *dev)
 {
@@ -163,6 +317,14 @@ xnvme_dev_openf(const char *dev_uri, int cmd_opts)
 		return NULL;
 	}
 
+	err = xnvme_inject_setup(dev);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_inject_setup(), err: %d", err);
+		xnvme_dev_close(dev);
+		errno = -err;
+		return NULL;
+	}
+
 	dev->cmd_opts = 0;	// Setup CMD options
 
 	if (cmd_opts & XNVME_CMD_MASK_IOMD) {
@@ -180,6 +342,63 @@ xnvme_dev_openf(const char *dev_uri, int cmd_opts)
 	return dev;
 }
 
+struct xnvme_dev *
+xnvme_dev_dup(struct xnvme_dev *dev)
+{
+	struct xnvme_dev *dup = NULL;
+	int err;
+
+	if (!dev) {
+		XNVME_DEBUG("FAILED: !dev");
+		errno = EINVAL;
+		return NULL;
+	}
+
+	err = xnvme_dev_alloc(&dup);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_dev_alloc()");
+		errno = -err;
+		return NULL;
+	}
+	dup->ident = dev->ident;
+	dup->geo = dev->geo;
+	dup->ssw = dev->ssw;
+	dup->nsid = dev->nsid;
+	dup->csi = dev->csi;
+	dup->dtype = dev->dtype;
+	dup->numa_node = dev->numa_node;
+	dup->id.ns = dev->id.ns;
+	dup->idcss.ns = dev->idcss.ns;
+
+	pthread_mutex_lock(&g_ctrlr_lock);
+	dev->ctrlr->refcount += 1;
+	pthread_mutex_unlock(&g_ctrlr_lock);
+	dup->ctrlr = dev->ctrlr;
+
+	err = dev->be.dev.dev_dup(dev, dup);
+	if (err) {
+		xnvme_dev_free(dup);
+		if (err == -ENOSYS) {
+			XNVME_DEBUG("INFO: no be.dev.dev_dup(), re-opening");
+			return xnvme_dev_openf(dev->ident.uri, dev->cmd_opts);
+		}
+		XNVME_DEBUG("FAILED: be.dev.dev_dup(), err: %d", err);
+		errno = -err;
+		return NULL;
+	}
+
+	err = xnvme_inject_setup(dup);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_inject_setup(), err: %d", err);
+		xnvme_dev_close(dup);
+		errno = -err;
+		return NULL;
+	}
+	dup->cmd_opts = dev->cmd_opts;
+
+	return dup;
+}
+
 struct xnvme_dev *
 xnvme_dev_open(const char *dev_uri)
 {
@@ -193,8 +412,10 @@ xnvme_dev_close(struct xnvme_dev *dev)
 		return;
 	}
 
+	xnvme_cmd_batch_teardown(dev);
+	xnvme_inject_teardown(dev);
 	dev->be.dev.dev_close(dev);
-	free(dev);
+	xnvme_dev_free(dev);
 }
 
 int
@@ -206,6 +427,19 @@ xnvme_dev_alloc(struct xnvme_dev **dev)
 		return -errno;
 	}
 	memset(*dev, 0, sizeof(**dev));
+	(*dev)->numa_node = -1;
 
 	return 0;
 }
+
+void
+xnvme_dev_free(struct xnvme_dev *dev)
+{
+	if (!dev) {
+		return;
+	}
+
+	_ctrlr_put(dev->ctrlr);
+	free(dev->aprobe);
+	free(dev);
+}
@@ -0,0 +1,502 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+#include <libxnvme.h>
+#include <xnvme_be.h>
+#include <xnvme_async.h>
+#include <xnvme_dispatcher.h>
+
+/**
+ * Enqueue a batch, taking the position of 'enq' when its cell is free, the cell
+ * is then published by advancing its 'seq'
+ *
+ * @return On success, 0 is returned. On error, -EAGAIN when the queue is full.
+ */
+static inline int
+dispatcher_enqueue(struct xnvme_dispatcher *dispatcher,
+		   struct xnvme_dispatch_slot *batch)
+{
+	struct xnvme_dispatcher_cell *cell;
+	uint64_t pos;
+
+	pos = atomic_load_explicit(&dispatcher->enq, memory_order_relaxed);
+	for (;;) {
+		int64_t dif;
+
+		cell = &dispatcher->cells[pos & dispatcher->mask];
+		dif = (int64_t)(atomic_load_explicit(&cell->seq,
+						     memory_order_acquire) - pos);
+		if (!dif) {
+			if (atomic_compare_exchange_weak_explicit(
+				    &dispatcher->enq, &pos, pos + 1,
+				    memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		} else if (dif < 0) {
+			return -EAGAIN;
+		} else {
+			pos = atomic_load_explicit(&dispatcher->enq,
+						   memory_order_relaxed);
+		}
+	}
+
+	cell->batch = batch;
+	atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+
+	return 0;
+}
+
+/**
+ * Dequeue a batch, the counterpart of dispatcher_enqueue(), the cell is handed
+ * back to the writer one lap ahead
+ *
+ * @return The batch, NULL when no batch is published at 'deq'
+ */
+static inline struct xnvme_dispatch_slot *
+dispatcher_dequeue(struct xnvme_dispatcher *dispatcher)
+{
+	struct xnvme_dispatcher_cell *cell;
+	struct xnvme_dispatch_slot *batch;
+	uint64_t pos;
+
+	pos = atomic_load_explicit(&dispatcher->deq, memory_order_relaxed);
+	for (;;) {
+		int64_t dif;
+
+		cell = &dispatcher->cells[pos & dispatcher->mask];
+		dif = (int64_t)(atomic_load_explicit(&cell->seq,
+						     memory_order_acquire) - (pos + 1));
+		if (!dif) {
+			if (atomic_compare_exchange_weak_explicit(
+				    &dispatcher->deq, &pos, pos + 1,
+				    memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		} else if (dif < 0) {
+			return NULL;
+		} else {
+			pos = atomic_load_explicit(&dispatcher->deq,
+						   memory_order_relaxed);
+		}
+	}
+
+	batch = cell->batch;
+	atomic_store_explicit(&cell->seq, pos + dispatcher->mask + 1,
+			      memory_order_release);
+
+	return batch;
+}
+
+/**
+ * Invoke the callbacks of the given batch, handing back each slot to its
+ * context; the context may be torn down once the last of its slots is handed
+ * back, thus it is not touched after that
+ */
+static void
+dispatcher_run(struct xnvme_dispatcher *dispatcher,
+	       struct xnvme_dispatch_slot *batch)
+{
+	uint64_t delay_nsec = 0, ndispatched = 0;
+
+	while (batch) {
+		struct xnvme_dispatch_slot *slot = batch;
+		struct xnvme_async_dispatch *dispatch = slot->dispatch;
+		struct xnvme_req *req = slot->req;
+		struct xnvme_dispatch_slot *first;
+
+		batch = slot->next;
+
+		delay_nsec += _xnvme_timer_clock_sample() - slot->ts;
+		ndispatched += 1;
+
+		req->async.cb = slot->cb;
+		req->async.cb_arg = slot->cb_arg;
+		req->async.cb(req, req->async.cb_arg);
+
+		first = atomic_load_explicit(&dispatch->freed, memory_order_relaxed);
+		do {
+			slot->next = first;
+		} while (!atomic_compare_exchange_weak_explicit(&dispatch->freed,
+				&first, slot, memory_order_release,
+				memory_order_relaxed));
+
+		atomic_fetch_sub_explicit(&dispatch->nqueued, 1,
+					  memory_order_release);
+	}
+
+	atomic_fetch_add_explicit(&dispatcher->ndispatched, ndispatched,
+				  memory_order_relaxed);
+	atomic_fetch_add_explicit(&dispatcher->delay_nsec, delay_nsec,
+				  memory_order_relaxed);
+}
+
+/**
+ * A callback thread, a post of the semaphore promises a batch, which might not
+ * yet be published, or, when stopping, that the queue is drained
+ */
+static void *
+dispatcher_thread(void *arg)
+{
+	struct xnvme_dispatcher *dispatcher = arg;
+
+	for (;;) {
+		struct xnvme_dispatch_slot *batch;
+
+		while (sem_wait(&dispatcher->sem)) {
+			continue;
+		}
+
+		while (!(batch = dispatcher_dequeue(dispatcher))) {
+			if (atomic_load(&dispatcher->stop) &&
+			    (atomic_load(&dispatcher->enq) ==
+			     atomic_load(&dispatcher->deq))) {
+				return NULL;
+			}
+			sched_yield();
+		}
+
+		dispatcher_run(dispatcher, batch);
+		atomic_fetch_add_explicit(&dispatcher->nbatches, 1,
+					  memory_order_relaxed);
+	}
+
+	return NULL;
+}
+
+/**
+ * Stop the first 'nthreads' callback threads and tear down the dispatcher
+ */
+static void
+dispatcher_teardown(struct xnvme_dispatcher *dispatcher, uint32_t nthreads)
+{
+	atomic_store(&dispatcher->stop, 1);
+	for (uint32_t i = 0; i < nthreads; ++i) {
+		sem_post(&dispatcher->sem);
+	}
+	for (uint32_t i = 0; i < nthreads; ++i) {
+		pthread_join(dispatcher->threads[i], NULL);
+	}
+
+	sem_destroy(&dispatcher->sem);
+	free(dispatcher->threads);
+	free(dispatcher->cells);
+	free(dispatcher);
+}
+
+#ifdef XNVME_BE_LINUX_ENABLED
+static int
+dispatcher_thread_create(struct xnvme_dispatcher *dispatcher, uint32_t idx,
+			 const struct xnvme_dispatcher_opts *opts)
+{
+	pthread_attr_t attr;
+	cpu_set_t cpus;
+	int err;
+
+	if (!opts->ncpus) {
+		return -pthread_create(&dispatcher->threads[idx], NULL,
+				       dispatcher_thread, dispatcher);
+	}
+
+	if (opts->cpus[idx % opts->ncpus] >= CPU_SETSIZE) {
+		XNVME_DEBUG("FAILED: cpu: %d", opts->cpus[idx % opts->ncpus]);
+		return -EINVAL;
+	}
+	CPU_ZERO(&cpus);
+	CPU_SET(opts->cpus[idx % opts->ncpus], &cpus);
+
+	err = pthread_attr_init(&attr);
+	if (err) {
+		return -err;
+	}
+	err = pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+	if (!err) {
+		err = pthread_create(&dispatcher->threads[idx], &attr,
+				     dispatcher_thread, dispatcher);
+	}
+	pthread_attr_destroy(&attr);
+
+	return -err;
+}
+#else
+static int
+dispatcher_thread_create(struct xnvme_dispatcher *dispatcher, uint32_t idx,
+			 const struct xnvme_dispatcher_opts *opts)
+{
+	if (opts->ncpus) {
+		XNVME_DEBUG("FAILED: pinning is not supported on this platform");
+		return -ENOSYS;
+	}
+
+	return -pthread_create(&dispatcher->threads[idx], NULL,
+			       dispatcher_thread, dispatcher);
+}
+#endif
+
+int
+xnvme_dispatcher_create(struct xnvme_dispatcher **dispatcher,
+			const struct xnvme_dispatcher_opts *opts)
+{
+	struct xnvme_dispatcher *d;
+	uint32_t nbatches;
+
+	if (!(dispatcher && opts)) {
+		XNVME_DEBUG("FAILED: dispatcher: %p, opts: %p",
+			    (void *)dispatcher, (void *)opts);
+		return -EINVAL;
+	}
+	if ((!opts->nthreads) || (opts->nthreads > XNVME_DISPATCHER_NTHREADS_MAX)) {
+		XNVME_DEBUG("FAILED: nthreads: %u", opts->nthreads);
+		return -EINVAL;
+	}
+	if (opts->ncpus && !opts->cpus) {
+		XNVME_DEBUG("FAILED: ncpus: %u, without cpus", opts->ncpus);
+		return -EINVAL;
+	}
+	for (uint32_t i = 0; i < opts->ncpus; ++i) {
+		if (opts->cpus[i] < 0) {
+			XNVME_DEBUG("FAILED: cpus[%u]: %d", i, opts->cpus[i]);
+			return -EINVAL;
+		}
+	}
+
+	// With a single cell, a full queue is not told apart from an empty one
+	nbatches = opts->nbatches ? opts->nbatches : XNVME_DISPATCHER_NBATCHES_DEF;
+	if ((nbatches < 2) || !xnvme_is_pow2(nbatches)) {
+		XNVME_DEBUG("FAILED: nbatches: %u", nbatches);
+		return -EINVAL;
+	}
+
+	d = calloc(1, sizeof(*d));
+	if (!d) {
+		XNVME_DEBUG("FAILED: calloc(dispatcher), errno: %d", errno);
+		return -errno;
+	}
+	d->cells = calloc(nbatches, sizeof(*d->cells));
+	d->threads = calloc(opts->nthreads, sizeof(*d->threads));
+	if (!(d->cells && d->threads)) {
+		int err = -errno;
+
+		XNVME_DEBUG("FAILED: calloc(), errno: %d", errno);
+		free(d->cells);
+		free(d->threads);
+		free(d);
+		return err;
+	}
+	for (uint32_t i = 0; i < nbatches; ++i) {
+		atomic_init(&d->cells[i].seq, i);
+	}
+	d->mask = nbatches - 1;
+
+	if (sem_init(&d->sem, 0, 0)) {
+		int err = -errno;
+
+		XNVME_DEBUG("FAILED: sem_init(), errno: %d", errno);
+		free(d->cells);
+		free(d->threads);
+		free(d);
+		return err;
+	}
+
+	for (uint32_t i = 0; i < opts->nthreads; ++i) {
+		int err = dispatcher_thread_create(d, i, opts);
+
+		if (err) {
+			XNVME_DEBUG("FAILED: dispatcher_thread_create(), i: %u, "
+				    "err: %d", i, err);
+			dispatcher_teardown(d, i);
+			return err;
+		}
+		d->nthreads += 1;
+	}
+
+	*dispatcher = d;
+
+	return 0;
+}
+
+void
+xnvme_dispatcher_destroy(struct xnvme_dispatcher *dispatcher)
+{
+	if (!dispatcher) {
+		return;
+	}
+
+	dispatcher_teardown(dispatcher, dispatcher->nthreads);
+}
+
+int
+xnvme_dispatcher_get_stats(struct xnvme_dispatcher *dispatcher,
+			   struct xnvme_dispatcher_stats *stats)
+{
+	if (!(dispatcher && stats)) {
+		XNVME_DEBUG("FAILED: dispatcher: %p, stats: %p",
+			    (void *)dispatcher, (void *)stats);
+		return -EINVAL;
+	}
+
+	stats->ndispatched = atomic_load(&dispatcher->ndispatched);
+	stats->nbatches = atomic_load(&dispatcher->nbatches);
+	stats->ninline = atomic_load(&dispatcher->ninline);
+	stats->delay_nsec = atomic_load(&dispatcher->delay_nsec);
+
+	return 0;
+}
+
+void
+xnvme_async_dispatch_flush(struct xnvme_async_dispatch *dispatch)
+{
+	struct xnvme_dispatcher *dispatcher = dispatch->dispatcher;
+	struct xnvme_dispatch_slot *batch = dispatch->batch;
+
+	if (!batch) {
+		return;
+	}
+
+	atomic_fetch_add_explicit(&dispatch->nqueued, dispatch->nbatched,
+				  memory_order_relaxed);
+	dispatch->batch = NULL;
+	dispatch->batch_tail = NULL;
+	dispatch->nbatched = 0;
+
+	if (dispatcher_enqueue(dispatcher, batch)) {
+		atomic_fetch_add_explicit(&dispatcher->ninline, 1,
+					  memory_order_relaxed);
+		dispatcher_run(dispatcher, batch);
+		return;
+	}
+
+	sem_post(&dispatcher->sem);
+}
+
+void
+xnvme_async_dispatch_drain(struct xnvme_async_dispatch *dispatch)
+{
+	xnvme_async_dispatch_flush(dispatch);
+
+	while (atomic_load_explicit(&dispatch->nqueued, memory_order_acquire)) {
+		struct timespec ts1 = {.tv_sec = 0, .tv_nsec = 1000};
+
+		nanosleep(&ts1, NULL);
+	}
+}
+
+/**
+ * Completion of a command on a context with a dispatcher, invoked by the thread
+ * poking it, which timestamps it and adds it to the batch of the context
+ */
+static void
+dispatch_cb(struct xnvme_req *XNVME_UNUSED(req), void *cb_arg)
+{
+	struct xnvme_dispatch_slot *slot = cb_arg;
+	struct xnvme_async_dispatch *dispatch = slot->dispatch;
+
+	slot->ts = _xnvme_timer_clock_sample();
+	slot->next = NULL;
+
+	if (dispatch->batch) {
+		dispatch->batch_tail->next = slot;
+	} else {
+		dispatch->batch = slot;
+	}
+	dispatch->batch_tail = slot;
+
+	dispatch->nbatched += 1;
+	if (dispatch->nbatched == dispatch->batch_max) {
+		xnvme_async_dispatch_flush(dispatch);
+	}
+}
+
+int
+xnvme_async_dispatch_enter(struct xnvme_req *req)
+{
+	struct xnvme_async_dispatch *dispatch = req->async.ctx->dispatch;
+	struct xnvme_dispatch_slot *slot = dispatch->free;
+
+	if (!slot) {
+		slot = atomic_exchange_explicit(&dispatch->freed, NULL,
+						memory_order_acquire);
+		if (!slot) {
+			return -EBUSY;
+		}
+	}
+	dispatch->free = slot->next;
+
+	slot->req = req;
+	slot->cb = req->async.cb;
+	slot->cb_arg = req->async.cb_arg;
+
+	req->async.cb = dispatch_cb;
+	req->async.cb_arg = slot;
+
+	return 0;
+}
+
+void
+xnvme_async_dispatch_cancel(struct xnvme_req *req)
+{
+	struct xnvme_async_dispatch *dispatch = req->async.ctx->dispatch;
+	struct xnvme_dispatch_slot *slot = req->async.cb_arg;
+
+	req->async.cb = slot->cb;
+	req->async.cb_arg = slot->cb_arg;
+
+	slot->next = dispatch->free;
+	dispatch->free = slot;
+}
+
+int
+xnvme_async_set_dispatcher(struct xnvme_async_ctx *ctx,
+			   struct xnvme_dispatcher *dispatcher, uint32_t batch)
+{
+	struct xnvme_async_dispatch *dispatch;
+	uint32_t nslots;
+
+	if (!ctx) {
+		XNVME_DEBUG("FAILED: !ctx");
+		return -EINVAL;
+	}
+	if (ctx->shared || ctx->ordered) {
+		XNVME_DEBUG("FAILED: not supported on a shared / ordered context");
+		return -ENOSYS;
+	}
+	if (!xnvme_async_idle(ctx)) {
+		XNVME_DEBUG("FAILED: the context is not idle");
+		return -EBUSY;
+	}
+	if (dispatcher && ((!batch) || (batch > XNVME_DISPATCHER_BATCH_MAX))) {
+		XNVME_DEBUG("FAILED: batch: %u", batch);
+		return -EINVAL;
+	}
+
+	free(ctx->dispatch);
+	ctx->dispatch = NULL;
+
+	if (!dispatcher) {
+		return 0;
+	}
+
+	nslots = ctx->depth;
+	dispatch = calloc(1, sizeof(*dispatch) + nslots * sizeof(*dispatch->elm));
+	if (!dispatch) {
+		XNVME_DEBUG("FAILED: calloc(dispatch), errno: %d", errno);
+		return -errno;
+	}
+	dispatch->dispatcher = dispatcher;
+	dispatch->batch_max = batch;
+	for (uint32_t i = 0; i < nslots; ++i) {
+		dispatch->elm[i].dispatch = dispatch;
+		dispatch->elm[i].next = dispatch->free;
+		dispatch->free = &dispatch->elm[i];
+	}
+
+	ctx->dispatch = dispatch;
+
+	return 0;
+}
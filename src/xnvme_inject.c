@@ -0,0 +1,589 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <libxnvme.h>
+#include <xnvme_be.h>
+#include <xnvme_be_nosys.h>
+#include <xnvme_dev.h>
+#include <xnvme_async.h>
+#include <xnvme_inject.h>
+
+#define INJECT_P_ONE (1ULL << 53)
+
+static inline uint64_t
+inject_rand(void)
+{
+	static __thread uint64_t rnd;
+	uint64_t x = rnd ? rnd : (_xnvme_timer_clock_sample() ^ (uintptr_t)&rnd) | 1;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	rnd = x;
+
+	return (x * 0x2545F4914F6CDD1DULL) >> 11;
+}
+
+static void
+inject_sleep(uint64_t usec)
+{
+	struct timespec ts = {
+		.tv_sec = usec / 1000000,
+		.tv_nsec = (usec % 1000000) * 1000
+	};
+
+	while (nanosleep(&ts, &ts) && (errno == EINTR));
+}
+
+/**
+ * Find the first rule matching the given command and let it fire by its
+ * probability
+ */
+static struct xnvme_inject_rule *
+inject_match(struct xnvme_inject *inject, const struct xnvme_spec_cmd *cmd,
+	     int admin)
+{
+	for (uint32_t i = 0; i < inject->nrules; ++i) {
+		struct xnvme_inject_rule *rule = &inject->rules[i];
+
+		if (rule->admin != admin) {
+			continue;
+		}
+		if ((rule->opc >= 0) && (rule->opc != cmd->common.opcode)) {
+			continue;
+		}
+		if ((!admin) && ((cmd->lblk.slba > rule->elba) || \
+				 (cmd->lblk.slba + cmd->lblk.nlb < rule->slba))) {
+			continue;
+		}
+		if ((rule->p_thr < INJECT_P_ONE) && (inject_rand() >= rule->p_thr)) {
+			continue;
+		}
+
+		atomic_fetch_add_explicit(&rule->nhits, 1, memory_order_relaxed);
+
+		return rule;
+	}
+
+	return NULL;
+}
+
+static inline void
+inject_cpl_status(struct xnvme_req *req, uint8_t sct, uint8_t sc)
+{
+	memset(&req->cpl, 0, sizeof(req->cpl));
+	req->cpl.status.sct = sct;
+	req->cpl.status.sc = sc;
+}
+
+/**
+ * Sync commands cannot be dropped, thus a drop is injected as a timeout
+ */
+static int
+inject_sync_cmd(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd, void *dbuf,
+		size_t dbuf_nbytes, void *mbuf, size_t mbuf_nbytes, int opts,
+		struct xnvme_req *req, int admin)
+{
+	struct xnvme_inject *inject = dev->inject;
+	struct xnvme_inject_rule *rule = inject_match(inject, cmd, admin);
+	int (*cmd_pass)(struct xnvme_dev *, struct xnvme_spec_cmd *, void *,
+			size_t, void *, size_t, int, struct xnvme_req *);
+	struct xnvme_req rsp = { 0 };
+	uint64_t due, now;
+
+	cmd_pass = admin ? inject->sync.cmd_admin : inject->sync.cmd_io;
+	if (!rule) {
+		return cmd_pass(dev, cmd, dbuf, dbuf_nbytes, mbuf, mbuf_nbytes,
+				opts, req);
+	}
+
+	req = req ? req : &rsp;
+
+	switch (rule->action) {
+	case XNVME_INJECT_DELAY:
+		inject_sleep(rule->usec);
+		return cmd_pass(dev, cmd, dbuf, dbuf_nbytes, mbuf, mbuf_nbytes,
+				opts, req);
+
+	case XNVME_INJECT_ERROR:
+		inject_sleep(rule->usec);
+		inject_cpl_status(req, rule->sct, rule->sc);
+		return (rule->sct << 8) | rule->sc;
+
+	case XNVME_INJECT_TIMEOUT:
+	case XNVME_INJECT_DROP:
+		due = _xnvme_timer_clock_sample() + rule->usec * 1000;
+
+		cmd_pass(dev, cmd, dbuf, dbuf_nbytes, mbuf, mbuf_nbytes, opts,
+			 req);
+
+		now = _xnvme_timer_clock_sample();
+		if (due > now) {
+			inject_sleep((due - now) / 1000);
+		}
+		inject_cpl_status(req, 0, XNVME_INJECT_SC_ABORT);
+		return XNVME_INJECT_SC_ABORT;
+	}
+
+	return -EINVAL;
+}
+
+static int
+inject_sync_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+		   void *dbuf, size_t dbuf_nbytes, void *mbuf,
+		   size_t mbuf_nbytes, int opts, struct xnvme_req *req)
+{
+	return inject_sync_cmd(dev, cmd, dbuf, dbuf_nbytes, mbuf, mbuf_nbytes,
+			       opts, req, 0);
+}
+
+static int
+inject_sync_cmd_admin(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+		      void *dbuf, size_t dbuf_nbytes, void *mbuf,
+		      size_t mbuf_nbytes, int opts, struct xnvme_req *req)
+{
+	return inject_sync_cmd(dev, cmd, dbuf, dbuf_nbytes, mbuf, mbuf_nbytes,
+			       opts, req, 1);
+}
+
+static inline void
+inject_hold(struct xnvme_async_inject *aij, struct xnvme_inject_entry *entry)
+{
+	TAILQ_INSERT_TAIL(&aij->held, entry, link);
+	aij->nheld += 1;
+}
+
+/**
+ * Intercepts the completion, by the backend, of a command a rule applied to
+ */
+static void
+inject_async_cb(struct xnvme_req *req, void *cb_arg)
+{
+	struct xnvme_inject_entry *entry = cb_arg;
+	struct xnvme_async_inject *aij = req->async.ctx->inject;
+
+	req->async.cb = entry->cb;
+	req->async.cb_arg = entry->cb_arg;
+	aij->nintercepted += 1;
+
+	switch (entry->rule->action) {
+	case XNVME_INJECT_DELAY:
+		entry->due = _xnvme_timer_clock_sample() + entry->rule->usec * 1000;
+		break;
+
+	case XNVME_INJECT_TIMEOUT:
+		inject_cpl_status(req, 0, XNVME_INJECT_SC_ABORT);
+		break;
+
+	case XNVME_INJECT_DROP:
+		aij->ndropped += 1;
+		aij->nheld += 1;
+		return;
+
+	case XNVME_INJECT_ERROR:
+		break;
+	}
+
+	inject_hold(aij, entry);
+}
+
+static int
+inject_async_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+		    void *dbuf, size_t dbuf_nbytes, void *mbuf,
+		    size_t mbuf_nbytes, int opts, struct xnvme_req *req)
+{
+	struct xnvme_inject *inject = dev->inject;
+	struct xnvme_async_ctx *ctx = req->async.ctx;
+	struct xnvme_async_inject *aij = ctx->inject;
+	struct xnvme_inject_entry *entry;
+	struct xnvme_inject_rule *rule;
+	uint64_t now;
+	int err;
+
+	// Completions held back occupy the queue as they would on the device
+	if (ctx->outstanding + aij->nheld >= ctx->depth) {
+		return -EBUSY;
+	}
+
+	rule = inject_match(inject, cmd, 0);
+	if (!rule) {
+		return inject->async.cmd_io(dev, cmd, dbuf, dbuf_nbytes, mbuf,
+					    mbuf_nbytes, opts, req);
+	}
+
+	entry = TAILQ_FIRST(&aij->pool);
+	if (!entry) {
+		return -EBUSY;
+	}
+	TAILQ_REMOVE(&aij->pool, entry, link);
+
+	now = _xnvme_timer_clock_sample();
+
+	entry->req = req;
+	entry->cb = req->async.cb;
+	entry->cb_arg = req->async.cb_arg;
+	entry->rule = rule;
+	entry->due = now + rule->usec * 1000;
+
+	if (rule->action == XNVME_INJECT_ERROR) {
+		inject_cpl_status(req, rule->sct, rule->sc);
+		inject_hold(aij, entry);
+		return 0;
+	}
+
+	req->async.cb = inject_async_cb;
+	req->async.cb_arg = entry;
+
+	err = inject->async.cmd_io(dev, cmd, dbuf, dbuf_nbytes, mbuf,
+				   mbuf_nbytes, opts, req);
+	if (err) {
+		req->async.cb = entry->cb;
+		req->async.cb_arg = entry->cb_arg;
+		TAILQ_INSERT_HEAD(&aij->pool, entry, link);
+	}
+
+	return err;
+}
+
+/**
+ * Deliver the completions held back which are due, at most 'max' of them
+ */
+static int
+inject_async_release(struct xnvme_async_inject *aij, uint32_t max)
+{
+	struct xnvme_inject_entry *entry, *next;
+	uint64_t now;
+	int completed = 0;
+
+	if (!(aij->nheld - aij->ndropped)) {
+		return 0;
+	}
+
+	now = _xnvme_timer_clock_sample();
+	for (entry = TAILQ_FIRST(&aij->held); entry; entry = next) {
+		struct xnvme_req *req = entry->req;
+
+		next = TAILQ_NEXT(entry, link);
+		if (max && ((uint32_t)completed == max)) {
+			break;
+		}
+		if (entry->due > now) {
+			continue;
+		}
+
+		// Release the entry before the callback, it may submit
+		TAILQ_REMOVE(&aij->held, entry, link);
+		TAILQ_INSERT_HEAD(&aij->pool, entry, link);
+		aij->nheld -= 1;
+
+		req->async.cb(req, req->async.cb_arg);
+
+		++completed;
+	}
+
+	return completed;
+}
+
+static int
+inject_async_poke(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+		  uint32_t max)
+{
+	struct xnvme_inject *inject = dev->inject;
+	struct xnvme_async_inject *aij = ctx->inject;
+	const uint32_t nintercepted = aij->nintercepted;
+	int err, released;
+
+	err = ctx->outstanding ? inject->async.poke(dev, ctx, max) : 0;
+	if (err < 0) {
+		XNVME_DEBUG("FAILED: async.poke(), err: %d", err);
+		return err;
+	}
+	// Completions intercepted, and thereby held back, are not delivered
+	err -= aij->nintercepted - nintercepted;
+
+	if (max && ((uint32_t)err >= max)) {
+		return err;
+	}
+	released = inject_async_release(aij, max ? max - err : 0);
+
+	return err + released;
+}
+
+/**
+ * Dropped completions are never delivered, thus waiting stops when only those
+ * remain outstanding
+ */
+static int
+inject_async_wait(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_async_inject *aij = ctx->inject;
+	int acc = 0;
+
+	while (ctx->outstanding + aij->nheld - aij->ndropped) {
+		struct timespec ts1 = {.tv_sec = 0, .tv_nsec = 1000};
+		int err;
+
+		err = inject_async_poke(dev, ctx, 0);
+		if (err >= 0) {
+			acc += err;
+			if ((!err) && (!ctx->outstanding)) {
+				nanosleep(&ts1, NULL);
+			}
+			continue;
+		}
+
+		switch (err) {
+		case -EAGAIN:
+		case -EBUSY:
+			nanosleep(&ts1, NULL);
+			continue;
+
+		default:
+			return err;
+		}
+	}
+
+	return acc;
+}
+
+static int
+inject_async_init(struct xnvme_dev *dev, struct xnvme_async_ctx **ctx,
+		  uint16_t depth, int flags)
+{
+	struct xnvme_inject *inject = dev->inject;
+	struct xnvme_async_inject *aij;
+	int err;
+
+	aij = calloc(1, sizeof(*aij) + depth * sizeof(*aij->elm));
+	if (!aij) {
+		XNVME_DEBUG("FAILED: calloc(aij), errno: %d", errno);
+		return -errno;
+	}
+	aij->inject = inject;
+	TAILQ_INIT(&aij->pool);
+	TAILQ_INIT(&aij->held);
+	for (uint32_t i = 0; i < depth; ++i) {
+		TAILQ_INSERT_HEAD(&aij->pool, &aij->elm[i], link);
+	}
+
+	err = inject->async.init(dev, ctx, depth, flags);
+	if (err) {
+		XNVME_DEBUG("FAILED: async.init(), err: %d", err);
+		free(aij);
+		return err;
+	}
+	(*ctx)->inject = aij;
+
+	return 0;
+}
+
+static int
+inject_async_term(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_inject *inject = dev->inject;
+
+	if (ctx) {
+		free(ctx->inject);
+		ctx->inject = NULL;
+	}
+
+	return inject->async.term(dev, ctx);
+}
+
+static int
+inject_parse_rule(char *str, struct xnvme_inject_rule *rule)
+{
+	char *save = NULL;
+	char *tok;
+
+	tok = strtok_r(str, ",", &save);
+	if (!tok) {
+		return -EINVAL;
+	}
+
+	if (!strcmp(tok, "delay")) {
+		rule->action = XNVME_INJECT_DELAY;
+		rule->usec = XNVME_INJECT_DELAY_USEC_DEF;
+	} else if (!strcmp(tok, "error")) {
+		rule->action = XNVME_INJECT_ERROR;
+		rule->sc = XNVME_INJECT_SC_DEF;
+	} else if (!strcmp(tok, "timeout")) {
+		rule->action = XNVME_INJECT_TIMEOUT;
+		rule->usec = XNVME_INJECT_TIMEOUT_USEC_DEF;
+	} else if (!strcmp(tok, "drop")) {
+		rule->action = XNVME_INJECT_DROP;
+		rule->usec = XNVME_INJECT_TIMEOUT_USEC_DEF;
+	} else {
+		XNVME_DEBUG("FAILED: invalid action: '%s'", tok);
+		return -EINVAL;
+	}
+	rule->opc = -1;
+	rule->slba = 0;
+	rule->elba = UINT64_MAX;
+	rule->p_thr = INJECT_P_ONE;
+
+	while ((tok = strtok_r(NULL, ",", &save))) {
+		char *val = strchr(tok, '=');
+		char *end = NULL;
+		double p;
+
+		if (!val) {
+			XNVME_DEBUG("FAILED: invalid key=val: '%s'", tok);
+			return -EINVAL;
+		}
+		*val++ = '\0';
+
+		if (!strcmp(tok, "opc")) {
+			rule->opc = strtol(val, &end, 0) & 0xFF;
+		} else if (!strcmp(tok, "slba")) {
+			rule->slba = strtoull(val, &end, 0);
+			rule->elba = rule->slba;
+			if (*end == '-') {
+				rule->elba = strtoull(end + 1, &end, 0);
+			}
+		} else if (!strcmp(tok, "p")) {
+			p = strtod(val, &end);
+			if ((p < 0.0) || (p > 100.0)) {
+				XNVME_DEBUG("FAILED: p: %f", p);
+				return -EINVAL;
+			}
+			rule->p_thr = (p / 100.0) * INJECT_P_ONE;
+		} else if (!strcmp(tok, "usec")) {
+			rule->usec = strtoull(val, &end, 0);
+		} else if (!strcmp(tok, "sct")) {
+			rule->sct = strtoul(val, &end, 0);
+		} else if (!strcmp(tok, "sc")) {
+			rule->sc = strtoul(val, &end, 0);
+		} else if (!strcmp(tok, "admin")) {
+			rule->admin = strtoul(val, &end, 0) ? 1 : 0;
+		} else {
+			XNVME_DEBUG("FAILED: invalid key: '%s'", tok);
+			return -EINVAL;
+		}
+		if ((end == val) || (*end != '\0')) {
+			XNVME_DEBUG("FAILED: invalid value of key: '%s'", tok);
+			return -EINVAL;
+		}
+	}
+	if (rule->elba < rule->slba) {
+		XNVME_DEBUG("FAILED: slba: %"PRIu64" > elba: %"PRIu64, rule->slba,
+			    rule->elba);
+		return -EINVAL;
+	}
+	if (rule->admin && (rule->action == XNVME_INJECT_DROP)) {
+		rule->action = XNVME_INJECT_TIMEOUT;
+	}
+
+	return 0;
+}
+
+/**
+ * Copy the value of the 'inject' option into 'spec'
+ *
+ * @return true when the identifier has the option, false otherwise
+ */
+static bool
+inject_spec(const struct xnvme_ident *ident, char *spec)
+{
+	const char *ofz = ident->opts;
+	size_t len;
+
+	while ((ofz = strstr(ofz, "inject="))) {
+		if ((ofz != ident->opts) && (ofz[-1] == '?' || ofz[-1] == '&')) {
+			break;
+		}
+		ofz += 1;
+	}
+	if (!ofz) {
+		return false;
+	}
+
+	ofz += strlen("inject=");
+	len = strcspn(ofz, "&");
+	memcpy(spec, ofz, len);
+	spec[len] = '\0';
+
+	return true;
+}
+
+int
+xnvme_inject_setup(struct xnvme_dev *dev)
+{
+	char spec[XNVME_IDENT_OPTS_LEN] = { 0 };
+	struct xnvme_inject *inject;
+	char *save = NULL;
+	char *tok;
+	int err;
+
+	if (!inject_spec(&dev->ident, spec)) {
+		return 0;
+	}
+
+	inject = calloc(1, sizeof(*inject));
+	if (!inject) {
+		XNVME_DEBUG("FAILED: calloc(inject), errno: %d", errno);
+		return -errno;
+	}
+
+	for (tok = strtok_r(spec, ";", &save); tok;
+	     tok = strtok_r(NULL, ";", &save)) {
+		if (inject->nrules == XNVME_INJECT_NRULES_MAX) {
+			XNVME_DEBUG("FAILED: nrules > %d", XNVME_INJECT_NRULES_MAX);
+			free(inject);
+			return -EINVAL;
+		}
+		err = inject_parse_rule(tok, &inject->rules[inject->nrules++]);
+		if (err) {
+			XNVME_DEBUG("FAILED: inject_parse_rule(), err: %d", err);
+			free(inject);
+			return err;
+		}
+	}
+
+	inject->async = dev->be.async;
+	inject->sync = dev->be.sync;
+
+	dev->be.sync.cmd_io = inject_sync_cmd_io;
+	dev->be.sync.cmd_admin = inject_sync_cmd_admin;
+
+	dev->be.async.cmd_io = inject_async_cmd_io;
+	dev->be.async.poke = inject_async_poke;
+	dev->be.async.wait = inject_async_wait;
+	dev->be.async.init = inject_async_init;
+	dev->be.async.term = inject_async_term;
+	// Links and batches are submitted one by one, held completions are
+	// neither signalled nor reaped but called back, and templates must pass
+	// through the rules
+	dev->be.async.cmd_chain = xnvme_be_nosys_async_cmd_chain;
+	dev->be.async.notify = xnvme_be_nosys_async_notify;
+	dev->be.async.reap = xnvme_be_nosys_async_reap;
+	dev->be.async.cmd_tmpl = xnvme_be_nosys_async_cmd_tmpl;
+	dev->be.async.cmd_batch = xnvme_be_nosys_async_cmd_batch;
+
+	dev->inject = inject;
+
+	return 0;
+}
+
+void
+xnvme_inject_teardown(struct xnvme_dev *dev)
+{
+	if (!dev->inject) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < dev->inject->nrules; ++i) {
+		XNVME_DEBUG("INFO: rule: %u, nhits: %"PRIu64, i,
+			    atomic_load(&dev->inject->rules[i].nhits));
+	}
+
+	dev->be.async = dev->inject->async;
+	dev->be.sync = dev->inject->sync;
+
+	free(dev->inject);
+	dev->inject = NULL;
+}
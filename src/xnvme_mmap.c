@@ -0,0 +1,807 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <libxnvme.h>
+#include <xnvme_be.h>
+#include <xnvme_dev.h>
+#include <xnvme_mmap.h>
+
+#ifdef XNVME_BE_LINUX_ENABLED
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+
+// Poisoning via userfaultfd, Linux 6.6, which the system headers may predate
+#ifndef UFFD_FEATURE_POISON
+#define UFFD_FEATURE_POISON (1 << 14)
+#endif
+#ifndef UFFDIO_POISON
+struct uffdio_poison {
+	struct uffdio_range range;
+	__u64 mode;
+	__s64 updated;
+};
+#define UFFDIO_POISON _IOWR(UFFDIO, 0x08, struct uffdio_poison)
+#endif
+
+#define XNVME_MADV_READAHEAD (XNVME_MADV_RANDOM | XNVME_MADV_SEQUENTIAL)
+#define XNVME_MADV_RANGE (XNVME_MADV_WILLNEED | XNVME_MADV_DONTNEED)
+
+static SLIST_HEAD(, xnvme_mmap) g_mmaps = SLIST_HEAD_INITIALIZER(g_mmaps);
+static pthread_mutex_t g_mmaps_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline int
+_present(const struct xnvme_mmap *map, uint64_t page)
+{
+	return (map->present[page / 64] >> (page % 64)) & 1;
+}
+
+static void
+_present_set(struct xnvme_mmap *map, uint64_t page, uint64_t npages, int val)
+{
+	for (uint64_t i = page; i < page + npages; ++i) {
+		if (val) {
+			map->present[i / 64] |= 1ULL << (i % 64);
+		} else {
+			map->present[i / 64] &= ~(1ULL << (i % 64));
+		}
+	}
+}
+
+static int
+_advice_valid(int advice)
+{
+	if (advice & ~(XNVME_MADV_READAHEAD | XNVME_MADV_RANGE)) {
+		return 0;
+	}
+	if ((advice & XNVME_MADV_READAHEAD) == XNVME_MADV_READAHEAD) {
+		return 0;
+	}
+	if ((advice & XNVME_MADV_RANGE) == XNVME_MADV_RANGE) {
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * Pages to read following a fault on the given page; with XNVME_MADV_NORMAL the
+ * window doubles when the fault follows the previous read-ahead, and is reset
+ * otherwise, as the kernel does for page-cache read-ahead
+ */
+static uint32_t
+_mmap_ra(struct xnvme_mmap *map, uint64_t page)
+{
+	switch (map->advice) {
+	case XNVME_MADV_RANDOM:
+		return 0;
+
+	case XNVME_MADV_SEQUENTIAL:
+		return XNVME_MMAP_RA_MAX;
+
+	default:
+		break;
+	}
+
+	if (page == map->ra_next) {
+		map->ra_npages *= 2;
+		if (map->ra_npages > XNVME_MMAP_RA_MAX) {
+			map->ra_npages = XNVME_MMAP_RA_MAX;
+		}
+	} else {
+		map->ra_npages = XNVME_MMAP_RA_MIN;
+	}
+
+	return map->ra_npages;
+}
+
+static int
+_mmap_covered(const struct xnvme_mmap_extent *exts, uint32_t nexts,
+	      uint64_t page)
+{
+	for (uint32_t i = 0; i < nexts; ++i) {
+		if ((page >= exts[i].page) &&
+		    (page < exts[i].page + exts[i].npages)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Setup an extent for each faulting page, with read-ahead up to the next
+ * present page, room is kept in the stage for a page of each of the faults
+ *
+ * Must be called with the lock of the mapping held
+ */
+static uint32_t
+_mmap_extents_faults(struct xnvme_mmap *map, const uint64_t *faults,
+		     uint32_t nfaults, struct xnvme_mmap_extent *exts)
+{
+	uint32_t nexts = 0, nstage = 0;
+
+	for (uint32_t i = 0; i < nfaults; ++i) {
+		const uint64_t page = faults[i];
+		const uint32_t budget = XNVME_MMAP_STAGE_NPAGES - nstage -
+					(nfaults - i - 1);
+		uint32_t npages = 1, window;
+
+		if (_mmap_covered(exts, nexts, page)) {
+			continue;
+		}
+
+		window = 1 + _mmap_ra(map, page);
+		while ((npages < window) && (npages < budget) &&
+		       (page + npages < map->npages) &&
+		       !_present(map, page + npages) &&
+		       !_mmap_covered(exts, nexts, page + npages)) {
+			npages += 1;
+		}
+		map->ra_next = page + npages;
+
+		exts[nexts].page = page;
+		exts[nexts].npages = npages;
+		exts[nexts].stage = nstage;
+		exts[nexts].fault = 1;
+		exts[nexts].err = 0;
+		nexts += 1;
+		nstage += npages;
+	}
+
+	return nexts;
+}
+
+/**
+ * Setup extents of the pages, advised WILLNEED, which are not yet present
+ *
+ * Must be called with the lock of the mapping held
+ */
+static uint32_t
+_mmap_extents_willneed(struct xnvme_mmap *map, struct xnvme_mmap_extent *exts)
+{
+	uint32_t nexts = 0, nstage = 0;
+
+	while ((map->wn_page < map->wn_end) && (nexts < XNVME_MMAP_NFAULTS) &&
+	       (nstage < XNVME_MMAP_STAGE_NPAGES)) {
+		uint64_t page = map->wn_page;
+		uint32_t npages = 0;
+
+		if (_present(map, page)) {
+			map->wn_page += 1;
+			continue;
+		}
+		while ((page + npages < map->wn_end) &&
+		       (nstage + npages < XNVME_MMAP_STAGE_NPAGES) &&
+		       !_present(map, page + npages)) {
+			npages += 1;
+		}
+
+		exts[nexts].page = page;
+		exts[nexts].npages = npages;
+		exts[nexts].stage = nstage;
+		exts[nexts].fault = 0;
+		exts[nexts].err = 0;
+		nexts += 1;
+		nstage += npages;
+
+		map->wn_page += npages;
+	}
+
+	return nexts;
+}
+
+static void
+_mmap_read_cb(struct xnvme_req *req, void *cb_arg)
+{
+	struct xnvme_mmap_extent *ext = cb_arg;
+
+	if (xnvme_req_cpl_status(req)) {
+		ext->err = -EIO;
+	}
+
+	SLIST_INSERT_HEAD(&req->pool->head, req, link);
+}
+
+/**
+ * Read the extents into the stage, with commands of at most mdts bytes, the
+ * part of an extent beyond the end of the device is zeroed
+ */
+static int
+_mmap_read(struct xnvme_mmap *map, struct xnvme_mmap_extent *exts,
+	   uint32_t nexts)
+{
+	struct xnvme_dev *dev = map->dev;
+	const struct xnvme_geo *geo = &dev->geo;
+	uint64_t cmd_nbytes = geo->mdts_nbytes - geo->mdts_nbytes % geo->lba_nbytes;
+	int err;
+
+	if (!cmd_nbytes) {
+		cmd_nbytes = geo->lba_nbytes;
+	}
+
+	for (uint32_t i = 0; i < nexts; ++i) {
+		struct xnvme_mmap_extent *ext = &exts[i];
+		uint64_t ofz = map->off + ext->page * map->pagesize;
+		uint64_t end = ofz + (uint64_t)ext->npages * map->pagesize;
+		uint8_t *buf = map->stage + (uint64_t)ext->stage * map->pagesize;
+
+		if (end > geo->tbytes) {
+			const uint64_t avail = ofz < geo->tbytes ? geo->tbytes - ofz : 0;
+
+			memset(buf + avail, 0, end - ofz - avail);
+			end = ofz + avail;
+		}
+
+		while (ofz < end) {
+			struct xnvme_req *req = SLIST_FIRST(&map->pool->head);
+			const uint64_t nbytes = (end - ofz) < cmd_nbytes ?
+						(end - ofz) : cmd_nbytes;
+
+			if (!req) {
+				err = xnvme_async_poke(dev, map->ctx, 0);
+				if (err < 0) {
+					XNVME_DEBUG("FAILED: xnvme_async_poke(), err: %d",
+						    err);
+					return err;
+				}
+				continue;
+			}
+			SLIST_REMOVE_HEAD(&map->pool->head, link);
+			req->async.cb_arg = ext;
+
+			err = xnvme_cmd_read(dev, dev->nsid, ofz / geo->lba_nbytes,
+					     nbytes / geo->lba_nbytes - 1, buf, NULL,
+					     XNVME_CMD_ASYNC, req);
+			switch (err) {
+			case 0:
+				ofz += nbytes;
+				buf += nbytes;
+				continue;
+
+			case -EBUSY:
+			case -EAGAIN:
+				SLIST_INSERT_HEAD(&map->pool->head, req, link);
+				xnvme_async_poke(dev, map->ctx, 0);
+				continue;
+
+			default:
+				XNVME_DEBUG("FAILED: xnvme_cmd_read(), err: %d", err);
+				SLIST_INSERT_HEAD(&map->pool->head, req, link);
+				ext->err = err;
+				ofz = end;
+				continue;
+			}
+		}
+	}
+
+	err = xnvme_async_wait(dev, map->ctx);
+	if (err < 0) {
+		XNVME_DEBUG("FAILED: xnvme_async_wait(), err: %d", err);
+		return err;
+	}
+
+	return 0;
+}
+
+/**
+ * Resolve the fault on the first page of an extent which failed to be read, by
+ * poisoning the page, thus raising SIGBUS on access; threads faulting on the
+ * read-ahead part are woken, to fault again, and have it read as an extent of
+ * their own. A page is never filled with anything but what is read, thus, when
+ * poisoning fails, the faulting thread is woken as well, to have it read again
+ */
+static void
+_mmap_fail(struct xnvme_mmap *map, struct xnvme_mmap_extent *ext)
+{
+	const uint64_t start = (uint64_t)map->addr + ext->page * map->pagesize;
+	struct uffdio_poison poison = {
+		.range = {.start = start, .len = map->pagesize},
+	};
+	struct uffdio_range wake = {
+		.start = start + map->pagesize,
+		.len = (uint64_t)(ext->npages - 1) * map->pagesize,
+	};
+
+	XNVME_DEBUG("FAILED: page: %lu, err: %d", ext->page, ext->err);
+
+	if (ext->fault && ioctl(map->uffd, UFFDIO_POISON, &poison) &&
+	    (errno != EEXIST)) {
+		XNVME_DEBUG("FAILED: UFFDIO_POISON, errno: %d", errno);
+		wake.start = start;
+		wake.len += map->pagesize;
+	}
+	if (wake.len && ioctl(map->uffd, UFFDIO_WAKE, &wake)) {
+		XNVME_DEBUG("FAILED: UFFDIO_WAKE, errno: %d", errno);
+	}
+}
+
+/**
+ * Copy the extent from the stage into the mapping, waking the threads faulting
+ * on it; pages made present meanwhile, e.g. by a fault racing with
+ * xnvme_madvise(), are skipped
+ */
+static void
+_mmap_copy(struct xnvme_mmap *map, struct xnvme_mmap_extent *ext)
+{
+	const uint64_t start = (uint64_t)map->addr + ext->page * map->pagesize;
+	const uint64_t src = (uint64_t)map->stage + (uint64_t)ext->stage * map->pagesize;
+	const uint64_t len = (uint64_t)ext->npages * map->pagesize;
+	struct uffdio_copy copy = {.dst = start, .src = src, .len = len};
+
+	if (ext->err) {
+		_mmap_fail(map, ext);
+		return;
+	}
+
+	if (ioctl(map->uffd, UFFDIO_COPY, &copy)) {
+		struct uffdio_range wake = {.start = start, .len = len};
+		const uint64_t done = copy.copy > 0 ? copy.copy : 0;
+
+		for (uint64_t ofz = done; ofz < len; ofz += map->pagesize) {
+			struct uffdio_copy page = {
+				.dst = start + ofz,
+				.src = src + ofz,
+				.len = map->pagesize,
+				.mode = UFFDIO_COPY_MODE_DONTWAKE,
+			};
+
+			if (ioctl(map->uffd, UFFDIO_COPY, &page) && (errno != EEXIST)) {
+				XNVME_DEBUG("FAILED: UFFDIO_COPY, errno: %d", errno);
+			}
+		}
+		if (ioctl(map->uffd, UFFDIO_WAKE, &wake)) {
+			XNVME_DEBUG("FAILED: UFFDIO_WAKE, errno: %d", errno);
+		}
+	}
+
+	pthread_mutex_lock(&map->lock);
+	_present_set(map, ext->page, ext->npages, 1);
+	pthread_mutex_unlock(&map->lock);
+}
+
+/**
+ * Setup the async. context in the thread using it, as the backend may tie the
+ * context to the thread creating it, e.g. io_uring with SINGLE_ISSUER
+ */
+static int
+_mmap_thread_setup(struct xnvme_mmap *map)
+{
+	int err;
+
+	err = xnvme_async_init(map->dev, &map->ctx, XNVME_MMAP_QDEPTH, 0);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_async_init(), err: %d", err);
+		map->ctx = NULL;
+		return err;
+	}
+	err = xnvme_req_pool_alloc(&map->pool, XNVME_MMAP_QDEPTH);
+	if (err) {
+		XNVME_DEBUG("FAILED: xnvme_req_pool_alloc(), err: %d", err);
+		map->pool = NULL;
+		return err;
+	}
+	xnvme_req_pool_init(map->pool, map->ctx, _mmap_read_cb, NULL);
+
+	return 0;
+}
+
+static void
+_mmap_thread_teardown(struct xnvme_mmap *map)
+{
+	xnvme_req_pool_free(map->pool);
+	map->pool = NULL;
+	if (map->ctx) {
+		xnvme_async_term(map->dev, map->ctx);
+		map->ctx = NULL;
+	}
+}
+
+/**
+ * Service page-faults, a batch at a time, and, when there are none, read the
+ * pages advised WILLNEED
+ */
+static void *
+_mmap_thread(void *arg)
+{
+	struct xnvme_mmap *map = arg;
+	struct xnvme_mmap_extent exts[XNVME_MMAP_NFAULTS];
+	int err;
+
+	err = _mmap_thread_setup(map);
+
+	pthread_mutex_lock(&map->lock);
+	map->ready = err ? err : 1;
+	pthread_cond_signal(&map->cond);
+	pthread_mutex_unlock(&map->lock);
+
+	if (err) {
+		_mmap_thread_teardown(map);
+		return NULL;
+	}
+
+	for (;;) {
+		struct pollfd pfds[2] = {
+			{.fd = map->uffd, .events = POLLIN},
+			{.fd = map->efd, .events = POLLIN},
+		};
+		struct uffd_msg msgs[XNVME_MMAP_NFAULTS];
+		uint64_t faults[XNVME_MMAP_NFAULTS];
+		uint32_t nfaults = 0, nexts;
+		int stop, pending, err;
+
+		pthread_mutex_lock(&map->lock);
+		stop = map->stop;
+		pending = map->wn_page < map->wn_end;
+		pthread_mutex_unlock(&map->lock);
+
+		if (stop) {
+			break;
+		}
+
+		if (poll(pfds, 2, pending ? 0 : -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			XNVME_DEBUG("FAILED: poll(), errno: %d", errno);
+			break;
+		}
+		if (pfds[1].revents & POLLIN) {
+			eventfd_t val;
+
+			eventfd_read(map->efd, &val);
+		}
+		if (pfds[0].revents & POLLIN) {
+			ssize_t nbytes = read(map->uffd, msgs, sizeof(msgs));
+
+			for (ssize_t i = 0; i < nbytes / (ssize_t)sizeof(*msgs); ++i) {
+				if (msgs[i].event != UFFD_EVENT_PAGEFAULT) {
+					continue;
+				}
+				faults[nfaults++] = (msgs[i].arg.pagefault.address -
+						     (uint64_t)map->addr) / map->pagesize;
+			}
+		}
+
+		pthread_mutex_lock(&map->lock);
+		nexts = nfaults ? _mmap_extents_faults(map, faults, nfaults, exts) :
+			_mmap_extents_willneed(map, exts);
+		pthread_mutex_unlock(&map->lock);
+
+		if (!nexts) {
+			continue;
+		}
+
+		err = _mmap_read(map, exts, nexts);
+		for (uint32_t i = 0; i < nexts; ++i) {
+			if (err && !exts[i].err) {
+				exts[i].err = err;
+			}
+			_mmap_copy(map, &exts[i]);
+		}
+	}
+
+	_mmap_thread_teardown(map);
+
+	return NULL;
+}
+
+static int
+_mmap_uffd_open(uint64_t features)
+{
+	struct uffdio_api api = {.api = UFFD_API, .features = features};
+	int uffd;
+
+	uffd = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK);
+	if (uffd < 0) {
+		XNVME_DEBUG("FAILED: userfaultfd(), errno: %d", errno);
+		return -errno;
+	}
+	if (ioctl(uffd, UFFDIO_API, &api)) {
+		int err = -errno;
+
+		XNVME_DEBUG("FAILED: UFFDIO_API, features: 0x%lx, errno: %d",
+			    features, errno);
+		close(uffd);
+		return err;
+	}
+
+	return uffd;
+}
+
+static void
+_mmap_free(struct xnvme_mmap *map)
+{
+	if (!map) {
+		return;
+	}
+
+	xnvme_buf_free(map->dev, map->stage);
+	if (map->efd >= 0) {
+		close(map->efd);
+	}
+	if (map->uffd >= 0) {
+		close(map->uffd);
+	}
+	if (map->addr) {
+		munmap(map->addr, map->nbytes);
+	}
+	pthread_cond_destroy(&map->cond);
+	pthread_mutex_destroy(&map->lock);
+	free(map->present);
+	free(map);
+}
+
+static int
+_mmap_setup(struct xnvme_mmap *map)
+{
+	struct uffdio_register reg = { 0 };
+
+	map->addr = mmap(NULL, map->nbytes, PROT_READ,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (map->addr == MAP_FAILED) {
+		XNVME_DEBUG("FAILED: mmap(), errno: %d", errno);
+		map->addr = NULL;
+		return -errno;
+	}
+
+	// Without poisoning, a page failing to be read could not be told apart
+	map->uffd = _mmap_uffd_open(UFFD_FEATURE_POISON);
+	if (map->uffd == -EINVAL) {
+		XNVME_DEBUG("FAILED: UFFD_FEATURE_POISON is not supported");
+		return -ENOTSUP;
+	}
+	if (map->uffd < 0) {
+		return map->uffd;
+	}
+
+	reg.range.start = (uint64_t)map->addr;
+	reg.range.len = map->nbytes;
+	reg.mode = UFFDIO_REGISTER_MODE_MISSING;
+	if (ioctl(map->uffd, UFFDIO_REGISTER, &reg)) {
+		XNVME_DEBUG("FAILED: UFFDIO_REGISTER, errno: %d", errno);
+		return -errno;
+	}
+
+	map->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (map->efd < 0) {
+		XNVME_DEBUG("FAILED: eventfd(), errno: %d", errno);
+		return -errno;
+	}
+
+	map->stage = xnvme_buf_alloc(map->dev, XNVME_MMAP_STAGE_NPAGES *
+				     map->pagesize, NULL);
+	if (!map->stage) {
+		XNVME_DEBUG("FAILED: xnvme_buf_alloc(), errno: %d", errno);
+		return -errno;
+	}
+
+	return 0;
+}
+
+void *
+xnvme_mmap(struct xnvme_dev *dev, uint64_t off, size_t len, int flags)
+{
+	const uint32_t pagesize = getpagesize();
+	struct xnvme_mmap *map = NULL;
+	int err;
+
+	if (!(dev && len)) {
+		XNVME_DEBUG("FAILED: dev: %p, len: %zu", (void *)dev, len);
+		errno = EINVAL;
+		return NULL;
+	}
+	if ((pagesize % dev->geo.lba_nbytes) || (off % pagesize) ||
+	    (off >= dev->geo.tbytes)) {
+		XNVME_DEBUG("FAILED: off: %lu, lba_nbytes: %u, tbytes: %lu", off,
+			    dev->geo.lba_nbytes, dev->geo.tbytes);
+		errno = EINVAL;
+		return NULL;
+	}
+	if (!_advice_valid(flags) || (flags & XNVME_MADV_DONTNEED)) {
+		XNVME_DEBUG("FAILED: flags: 0x%x", flags);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	map = calloc(1, sizeof(*map));
+	if (!map) {
+		XNVME_DEBUG("FAILED: calloc(map), errno: %d", errno);
+		return NULL;
+	}
+	map->dev = dev;
+	map->off = off;
+	map->pagesize = pagesize;
+	map->npages = (len + pagesize - 1) / pagesize;
+	map->nbytes = map->npages * pagesize;
+	map->uffd = -1;
+	map->efd = -1;
+	map->advice = flags & XNVME_MADV_READAHEAD;
+	map->ra_npages = XNVME_MMAP_RA_MIN;
+	if (flags & XNVME_MADV_WILLNEED) {
+		map->wn_end = map->npages;
+	}
+	pthread_mutex_init(&map->lock, NULL);
+	pthread_cond_init(&map->cond, NULL);
+
+	map->present = calloc((map->npages + 63) / 64, sizeof(*map->present));
+	if (!map->present) {
+		XNVME_DEBUG("FAILED: calloc(present), errno: %d", errno);
+		err = -errno;
+		goto failed;
+	}
+
+	err = _mmap_setup(map);
+	if (err) {
+		XNVME_DEBUG("FAILED: _mmap_setup(), err: %d", err);
+		goto failed;
+	}
+
+	err = -pthread_create(&map->thread, NULL, _mmap_thread, map);
+	if (err) {
+		XNVME_DEBUG("FAILED: pthread_create(), err: %d", err);
+		goto failed;
+	}
+
+	pthread_mutex_lock(&map->lock);
+	while (!map->ready) {
+		pthread_cond_wait(&map->cond, &map->lock);
+	}
+	err = map->ready < 0 ? map->ready : 0;
+	pthread_mutex_unlock(&map->lock);
+
+	if (err) {
+		XNVME_DEBUG("FAILED: _mmap_thread_setup(), err: %d", err);
+		pthread_join(map->thread, NULL);
+		goto failed;
+	}
+
+	pthread_mutex_lock(&g_mmaps_lock);
+	SLIST_INSERT_HEAD(&g_mmaps, map, link);
+	pthread_mutex_unlock(&g_mmaps_lock);
+
+	return map->addr;
+
+failed:
+	_mmap_free(map);
+	errno = -err;
+	return NULL;
+}
+
+static struct xnvme_mmap *
+_mmap_lookup(const void *addr)
+{
+	struct xnvme_mmap *map;
+
+	SLIST_FOREACH(map, &g_mmaps, link) {
+		if (((uint8_t *)addr >= map->addr) &&
+		    ((uint8_t *)addr < map->addr + map->nbytes)) {
+			return map;
+		}
+	}
+
+	return NULL;
+}
+
+int
+xnvme_munmap(void *addr)
+{
+	struct xnvme_mmap *map;
+
+	pthread_mutex_lock(&g_mmaps_lock);
+	map = _mmap_lookup(addr);
+	if (map) {
+		SLIST_REMOVE(&g_mmaps, map, xnvme_mmap, link);
+	}
+	pthread_mutex_unlock(&g_mmaps_lock);
+
+	if (!map) {
+		XNVME_DEBUG("FAILED: no mapping at addr: %p", addr);
+		return -EINVAL;
+	}
+
+	pthread_mutex_lock(&map->lock);
+	map->stop = 1;
+	pthread_mutex_unlock(&map->lock);
+
+	eventfd_write(map->efd, 1);
+	pthread_join(map->thread, NULL);
+
+	_mmap_free(map);
+
+	return 0;
+}
+
+int
+xnvme_madvise(void *addr, size_t len, int advice)
+{
+	struct xnvme_mmap *map;
+	uint64_t page, end;
+	int err = 0;
+
+	if (!_advice_valid(advice)) {
+		XNVME_DEBUG("FAILED: advice: 0x%x", advice);
+		return -EINVAL;
+	}
+
+	// The lock of the mapping is taken before the list is unlocked, such that
+	// xnvme_munmap(), which locks the mapping after removing it from the
+	// list, does not free it until the advice is given
+	pthread_mutex_lock(&g_mmaps_lock);
+	map = _mmap_lookup(addr);
+	if (map) {
+		pthread_mutex_lock(&map->lock);
+	}
+	pthread_mutex_unlock(&g_mmaps_lock);
+
+	if (!map) {
+		XNVME_DEBUG("FAILED: no mapping at addr: %p", addr);
+		return -EINVAL;
+	}
+
+	page = ((uint8_t *)addr - map->addr) / map->pagesize;
+	end = ((uint8_t *)addr - map->addr + len + map->pagesize - 1) /
+	      map->pagesize;
+	if (end > map->npages) {
+		end = map->npages;
+	}
+
+	if ((advice & XNVME_MADV_READAHEAD) || !(advice & XNVME_MADV_RANGE)) {
+		map->advice = advice & XNVME_MADV_READAHEAD;
+	}
+
+	if (advice & XNVME_MADV_WILLNEED) {
+		map->wn_page = page;
+		map->wn_end = end;
+		eventfd_write(map->efd, 1);
+	}
+
+	if ((advice & XNVME_MADV_DONTNEED) && (end > page)) {
+		if (madvise(map->addr + page * map->pagesize,
+			    (end - page) * map->pagesize, MADV_DONTNEED)) {
+			XNVME_DEBUG("FAILED: madvise(), errno: %d", errno);
+			err = -errno;
+		} else {
+			_present_set(map, page, end - page, 0);
+		}
+	}
+
+	pthread_mutex_unlock(&map->lock);
+
+	return err;
+}
+#else
+void *
+xnvme_mmap(struct xnvme_dev *XNVME_UNUSED(dev), uint64_t XNVME_UNUSED(off),
+	   size_t XNVME_UNUSED(len), int XNVME_UNUSED(flags))
+{
+	XNVME_DEBUG("FAILED: not supported on this platform");
+	errno = ENOSYS;
+	return NULL;
+}
+
+int
+xnvme_munmap(void *XNVME_UNUSED(addr))
+{
+	XNVME_DEBUG("FAILED: not supported on this platform");
+	return -ENOSYS;
+}
+
+int
+xnvme_madvise(void *XNVME_UNUSED(addr), size_t XNVME_UNUSED(len),
+	      int XNVME_UNUSED(advice))
+{
+	XNVME_DEBUG("FAILED: not supported on this platform");
+	return -ENOSYS;
+}
+#endif
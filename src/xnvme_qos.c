@@ -0,0 +1,352 @@
+// Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
+// SPDX-License-Identifier: Apache-2.0
+#include <stdlib.h>
+#include <errno.h>
+#include <libxnvme.h>
+#include <xnvme_be.h>
+#include <xnvme_dev.h>
+#include <xnvme_async.h>
+#include <xnvme_qos.h>
+
+#define NSEC_PER_SEC 1000000000ULL
+
+/**
+ * Number of tokens accumulated at the given rate over the given nsec, nsec must
+ * be no larger than a second
+ */
+static inline uint64_t
+qos_ntokens(uint64_t rate, uint64_t nsec)
+{
+	return (rate / NSEC_PER_SEC) * nsec + \
+	       ((rate % NSEC_PER_SEC) * nsec) / NSEC_PER_SEC;
+}
+
+/**
+ * Read and write commands mapped to the offset of their buckets; -1 for other
+ * commands, which are not subject to rate-limiting, e.g. the data-transfer bits
+ * of Dataset Management and Copy do not describe the LBAs they act on
+ */
+static inline int
+qos_cmd_dir(const struct xnvme_spec_cmd *cmd)
+{
+	switch (cmd->common.opcode) {
+	case XNVME_SPEC_OPC_WRITE:
+		return XNVME_QOS_WRITE_IOPS;
+	case XNVME_SPEC_OPC_READ:
+		return XNVME_QOS_READ_IOPS;
+	default:
+		return -1;
+	}
+}
+
+/**
+ * Add the tokens accumulated since the last refill; when racing with another
+ * thread, then only one of them refills
+ */
+static void
+qos_bucket_refill(struct xnvme_qos_bucket *bucket, uint64_t now)
+{
+	uint64_t last = atomic_load(&bucket->last);
+	uint64_t base = last, elapsed, ntokens, consumed;
+	int64_t cur;
+
+	if (now <= last) {
+		return;
+	}
+	elapsed = now - last;
+	if (elapsed > bucket->burst_nsec) {
+		base = now - bucket->burst_nsec;
+		elapsed = bucket->burst_nsec;
+	}
+
+	ntokens = qos_ntokens(bucket->rate, elapsed);
+	if (!ntokens) {
+		return;
+	}
+
+	// Only account the time which the tokens correspond to, such that the
+	// fractions of a token add up over refills
+	consumed = ntokens < 1024 ? (ntokens * NSEC_PER_SEC) / bucket->rate : elapsed;
+
+	if (!atomic_compare_exchange_strong(&bucket->last, &last, base + consumed)) {
+		return;
+	}
+
+	cur = atomic_fetch_add(&bucket->tokens, ntokens) + ntokens;
+	while ((cur > bucket->capacity) && \
+	       (!atomic_compare_exchange_weak(&bucket->tokens, &cur,
+					      bucket->capacity)));
+}
+
+static inline int
+qos_bucket_ready(struct xnvme_qos_bucket *bucket, uint64_t *now)
+{
+	if (!bucket->rate) {
+		return 1;
+	}
+	if (atomic_load_explicit(&bucket->tokens, memory_order_relaxed) > 0) {
+		return 1;
+	}
+
+	*now = *now ? *now : _xnvme_timer_clock_sample();
+	qos_bucket_refill(bucket, *now);
+
+	return atomic_load_explicit(&bucket->tokens, memory_order_relaxed) > 0;
+}
+
+static inline void
+qos_bucket_sub(struct xnvme_qos_bucket *bucket, int64_t ntokens)
+{
+	if (bucket->rate) {
+		atomic_fetch_sub_explicit(&bucket->tokens, ntokens,
+					  memory_order_relaxed);
+	}
+}
+
+/**
+ * Take tokens for a command of the given direction and size
+ *
+ * @return 1 when the command may be submitted, 0 when it must be held back
+ */
+static inline int
+qos_take(struct xnvme_qos *qos, int dir, size_t nbytes)
+{
+	struct xnvme_qos_bucket *iops = &qos->buckets[dir];
+	struct xnvme_qos_bucket *bps = &qos->buckets[dir + XNVME_QOS_READ_BPS];
+	uint64_t now = 0;
+
+	if (!(qos_bucket_ready(iops, &now) && qos_bucket_ready(bps, &now))) {
+		return 0;
+	}
+
+	qos_bucket_sub(iops, 1);
+	qos_bucket_sub(bps, nbytes);
+
+	return 1;
+}
+
+static inline void
+qos_refund(struct xnvme_qos *qos, int dir, size_t nbytes)
+{
+	qos_bucket_sub(&qos->buckets[dir], -1);
+	qos_bucket_sub(&qos->buckets[dir + XNVME_QOS_READ_BPS],
+		       -(int64_t)nbytes);
+}
+
+int
+xnvme_async_qos_cmd_io(struct xnvme_dev *dev, struct xnvme_spec_cmd *cmd,
+		       void *dbuf, size_t dbuf_nbytes, void *mbuf,
+		       size_t mbuf_nbytes, int opts, struct xnvme_req *req)
+{
+	struct xnvme_async_qos *aqos = req->async.ctx->qos;
+	struct xnvme_qos *qos = aqos->qos;
+	struct xnvme_qos_entry *entry;
+	const int dir = qos_cmd_dir(cmd);
+	int err;
+
+	if (dir < 0) {
+		return dev->be.async.cmd_io(dev, cmd, dbuf, dbuf_nbytes, mbuf,
+					    mbuf_nbytes, opts, req);
+	}
+
+	// Commands held back are not to be overtaken
+	if (STAILQ_EMPTY(&aqos->queue) && qos_take(qos, dir, dbuf_nbytes)) {
+		err = dev->be.async.cmd_io(dev, cmd, dbuf, dbuf_nbytes, mbuf,
+					   mbuf_nbytes, opts, req);
+		if (err) {
+			qos_refund(qos, dir, dbuf_nbytes);
+			return err;
+		}
+		atomic_fetch_add_explicit(&qos->nsubmitted, 1,
+					  memory_order_relaxed);
+		return 0;
+	}
+
+	entry = STAILQ_FIRST(&aqos->pool);
+	if (!entry) {
+		XNVME_DEBUG("FAILED: nqueued: %u, capacity: %u", aqos->nqueued,
+			    aqos->capacity);
+		return -EBUSY;
+	}
+	STAILQ_REMOVE_HEAD(&aqos->pool, link);
+
+	entry->cmd = *cmd;
+	entry->dbuf = dbuf;
+	entry->dbuf_nbytes = dbuf_nbytes;
+	entry->mbuf = mbuf;
+	entry->mbuf_nbytes = mbuf_nbytes;
+	entry->opts = opts;
+	entry->req = req;
+	entry->ts = _xnvme_timer_clock_sample();
+
+	STAILQ_INSERT_TAIL(&aqos->queue, entry, link);
+	aqos->nqueued += 1;
+
+	atomic_fetch_add_explicit(&qos->nthrottled, 1, memory_order_relaxed);
+
+	return 0;
+}
+
+int
+xnvme_async_qos_release(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx)
+{
+	struct xnvme_async_qos *aqos = ctx->qos;
+	struct xnvme_qos *qos = aqos->qos;
+	struct xnvme_qos_entry *entry;
+	uint64_t now = 0;
+	int nreleased = 0;
+
+	while ((entry = STAILQ_FIRST(&aqos->queue))) {
+		struct xnvme_req *req = entry->req;
+		const int dir = qos_cmd_dir(&entry->cmd);
+		const size_t nbytes = entry->dbuf_nbytes;
+		int err;
+
+		if (!qos_take(qos, dir, nbytes)) {
+			break;
+		}
+
+		err = dev->be.async.cmd_io(dev, &entry->cmd, entry->dbuf,
+					   nbytes, entry->mbuf,
+					   entry->mbuf_nbytes, entry->opts, req);
+		if ((err == -EBUSY) || (err == -EAGAIN)) {
+			qos_refund(qos, dir, nbytes);
+			break;
+		}
+
+		now = now ? now : _xnvme_timer_clock_sample();
+		atomic_fetch_add_explicit(&qos->throttled_nsec, now - entry->ts,
+					  memory_order_relaxed);
+
+		STAILQ_REMOVE_HEAD(&aqos->queue, link);
+		STAILQ_INSERT_HEAD(&aqos->pool, entry, link);
+		aqos->nqueued -= 1;
+
+		if (err) {
+			XNVME_DEBUG("FAILED: be.async.cmd_io(), err: %d", err);
+			qos_refund(qos, dir, nbytes);
+			xnvme_async_cpl_errno(req, err);
+			req->async.cb(req, req->async.cb_arg);
+			continue;
+		}
+
+		atomic_fetch_add_explicit(&qos->nsubmitted, 1,
+					  memory_order_relaxed);
+		nreleased += 1;
+	}
+
+	return nreleased;
+}
+
+int
+xnvme_qos_create(struct xnvme_qos **qos, const struct xnvme_qos_limits *limits)
+{
+	uint64_t rates[XNVME_QOS_NBUCKETS];
+	uint64_t burst_usec, now;
+
+	if (!(qos && limits)) {
+		XNVME_DEBUG("FAILED: qos: %p, limits: %p", (void *)qos,
+			    (void *)limits);
+		return -EINVAL;
+	}
+
+	rates[XNVME_QOS_READ_IOPS] = limits->read_iops;
+	rates[XNVME_QOS_WRITE_IOPS] = limits->write_iops;
+	rates[XNVME_QOS_READ_BPS] = limits->read_bps;
+	rates[XNVME_QOS_WRITE_BPS] = limits->write_bps;
+
+	burst_usec = limits->burst_usec ? limits->burst_usec : \
+		     XNVME_QOS_BURST_USEC_DEF;
+	if (burst_usec > XNVME_QOS_BURST_USEC_MAX) {
+		XNVME_DEBUG("FAILED: burst_usec: %zu > max", burst_usec);
+		return -EINVAL;
+	}
+
+	*qos = calloc(1, sizeof(**qos));
+	if (!*qos) {
+		XNVME_DEBUG("FAILED: calloc(qos), errno: %d", errno);
+		return -errno;
+	}
+
+	now = _xnvme_timer_clock_sample();
+	for (int i = 0; i < XNVME_QOS_NBUCKETS; ++i) {
+		struct xnvme_qos_bucket *bucket = &(*qos)->buckets[i];
+		uint64_t capacity;
+
+		bucket->rate = rates[i];
+		bucket->burst_nsec = burst_usec * 1000;
+
+		capacity = qos_ntokens(bucket->rate, bucket->burst_nsec);
+		bucket->capacity = capacity ? capacity : 1;
+
+		atomic_store(&bucket->tokens, bucket->capacity);
+		atomic_store(&bucket->last, now);
+	}
+
+	return 0;
+}
+
+void
+xnvme_qos_destroy(struct xnvme_qos *qos)
+{
+	free(qos);
+}
+
+int
+xnvme_qos_get_stats(struct xnvme_qos *qos, struct xnvme_qos_stats *stats)
+{
+	if (!(qos && stats)) {
+		XNVME_DEBUG("FAILED: qos: %p, stats: %p", (void *)qos,
+			    (void *)stats);
+		return -EINVAL;
+	}
+
+	stats->nsubmitted = atomic_load(&qos->nsubmitted);
+	stats->nthrottled = atomic_load(&qos->nthrottled);
+	stats->throttled_nsec = atomic_load(&qos->throttled_nsec);
+
+	return 0;
+}
+
+int
+xnvme_async_set_qos(struct xnvme_async_ctx *ctx, struct xnvme_qos *qos)
+{
+	struct xnvme_async_qos *aqos;
+
+	if (!ctx) {
+		XNVME_DEBUG("FAILED: !ctx");
+		return -EINVAL;
+	}
+	if (ctx->qos && ctx->qos->nqueued) {
+		XNVME_DEBUG("FAILED: nqueued: %u", ctx->qos->nqueued);
+		return -EBUSY;
+	}
+	if (ctx->shared) {
+		XNVME_DEBUG("FAILED: not supported on a shared context");
+		return -ENOSYS;
+	}
+
+	free(ctx->qos);
+	ctx->qos = NULL;
+
+	if (!qos) {
+		return 0;
+	}
+
+	aqos = calloc(1, sizeof(*aqos) + ctx->depth * sizeof(*aqos->elm));
+	if (!aqos) {
+		XNVME_DEBUG("FAILED: calloc(aqos), errno: %d", errno);
+		return -errno;
+	}
+	aqos->qos = qos;
+	aqos->capacity = ctx->depth;
+	STAILQ_INIT(&aqos->pool);
+	STAILQ_INIT(&aqos->queue);
+	for (uint32_t i = 0; i < aqos->capacity; ++i) {
+		STAILQ_INSERT_HEAD(&aqos->pool, &aqos->elm[i], link);
+	}
+
+	ctx->qos = aqos;
+
+	return 0;
+}
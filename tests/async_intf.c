@@ -1,7 +1,17 @@
 // Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
 // SPDX-License-Identifier: Apache-2.0
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 #include <libxnvmec.h>
 
 #define XNVME_TESTS_QDEPTH_MAX 512
@@ -96,9 +106,1864 @@ exit:
 	return err;
 }
 
+static void
+cb_chain(struct xnvme_req *req, void *cb_arg)
+{
+	int *ncompleted = cb_arg;
+
+	if (xnvme_req_cpl_status(req)) {
+		xnvme_req_pr(req, XNVME_PR_DEF);
+	}
+
+	*ncompleted += 1;
+}
+
+/**
+ * Submit the chain: write data, flush, write commit record; then verify that
+ * the chain completed once and that both writes landed
+ */
+static int
+test_chain(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	uint32_t nsid = cli->given[XNVMEC_OPT_NSID] ?
+			cli->args.nsid : xnvme_dev_get_nsid(dev);
+	uint64_t slba = cli->given[XNVMEC_OPT_SLBA] ? cli->args.slba : 0x0;
+	const size_t nbytes = geo->lba_nbytes;
+	struct xnvme_cmd_link links[3] = { 0 };
+	struct xnvme_async_ctx *ctx = NULL;
+	struct xnvme_req req = { 0 };
+	char *wbuf = NULL, *rbuf = NULL;
+	int ncompleted = 0;
+	int err;
+
+	wbuf = xnvme_buf_alloc(dev, 2 * nbytes, NULL);
+	rbuf = xnvme_buf_alloc(dev, 2 * nbytes, NULL);
+	if (!(wbuf && rbuf)) {
+		err = -errno;
+		xnvmec_perr("xnvme_buf_alloc()", err);
+		goto exit;
+	}
+	xnvmec_buf_fill(wbuf, 2 * nbytes, "anum");
+	xnvmec_buf_clear(rbuf, 2 * nbytes);
+
+	err = xnvme_async_init(dev, &ctx, 4, 0);
+	if (err) {
+		xnvmec_perr("xnvme_async_init()", err);
+		goto exit;
+	}
+
+	links[0].cmd.common.opcode = XNVME_SPEC_OPC_WRITE;
+	links[0].cmd.common.nsid = nsid;
+	links[0].cmd.lblk.slba = slba;
+	links[0].dbuf = wbuf;
+	links[0].dbuf_nbytes = nbytes;
+
+	links[1].cmd.common.opcode = XNVME_SPEC_OPC_FLUSH;
+	links[1].cmd.common.nsid = nsid;
+
+	links[2].cmd.common.opcode = XNVME_SPEC_OPC_WRITE;
+	links[2].cmd.common.nsid = nsid;
+	links[2].cmd.lblk.slba = slba + 1;
+	links[2].dbuf = wbuf + nbytes;
+	links[2].dbuf_nbytes = nbytes;
+
+	req.async.ctx = ctx;
+	req.async.cb = cb_chain;
+	req.async.cb_arg = &ncompleted;
+
+	err = xnvme_cmd_chain(dev, links, 3, XNVME_CMD_ASYNC, &req);
+	if (err) {
+		xnvmec_perr("xnvme_cmd_chain()", err);
+		goto exit;
+	}
+
+	err = xnvme_async_wait(dev, ctx);
+	if (err < 0) {
+		xnvmec_perr("xnvme_async_wait()", err);
+		goto exit;
+	}
+	if (ncompleted != 1) {
+		xnvmec_pinf("FAILED: ncompleted: %d != 1", ncompleted);
+		err = -EIO;
+		goto exit;
+	}
+	if (xnvme_req_cpl_status(&req)) {
+		err = -EIO;
+		goto exit;
+	}
+
+	xnvme_req_clear(&req);
+	err = xnvme_cmd_read(dev, nsid, slba, 1, rbuf, NULL, XNVME_CMD_SYNC,
+			     &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		xnvmec_perr("xnvme_cmd_read()", err);
+		goto exit;
+	}
+	if (xnvmec_buf_diff(wbuf, rbuf, 2 * nbytes)) {
+		xnvmec_buf_diff_pr(wbuf, rbuf, 2 * nbytes, XNVME_PR_DEF);
+		err = -EIO;
+		goto exit;
+	}
+
+exit:
+	if (ctx) {
+		xnvme_async_term(dev, ctx);
+	}
+	xnvme_buf_free(dev, wbuf);
+	xnvme_buf_free(dev, rbuf);
+
+	return err < 0 ? err : 0;
+}
+
+/**
+ * Fill the context, leaving room for a single command, then submit a chain of
+ * two; a chain which cannot be submitted as a whole must fail without leaving
+ * any of its links behind, thus the context must drain without completing the
+ * chain, after which the chain is submitted again, and must complete once
+ */
+static int
+test_chain_full(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	uint32_t nsid = cli->given[XNVMEC_OPT_NSID] ?
+			cli->args.nsid : xnvme_dev_get_nsid(dev);
+	uint64_t slba = cli->given[XNVMEC_OPT_SLBA] ? cli->args.slba : 0x0;
+	const uint32_t qd = 8;
+	const size_t nbytes = geo->lba_nbytes;
+	struct xnvme_req reqs[8] = { 0 };
+	struct xnvme_cmd_link links[2] = { 0 };
+	struct xnvme_async_ctx *ctx = NULL;
+	struct xnvme_req req = { 0 };
+	int nreads = 0, nchains = 0, expected = 0;
+	char *buf = NULL;
+	int err;
+
+	buf = xnvme_buf_alloc(dev, 3 * nbytes, NULL);
+	if (!buf) {
+		err = -errno;
+		xnvmec_perr("xnvme_buf_alloc()", err);
+		goto exit;
+	}
+	xnvmec_buf_fill(buf, 2 * nbytes, "anum");
+
+	err = xnvme_async_init(dev, &ctx, qd, 0);
+	if (err) {
+		xnvmec_perr("xnvme_async_init()", err);
+		goto exit;
+	}
+
+	for (uint32_t i = 0; i < (qd - 1); ++i) {
+		reqs[i].async.ctx = ctx;
+		reqs[i].async.cb = cb_chain;
+		reqs[i].async.cb_arg = &nreads;
+
+		err = xnvme_cmd_read(dev, nsid, slba + 2, 0, buf + 2 * nbytes,
+				     NULL, XNVME_CMD_ASYNC, &reqs[i]);
+		if (err) {
+			xnvmec_perr("xnvme_cmd_read()", err);
+			goto exit;
+		}
+	}
+
+	for (int i = 0; i < 2; ++i) {
+		links[i].cmd.common.opcode = XNVME_SPEC_OPC_WRITE;
+		links[i].cmd.common.nsid = nsid;
+		links[i].cmd.lblk.slba = slba + i;
+		links[i].dbuf = buf + i * nbytes;
+		links[i].dbuf_nbytes = nbytes;
+	}
+	req.async.ctx = ctx;
+	req.async.cb = cb_chain;
+	req.async.cb_arg = &nchains;
+
+	// Linking backends reject the chain, others submit it link by link
+	err = xnvme_cmd_chain(dev, links, 2, XNVME_CMD_ASYNC, &req);
+	switch (err) {
+	case 0:
+		expected = 1;
+		break;
+	case -EBUSY:
+	case -EAGAIN:
+		break;
+	default:
+		xnvmec_perr("xnvme_cmd_chain()", err);
+		goto exit;
+	}
+	xnvmec_pinf("chain on a full context: %d", err);
+
+	err = xnvme_async_wait(dev, ctx);
+	if (err < 0) {
+		xnvmec_perr("xnvme_async_wait()", err);
+		goto exit;
+	}
+	if ((nreads != (int)(qd - 1)) || (nchains != expected) ||
+	    xnvme_async_get_outstanding(ctx)) {
+		xnvmec_pinf("FAILED: nreads: %d, nchains: %d != %d, outstanding: %u",
+			    nreads, nchains, expected,
+			    xnvme_async_get_outstanding(ctx));
+		err = -EIO;
+		goto exit;
+	}
+
+	xnvme_req_clear(&req);
+	req.async.ctx = ctx;
+	req.async.cb = cb_chain;
+	req.async.cb_arg = &nchains;
+
+	err = xnvme_cmd_chain(dev, links, 2, XNVME_CMD_ASYNC, &req);
+	if (err) {
+		xnvmec_perr("xnvme_cmd_chain()", err);
+		goto exit;
+	}
+	err = xnvme_async_wait(dev, ctx);
+	if (err < 0) {
+		xnvmec_perr("xnvme_async_wait()", err);
+		goto exit;
+	}
+	err = 0;
+
+	if ((nchains != expected + 1) || xnvme_req_cpl_status(&req)) {
+		xnvmec_pinf("FAILED: nchains: %d != %d", nchains, expected + 1);
+		err = -EIO;
+	}
+
+exit:
+	if (ctx) {
+		xnvme_async_term(dev, ctx);
+	}
+	xnvme_buf_free(dev, buf);
+
+	return err;
+}
+
+static void
+cb_qos(struct xnvme_req *req, void *cb_arg)
+{
+	uint64_t *nerrs = cb_arg;
+
+	if (xnvme_req_cpl_status(req)) {
+		xnvme_req_pr(req, XNVME_PR_DEF);
+		*nerrs += 1;
+	}
+
+	SLIST_INSERT_HEAD(&req->pool->head, req, link);
+}
+
+/**
+ * Read 'count' LBAs with a read-iops limit of 'limit', then verify that it took
+ * at least the time the limit allows for and that reads were held back
+ */
+static int
+test_qos(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	uint32_t nsid = xnvme_dev_get_nsid(dev);
+	uint64_t count = cli->given[XNVMEC_OPT_COUNT] ? cli->args.count : 1000;
+	uint32_t qd = cli->given[XNVMEC_OPT_QDEPTH] ? cli->args.qdepth : 16;
+	struct xnvme_qos_limits limits = { 0 };
+	struct xnvme_qos_stats stats = { 0 };
+	struct xnvme_req_pool *reqs = NULL;
+	struct xnvme_async_ctx *ctx = NULL;
+	struct xnvme_qos *qos = NULL;
+	struct xnvme_timer timer = { 0 };
+	double expected;
+	uint64_t nerrs = 0;
+	char *buf = NULL;
+	int err;
+
+	limits.read_iops = cli->given[XNVMEC_OPT_LIMIT] ? cli->args.limit : 1000;
+	limits.burst_usec = 10000;
+
+	// Tokens in the bucket up front are not held back, and allow for a bit of
+	// slack in the clock
+	expected = (count - (limits.read_iops / 100)) / (double)limits.read_iops;
+	expected *= 0.9;
+
+	xnvmec_pinf("count: %zu, qd: %u, read_iops: %zu, expected: >= %.3f sec",
+		    count, qd, limits.read_iops, expected);
+
+	buf = xnvme_buf_alloc(dev, geo->lba_nbytes, NULL);
+	if (!buf) {
+		err = -errno;
+		xnvmec_perr("xnvme_buf_alloc()", err);
+		goto exit;
+	}
+	err = xnvme_async_init(dev, &ctx, qd, 0);
+	if (err) {
+		xnvmec_perr("xnvme_async_init()", err);
+		goto exit;
+	}
+	err = xnvme_req_pool_alloc(&reqs, qd);
+	if (err) {
+		xnvmec_perr("xnvme_req_pool_alloc()", err);
+		goto exit;
+	}
+	err = xnvme_req_pool_init(reqs, ctx, cb_qos, &nerrs);
+	if (err) {
+		xnvmec_perr("xnvme_req_pool_init()", err);
+		goto exit;
+	}
+	err = xnvme_qos_create(&qos, &limits);
+	if (err) {
+		xnvmec_perr("xnvme_qos_create()", err);
+		goto exit;
+	}
+	err = xnvme_async_set_qos(ctx, qos);
+	if (err) {
+		xnvmec_perr("xnvme_async_set_qos()", err);
+		goto exit;
+	}
+
+	xnvme_timer_start(&timer);
+	for (uint64_t i = 0; i < count; ++i) {
+		struct xnvme_req *req = SLIST_FIRST(&reqs->head);
+
+		if (!req) {
+			err = xnvme_async_poke(dev, ctx, 0);
+			if (err < 0) {
+				xnvmec_perr("xnvme_async_poke()", err);
+				goto exit;
+			}
+			--i;
+			continue;
+		}
+		SLIST_REMOVE_HEAD(&reqs->head, link);
+
+		err = xnvme_cmd_read(dev, nsid, i % (geo->tbytes / geo->lba_nbytes),
+				     0, buf, NULL, XNVME_CMD_ASYNC, req);
+		if ((err == -EBUSY) || (err == -EAGAIN)) {
+			SLIST_INSERT_HEAD(&reqs->head, req, link);
+			xnvme_async_poke(dev, ctx, 0);
+			--i;
+			continue;
+		}
+		if (err) {
+			xnvmec_perr("xnvme_cmd_read()", err);
+			goto exit;
+		}
+	}
+	{
+		struct xnvme_req *req;
+		uint32_t nfree = 0;
+
+		SLIST_FOREACH(req, &reqs->head, link) {
+			nfree += 1;
+		}
+		if (xnvme_async_get_outstanding(ctx) != qd - nfree) {
+			xnvmec_pinf("FAILED: outstanding: %u != %u",
+				    xnvme_async_get_outstanding(ctx), qd - nfree);
+			err = -EIO;
+			goto exit;
+		}
+	}
+	err = xnvme_async_wait(dev, ctx);
+	if (err < 0) {
+		xnvmec_perr("xnvme_async_wait()", err);
+		goto exit;
+	}
+	xnvme_timer_stop(&timer);
+	err = 0;
+
+	xnvme_qos_get_stats(qos, &stats);
+	xnvmec_pinf("elapsed: %.3f sec, nsubmitted: %zu, nthrottled: %zu, "
+		    "throttled: %.3f sec", xnvme_timer_elapsed_secs(&timer),
+		    stats.nsubmitted, stats.nthrottled,
+		    stats.throttled_nsec / 1e9);
+
+	if (nerrs || (stats.nsubmitted != count)) {
+		xnvmec_pinf("FAILED: nerrs: %zu, nsubmitted: %zu", nerrs,
+			    stats.nsubmitted);
+		err = -EIO;
+	}
+	if ((!stats.nthrottled) || (xnvme_timer_elapsed_secs(&timer) < expected)) {
+		xnvmec_pinf("FAILED: the limit was not enforced");
+		err = -EIO;
+	}
+
+exit:
+	if (ctx) {
+		xnvme_async_term(dev, ctx);
+	}
+	xnvme_qos_destroy(qos);
+	xnvme_req_pool_free(reqs);
+	xnvme_buf_free(dev, buf);
+
+	return err;
+}
+
+struct cb_bufsel_args {
+	struct xnvme_dev *dev;
+	const uint8_t *wbuf;	///< Content written, by LBA
+	uint64_t *slbas;	///< LBA read by the request, by index in the pool
+	uint32_t lba_nbytes;
+	uint64_t nerrs;
+};
+
+static void
+cb_bufsel(struct xnvme_req *req, void *cb_arg)
+{
+	struct cb_bufsel_args *args = cb_arg;
+	uint64_t slba = args->slbas[req - req->pool->elm];
+	uint8_t *buf = xnvme_async_buf(req->async.ctx, req->async.bid);
+
+	if (xnvme_req_cpl_status(req) || !buf) {
+		xnvme_req_pr(req, XNVME_PR_DEF);
+		args->nerrs += 1;
+	} else if (xnvmec_buf_diff(args->wbuf + slba * args->lba_nbytes, buf,
+				   args->lba_nbytes)) {
+		xnvmec_pinf("FAILED: content of slba: %zu", slba);
+		args->nerrs += 1;
+	}
+
+	if (buf && xnvme_async_buf_put(args->dev, req->async.ctx,
+				       req->async.bid)) {
+		args->nerrs += 1;
+	}
+
+	SLIST_INSERT_HEAD(&req->pool->head, req, link);
+}
+
+/**
+ * Write 'count' LBAs, then read them back, into buffers selected by the
+ * backend, from a quarter as many buffers as the context has slots, thus, the
+ * requests are also a quarter, limiting the reads in-flight to the buffers
+ */
+static int
+test_bufsel(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	uint32_t nsid = xnvme_dev_get_nsid(dev);
+	uint64_t count = cli->given[XNVMEC_OPT_COUNT] ? cli->args.count : 256;
+	uint32_t qd = cli->given[XNVMEC_OPT_QDEPTH] ? cli->args.qdepth : 16;
+	uint32_t nbufs = qd / 4 ? qd / 4 : 1;
+	struct cb_bufsel_args args = { 0 };
+	struct xnvme_req_pool *reqs = NULL;
+	struct xnvme_async_ctx *ctx = NULL;
+	uint8_t *wbuf = NULL;
+	int err;
+
+	if (count > geo->tbytes / geo->lba_nbytes) {
+		count = geo->tbytes / geo->lba_nbytes;
+	}
+
+	xnvmec_pinf("count: %zu, qd: %u, nbufs: %u", count, qd, nbufs);
+
+	args.dev = dev;
+	args.lba_nbytes = geo->lba_nbytes;
+	args.slbas = calloc(nbufs, sizeof(*args.slbas));
+	wbuf = xnvme_buf_alloc(dev, count * geo->lba_nbytes, NULL);
+	if (!(args.slbas && wbuf)) {
+		err = -errno;
+		xnvmec_perr("alloc()", err);
+		goto exit;
+	}
+	args.wbuf = wbuf;
+
+	err = xnvmec_buf_fill(wbuf, count * geo->lba_nbytes, "anum");
+	if (err) {
+		xnvmec_perr("xnvmec_buf_fill()", err);
+		goto exit;
+	}
+	for (uint64_t slba = 0; slba < count; ++slba) {
+		struct xnvme_req req = { 0 };
+
+		err = xnvme_cmd_write(dev, nsid, slba, 0,
+				      wbuf + slba * geo->lba_nbytes, NULL,
+				      XNVME_CMD_SYNC, &req);
+		if (err || xnvme_req_cpl_status(&req)) {
+			xnvmec_perr("xnvme_cmd_write()", err);
+			err = err ? err : -EIO;
+			goto exit;
+		}
+	}
+
+	err = xnvme_async_init(dev, &ctx, qd, 0);
+	if (err) {
+		xnvmec_perr("xnvme_async_init()", err);
+		goto exit;
+	}
+	err = xnvme_async_bufs_init(dev, ctx, nbufs, geo->lba_nbytes);
+	if (err) {
+		xnvmec_perr("xnvme_async_bufs_init()", err);
+		goto exit;
+	}
+	err = xnvme_req_pool_alloc(&reqs, nbufs);
+	if (err) {
+		xnvmec_perr("xnvme_req_pool_alloc()", err);
+		goto exit;
+	}
+	err = xnvme_req_pool_init(reqs, ctx, cb_bufsel, &args);
+	if (err) {
+		xnvmec_perr("xnvme_req_pool_init()", err);
+		goto exit;
+	}
+
+	for (uint64_t slba = 0; slba < count; ++slba) {
+		struct xnvme_req *req = SLIST_FIRST(&reqs->head);
+
+		if (!req) {
+			err = xnvme_async_poke(dev, ctx, 0);
+			if (err < 0) {
+				xnvmec_perr("xnvme_async_poke()", err);
+				goto exit;
+			}
+			--slba;
+			continue;
+		}
+		SLIST_REMOVE_HEAD(&reqs->head, link);
+		args.slbas[req - reqs->elm] = slba;
+
+		err = xnvme_cmd_read(dev, nsid, slba, 0, NULL, NULL,
+				     XNVME_CMD_ASYNC | XNVME_CMD_BUFSEL, req);
+		if ((err == -EBUSY) || (err == -EAGAIN)) {
+			SLIST_INSERT_HEAD(&reqs->head, req, link);
+			xnvme_async_poke(dev, ctx, 0);
+			--slba;
+			continue;
+		}
+		if (err) {
+			xnvmec_perr("xnvme_cmd_read()", err);
+			SLIST_INSERT_HEAD(&reqs->head, req, link);
+			goto exit;
+		}
+	}
+	err = xnvme_async_wait(dev, ctx);
+	if (err < 0) {
+		xnvmec_perr("xnvme_async_wait()", err);
+		goto exit;
+	}
+	err = 0;
+
+	if (args.nerrs) {
+		xnvmec_pinf("FAILED: nerrs: %zu", args.nerrs);
+		err = -EIO;
+	}
+
+exit:
+	if (ctx) {
+		xnvme_async_wait(dev, ctx);
+		xnvme_async_term(dev, ctx);
+	}
+	xnvme_req_pool_free(reqs);
+	xnvme_buf_free(dev, wbuf);
+	free(args.slbas);
+
+	return err;
+}
+
 //
 // Command-Line Interface (CLI) definition
 //
+static void
+cb_group(struct xnvme_req *req, void *cb_arg)
+{
+	uint64_t *ncompleted = cb_arg;
+
+	if (xnvme_req_cpl_status(req)) {
+		xnvmec_perr("cb_group()", -EIO);
+		xnvme_req_pr(req, XNVME_PR_DEF);
+	}
+
+	*ncompleted += 1;
+
+	SLIST_INSERT_HEAD(&req->pool->head, req, link);
+}
+
+/**
+ * Submit 'qdepth' reads on every other context of a group of 'count' contexts,
+ * then reap them via the group, once by waiting and once by poking
+ */
+static int
+test_group(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	uint32_t nsid = xnvme_dev_get_nsid(dev);
+	uint32_t count = cli->given[XNVMEC_OPT_COUNT] ? cli->args.count : 8;
+	uint32_t qd = cli->given[XNVMEC_OPT_QDEPTH] ? cli->args.qdepth : 16;
+	struct xnvme_async_ctx **ctxs = NULL;
+	struct xnvme_req_pool **reqs = NULL;
+	struct xnvme_async_group *group = NULL;
+	uint64_t ncompleted = 0;
+	uint32_t nsignalling = 0;
+	char *buf = NULL;
+	int err;
+
+	ctxs = calloc(count, sizeof(*ctxs));
+	reqs = calloc(count, sizeof(*reqs));
+	if (!(ctxs && reqs)) {
+		err = -errno;
+		xnvmec_perr("calloc()", err);
+		goto exit;
+	}
+	buf = xnvme_buf_alloc(dev, geo->lba_nbytes, NULL);
+	if (!buf) {
+		err = -errno;
+		xnvmec_perr("xnvme_buf_alloc()", err);
+		goto exit;
+	}
+	err = xnvme_async_group_create(&group, count);
+	if (err) {
+		xnvmec_perr("xnvme_async_group_create()", err);
+		goto exit;
+	}
+
+	for (uint32_t i = 0; i < count; ++i) {
+		err = xnvme_async_init(dev, &ctxs[i], qd, 0);
+		if (err) {
+			xnvmec_perr("xnvme_async_init()", err);
+			goto exit;
+		}
+		err = xnvme_req_pool_alloc(&reqs[i], qd);
+		if (err) {
+			xnvmec_perr("xnvme_req_pool_alloc()", err);
+			goto exit;
+		}
+		err = xnvme_req_pool_init(reqs[i], ctxs[i], cb_group,
+					  &ncompleted);
+		if (err) {
+			xnvmec_perr("xnvme_req_pool_init()", err);
+			goto exit;
+		}
+		err = xnvme_async_group_add(group, dev, ctxs[i]);
+		if (err) {
+			xnvmec_perr("xnvme_async_group_add()", err);
+			goto exit;
+		}
+	}
+
+	err = xnvme_async_group_get_fd(group, &nsignalling);
+	xnvmec_pinf("count: %u, qd: %u, fd: %d, nsignalling: %u", count, qd,
+		    err, nsignalling);
+
+	for (int round = 0; round < 2; ++round) {
+		uint32_t nbusy = 0;
+		uint64_t nsubmitted = 0;
+
+		ncompleted = 0;
+
+		for (uint32_t i = 0; i < count; i += 2) {
+			for (uint32_t j = 0; j < qd; ++j) {
+				struct xnvme_req *req = SLIST_FIRST(&reqs[i]->head);
+
+				SLIST_REMOVE_HEAD(&reqs[i]->head, link);
+
+				err = xnvme_cmd_read(dev, nsid, j, 0, buf, NULL,
+						     XNVME_CMD_ASYNC, req);
+				if (err) {
+					xnvmec_perr("xnvme_cmd_read()", err);
+					goto exit;
+				}
+				nsubmitted += 1;
+			}
+			nbusy += 1;
+		}
+
+		if (xnvme_async_group_get_nactive(group) != nbusy) {
+			xnvmec_pinf("FAILED: nactive: %u != nbusy: %u",
+				    xnvme_async_group_get_nactive(group), nbusy);
+			err = -EIO;
+			goto exit;
+		}
+
+		if (!round) {
+			err = xnvme_async_group_wait(group);
+			if (err < 0) {
+				xnvmec_perr("xnvme_async_group_wait()", err);
+				goto exit;
+			}
+		} else {
+			while (xnvme_async_group_get_nactive(group)) {
+				err = xnvme_async_group_poke(group, 1);
+				if (err < 0) {
+					xnvmec_perr("xnvme_async_group_poke()", err);
+					goto exit;
+				}
+			}
+		}
+
+		xnvmec_pinf("round: %d, nsubmitted: %zu, ncompleted: %zu", round,
+			    nsubmitted, ncompleted);
+
+		if (ncompleted != nsubmitted) {
+			xnvmec_pinf("FAILED: ncompleted != nsubmitted");
+			err = -EIO;
+			goto exit;
+		}
+	}
+	err = 0;
+
+exit:
+	for (uint32_t i = 0; ctxs && (i < count); ++i) {
+		if (ctxs[i]) {
+			xnvme_async_term(dev, ctxs[i]);
+		}
+		xnvme_req_pool_free(reqs[i]);
+	}
+	xnvme_async_group_destroy(group);
+	xnvme_buf_free(dev, buf);
+	free(reqs);
+	free(ctxs);
+
+	return err;
+}
+
+static void
+cb_reap(struct xnvme_req *XNVME_UNUSED(req), void *cb_arg)
+{
+	uint64_t *ncalls = cb_arg;
+
+	*ncalls += 1;
+}
+
+/**
+ * Read 'count' LBAs, reaping the completions in batches, and verify that all
+ * complete, and without invoking their callbacks
+ */
+static int
+test_reap(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	uint32_t nsid = xnvme_dev_get_nsid(dev);
+	uint64_t count = cli->given[XNVMEC_OPT_COUNT] ? cli->args.count : 1000;
+	uint32_t qd = cli->given[XNVMEC_OPT_QDEPTH] ? cli->args.qdepth : 16;
+	struct xnvme_req_pool *reqs = NULL;
+	struct xnvme_async_ctx *ctx = NULL;
+	struct xnvme_req **out = NULL;
+	uint64_t nsubmitted = 0, nreaped = 0, nerrs = 0, ncalls = 0;
+	char *buf = NULL;
+	int err;
+
+	xnvmec_pinf("count: %zu, qd: %u", count, qd);
+
+	out = calloc(qd, sizeof(*out));
+	if (!out) {
+		err = -errno;
+		xnvmec_perr("calloc()", err);
+		goto exit;
+	}
+	buf = xnvme_buf_alloc(dev, geo->lba_nbytes, NULL);
+	if (!buf) {
+		err = -errno;
+		xnvmec_perr("xnvme_buf_alloc()", err);
+		goto exit;
+	}
+	err = xnvme_async_init(dev, &ctx, qd, 0);
+	if (err) {
+		xnvmec_perr("xnvme_async_init()", err);
+		goto exit;
+	}
+	err = xnvme_req_pool_alloc(&reqs, qd);
+	if (err) {
+		xnvmec_perr("xnvme_req_pool_alloc()", err);
+		goto exit;
+	}
+	err = xnvme_req_pool_init(reqs, ctx, cb_reap, &ncalls);
+	if (err) {
+		xnvmec_perr("xnvme_req_pool_init()", err);
+		goto exit;
+	}
+
+	while (nreaped < count) {
+		struct xnvme_req *req = SLIST_FIRST(&reqs->head);
+
+		if (req && (nsubmitted < count)) {
+			uint64_t slba = nsubmitted % (geo->tbytes / geo->lba_nbytes);
+
+			SLIST_REMOVE_HEAD(&reqs->head, link);
+
+			err = xnvme_cmd_read(dev, nsid, slba, 0, buf, NULL,
+					     XNVME_CMD_ASYNC, req);
+			if (!err) {
+				++nsubmitted;
+				continue;
+			}
+			SLIST_INSERT_HEAD(&reqs->head, req, link);
+			if ((err != -EBUSY) && (err != -EAGAIN)) {
+				xnvmec_perr("xnvme_cmd_read()", err);
+				goto exit;
+			}
+		}
+
+		err = xnvme_async_reap(dev, ctx, out, qd);
+		if (err < 0) {
+			xnvmec_perr("xnvme_async_reap()", err);
+			goto exit;
+		}
+		for (int i = 0; i < err; ++i) {
+			if (xnvme_req_cpl_status(out[i])) {
+				xnvme_req_pr(out[i], XNVME_PR_DEF);
+				++nerrs;
+			}
+			SLIST_INSERT_HEAD(&reqs->head, out[i], link);
+		}
+		nreaped += err;
+	}
+	err = 0;
+
+	xnvmec_pinf("nsubmitted: %zu, nreaped: %zu, ncalls: %zu", nsubmitted,
+		    nreaped, ncalls);
+	if (nerrs || ncalls || (nreaped != count)) {
+		xnvmec_pinf("FAILED: nerrs: %zu", nerrs);
+		err = -EIO;
+	}
+
+exit:
+	if (ctx) {
+		xnvme_async_term(dev, ctx);
+	}
+	xnvme_req_pool_free(reqs);
+	xnvme_buf_free(dev, buf);
+	free(out);
+
+	return err;
+}
+
+/**
+ * Open a counter of the instructions retired, in user-space, by the calling
+ * thread
+ *
+ * @return On success, the counter is returned. On error, e.g. when not
+ * permitted, -1 is returned.
+ */
+static int
+tmpl_counter_open(void)
+{
+#ifdef __linux__
+	struct perf_event_attr attr = { 0 };
+
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+	return -1;
+#endif
+}
+
+static void
+tmpl_counter_toggle(int fd, int enable)
+{
+#ifdef __linux__
+	if (fd < 0) {
+		return;
+	}
+	if (enable) {
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+	}
+	ioctl(fd, enable ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+#else
+	XNVME_UNUSED(fd);
+	XNVME_UNUSED(enable);
+#endif
+}
+
+static uint64_t
+tmpl_counter_read(int fd)
+{
+	uint64_t val = 0;
+
+#ifdef __linux__
+	if ((fd < 0) || (read(fd, &val, sizeof(val)) != sizeof(val))) {
+		return 0;
+	}
+#endif
+
+	return val;
+}
+
+struct tmpl_run {
+	struct xnvme_req_pool *reqs;
+	uint64_t ncompleted;
+	uint64_t nerrs;
+};
+
+static void
+cb_tmpl(struct xnvme_req *req, void *cb_arg)
+{
+	struct tmpl_run *run = cb_arg;
+
+	if (xnvme_req_cpl_status(req)) {
+		xnvme_req_pr(req, XNVME_PR_DEF);
+		run->nerrs += 1;
+	}
+	run->ncompleted += 1;
+
+	SLIST_INSERT_HEAD(&run->reqs->head, req, link);
+}
+
+/**
+ * Read 'count' LBAs, via the given template, or via xnvme_cmd_read() when it is
+ * NULL, and wait for their completion
+ */
+static int
+tmpl_read(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx,
+	  struct xnvme_cmd_tmpl *tmpl, struct tmpl_run *run, uint64_t count,
+	  char *buf)
+{
+	const struct xnvme_geo *geo = xnvme_dev_get_geo(dev);
+	uint32_t nsid = xnvme_dev_get_nsid(dev);
+	uint64_t nlbas = geo->tbytes / geo->lba_nbytes;
+	uint64_t nsubmitted = 0;
+	int err;
+
+	run->ncompleted = 0;
+	run->nerrs = 0;
+
+	while (run->ncompleted < count) {
+		struct xnvme_req *req = SLIST_FIRST(&run->reqs->head);
+
+		if (req && (nsubmitted < count)) {
+			uint64_t slba = nsubmitted % nlbas;
+
+			SLIST_REMOVE_HEAD(&run->reqs->head, link);
+
+			err = tmpl ? xnvme_cmd_tmpl_submit(tmpl, slba, 0, buf, req) :
+			      xnvme_cmd_read(dev, nsid, slba, 0, buf, NULL,
+					     XNVME_CMD_ASYNC, req);
+			if (!err) {
+				++nsubmitted;
+				continue;
+			}
+			SLIST_INSERT_HEAD(&run->reqs->head, req, link);
+			if ((err != -EBUSY) && (err != -EAGAIN)) {
+				xnvmec_perr("submit", err);
+				return err;
+			}
+		}
+
+		err = xnvme_async_poke(dev, ctx, 0);
+		if (err < 0) {
+			xnvmec_perr("xnvme_async_poke()", err);
+			return err;
+		}
+	}
+
+	return run->nerrs ? -EIO : 0;
+}
+
+/**
+ * Read 'count' LBAs via xnvme_cmd_read() and via a command template, printing
+ * the time and, when permitted, the user-space instructions spent per read
+ */
+static int
+test_tmpl(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	uint32_t nsid = xnvme_dev_get_nsid(dev);
+	uint64_t count = cli->given[XNVMEC_OPT_COUNT] ? cli->args.count : 100000;
+	uint32_t qd = cli->given[XNVMEC_OPT_QDEPTH] ? cli->args.qdepth : 16;
+	struct xnvme_async_ctx *ctx = NULL;
+	struct xnvme_cmd_tmpl *tmpl = NULL;
+	struct tmpl_run run = { 0 };
+	char *buf = NULL;
+	int counter;
+	int err;
+
+	xnvmec_pinf("count: %zu, qd: %u", count, qd);
+
+	counter = tmpl_counter_open();
+	if (counter < 0) {
+		xnvmec_pinf("instruction counter: n/a");
+	}
+
+	buf = xnvme_buf_alloc(dev, geo->lba_nbytes, NULL);
+	if (!buf) {
+		err = -errno;
+		xnvmec_perr("xnvme_buf_alloc()", err);
+		goto exit;
+	}
+	err = xnvme_async_init(dev, &ctx, qd, 0);
+	if (err) {
+		xnvmec_perr("xnvme_async_init()", err);
+		goto exit;
+	}
+	err = xnvme_req_pool_alloc(&run.reqs, qd);
+	if (err) {
+		xnvmec_perr("xnvme_req_pool_alloc()", err);
+		goto exit;
+	}
+	err = xnvme_req_pool_init(run.reqs, ctx, cb_tmpl, &run);
+	if (err) {
+		xnvmec_perr("xnvme_req_pool_init()", err);
+		goto exit;
+	}
+	err = xnvme_cmd_tmpl_create(dev, ctx, XNVME_SPEC_OPC_READ, nsid,
+				    XNVME_CMD_ASYNC, &tmpl);
+	if (err) {
+		xnvmec_perr("xnvme_cmd_tmpl_create()", err);
+		goto exit;
+	}
+
+	for (int i = 0; i < 2; ++i) {
+		struct xnvme_timer timer = { 0 };
+		uint64_t ninsts;
+
+		tmpl_counter_toggle(counter, 1);
+		xnvme_timer_start(&timer);
+		err = tmpl_read(dev, ctx, i ? tmpl : NULL, &run, count, buf);
+		xnvme_timer_stop(&timer);
+		tmpl_counter_toggle(counter, 0);
+		if (err) {
+			xnvmec_perr("tmpl_read()", err);
+			goto exit;
+		}
+		if (run.ncompleted != count) {
+			xnvmec_pinf("FAILED: ncompleted: %zu", run.ncompleted);
+			err = -EIO;
+			goto exit;
+		}
+
+		xnvmec_pinf("%s: nsec/io: %.1f",
+			    i ? "xnvme_cmd_tmpl_submit" : "xnvme_cmd_read",
+			    (xnvme_timer_elapsed_secs(&timer) * 1e9) / count);
+		if (counter >= 0) {
+			ninsts = tmpl_counter_read(counter);
+			xnvmec_pinf("insts/io: %.1f", (double)ninsts / count);
+		}
+	}
+
+exit:
+	xnvme_cmd_tmpl_destroy(tmpl);
+	if (ctx) {
+		xnvme_async_term(dev, ctx);
+	}
+	xnvme_req_pool_free(run.reqs);
+	xnvme_buf_free(dev, buf);
+#ifdef __linux__
+	if (counter >= 0) {
+		close(counter);
+	}
+#endif
+
+	return err;
+}
+
+#define XNVME_TESTS_SHARED_NTHREADS 4
+
+struct shared_producer {
+	struct xnvme_dev *dev;
+	struct xnvme_async_ctx *ctx;	///< The shared context
+	pthread_t thread;
+	uint32_t idx;
+	uint32_t qd;
+	uint64_t count;
+	uint64_t ncompleted;
+	uint64_t nerrs;
+	uint64_t nforeign;		///< Callbacks invoked on another thread
+	int err;
+};
+
+static void
+cb_shared(struct xnvme_req *req, void *cb_arg)
+{
+	struct shared_producer *sp = cb_arg;
+
+	if (xnvme_req_cpl_status(req)) {
+		xnvme_req_pr(req, XNVME_PR_DEF);
+		sp->nerrs += 1;
+	}
+	if (!pthread_equal(sp->thread, pthread_self())) {
+		sp->nforeign += 1;
+	}
+	sp->ncompleted += 1;
+
+	SLIST_INSERT_HEAD(&req->pool->head, req, link);
+}
+
+/**
+ * Submit 'count' commands of the given opcode on the producer, 'qd' LBAs, one
+ * at a time, round-robin, starting at the LBAs of the producer
+ */
+static int
+shared_rw(struct shared_producer *sp, struct xnvme_async_ctx *producer,
+	  struct xnvme_req_pool *reqs, uint8_t opcode, uint64_t count,
+	  char *buf, size_t lba_nbytes)
+{
+	uint32_t nsid = xnvme_dev_get_nsid(sp->dev);
+	uint64_t nsubmitted = 0;
+	int err;
+
+	sp->ncompleted = 0;
+
+	while (nsubmitted < count) {
+		struct xnvme_req *req = SLIST_FIRST(&reqs->head);
+		uint32_t i = nsubmitted % sp->qd;
+
+		if (!req) {
+			err = xnvme_async_poke(sp->dev, producer, 0);
+			if (err < 0) {
+				xnvmec_perr("xnvme_async_poke()", err);
+				return err;
+			}
+			continue;
+		}
+		SLIST_REMOVE_HEAD(&reqs->head, link);
+
+		err = (opcode == XNVME_SPEC_OPC_WRITE) ?
+		      xnvme_cmd_write(sp->dev, nsid, sp->idx * sp->qd + i, 0,
+				      buf + i * lba_nbytes, NULL,
+				      XNVME_CMD_ASYNC, req) :
+		      xnvme_cmd_read(sp->dev, nsid, sp->idx * sp->qd + i, 0,
+				     buf + i * lba_nbytes, NULL, XNVME_CMD_ASYNC,
+				     req);
+		if (err) {
+			SLIST_INSERT_HEAD(&reqs->head, req, link);
+			xnvmec_perr("submit", err);
+			return err;
+		}
+		++nsubmitted;
+	}
+
+	err = xnvme_async_wait(sp->dev, producer);
+	if (err < 0) {
+		xnvmec_perr("xnvme_async_wait()", err);
+		return err;
+	}
+
+	return (sp->ncompleted == count) ? 0 : -EIO;
+}
+
+static void *
+shared_producer_run(void *arg)
+{
+	struct shared_producer *sp = arg;
+	size_t lba_nbytes = xnvme_dev_get_geo(sp->dev)->lba_nbytes;
+	size_t nbytes = sp->qd * lba_nbytes;
+	struct xnvme_async_ctx *producer = NULL;
+	struct xnvme_req_pool *reqs = NULL;
+	char *wbuf = NULL, *rbuf = NULL;
+	int err;
+
+	wbuf = xnvme_buf_alloc(sp->dev, nbytes, NULL);
+	rbuf = xnvme_buf_alloc(sp->dev, nbytes, NULL);
+	if (!(wbuf && rbuf)) {
+		err = -ENOMEM;
+		goto exit;
+	}
+	memset(wbuf, 'A' + sp->idx, nbytes);
+	memset(rbuf, 0, nbytes);
+
+	err = xnvme_async_producer_init(sp->dev, sp->ctx, sp->qd, &producer);
+	if (err) {
+		xnvmec_perr("xnvme_async_producer_init()", err);
+		goto exit;
+	}
+	err = xnvme_req_pool_alloc(&reqs, sp->qd);
+	if (err) {
+		xnvmec_perr("xnvme_req_pool_alloc()", err);
+		goto exit;
+	}
+	err = xnvme_req_pool_init(reqs, producer, cb_shared, sp);
+	if (err) {
+		xnvmec_perr("xnvme_req_pool_init()", err);
+		goto exit;
+	}
+
+	err = shared_rw(sp, producer, reqs, XNVME_SPEC_OPC_WRITE, sp->qd, wbuf,
+			lba_nbytes);
+	if (err) {
+		goto exit;
+	}
+	err = shared_rw(sp, producer, reqs, XNVME_SPEC_OPC_READ, sp->qd, rbuf,
+			lba_nbytes);
+	if (err) {
+		goto exit;
+	}
+	if (memcmp(wbuf, rbuf, nbytes)) {
+		xnvmec_pinf("FAILED: producer: %u, data mismatch", sp->idx);
+		err = -EIO;
+		goto exit;
+	}
+
+	err = shared_rw(sp, producer, reqs, XNVME_SPEC_OPC_READ, sp->count,
+			rbuf, lba_nbytes);
+
+exit:
+	if (producer) {
+		int term = xnvme_async_term(sp->dev, producer);
+
+		err = err ? err : term;
+	}
+	xnvme_req_pool_free(reqs);
+	xnvme_buf_free(sp->dev, wbuf);
+	xnvme_buf_free(sp->dev, rbuf);
+
+	sp->err = err;
+
+	return NULL;
+}
+
+/**
+ * Let threads submit to a single context, each via its own producer, writing
+ * and reading back its LBAs, then reading 'count' LBAs, and verify that the
+ * callbacks are invoked on the thread of the producer
+ */
+static int
+test_shared(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	uint64_t count = cli->given[XNVMEC_OPT_COUNT] ? cli->args.count : 10000;
+	uint32_t qd = cli->given[XNVMEC_OPT_QDEPTH] ? cli->args.qdepth : 16;
+	struct shared_producer sps[XNVME_TESTS_SHARED_NTHREADS] = { 0 };
+	struct xnvme_async_ctx *ctx = NULL;
+	uint32_t nstarted = 0;
+	int err;
+
+	xnvmec_pinf("count: %zu, qd: %u, nthreads: %d", count, qd,
+		    XNVME_TESTS_SHARED_NTHREADS);
+
+	err = xnvme_async_init(dev, &ctx, qd * 2, XNVME_ASYNC_SHARED);
+	if (err) {
+		xnvmec_perr("xnvme_async_init()", err);
+		return err;
+	}
+
+	for (uint32_t i = 0; i < XNVME_TESTS_SHARED_NTHREADS; ++i) {
+		struct shared_producer *sp = &sps[i];
+
+		sp->dev = dev;
+		sp->ctx = ctx;
+		sp->idx = i;
+		sp->qd = qd;
+		sp->count = count;
+
+		err = -pthread_create(&sp->thread, NULL, shared_producer_run, sp);
+		if (err) {
+			xnvmec_perr("pthread_create()", err);
+			break;
+		}
+		nstarted += 1;
+	}
+
+	for (uint32_t i = 0; i < nstarted; ++i) {
+		struct shared_producer *sp = &sps[i];
+
+		pthread_join(sp->thread, NULL);
+
+		xnvmec_pinf("producer: %u, err: %d, nerrs: %zu, nforeign: %zu",
+			    i, sp->err, sp->nerrs, sp->nforeign);
+		if (sp->err || sp->nerrs || sp->nforeign) {
+			err = err ? err : -EIO;
+		}
+	}
+
+	{
+		int term = xnvme_async_term(dev, ctx);
+
+		if (term) {
+			xnvmec_perr("xnvme_async_term()", term);
+			err = err ? err : term;
+		}
+	}
+
+	return err;
+}
+
+struct ordered_run {
+	struct xnvme_req_pool *reqs;
+	uint64_t *seqs;			///< Sequence number of each request
+	uint64_t next;			///< Sequence number expected next
+	uint64_t nmisordered;
+	uint64_t nerrs;
+};
+
+static void
+ordered_complete(struct ordered_run *run, struct xnvme_req *req)
+{
+	if (xnvme_req_cpl_status(req)) {
+		xnvme_req_pr(req, XNVME_PR_DEF);
+		run->nerrs += 1;
+	}
+	if (run->seqs[req - run->reqs->elm] != run->next) {
+		run->nmisordered += 1;
+	}
+	run->next += 1;
+
+	SLIST_INSERT_HEAD(&run->reqs->head, req, link);
+}
+
+static void
+cb_ordered(struct xnvme_req *req, void *cb_arg)
+{
+	ordered_complete(cb_arg, req);
+}
+
+/**
+ * Read 'count' LBAs on a context allocated with XNVME_ASYNC_ORDERED, first by
+ * poking, then by reaping, and verify that completions are delivered in the
+ * order of submission; give the device e.g. '?inject=delay,p=0.5,usec=500' to
+ * have commands complete out of order
+ */
+static int
+test_ordered(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	uint32_t nsid = xnvme_dev_get_nsid(dev);
+	uint64_t count = cli->given[XNVMEC_OPT_COUNT] ? cli->args.count : 1000;
+	uint32_t qd = cli->given[XNVMEC_OPT_QDEPTH] ? cli->args.qdepth : 16;
+	uint64_t nlbas = geo->tbytes / geo->lba_nbytes;
+	struct xnvme_async_ctx *ctx = NULL;
+	struct xnvme_req **out = NULL;
+	struct ordered_run run = { 0 };
+	char *buf = NULL;
+	int err;
+
+	xnvmec_pinf("count: %zu, qd: %u", count, qd);
+
+	run.seqs = calloc(qd, sizeof(*run.seqs));
+	out = calloc(qd, sizeof(*out));
+	if (!(run.seqs && out)) {
+		err = -ENOMEM;
+		xnvmec_perr("calloc()", err);
+		goto exit;
+	}
+	buf = xnvme_buf_alloc(dev, geo->lba_nbytes, NULL);
+	if (!buf) {
+		err = -errno;
+		xnvmec_perr("xnvme_buf_alloc()", err);
+		goto exit;
+	}
+	err = xnvme_async_init(dev, &ctx, qd, XNVME_ASYNC_ORDERED);
+	if (err) {
+		xnvmec_perr("xnvme_async_init()", err);
+		goto exit;
+	}
+	err = xnvme_req_pool_alloc(&run.reqs, qd);
+	if (err) {
+		xnvmec_perr("xnvme_req_pool_alloc()", err);
+		goto exit;
+	}
+	err = xnvme_req_pool_init(run.reqs, ctx, cb_ordered, &run);
+	if (err) {
+		xnvmec_perr("xnvme_req_pool_init()", err);
+		goto exit;
+	}
+
+	for (int reap = 0; reap < 2; ++reap) {
+		uint64_t nsubmitted = 0;
+
+		run.next = 0;
+
+		while (run.next < count) {
+			struct xnvme_req *req = SLIST_FIRST(&run.reqs->head);
+
+			if (req && (nsubmitted < count)) {
+				SLIST_REMOVE_HEAD(&run.reqs->head, link);
+
+				run.seqs[req - run.reqs->elm] = nsubmitted;
+				err = xnvme_cmd_read(dev, nsid, nsubmitted % nlbas,
+						     0, buf, NULL, XNVME_CMD_ASYNC,
+						     req);
+				if (!err) {
+					++nsubmitted;
+					continue;
+				}
+				SLIST_INSERT_HEAD(&run.reqs->head, req, link);
+				if ((err != -EBUSY) && (err != -EAGAIN)) {
+					xnvmec_perr("xnvme_cmd_read()", err);
+					goto exit;
+				}
+			}
+
+			if (!reap) {
+				err = xnvme_async_poke(dev, ctx, 0);
+				if (err < 0) {
+					xnvmec_perr("xnvme_async_poke()", err);
+					goto exit;
+				}
+				continue;
+			}
+
+			err = xnvme_async_reap(dev, ctx, out, qd);
+			if (err == -ENOSYS) {
+				xnvmec_pinf("skipping reap, not supported");
+				err = xnvme_async_wait(dev, ctx);
+				break;
+			}
+			if (err < 0) {
+				xnvmec_perr("xnvme_async_reap()", err);
+				goto exit;
+			}
+			for (int i = 0; i < err; ++i) {
+				ordered_complete(&run, out[i]);
+			}
+		}
+		err = err < 0 ? err : 0;
+
+		xnvmec_pinf("%s: nsubmitted: %zu, nmisordered: %zu, nerrs: %zu",
+			    reap ? "reap" : "poke", nsubmitted, run.nmisordered,
+			    run.nerrs);
+		if (err || run.nmisordered || run.nerrs) {
+			err = err ? err : -EIO;
+			goto exit;
+		}
+	}
+
+exit:
+	if (ctx) {
+		xnvme_async_term(dev, ctx);
+	}
+	xnvme_req_pool_free(run.reqs);
+	xnvme_buf_free(dev, buf);
+	free(run.seqs);
+	free(out);
+
+	return err;
+}
+
+struct dispatch_run {
+	pthread_t main;			///< The thread submitting and poking
+	_Atomic uint32_t *free;		///< Request 'i' may be submitted
+	_Atomic uint64_t ncompleted;
+	_Atomic uint64_t nerrs;
+	_Atomic uint64_t nmain;		///< Callbacks invoked on 'main'
+	_Atomic uint64_t csum;
+	uint32_t lba_nbytes;
+};
+
+struct dispatch_arg {
+	struct dispatch_run *run;
+	uint32_t idx;
+	char *buf;
+};
+
+/**
+ * Completion of a read, doing work on the data, as would e.g. checksum
+ * verification, the request is handed back via 'free', as the callback runs
+ * on a thread of the dispatcher
+ */
+static void
+cb_dispatch(struct xnvme_req *req, void *cb_arg)
+{
+	struct dispatch_arg *arg = cb_arg;
+	struct dispatch_run *run = arg->run;
+	uint64_t csum = 0;
+
+	if (xnvme_req_cpl_status(req)) {
+		xnvme_req_pr(req, XNVME_PR_DEF);
+		atomic_fetch_add(&run->nerrs, 1);
+	}
+	if (pthread_equal(pthread_self(), run->main)) {
+		atomic_fetch_add(&run->nmain, 1);
+	}
+	for (uint32_t i = 0; i < run->lba_nbytes; ++i) {
+		csum = csum * 31 + (uint8_t)arg->buf[i];
+	}
+	atomic_fetch_add(&run->csum, csum);
+	atomic_fetch_add(&run->ncompleted, 1);
+
+	atomic_store_explicit(&run->free[arg->idx], 1, memory_order_release);
+}
+
+/**
+ * Read 'count' LBAs on a context with a completion dispatcher, and verify that
+ * every callback is invoked, by the callback threads, and that waiting on the
+ * context waits for the callbacks
+ */
+static int
+test_dispatch(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	uint32_t nsid = xnvme_dev_get_nsid(dev);
+	uint64_t count = cli->given[XNVMEC_OPT_COUNT] ? cli->args.count : 10000;
+	uint32_t qd = cli->given[XNVMEC_OPT_QDEPTH] ? cli->args.qdepth : 16;
+	uint64_t nlbas = geo->tbytes / geo->lba_nbytes;
+	struct xnvme_dispatcher_opts opts = { .nthreads = 2 };
+	struct xnvme_dispatcher_stats stats = { 0 };
+	struct xnvme_dispatcher *dispatcher = NULL;
+	struct xnvme_async_ctx *ctx = NULL;
+	struct xnvme_req *reqs = NULL;
+	struct dispatch_arg *args = NULL;
+	struct dispatch_run run = { 0 };
+	char *bufs = NULL;
+	int err;
+
+	xnvmec_pinf("count: %zu, qd: %u, nthreads: %u", count, qd, opts.nthreads);
+
+	run.main = pthread_self();
+	run.lba_nbytes = geo->lba_nbytes;
+	run.free = calloc(qd, sizeof(*run.free));
+	reqs = calloc(qd, sizeof(*reqs));
+	args = calloc(qd, sizeof(*args));
+	if (!(run.free && reqs && args)) {
+		err = -ENOMEM;
+		xnvmec_perr("calloc()", err);
+		goto exit;
+	}
+	bufs = xnvme_buf_alloc(dev, (size_t)qd * geo->lba_nbytes, NULL);
+	if (!bufs) {
+		err = -errno;
+		xnvmec_perr("xnvme_buf_alloc()", err);
+		goto exit;
+	}
+	err = xnvme_async_init(dev, &ctx, qd, 0);
+	if (err) {
+		xnvmec_perr("xnvme_async_init()", err);
+		goto exit;
+	}
+	err = xnvme_dispatcher_create(&dispatcher, &opts);
+	if (err) {
+		xnvmec_perr("xnvme_dispatcher_create()", err);
+		goto exit;
+	}
+	err = xnvme_async_set_dispatcher(ctx, dispatcher, 8);
+	if (err) {
+		xnvmec_perr("xnvme_async_set_dispatcher()", err);
+		goto exit;
+	}
+
+	for (uint32_t i = 0; i < qd; ++i) {
+		args[i].run = &run;
+		args[i].idx = i;
+		args[i].buf = bufs + (size_t)i * geo->lba_nbytes;
+		atomic_init(&run.free[i], 1);
+	}
+
+	for (uint64_t nsubmitted = 0; nsubmitted < count;) {
+		uint32_t idx = nsubmitted % qd;
+		struct xnvme_req *req = &reqs[idx];
+
+		if (!atomic_load_explicit(&run.free[idx], memory_order_acquire)) {
+			err = xnvme_async_poke(dev, ctx, 0);
+			if (err < 0) {
+				xnvmec_perr("xnvme_async_poke()", err);
+				goto exit;
+			}
+			continue;
+		}
+
+		xnvme_req_clear(req);
+		req->async.ctx = ctx;
+		req->async.cb = cb_dispatch;
+		req->async.cb_arg = &args[idx];
+		atomic_store(&run.free[idx], 0);
+
+		err = xnvme_cmd_read(dev, nsid, nsubmitted % nlbas, 0,
+				     args[idx].buf, NULL, XNVME_CMD_ASYNC, req);
+		switch (err) {
+		case 0:
+			++nsubmitted;
+			continue;
+
+		case -EBUSY:
+		case -EAGAIN:
+			atomic_store(&run.free[idx], 1);
+			err = xnvme_async_poke(dev, ctx, 0);
+			if (err >= 0) {
+				continue;
+			}
+			xnvmec_perr("xnvme_async_poke()", err);
+			goto exit;
+
+		default:
+			xnvmec_perr("xnvme_cmd_read()", err);
+			goto exit;
+		}
+	}
+
+	err = xnvme_async_wait(dev, ctx);
+	if (err < 0) {
+		xnvmec_perr("xnvme_async_wait()", err);
+		goto exit;
+	}
+	err = 0;
+
+	xnvme_dispatcher_get_stats(dispatcher, &stats);
+	xnvmec_pinf("ncompleted: %zu, nerrs: %zu, nmain: %zu, nbatches: %zu, "
+		    "ninline: %zu, delay: %.1f usec/cpl", run.ncompleted,
+		    run.nerrs, run.nmain, stats.nbatches, stats.ninline,
+		    stats.ndispatched ?
+		    stats.delay_nsec / 1000.0 / stats.ndispatched : 0.0);
+
+	// Every callback is invoked by the time the wait returns, and, unless
+	// the queue filled, by the callback threads
+	if ((run.ncompleted != count) || run.nerrs ||
+	    (stats.ndispatched != count) || (!stats.ninline && run.nmain)) {
+		err = -EIO;
+	}
+
+exit:
+	if (ctx) {
+		xnvme_async_term(dev, ctx);
+	}
+	xnvme_dispatcher_destroy(dispatcher);
+	xnvme_buf_free(dev, bufs);
+	free(run.free);
+	free(reqs);
+	free(args);
+
+	return err;
+}
+
+struct mirror_run {
+	uint64_t ncompleted;
+	uint64_t nerrs;
+};
+
+static void
+cb_mirror(struct xnvme_req *req, void *cb_arg)
+{
+	struct mirror_run *run = cb_arg;
+
+	run->ncompleted += 1;
+	run->nerrs += xnvme_req_cpl_status(req) ? 1 : 0;
+}
+
+/**
+ * Open the mirror given by 'uri', with the given options added
+ */
+static struct xnvme_dev *
+mirror_open(const char *uri, const char *opts)
+{
+	char buf[XNVME_IDENT_URI_LEN] = { 0 };
+	struct xnvme_dev *dev;
+
+	snprintf(buf, sizeof(buf), "%s%c%s", uri, strchr(uri, '?') ? '&' : '?',
+		 opts);
+	xnvmec_pinf("uri: '%s'", buf);
+
+	dev = xnvme_dev_open(buf);
+	if (!dev) {
+		xnvmec_perr("xnvme_dev_open()", -errno);
+	}
+
+	return dev;
+}
+
+/**
+ * Write, or read, LBA [0,count[ one LBA per command, 'qd' commands at a time;
+ * an LBA is written with its address, and a read verifies that it holds it,
+ * unless the read failed. The number of failed commands is returned in 'nerrs'
+ */
+static int
+mirror_io(struct xnvme_dev *dev, struct xnvme_async_ctx *ctx, uint8_t opc,
+	  uint64_t count, uint32_t qd, char *bufs, uint64_t *nerrs)
+{
+	const struct xnvme_geo *geo = xnvme_dev_get_geo(dev);
+	uint32_t nsid = xnvme_dev_get_nsid(dev);
+	uint64_t nwords = geo->lba_nbytes / sizeof(uint64_t);
+	struct mirror_run run = { 0 };
+	struct xnvme_req *reqs;
+	int err = 0;
+
+	reqs = calloc(qd, sizeof(*reqs));
+	if (!reqs) {
+		err = -errno;
+		xnvmec_perr("calloc()", err);
+		return err;
+	}
+
+	for (uint64_t slba = 0; slba < count; slba += qd) {
+		uint32_t nreqs = XNVME_MIN(qd, count - slba);
+
+		for (uint32_t i = 0; i < nreqs; ++i) {
+			uint64_t *words = (void *)(bufs + i * geo->lba_nbytes);
+			struct xnvme_req *req = &reqs[i];
+
+			for (uint64_t w = 0; w < nwords; ++w) {
+				words[w] = (opc == XNVME_SPEC_OPC_WRITE) ?
+					   slba + i : 0;
+			}
+
+			xnvme_req_clear(req);
+			req->async.ctx = ctx;
+			req->async.cb = cb_mirror;
+			req->async.cb_arg = &run;
+
+			if (opc == XNVME_SPEC_OPC_WRITE) {
+				err = xnvme_cmd_write(dev, nsid, slba + i, 0,
+						      words, NULL,
+						      XNVME_CMD_ASYNC, req);
+			} else {
+				err = xnvme_cmd_read(dev, nsid, slba + i, 0,
+						     words, NULL,
+						     XNVME_CMD_ASYNC, req);
+			}
+			if (err) {
+				xnvmec_perr("xnvme_cmd_{read,write}()", err);
+				xnvme_async_wait(dev, ctx);
+				goto exit;
+			}
+		}
+
+		err = xnvme_async_wait(dev, ctx);
+		if (err < 0) {
+			xnvmec_perr("xnvme_async_wait()", err);
+			goto exit;
+		}
+		err = 0;
+
+		for (uint32_t i = 0; i < nreqs; ++i) {
+			const uint64_t *words = (void *)(bufs + i * geo->lba_nbytes);
+
+			if ((opc != XNVME_SPEC_OPC_READ) || \
+			    xnvme_req_cpl_status(&reqs[i])) {
+				continue;
+			}
+			for (uint64_t w = 0; w < nwords; ++w) {
+				if (words[w] != slba + i) {
+					xnvmec_pinf("FAILED: lba: %zu, holds: %zu",
+						    slba + i, words[w]);
+					err = -EIO;
+					goto exit;
+				}
+			}
+		}
+	}
+
+	if (run.ncompleted != count) {
+		xnvmec_pinf("FAILED: ncompleted: %zu != %zu", run.ncompleted,
+			    count);
+		err = -EIO;
+		goto exit;
+	}
+	*nerrs = run.nerrs;
+
+exit:
+	free(reqs);
+
+	return err;
+}
+
+/**
+ * A scenario of 'mirror': the options added to the uri of the mirror, and
+ * whether the writes, and reads, are expected to fail; the LBAs are only read
+ * back when all members hold what was written. Faults on reads are injected on
+ * all members, as which member a read goes to depends on the queue-depth
+ */
+struct mirror_scenario {
+	const char *descr;
+	const char *opts;
+	int write_fails;
+	int read;
+	int read_fails;
+	int hedged;			///< Reads are expected to be hedged
+};
+
+static struct mirror_scenario g_mirror_scenarios[] = {
+	{
+		"Writes complete once 'quorum' members have completed them",
+		"quorum=1&inject.1=error,opc=0x01", 0, 0, 0, 0,
+	},
+	{
+		"Writes fail once 'quorum' is no longer possible",
+		"inject.1=error,opc=0x01", 1, 0, 0, 0,
+	},
+	{
+		"Reads failing on a member are retried on another",
+		"inject.0=error,opc=0x02,slba=0-1023&"
+		"inject.1=error,opc=0x02,slba=1024-0xffffffff", 0, 1, 0, 0,
+	},
+	{
+		"Reads fail once they have failed on all members",
+		"inject.0=error,opc=0x02&inject.1=error,opc=0x02", 0, 1, 1, 0,
+	},
+	{
+		"Reads slow on a member are hedged to another",
+		"hedge=90&inject.0=delay,opc=0x02,p=3,usec=2000&"
+		"inject.1=delay,opc=0x02,p=3,usec=2000", 0, 1, 0, 1,
+	},
+};
+
+/**
+ * Verify the completion of commands on a mirror of two members, e.g.
+ * 'mirror:emu:ram0,emu:ram1', with errors and delays injected on one, or
+ * both, of its members, see g_mirror_scenarios
+ */
+static int
+test_mirror(struct xnvmec *cli)
+{
+	uint64_t count = cli->given[XNVMEC_OPT_COUNT] ? cli->args.count : 2048;
+	uint32_t qd = cli->given[XNVMEC_OPT_QDEPTH] ? cli->args.qdepth : 16;
+	int err = 0;
+
+	xnvmec_pinf("count: %zu, qd: %u", count, qd);
+
+	if (strncmp(cli->args.uri, "mirror:", strlen("mirror:"))) {
+		xnvmec_perr("not a mirror", -EINVAL);
+		return -EINVAL;
+	}
+	if (!count || (count > cli->args.geo->nsect)) {
+		xnvmec_perr("invalid count", -EINVAL);
+		return -EINVAL;
+	}
+
+	for (size_t s = 0; !err && (s < sizeof g_mirror_scenarios /
+				    sizeof(*g_mirror_scenarios)); ++s) {
+		struct mirror_scenario *sc = &g_mirror_scenarios[s];
+		struct xnvme_async_ctx *ctx = NULL;
+		struct xnvme_dev *dev = NULL;
+		uint64_t nwerrs = 0, nrerrs = 0;
+		char *bufs = NULL;
+
+		xnvmec_pinf("%s", sc->descr);
+
+		dev = mirror_open(cli->args.uri, sc->opts);
+		if (!dev) {
+			err = errno ? -errno : -EIO;
+			break;
+		}
+		bufs = xnvme_buf_alloc(dev, (size_t)qd *
+				       xnvme_dev_get_geo(dev)->lba_nbytes,
+				       NULL);
+		if (!bufs) {
+			err = -errno;
+			xnvmec_perr("xnvme_buf_alloc()", err);
+			goto next;
+		}
+		err = xnvme_async_init(dev, &ctx, qd, 0);
+		if (err) {
+			xnvmec_perr("xnvme_async_init()", err);
+			goto next;
+		}
+
+		err = mirror_io(dev, ctx, XNVME_SPEC_OPC_WRITE, count, qd, bufs,
+				&nwerrs);
+		if (err) {
+			goto next;
+		}
+		if (sc->read) {
+			err = mirror_io(dev, ctx, XNVME_SPEC_OPC_READ, count, qd,
+					bufs, &nrerrs);
+			if (err) {
+				goto next;
+			}
+		}
+
+		xnvmec_pinf("nwerrs: %zu, nrerrs: %zu, nhedged: %u", nwerrs,
+			    nrerrs, xnvme_async_get_nhedged(ctx));
+		if ((nwerrs != (sc->write_fails ? count : 0)) || \
+		    (nrerrs != (sc->read_fails ? count : 0)) || \
+		    (!xnvme_async_get_nhedged(ctx) != !sc->hedged)) {
+			xnvmec_pinf("FAILED: unexpected completions");
+			err = -EIO;
+		}
+
+next:
+		if (ctx) {
+			xnvme_async_term(dev, ctx);
+		}
+		xnvme_buf_free(dev, bufs);
+		xnvme_dev_close(dev);
+	}
+
+	return err;
+}
+
 static struct xnvmec_sub g_subs[] = {
 	{
 		"init_term",
@@ -110,6 +1975,126 @@ static struct xnvmec_sub g_subs[] = {
 			{XNVMEC_OPT_CLEAR, XNVMEC_LFLG},
 		}
 	},
+	{
+		"chain",
+		"Submit a chain of write, flush, write",
+		"Submit a chain of write, flush, write and verify the writes",
+		test_chain, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_NSID, XNVMEC_LOPT},
+			{XNVMEC_OPT_SLBA, XNVMEC_LOPT},
+		}
+	},
+	{
+		"chain_full",
+		"Submit a chain on a context with room for a single command",
+		"Submit a chain on a context with room for a single command, and "
+		"verify that a rejected chain leaves nothing behind",
+		test_chain_full, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_NSID, XNVMEC_LOPT},
+			{XNVMEC_OPT_SLBA, XNVMEC_LOPT},
+		}
+	},
+	{
+		"qos",
+		"Read 'count' LBAs with a read-iops 'limit'",
+		"Read 'count' LBAs with a read-iops 'limit' and verify it",
+		test_qos, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_COUNT, XNVMEC_LOPT},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LOPT},
+			{XNVMEC_OPT_LIMIT, XNVMEC_LOPT},
+		}
+	},
+	{
+		"group",
+		"Reap the reads on 'count' contexts via a group",
+		"Reap the reads on every other of 'count' contexts via a group",
+		test_group, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_COUNT, XNVMEC_LOPT},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LOPT},
+		}
+	},
+	{
+		"bufsel",
+		"Read 'count' LBAs into backend-selected buffers",
+		"Write 'count' LBAs, read them into backend-selected buffers and "
+		"verify them",
+		test_bufsel, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_COUNT, XNVMEC_LOPT},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LOPT},
+		}
+	},
+	{
+		"reap",
+		"Read 'count' LBAs, reaping completions in batches",
+		"Read 'count' LBAs, reaping completions in batches, and verify "
+		"that callbacks are not invoked",
+		test_reap, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_COUNT, XNVMEC_LOPT},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LOPT},
+		}
+	},
+	{
+		"tmpl",
+		"Read 'count' LBAs via a command template",
+		"Read 'count' LBAs via xnvme_cmd_read() and via a command template, "
+		"and print the time and instructions per read",
+		test_tmpl, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_COUNT, XNVMEC_LOPT},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LOPT},
+		}
+	},
+	{
+		"shared",
+		"Submit from multiple threads to a shared context",
+		"Write, read back and read 'count' LBAs from multiple threads, each "
+		"via a producer of a single shared context",
+		test_shared, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_COUNT, XNVMEC_LOPT},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LOPT},
+		}
+	},
+	{
+		"ordered",
+		"Read 'count' LBAs on an ordered context",
+		"Read 'count' LBAs on an ordered context, and verify that "
+		"completions are delivered in the order of submission",
+		test_ordered, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_COUNT, XNVMEC_LOPT},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LOPT},
+		}
+	},
+	{
+		"dispatch",
+		"Read 'count' LBAs with callbacks on a dispatcher",
+		"Read 'count' LBAs on a context with a completion dispatcher, and "
+		"verify that callbacks are invoked by its callback threads",
+		test_dispatch, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_COUNT, XNVMEC_LOPT},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LOPT},
+		}
+	},
+	{
+		"mirror",
+		"Inject errors and delays on the members of a mirror",
+		"Inject errors and delays on the members of a mirror, and verify "
+		"the completion of writes with a quorum, failover and hedging "
+		"of reads",
+		test_mirror, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_COUNT, XNVMEC_LOPT},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LOPT},
+		}
+	},
 };
 
 static struct xnvmec g_cli = {
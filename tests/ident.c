@@ -147,6 +147,17 @@ static struct test_input input[] = {
 		SUCCESS
 	},
 
+	{
+		"stripe:/dev/nvme0n1,/dev/nvme1n1",
+		EXPECTED("stripe", "/dev/nvme0n1,/dev/nvme1n1", ""),
+		SUCCESS
+	},
+	{
+		"stripe:emu:ram0,emu:ram1?chunk=64",
+		EXPECTED("stripe", "emu:ram0,emu:ram1", "?chunk=64"),
+		SUCCESS
+	},
+
 	// Should be one of: fioc, lioc, liou
 	{
 		"/dev/nvme2",
@@ -1,7 +1,9 @@
 // Copyright (C) Simon A. F. Lund <simon.lund@samsung.com>
 // SPDX-License-Identifier: Apache-2.0
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
+#include <unistd.h>
 #include <liblblk.h>
 #include <libxnvmec.h>
 
@@ -70,6 +72,63 @@ boilerplate(struct xnvmec *cli, uint8_t **wbuf, uint8_t **rbuf,
 	return 0;
 }
 
+static void
+cb_scopy(struct xnvme_req *XNVME_UNUSED(req), void *cb_arg)
+{
+	int *ncompleted = cb_arg;
+
+	*ncompleted += 1;
+}
+
+/**
+ * Submit the copy asynchronously and wait for its one completion
+ */
+static int
+scopy_async(struct xnvmec *cli, uint64_t sdlba,
+	    struct lblk_source_range *sranges, uint8_t nr,
+	    enum lblk_scopy_fmt copy_fmt, struct xnvme_req *req)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	struct xnvme_async_ctx *ctx = NULL;
+	int ncompleted = 0;
+	int err;
+
+	err = xnvme_async_init(dev, &ctx, cli->args.qdepth, 0);
+	if (err) {
+		xnvmec_perr("xnvme_async_init()", err);
+		return err;
+	}
+
+	req->async.ctx = ctx;
+	req->async.cb = cb_scopy;
+	req->async.cb_arg = &ncompleted;
+
+	err = lblk_cmd_scopy(dev, xnvme_dev_get_nsid(dev), sdlba,
+			     sranges->entry, nr, copy_fmt, XNVME_CMD_ASYNC,
+			     req);
+	if (err) {
+		xnvmec_perr("lblk_cmd_scopy()", err);
+		goto exit;
+	}
+
+	err = xnvme_async_wait(dev, ctx);
+	if (err < 0) {
+		xnvmec_perr("xnvme_async_wait()", err);
+		goto exit;
+	}
+	err = 0;
+
+	if (ncompleted != 1) {
+		xnvmec_pinf("FAILED: ncompleted: %d != 1", ncompleted);
+		err = -EIO;
+	}
+
+exit:
+	xnvme_async_term(dev, ctx);
+
+	return err;
+}
+
 /**
  * 0) Fill wbuf with '!'
  * 1) Write the entire LBA range [slba, elba] using wbuf
@@ -265,8 +324,13 @@ test_scopy(struct xnvmec *cli)
 		xnvmec_pinf("scopy sranges to sdlba: 0x%016lx", sdlba);
 		lblk_source_range_pr(sranges, nr, XNVME_PR_DEF);
 
-		err = lblk_cmd_scopy(dev, nsid, sdlba, sranges->entry, nr,
-				     copy_fmt, XNVME_CMD_SYNC, &req);
+		if (cli->given[XNVMEC_OPT_QDEPTH]) {
+			err = scopy_async(cli, sdlba, sranges, nr, copy_fmt,
+					  &req);
+		} else {
+			err = lblk_cmd_scopy(dev, nsid, sdlba, sranges->entry,
+					     nr, copy_fmt, XNVME_CMD_SYNC, &req);
+		}
 		if (err || xnvme_req_cpl_status(&req)) {
 			xnvmec_perr("xnvme_cmd_scopy()", err);
 			xnvme_req_pr(&req, XNVME_PR_DEF);
@@ -301,10 +365,700 @@ exit:
 	return err;
 }
 
+/**
+ * Transfer 'naddr' LBAs starting at 'slba', in commands of at most 'mdts_naddr'
+ */
+static int
+_scopy_overlap_io(struct xnvmec *cli, uint32_t nsid, uint64_t slba,
+		  uint64_t naddr, uint64_t mdts_naddr, uint8_t *buf, int write)
+{
+	const struct xnvme_geo *geo = cli->args.geo;
+
+	for (uint64_t ofz = 0; ofz < naddr; ofz += mdts_naddr) {
+		uint16_t nlb = XNVME_MIN(naddr - ofz, mdts_naddr) - 1;
+		uint8_t *payload = buf + ofz * geo->lba_nbytes;
+		struct xnvme_req req = { 0 };
+		int err;
+
+		err = write ? xnvme_cmd_write(cli->args.dev, nsid, slba + ofz,
+					      nlb, payload, NULL,
+					      XNVME_CMD_SYNC, &req) :
+		      xnvme_cmd_read(cli->args.dev, nsid, slba + ofz, nlb,
+				     payload, NULL, XNVME_CMD_SYNC, &req);
+		if (err || xnvme_req_cpl_status(&req)) {
+			xnvmec_perr(write ? "xnvme_cmd_write()" :
+				    "xnvme_cmd_read()", err);
+			xnvme_req_pr(&req, XNVME_PR_DEF);
+			return err ? err : -EIO;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Copy, in four ranges, an area of LBAs onto itself shifted towards higher and
+ * then towards lower LBAs, verifying that the result is that of memmove()
+ *
+ * This verifies the emulation of the command, the outcome of an overlapping
+ * copy is up to the controller when it supports the command
+ */
+static int
+test_scopy_overlap(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct lblk_idfy_ctrlr *ctrlr = (void *)xnvme_dev_get_ctrlr(dev);
+	const struct xnvme_geo *geo = cli->args.geo;
+	uint32_t nsid;
+	uint64_t rng_slba, rng_elba, mdts_naddr, naddr, shift;
+	size_t buf_nbytes, area_nbytes;
+	uint8_t *wbuf = NULL, *rbuf = NULL, *area = NULL, *expected = NULL;
+	struct lblk_source_range *sranges = NULL;
+	const uint8_t nr = 3;
+	int err;
+
+	if (ctrlr && ctrlr->oncs.copy) {
+		xnvmec_pinf("skipping -- the controller supports Simple-Copy");
+		return 0;
+	}
+
+	err = boilerplate(cli, &wbuf, &rbuf, &buf_nbytes, &mdts_naddr, &nsid,
+			  &rng_slba, &rng_elba);
+	if (err) {
+		xnvmec_perr("boilerplate()", err);
+		goto exit;
+	}
+
+	// Several chunks, shifted by a distance not aligned to a chunk
+	naddr = (nr + 1) * mdts_naddr;
+	shift = mdts_naddr + mdts_naddr / 2 + 1;
+	area_nbytes = (naddr + shift) * geo->lba_nbytes;
+
+	area = xnvme_buf_alloc(dev, area_nbytes, NULL);
+	expected = malloc(area_nbytes);
+	sranges = xnvme_buf_alloc(dev, sizeof(*sranges), NULL);
+	if (!(area && expected && sranges)) {
+		err = -ENOMEM;
+		xnvmec_perr("alloc()", err);
+		goto exit;
+	}
+
+	for (int up = 1; up >= 0; --up) {
+		uint64_t slba = rng_slba + (up ? 0 : shift);
+		uint64_t sdlba = rng_slba + (up ? shift : 0);
+		struct xnvme_req req = { 0 };
+
+		memset(sranges, 0, sizeof(*sranges));
+		for (uint8_t i = 0; i <= nr; ++i) {
+			sranges->entry[i].slba = slba + i * mdts_naddr;
+			sranges->entry[i].nlb = mdts_naddr - 1;
+		}
+
+		xnvmec_pinf("Writing payload to [0x%016lx, 0x%016lx]", rng_slba,
+			    rng_slba + naddr + shift - 1);
+		xnvmec_buf_fill(expected, area_nbytes, "anum");
+		memcpy(area, expected, area_nbytes);
+		err = _scopy_overlap_io(cli, nsid, rng_slba, naddr + shift,
+					mdts_naddr, area, 1);
+		if (err) {
+			goto exit;
+		}
+		memmove(expected + (sdlba - rng_slba) * geo->lba_nbytes,
+			expected + (slba - rng_slba) * geo->lba_nbytes,
+			naddr * geo->lba_nbytes);
+
+		xnvmec_pinf("scopy slba: 0x%016lx to sdlba: 0x%016lx", slba,
+			    sdlba);
+		lblk_source_range_pr(sranges, nr, XNVME_PR_DEF);
+
+		if (cli->given[XNVMEC_OPT_QDEPTH]) {
+			err = scopy_async(cli, sdlba, sranges, nr,
+					  LBLK_SCOPY_FMT_ZERO, &req);
+		} else {
+			err = lblk_cmd_scopy(dev, nsid, sdlba, sranges->entry,
+					     nr, LBLK_SCOPY_FMT_ZERO,
+					     XNVME_CMD_SYNC, &req);
+		}
+		if (err || xnvme_req_cpl_status(&req)) {
+			xnvmec_perr("lblk_cmd_scopy()", err);
+			xnvme_req_pr(&req, XNVME_PR_DEF);
+			err = err ? err : -EIO;
+			goto exit;
+		}
+
+		memset(area, 0, area_nbytes);
+		err = _scopy_overlap_io(cli, nsid, rng_slba, naddr + shift,
+					mdts_naddr, area, 0);
+		if (err) {
+			goto exit;
+		}
+
+		xnvmec_pinf("Comparing the area and the expected payload");
+		if (xnvmec_buf_diff(expected, area, area_nbytes)) {
+			xnvmec_buf_diff_pr(expected, area, area_nbytes,
+					   XNVME_PR_DEF);
+			err = -EIO;
+			goto exit;
+		}
+	}
+
+exit:
+	xnvme_buf_free(dev, wbuf);
+	xnvme_buf_free(dev, rbuf);
+	xnvme_buf_free(dev, area);
+	xnvme_buf_free(dev, sranges);
+	free(expected);
+
+	return err;
+}
+
+/**
+ * 0) Fill wbuf with '!'
+ * 1) Write the first mdts_naddr LBAs of [slba, elba] using wbuf
+ * 2) Write Zeroes to the same LBAs
+ * 3) Read the LBAs using rbuf
+ * 4) Verify that the content of rbuf is all zeroes
+ */
+static int
+test_write_zeroes(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	uint32_t nsid;
+	uint64_t rng_slba, rng_elba, mdts_naddr;
+	size_t buf_nbytes;
+	uint8_t *wbuf = NULL, *rbuf = NULL;
+	struct xnvme_req req = { 0 };
+	int err;
+
+	err = boilerplate(cli, &wbuf, &rbuf, &buf_nbytes, &mdts_naddr, &nsid,
+			  &rng_slba, &rng_elba);
+	if (err) {
+		xnvmec_perr("boilerplate()", err);
+		goto exit;
+	}
+
+	xnvmec_pinf("Writing '!' to LBA range [slba,slba+mdts_naddr]");
+	memset(wbuf, '!', buf_nbytes);
+	err = xnvme_cmd_write(dev, nsid, rng_slba, mdts_naddr - 1, wbuf, NULL,
+			      XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		xnvmec_perr("xnvme_cmd_write()", err);
+		xnvme_req_pr(&req, XNVME_PR_DEF);
+		err = err ? err : -EIO;
+		goto exit;
+	}
+
+	xnvmec_pinf("Write Zeroes to LBA range [slba,slba+mdts_naddr]");
+	err = lblk_cmd_write_zeroes(dev, nsid, rng_slba, mdts_naddr - 1, 0,
+				    XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		xnvmec_perr("lblk_cmd_write_zeroes()", err);
+		xnvme_req_pr(&req, XNVME_PR_DEF);
+		err = err ? err : -EIO;
+		goto exit;
+	}
+
+	memset(rbuf, '!', buf_nbytes);
+	err = xnvme_cmd_read(dev, nsid, rng_slba, mdts_naddr - 1, rbuf, NULL,
+			     XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		xnvmec_perr("xnvme_cmd_read()", err);
+		xnvme_req_pr(&req, XNVME_PR_DEF);
+		err = err ? err : -EIO;
+		goto exit;
+	}
+
+	xnvmec_pinf("Comparing rbuf to zeroes");
+	memset(wbuf, 0, buf_nbytes);
+	if (xnvmec_buf_diff(wbuf, rbuf, buf_nbytes)) {
+		xnvmec_buf_diff_pr(wbuf, rbuf, buf_nbytes, XNVME_PR_DEF);
+		err = -EIO;
+		goto exit;
+	}
+
+exit:
+	xnvme_buf_free(dev, wbuf);
+	xnvme_buf_free(dev, rbuf);
+
+	return err;
+}
+
+/**
+ * 0) Duplicate the device handle
+ * 1) Verify that the identify data of the duplicate is that of the device
+ * 2) Write the range [slba,slba+mdts_naddr] using the device
+ * 3) Read the range using the duplicate and verify that it is what was written
+ */
+static int
+test_dup(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	struct xnvme_dev *dup = NULL;
+	uint32_t nsid;
+	uint64_t rng_slba, rng_elba, mdts_naddr;
+	size_t buf_nbytes;
+	uint8_t *wbuf = NULL, *rbuf = NULL;
+	struct xnvme_req req = { 0 };
+	int err;
+
+	err = boilerplate(cli, &wbuf, &rbuf, &buf_nbytes, &mdts_naddr, &nsid,
+			  &rng_slba, &rng_elba);
+	if (err) {
+		xnvmec_perr("boilerplate()", err);
+		goto exit;
+	}
+
+	dup = xnvme_dev_dup(dev);
+	if (!dup) {
+		err = -errno;
+		xnvmec_perr("xnvme_dev_dup()", err);
+		goto exit;
+	}
+
+	xnvmec_pinf("Comparing identify data of the duplicate");
+	if ((xnvme_dev_get_nsid(dup) != nsid) || \
+	    memcmp(xnvme_dev_get_geo(dup), xnvme_dev_get_geo(dev),
+		   sizeof(struct xnvme_geo)) || \
+	    memcmp(xnvme_dev_get_ctrlr(dup), xnvme_dev_get_ctrlr(dev),
+		   sizeof(struct xnvme_spec_idfy_ctrlr)) || \
+	    memcmp(xnvme_dev_get_ns(dup), xnvme_dev_get_ns(dev),
+		   sizeof(struct xnvme_spec_idfy_ns))) {
+		xnvmec_pinf("FAILED: identify data differs");
+		err = -EIO;
+		goto exit;
+	}
+
+	xnvmec_pinf("Writing to LBA range [slba,slba+mdts_naddr] using dev");
+	xnvmec_buf_fill(wbuf, buf_nbytes, "anum");
+	err = xnvme_cmd_write(dev, nsid, rng_slba, mdts_naddr - 1, wbuf, NULL,
+			      XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		xnvmec_perr("xnvme_cmd_write()", err);
+		xnvme_req_pr(&req, XNVME_PR_DEF);
+		err = err ? err : -EIO;
+		goto exit;
+	}
+
+	xnvmec_pinf("Reading LBA range [slba,slba+mdts_naddr] using dup");
+	memset(rbuf, 0, buf_nbytes);
+	err = xnvme_cmd_read(dup, nsid, rng_slba, mdts_naddr - 1, rbuf, NULL,
+			     XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		xnvmec_perr("xnvme_cmd_read()", err);
+		xnvme_req_pr(&req, XNVME_PR_DEF);
+		err = err ? err : -EIO;
+		goto exit;
+	}
+
+	xnvmec_pinf("Comparing wbuf and rbuf");
+	if (xnvmec_buf_diff(wbuf, rbuf, buf_nbytes)) {
+		xnvmec_buf_diff_pr(wbuf, rbuf, buf_nbytes, XNVME_PR_DEF);
+		err = -EIO;
+		goto exit;
+	}
+
+exit:
+	xnvme_dev_close(dup);
+	xnvme_buf_free(dev, wbuf);
+	xnvme_buf_free(dev, rbuf);
+
+	return err;
+}
+
+
+static int
+_mmap_write(struct xnvmec *cli, uint32_t nsid, uint64_t slba, uint64_t naddr,
+	    uint8_t *wbuf)
+{
+	struct xnvme_req req = { 0 };
+	int err;
+
+	err = xnvme_cmd_write(cli->args.dev, nsid, slba, naddr - 1, wbuf, NULL,
+			      XNVME_CMD_SYNC, &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		xnvmec_perr("xnvme_cmd_write()", err);
+		xnvme_req_pr(&req, XNVME_PR_DEF);
+		return err ? err : -EIO;
+	}
+
+	return 0;
+}
+
+static int
+test_mmap(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	const uint64_t pagesize = getpagesize();
+	uint32_t nsid;
+	uint64_t rng_slba, rng_elba, mdts_naddr, off, delta;
+	size_t buf_nbytes;
+	uint8_t *wbuf = NULL, *rbuf = NULL, *map = NULL;
+	int err;
+
+	err = boilerplate(cli, &wbuf, &rbuf, &buf_nbytes, &mdts_naddr, &nsid,
+			  &rng_slba, &rng_elba);
+	if (err) {
+		xnvmec_perr("boilerplate()", err);
+		goto exit;
+	}
+
+	off = (rng_slba * geo->lba_nbytes) & ~(pagesize - 1);
+	delta = rng_slba * geo->lba_nbytes - off;
+
+	xnvmec_pinf("Writing to LBA range [slba,slba+mdts_naddr]");
+	xnvmec_buf_fill(wbuf, buf_nbytes, "anum");
+	err = _mmap_write(cli, nsid, rng_slba, mdts_naddr, wbuf);
+	if (err) {
+		goto exit;
+	}
+
+	xnvmec_pinf("Mapping { off: %lu, len: %lu }", off, delta + buf_nbytes);
+	map = xnvme_mmap(dev, off, delta + buf_nbytes, XNVME_MADV_NORMAL);
+	if (!map) {
+		err = -errno;
+		xnvmec_perr("xnvme_mmap()", err);
+		goto exit;
+	}
+
+	xnvmec_pinf("Comparing wbuf and the mapping");
+	if (xnvmec_buf_diff(wbuf, map + delta, buf_nbytes)) {
+		xnvmec_buf_diff_pr(wbuf, map + delta, buf_nbytes, XNVME_PR_DEF);
+		err = -EIO;
+		goto exit;
+	}
+
+	xnvmec_pinf("Overwriting the range, and dropping it from the mapping");
+	xnvmec_buf_fill(wbuf, buf_nbytes, "zero");
+	err = _mmap_write(cli, nsid, rng_slba, mdts_naddr, wbuf);
+	if (err) {
+		goto exit;
+	}
+	err = xnvme_madvise(map + delta, buf_nbytes, XNVME_MADV_DONTNEED);
+	if (err) {
+		xnvmec_perr("xnvme_madvise(DONTNEED)", err);
+		goto exit;
+	}
+	err = xnvme_madvise(map, delta + buf_nbytes, XNVME_MADV_WILLNEED);
+	if (err) {
+		xnvmec_perr("xnvme_madvise(WILLNEED)", err);
+		goto exit;
+	}
+
+	xnvmec_pinf("Comparing wbuf and the mapping");
+	if (xnvmec_buf_diff(wbuf, map + delta, buf_nbytes)) {
+		xnvmec_buf_diff_pr(wbuf, map + delta, buf_nbytes, XNVME_PR_DEF);
+		err = -EIO;
+		goto exit;
+	}
+
+exit:
+	if (map) {
+		xnvme_munmap(map);
+	}
+	xnvme_buf_free(dev, wbuf);
+	xnvme_buf_free(dev, rbuf);
+
+	return err;
+}
 
 //
 // Command-Line Interface (CLI) definition
 //
+/**
+ * Submit a batch of single-LBA commands, with the given opcode, scattered
+ * within [rng_slba,rng_elba], command 'i' transfers LBA 'i' of 'buf'
+ */
+static int
+_batch_scatter(struct xnvmec *cli, struct xnvme_cmd_link *cmds, uint16_t ncmds,
+	       uint8_t opc, uint8_t *buf, uint32_t nsid, uint64_t rng_slba,
+	       uint64_t rng_elba)
+{
+	const struct xnvme_geo *geo = cli->args.geo;
+	int err;
+
+	for (uint16_t i = 0; i < ncmds; ++i) {
+		struct xnvme_cmd_link *link = &cmds[i];
+
+		memset(link, 0, sizeof(*link));
+		link->cmd.common.opcode = opc;
+		link->cmd.common.nsid = nsid;
+		link->cmd.lblk.slba = rng_slba + (i * 7ULL) % (rng_elba - rng_slba);
+		link->dbuf = buf + i * geo->lba_nbytes;
+		link->dbuf_nbytes = geo->lba_nbytes;
+	}
+
+	err = xnvme_cmd_batch_sync(cli->args.dev, cmds, ncmds);
+	if (err) {
+		xnvmec_perr("xnvme_cmd_batch_sync()", err);
+		for (uint16_t i = 0; i < ncmds; ++i) {
+			if (xnvme_req_cpl_status(&cmds[i].req)) {
+				xnvme_req_pr(&cmds[i].req, XNVME_PR_DEF);
+			}
+		}
+	}
+
+	return err;
+}
+
+/**
+ * Write, and then read, LBAs scattered within [slba,elba] in batches of
+ * commands, and verify that the content read is what was written
+ */
+static int
+test_batch(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	struct xnvme_cmd_link *cmds = NULL;
+	uint64_t rng_slba, rng_elba, mdts_naddr;
+	uint8_t *wbuf = NULL, *rbuf = NULL;
+	size_t buf_nbytes;
+	uint16_t ncmds;
+	uint32_t nsid;
+	int err;
+
+	err = boilerplate(cli, &wbuf, &rbuf, &buf_nbytes, &mdts_naddr, &nsid,
+			  &rng_slba, &rng_elba);
+	if (err) {
+		xnvmec_perr("boilerplate()", err);
+		goto exit;
+	}
+
+	// More commands than the depth of the context of the batch
+	ncmds = XNVME_MIN(mdts_naddr, 128);
+	cmds = calloc(ncmds, sizeof(*cmds));
+	if (!cmds) {
+		err = -errno;
+		xnvmec_perr("calloc()", err);
+		goto exit;
+	}
+
+	err = xnvmec_buf_fill(wbuf, buf_nbytes, "anum");
+	if (err) {
+		xnvmec_perr("xnvmec_buf_fill()", err);
+		goto exit;
+	}
+	xnvmec_buf_clear(rbuf, buf_nbytes);
+
+	xnvmec_pinf("Batch of %u writes scattered within [slba,elba]", ncmds);
+	err = _batch_scatter(cli, cmds, ncmds, XNVME_SPEC_OPC_WRITE, wbuf, nsid,
+			     rng_slba, rng_elba);
+	if (err) {
+		goto exit;
+	}
+
+	xnvmec_pinf("Batch of %u reads scattered within [slba,elba]", ncmds);
+	err = _batch_scatter(cli, cmds, ncmds, XNVME_SPEC_OPC_READ, rbuf, nsid,
+			     rng_slba, rng_elba);
+	if (err) {
+		goto exit;
+	}
+
+	xnvmec_pinf("Comparing wbuf and rbuf");
+	if (xnvmec_buf_diff(wbuf, rbuf, ncmds * geo->lba_nbytes)) {
+		xnvmec_buf_diff_pr(wbuf, rbuf, ncmds * geo->lba_nbytes,
+				   XNVME_PR_DEF);
+		err = -EIO;
+		goto exit;
+	}
+
+exit:
+	xnvme_buf_free(dev, wbuf);
+	xnvme_buf_free(dev, rbuf);
+	free(cmds);
+
+	return err;
+}
+
+static void
+cb_span(struct xnvme_req *XNVME_UNUSED(req), void *cb_arg)
+{
+	int *ncompleted = cb_arg;
+
+	*ncompleted += 1;
+}
+
+/**
+ * Read or write 'nlb' LBAs starting at 'slba', synchronously, or on 'ctx' when
+ * it is given
+ */
+static int
+_span_io(struct xnvmec *cli, struct xnvme_async_ctx *ctx, uint8_t opc,
+	 uint32_t nsid, uint64_t slba, uint64_t nlb, uint8_t *buf)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	struct xnvme_req req = { 0 };
+	int ncompleted = 0;
+	int opts = XNVME_CMD_SYNC;
+	int err;
+
+	if (ctx) {
+		req.async.ctx = ctx;
+		req.async.cb = cb_span;
+		req.async.cb_arg = &ncompleted;
+		opts = XNVME_CMD_ASYNC;
+	}
+
+	if (opc == XNVME_SPEC_OPC_WRITE) {
+		err = xnvme_cmd_write(dev, nsid, slba, nlb - 1, buf, NULL, opts,
+				      &req);
+	} else {
+		err = xnvme_cmd_read(dev, nsid, slba, nlb - 1, buf, NULL, opts,
+				     &req);
+	}
+	if (!err && ctx) {
+		err = xnvme_async_wait(dev, ctx);
+		err = (err < 0) ? err : 0;
+		if (!err && (ncompleted != 1)) {
+			xnvmec_pinf("FAILED: ncompleted: %d != 1", ncompleted);
+			err = -EIO;
+		}
+	}
+	if (err || xnvme_req_cpl_status(&req)) {
+		xnvmec_perr("xnvme_cmd_{read,write}()", err);
+		xnvme_req_pr(&req, XNVME_PR_DEF);
+		return err ? err : -EIO;
+	}
+
+	return 0;
+}
+
+/**
+ * Fill each LBA of 'buf' with its address, starting at 'slba'
+ */
+static void
+_span_tag(uint8_t *buf, uint64_t slba, uint64_t nlb, uint32_t lba_nbytes)
+{
+	for (uint64_t i = 0; i < nlb; ++i) {
+		uint64_t *words = (void *)(buf + i * lba_nbytes);
+
+		for (uint32_t w = 0; w < lba_nbytes / sizeof(*words); ++w) {
+			words[w] = slba + i;
+		}
+	}
+}
+
+/**
+ * Verify that each LBA of 'buf' holds its address, starting at 'slba'
+ */
+static int
+_span_verify(const uint8_t *buf, uint64_t slba, uint64_t nlb,
+	     uint32_t lba_nbytes)
+{
+	for (uint64_t i = 0; i < nlb; ++i) {
+		const uint64_t *words = (const void *)(buf + i * lba_nbytes);
+
+		for (uint32_t w = 0; w < lba_nbytes / sizeof(*words); ++w) {
+			if (words[w] != slba + i) {
+				xnvmec_pinf("FAILED: lba: 0x%016lx, holds: 0x%016lx",
+					    slba + i, words[w]);
+				return -EIO;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Verify that commands spanning the chunk boundaries of a striped device,
+ * e.g. 'stripe:emu:ram0,emu:ram1?chunk=8', transfer the LBAs they address;
+ * on any other device, this verifies commands of varying length
+ *
+ * 1) Write [slba,elba], each LBA tagged with its address, in commands of
+ *    varying length, thus starting and ending within chunks
+ * 2) Read each LBA by itself and verify its tag; a single LBA is never split,
+ *    thus it is read from where the stripe places it
+ * 3) Read [slba,elba] in commands of mdts_naddr, offset by half of that, and
+ *    verify the tags
+ *
+ * The commands are submitted asynchronously when --qdepth is given
+ */
+static int
+test_stripe(struct xnvmec *cli)
+{
+	struct xnvme_dev *dev = cli->args.dev;
+	const struct xnvme_geo *geo = cli->args.geo;
+	struct xnvme_async_ctx *ctx = NULL;
+	uint64_t rng_slba, rng_elba, mdts_naddr, slba, nlb;
+	uint8_t *wbuf = NULL, *rbuf = NULL;
+	size_t buf_nbytes;
+	uint32_t nsid;
+	int err;
+
+	err = boilerplate(cli, &wbuf, &rbuf, &buf_nbytes, &mdts_naddr, &nsid,
+			  &rng_slba, &rng_elba);
+	if (err) {
+		xnvmec_perr("boilerplate()", err);
+		goto exit;
+	}
+	// Enough LBAs to span a lot of chunks, yet read one at a time
+	rng_elba = XNVME_MIN(rng_elba, rng_slba + 16 * mdts_naddr - 1);
+
+	if (cli->given[XNVMEC_OPT_QDEPTH]) {
+		err = xnvme_async_init(dev, &ctx, cli->args.qdepth, 0);
+		if (err) {
+			xnvmec_perr("xnvme_async_init()", err);
+			goto exit;
+		}
+	}
+
+	xnvmec_pinf("Writing tagged LBAs of [0x%016lx,0x%016lx]", rng_slba,
+		    rng_elba);
+	slba = rng_slba;
+	for (uint64_t i = 0; slba <= rng_elba; ++i) {
+		nlb = XNVME_MIN(1 + (i * 37) % mdts_naddr, rng_elba - slba + 1);
+
+		_span_tag(wbuf, slba, nlb, geo->lba_nbytes);
+		err = _span_io(cli, ctx, XNVME_SPEC_OPC_WRITE, nsid, slba, nlb,
+			       wbuf);
+		if (err) {
+			goto exit;
+		}
+		slba += nlb;
+	}
+
+	xnvmec_pinf("Reading, and verifying, one LBA at a time");
+	for (slba = rng_slba; slba <= rng_elba; ++slba) {
+		xnvmec_buf_clear(rbuf, geo->lba_nbytes);
+		err = _span_io(cli, ctx, XNVME_SPEC_OPC_READ, nsid, slba, 1,
+			       rbuf);
+		if (err) {
+			goto exit;
+		}
+		err = _span_verify(rbuf, slba, 1, geo->lba_nbytes);
+		if (err) {
+			goto exit;
+		}
+	}
+
+	xnvmec_pinf("Reading, and verifying, mdts_naddr LBAs at a time");
+	for (slba = rng_slba + mdts_naddr / 2; slba <= rng_elba; slba += nlb) {
+		nlb = XNVME_MIN(mdts_naddr, rng_elba - slba + 1);
+
+		xnvmec_buf_clear(rbuf, buf_nbytes);
+		err = _span_io(cli, ctx, XNVME_SPEC_OPC_READ, nsid, slba, nlb,
+			       rbuf);
+		if (err) {
+			goto exit;
+		}
+		err = _span_verify(rbuf, slba, nlb, geo->lba_nbytes);
+		if (err) {
+			goto exit;
+		}
+	}
+
+exit:
+	if (ctx) {
+		xnvme_async_term(dev, ctx);
+	}
+	xnvme_buf_free(dev, wbuf);
+	xnvme_buf_free(dev, rbuf);
+
+	return err;
+}
+
 static struct xnvmec_sub g_subs[] = {
 	{
 		"io",
@@ -324,6 +1078,68 @@ static struct xnvmec_sub g_subs[] = {
 		test_scopy, {
 			{XNVMEC_OPT_URI, XNVMEC_POSA},
 			{XNVMEC_OPT_SLBA, XNVMEC_LOPT},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LOPT},
+		}
+	},
+	{
+		"scopy_overlap",
+		"Verify the Simple-Copy Command on overlapping source and destination",
+		"Verify the Simple-Copy Command on overlapping source and destination",
+		test_scopy_overlap, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LOPT},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LOPT},
+		}
+	},
+	{
+		"write_zeroes",
+		"Basic Verification of the Write Zeroes Command",
+		"Basic Verification of the Write Zeroes Command",
+		test_write_zeroes, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LOPT},
+			{XNVMEC_OPT_ELBA, XNVMEC_LOPT},
+		}
+	},
+	{
+		"dup",
+		"Verify a duplicated handle reads what the device wrote",
+		"Verify a duplicated handle reads what the device wrote",
+		test_dup, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LOPT},
+			{XNVMEC_OPT_ELBA, XNVMEC_LOPT},
+		}
+	},
+	{
+		"mmap",
+		"Verify a device-mapping reads what the device wrote",
+		"Verify a device-mapping reads what the device wrote",
+		test_mmap, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LOPT},
+			{XNVMEC_OPT_ELBA, XNVMEC_LOPT},
+		}
+	},
+	{
+		"batch",
+		"Verify batches of scattered writes and reads",
+		"Verify batches of scattered writes and reads",
+		test_batch, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LOPT},
+			{XNVMEC_OPT_ELBA, XNVMEC_LOPT},
+		}
+	},
+	{
+		"stripe",
+		"Verify commands spanning the chunks of a striped device",
+		"Verify commands spanning the chunks of a striped device",
+		test_stripe, {
+			{XNVMEC_OPT_URI, XNVMEC_POSA},
+			{XNVMEC_OPT_SLBA, XNVMEC_LOPT},
+			{XNVMEC_OPT_ELBA, XNVMEC_LOPT},
+			{XNVMEC_OPT_QDEPTH, XNVMEC_LOPT},
 		}
 	},
 };
@@ -76,6 +76,7 @@
 #include <zbd_types.h>
 #include <optgroup.h>
 #include <libxnvme.h>
+#include <liblblk.h>
 #include <libznd.h>
 
 static pthread_mutex_t g_serialize = PTHREAD_MUTEX_INITIALIZER;
@@ -92,10 +93,13 @@ struct xnvme_fioe_fwrap {
 	struct xnvme_async_ctx *ctx;
 	struct xnvme_req_pool *reqs;
 
+	///< Range-buffer for trim, deallocated via Dataset Management
+	struct lblk_dsm_range *dsm;
+
 	uint32_t ssw;
 	uint32_t lba_nbytes;
 
-	uint8_t _pad[16];
+	uint8_t _pad[8];
 };
 XNVME_STATIC_ASSERT(sizeof(struct xnvme_fioe_fwrap) == 64, "Incorrect size")
 
@@ -204,6 +208,7 @@ _dev_close(struct thread_data *td, struct xnvme_fioe_fwrap *fwrap)
 {
 	if (fwrap->dev) {
 		xnvme_async_term(fwrap->dev, fwrap->ctx);
+		xnvme_buf_free(fwrap->dev, fwrap->dsm);
 	}
 	xnvme_req_pool_free(fwrap->reqs);
 	xnvme_dev_close(fwrap->dev);
@@ -324,6 +329,11 @@ _dev_open(struct thread_data *td, struct fio_file *f)
 		log_err("xnvme_fioe: init(): xnvme_req_pool_init()\n");
 		goto failure;
 	}
+	fwrap->dsm = xnvme_buf_alloc(fwrap->dev, sizeof(*fwrap->dsm), NULL);
+	if (!fwrap->dsm) {
+		log_err("xnvme_fioe: init(): xnvme_buf_alloc()\n");
+		goto failure;
+	}
 
 	fwrap->ssw = xnvme_dev_get_ssw(fwrap->dev);
 	fwrap->lba_nbytes = fwrap->geo->lba_nbytes;
@@ -340,6 +350,9 @@ _dev_open(struct thread_data *td, struct fio_file *f)
 failure:
 	xnvme_req_pool_free(fwrap->reqs);
 	xnvme_async_term(fwrap->dev, fwrap->ctx);
+	if (fwrap->dev) {
+		xnvme_buf_free(fwrap->dev, fwrap->dsm);
+	}
 	xnvme_dev_close(fwrap->dev);
 
 	pthread_mutex_unlock(&g_serialize);
@@ -548,6 +561,26 @@ xnvme_fioe_queue(struct thread_data *td, struct io_u *io_u)
 		return FIO_Q_COMPLETED;
 	}
 
+	// Trim is issued synchronously, like fio does for its native aio
+	// engines, as the async. implementations only do read/write/flush
+	if (io_u->ddir == DDIR_TRIM) {
+		struct xnvme_req dsm_req = { 0 };
+
+		fwrap->dsm->cattr = 0;
+		fwrap->dsm->slba = slba;
+		fwrap->dsm->nlb = io_u->xfer_buflen >> fwrap->ssw;
+
+		err = lblk_cmd_dsm(fwrap->dev, nsid, fwrap->dsm, 0,
+				   LBLK_DSM_ATTR_AD, XNVME_CMD_SYNC, &dsm_req);
+		if (err || xnvme_req_cpl_status(&dsm_req)) {
+			log_err("xnvme_fioe: queue(): lblk_cmd_dsm(), err: %d\n",
+				err);
+			io_u->error = err ? abs(err) : EIO;
+		}
+
+		return FIO_Q_COMPLETED;
+	}
+
 	req = SLIST_FIRST(&fwrap->reqs->head);
 	SLIST_REMOVE_HEAD(&fwrap->reqs->head, link);
 
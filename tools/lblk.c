@@ -3,6 +3,7 @@
 #include <string.h>
 #include <errno.h>
 #include <libxnvme.h>
+#include <liblblk.h>
 #include <libxnvmec.h>
 
 // TODO: only show namespaces of logical block type
@@ -221,11 +222,33 @@ exit:
 }
 
 static int
-sub_write_zeroes(struct xnvmec *XNVME_UNUSED(cli))
+sub_write_zeroes(struct xnvmec *cli)
 {
-	xnvmec_pinf("Not implemented");
+	struct xnvme_dev *dev = cli->args.dev;
+	const uint64_t slba = cli->args.slba;
+	const size_t nlb = cli->args.nlb;
+	uint32_t nsid = cli->args.nsid;
 
-	return -1;
+	struct xnvme_req req = { 0 };
+	int err;
+
+	if (!cli->given[XNVMEC_OPT_NSID]) {
+		nsid = xnvme_dev_get_nsid(cli->args.dev);
+	}
+
+	xnvmec_pinf("Write Zeroes nsid: 0x%x, slba: 0x%016lx, nlb: %zu",
+		    nsid, slba, nlb);
+
+	xnvmec_pinf("Sending the command...");
+	err = lblk_cmd_write_zeroes(dev, nsid, slba, nlb, 0, XNVME_CMD_SYNC,
+				    &req);
+	if (err || xnvme_req_cpl_status(&req)) {
+		xnvmec_perr("lblk_cmd_write_zeroes()", err);
+		xnvme_req_pr(&req, XNVME_PR_DEF);
+		err = err ? err : -EIO;
+	}
+
+	return err;
 }
 
 static int
@@ -290,8 +313,6 @@ static struct xnvmec_sub g_subs[] = {
 			{XNVMEC_OPT_SLBA, XNVMEC_LREQ},
 			{XNVMEC_OPT_NLB, XNVMEC_LREQ},
 			{XNVMEC_OPT_NSID, XNVMEC_LOPT},
-			{XNVMEC_OPT_DATA_INPUT, XNVMEC_LOPT},
-			{XNVMEC_OPT_META_INPUT, XNVMEC_LOPT},
 		}
 	},
 	{